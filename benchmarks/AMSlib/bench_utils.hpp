@@ -0,0 +1,259 @@
+/*
+ * Copyright 2021-2023 Lawrence Livermore National Security, LLC and other
+ * AMSLib Project Developers
+ *
+ * SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+ */
+
+#ifndef __AMS_BENCH_UTILS_HPP__
+#define __AMS_BENCH_UTILS_HPP__
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace ams
+{
+namespace bench
+{
+
+/**
+ * @brief Minimal wall-clock timer used by all benchmarks.
+ */
+class Timer
+{
+  using clock = std::chrono::steady_clock;
+  clock::time_point begin;
+
+public:
+  Timer() : begin(clock::now()) {}
+
+  void reset() { begin = clock::now(); }
+
+  /** @brief Returns the seconds elapsed since construction or the last reset */
+  double elapsed() const
+  {
+    return std::chrono::duration<double>(clock::now() - begin).count();
+  }
+};
+
+/**
+ * @brief Summary statistics of a set of samples (usually latencies in seconds).
+ */
+struct Stats {
+  size_t count = 0;
+  double sum = 0.0;
+  double min = 0.0;
+  double max = 0.0;
+  double mean = 0.0;
+  double p50 = 0.0;
+  double p90 = 0.0;
+  double p99 = 0.0;
+
+  /**
+   * @brief Computes the statistics of the samples. The samples are sorted in place.
+   * @param[in] samples the measurements to summarize
+   */
+  static Stats compute(std::vector<double>& samples)
+  {
+    Stats s;
+    if (samples.empty()) return s;
+
+    std::sort(samples.begin(), samples.end());
+    s.count = samples.size();
+    for (auto v : samples)
+      s.sum += v;
+    s.min = samples.front();
+    s.max = samples.back();
+    s.mean = s.sum / s.count;
+    s.p50 = percentile(samples, 50.0);
+    s.p90 = percentile(samples, 90.0);
+    s.p99 = percentile(samples, 99.0);
+    return s;
+  }
+
+  /**
+   * @brief Nearest-rank percentile of an already sorted vector.
+   */
+  static double percentile(const std::vector<double>& sorted, double pct)
+  {
+    if (sorted.empty()) return 0.0;
+    size_t rank = static_cast<size_t>((pct / 100.0) * sorted.size() + 0.5);
+    rank = std::min(std::max<size_t>(rank, 1), sorted.size());
+    return sorted[rank - 1];
+  }
+};
+
+/**
+ * @brief Collects named metrics of a benchmark run and emits them either as a
+ * human readable table or as JSON (consumed by the regression harness).
+ *
+ * @details Every record is a flat set of key/value pairs. String-valued keys
+ * describe the configuration of the run (backend, precision, ...) and
+ * numeric-valued keys are the measured metrics.
+ */
+class Report
+{
+  struct Record {
+    std::vector<std::pair<std::string, std::string>> labels;
+    std::vector<std::pair<std::string, double>> metrics;
+  };
+
+  std::string name;
+  std::vector<Record> records;
+
+  static std::string escape(const std::string& str)
+  {
+    std::string out;
+    for (auto c : str) {
+      if (c == '"' || c == '\\') out.push_back('\\');
+      out.push_back(c);
+    }
+    return out;
+  }
+
+public:
+  Report(std::string name) : name(std::move(name)) {}
+
+  /** @brief Starts a new record, subsequent label/metric calls refer to it */
+  void add() { records.emplace_back(); }
+
+  void label(const std::string& key, const std::string& value)
+  {
+    records.back().labels.emplace_back(key, value);
+  }
+
+  void metric(const std::string& key, double value)
+  {
+    records.back().metrics.emplace_back(key, value);
+  }
+
+  /** @brief Stores the usual latency statistics under '<prefix>_<stat>' */
+  void metric(const std::string& prefix, const Stats& s)
+  {
+    metric(prefix + "_mean", s.mean);
+    metric(prefix + "_p50", s.p50);
+    metric(prefix + "_p90", s.p90);
+    metric(prefix + "_p99", s.p99);
+    metric(prefix + "_max", s.max);
+  }
+
+  void print(std::ostream& os = std::cout) const
+  {
+    for (auto& R : records) {
+      os << "[" << name << "]";
+      for (auto& L : R.labels)
+        os << " " << L.first << "=" << L.second;
+      os << "\n";
+      for (auto& M : R.metrics) {
+        char buf[64];
+        std::snprintf(buf, sizeof(buf), "%.6g", M.second);
+        os << "    " << M.first << " : " << buf << "\n";
+      }
+    }
+  }
+
+  /**
+   * @brief Writes all records as a JSON document:
+   * {"benchmark": name, "records": [{"labels": {...}, "metrics": {...}}]}
+   */
+  bool writeJSON(const std::string& fn) const
+  {
+    std::ofstream fd(fn);
+    if (!fd.is_open()) {
+      std::cerr << "Cannot open json file: " << fn << "\n";
+      return false;
+    }
+    fd << "{\n  \"benchmark\": \"" << escape(name) << "\",\n";
+    fd << "  \"records\": [\n";
+    for (size_t r = 0; r < records.size(); r++) {
+      auto& R = records[r];
+      fd << "    {\"labels\": {";
+      for (size_t i = 0; i < R.labels.size(); i++) {
+        fd << (i ? ", " : "") << "\"" << escape(R.labels[i].first) << "\": \""
+           << escape(R.labels[i].second) << "\"";
+      }
+      fd << "}, \"metrics\": {";
+      for (size_t i = 0; i < R.metrics.size(); i++) {
+        char buf[64];
+        std::snprintf(buf, sizeof(buf), "%.9g", R.metrics[i].second);
+        fd << (i ? ", " : "") << "\"" << escape(R.metrics[i].first)
+           << "\": " << buf;
+      }
+      fd << "}}" << (r + 1 < records.size() ? "," : "") << "\n";
+    }
+    fd << "  ]\n}\n";
+    return true;
+  }
+};
+
+/**
+ * @brief Tiny '--key value' command line parser. Flags without a value are
+ * stored as "1".
+ */
+class Options
+{
+  std::unordered_map<std::string, std::string> opts;
+
+public:
+  Options(int argc, char* argv[])
+  {
+    for (int i = 1; i < argc; i++) {
+      std::string key(argv[i]);
+      if (key.compare(0, 2, "--") != 0) {
+        std::cerr << "Ignoring unknown positional argument: " << key << "\n";
+        continue;
+      }
+      key = key.substr(2);
+      if (i + 1 < argc && std::string(argv[i + 1]).compare(0, 2, "--") != 0)
+        opts[key] = argv[++i];
+      else
+        opts[key] = "1";
+    }
+  }
+
+  bool has(const std::string& key) const { return opts.count(key) != 0; }
+
+  std::string get(const std::string& key, const std::string& def) const
+  {
+    auto it = opts.find(key);
+    return (it == opts.end()) ? def : it->second;
+  }
+
+  long getInt(const std::string& key, long def) const
+  {
+    auto it = opts.find(key);
+    return (it == opts.end()) ? def : std::atol(it->second.c_str());
+  }
+
+  double getDouble(const std::string& key, double def) const
+  {
+    auto it = opts.find(key);
+    return (it == opts.end()) ? def : std::atof(it->second.c_str());
+  }
+
+  /** @brief Parses a comma separated list */
+  std::vector<std::string> getList(const std::string& key,
+                                   const std::string& def) const
+  {
+    std::vector<std::string> items;
+    std::stringstream ss(get(key, def));
+    std::string item;
+    while (std::getline(ss, item, ','))
+      if (!item.empty()) items.push_back(item);
+    return items;
+  }
+};
+
+}  // namespace bench
+}  // namespace ams
+
+#endif  // __AMS_BENCH_UTILS_HPP__
@@ -0,0 +1,219 @@
+/*
+ * Copyright 2021-2023 Lawrence Livermore National Security, LLC and other
+ * AMSLib Project Developers
+ *
+ * SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+ */
+
+/**
+ * Throughput benchmark of the AMS data base back-ends.
+ *
+ * Every available back-end is driven through getDB()/BaseDB::store() with
+ * synthetic batches. For each back-end we report MB/s, stores/s and the
+ * latency percentiles of a single store call.
+ *
+ * Usage:
+ *   ams_db_bench [--backends csv,hdf5,redis,rmq] [--path <dir>]
+ *                [--redis-config <json>] [--rmq-config <json>]
+ *                [--elements N] [--in-dims I] [--out-dims O]
+ *                [--iterations R] [--warmup W]
+ *                [--precision single|double|both] [--json <file>]
+ *
+ * File back-ends (csv, hdf5) write under '<path>/<backend>'. Redis and
+ * RabbitMQ need a reachable service described by the respective JSON
+ * configuration (see docker/rabbitmq for a local broker). Note that
+ * RabbitMQDB::store only enqueues the message, the latency measured for it
+ * is the cost observed by the application and not the time to deliver.
+ */
+
+#include <AMS.h>
+
+#include <cstring>
+#include <experimental/filesystem>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "bench_utils.hpp"
+#include "wf/basedb.hpp"
+#include "wf/resource_manager.hpp"
+
+using namespace ams::bench;
+
+static bool backendFromName(const std::string& name, AMSDBType& type)
+{
+  if (name == "csv")
+    type = AMSDBType::CSV;
+  else if (name == "hdf5")
+    type = AMSDBType::HDF5;
+  else if (name == "redis")
+    type = AMSDBType::REDIS;
+  else if (name == "rmq")
+    type = AMSDBType::RMQ;
+  else
+    return false;
+  return true;
+}
+
+static bool backendEnabled(AMSDBType type)
+{
+  switch (type) {
+    case AMSDBType::CSV:
+      return true;
+#ifdef __ENABLE_HDF5__
+    case AMSDBType::HDF5:
+      return true;
+#endif
+#ifdef __ENABLE_REDIS__
+    case AMSDBType::REDIS:
+      return true;
+#endif
+#ifdef __ENABLE_RMQ__
+    case AMSDBType::RMQ:
+      return true;
+#endif
+    default:
+      return false;
+  }
+}
+
+/**
+ * @brief Resolves the path getDB expects for every back-end. File back-ends
+ * get their own directory as getDB caches instances by path.
+ */
+static std::string backendPath(const std::string& name,
+                               AMSDBType type,
+                               const Options& opts)
+{
+  if (type == AMSDBType::REDIS) return opts.get("redis-config", "");
+  if (type == AMSDBType::RMQ) return opts.get("rmq-config", "");
+
+  fs::path dir(opts.get("path", "./ams_db_bench"));
+  dir /= name;
+  std::error_code ec;
+  fs::create_directories(dir, ec);
+  if (ec) {
+    std::cerr << "Cannot create directory " << dir << " : " << ec.message()
+              << "\n";
+    return "";
+  }
+  return dir.string();
+}
+
+template <typename FPTypeValue>
+static bool run(const std::string& name,
+                AMSDBType type,
+                const std::string& precision,
+                const Options& opts,
+                Report& report)
+{
+  const size_t elements = opts.getInt("elements", 1 << 16);
+  const int inDims = opts.getInt("in-dims", 8);
+  const int outDims = opts.getInt("out-dims", 4);
+  const int iterations = opts.getInt("iterations", 20);
+  const int warmup = opts.getInt("warmup", 2);
+
+  std::string path = backendPath(name, type, opts);
+  if (path.empty()) {
+    // Services are optional, the user must explicitly point us to them
+    bool isService = (type == AMSDBType::REDIS || type == AMSDBType::RMQ);
+    std::cerr << "[" << name << "] Missing path/configuration, skipping\n";
+    return isService;
+  }
+
+  auto db = getDB<FPTypeValue>(const_cast<char*>(path.c_str()), type, 0);
+  if (!db) {
+    std::cerr << "[" << name << "] Could not instantiate data base\n";
+    return false;
+  }
+
+  std::mt19937 gen(42);
+  std::uniform_real_distribution<FPTypeValue> dist(0, 1);
+  std::vector<std::vector<FPTypeValue>> inData(
+      inDims, std::vector<FPTypeValue>(elements));
+  std::vector<std::vector<FPTypeValue>> outData(
+      outDims, std::vector<FPTypeValue>(elements));
+  std::vector<FPTypeValue*> inputs, outputs;
+  for (auto& V : inData) {
+    for (auto& v : V)
+      v = dist(gen);
+    inputs.push_back(V.data());
+  }
+  for (auto& V : outData) {
+    for (auto& v : V)
+      v = dist(gen);
+    outputs.push_back(V.data());
+  }
+
+  for (int i = 0; i < warmup; i++)
+    db->store(elements, inputs, outputs);
+
+  std::vector<double> latency;
+  latency.reserve(iterations);
+  Timer total;
+  for (int i = 0; i < iterations; i++) {
+    Timer t;
+    db->store(elements, inputs, outputs);
+    latency.push_back(t.elapsed());
+  }
+  const double seconds = total.elapsed();
+
+  const double bytes = static_cast<double>(elements) * (inDims + outDims) *
+                       sizeof(FPTypeValue) * iterations;
+  Stats s = Stats::compute(latency);
+
+  report.add();
+  report.label("backend", name);
+  report.label("precision", precision);
+  report.label("elements", std::to_string(elements));
+  report.label("dims", std::to_string(inDims) + "x" + std::to_string(outDims));
+  report.metric("store_MBps", bytes / (1024.0 * 1024.0) / seconds);
+  report.metric("stores_per_sec", iterations / seconds);
+  report.metric("store_latency_s", s);
+  return true;
+}
+
+int main(int argc, char* argv[])
+{
+  Options opts(argc, argv);
+  if (opts.has("help")) {
+    std::cout << "Usage: " << argv[0]
+              << " [--backends csv,hdf5,redis,rmq] [--path <dir>]"
+                 " [--redis-config <json>] [--rmq-config <json>]"
+                 " [--elements N] [--in-dims I] [--out-dims O]"
+                 " [--iterations R] [--warmup W]"
+                 " [--precision single|double|both] [--json <file>]\n";
+    return 0;
+  }
+
+  ams::ResourceManager::init();
+
+  std::string precision = opts.get("precision", "double");
+  Report report("db");
+  int failures = 0;
+
+  for (auto& name : opts.getList("backends", "csv,hdf5,redis,rmq")) {
+    AMSDBType type;
+    if (!backendFromName(name, type)) {
+      std::cerr << "Unknown backend '" << name << "'\n";
+      failures++;
+      continue;
+    }
+    if (!backendEnabled(type)) {
+      std::cerr << "[" << name << "] Not enabled in this build, skipping\n";
+      continue;
+    }
+
+    if (precision == "single" || precision == "both")
+      failures += !run<float>(name, type, "single", opts, report);
+    if (precision == "double" || precision == "both")
+      failures += !run<double>(name, type, "double", opts, report);
+  }
+
+  report.print();
+  if (opts.has("json") && !report.writeJSON(opts.get("json", ""))) failures++;
+
+  return failures != 0;
+}
@@ -0,0 +1,242 @@
+/*
+ * Copyright 2021-2023 Lawrence Livermore National Security, LLC and other
+ * AMSLib Project Developers
+ *
+ * SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+ */
+
+/**
+ * Scaling benchmark of the AMSLoadBalancer.
+ *
+ * Every rank generates a synthetic load following an imbalance pattern and
+ * balances it through a full AMSLoadBalancer transaction (setup, scatter of
+ * inputs, gather of outputs). Root reports the time of every phase (max
+ * across ranks), the bytes moved through the communicator and the imbalance
+ * (max/mean load) before and after balancing.
+ *
+ * Usage:
+ *   mpirun -np P ams_lb_bench [--pattern uniform|skewed|hot|bimodal|all]
+ *                             [--elements N] [--factor F]
+ *                             [--in-dims I] [--out-dims O]
+ *                             [--iterations R] [--warmup W]
+ *                             [--precision single|double|both]
+ *                             [--device 0|1] [--json <file>]
+ *
+ * Patterns, with N the nominal elements per rank and F the imbalance factor:
+ *   uniform : every rank holds N elements.
+ *   skewed  : load grows linearly with the rank id, from N up to F*N.
+ *   hot     : rank P-1 holds F*N elements, all others hold N.
+ *   bimodal : even ranks hold N, odd ranks hold F*N.
+ */
+
+#include <AMS.h>
+#include <mpi.h>
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "bench_utils.hpp"
+#include "wf/redist_load.hpp"
+#include "wf/resource_manager.hpp"
+
+using namespace ams;
+using namespace ams::bench;
+
+static bool localLoad(const std::string& pattern,
+                      int rId,
+                      int wS,
+                      long elements,
+                      double factor,
+                      int& load)
+{
+  if (pattern == "uniform")
+    load = elements;
+  else if (pattern == "skewed")
+    load = elements + static_cast<long>((factor - 1.0) * elements * rId /
+                                        std::max(wS - 1, 1));
+  else if (pattern == "hot")
+    load = (rId == wS - 1) ? static_cast<long>(factor * elements) : elements;
+  else if (pattern == "bimodal")
+    load = (rId % 2) ? static_cast<long>(factor * elements) : elements;
+  else
+    return false;
+  return true;
+}
+
+/** @brief max/mean ratio of the per rank load, 1.0 is perfectly balanced */
+static double imbalance(int load, MPI_Comm comm, int wS)
+{
+  long local = load, maxLoad = 0, sumLoad = 0;
+  MPI_Allreduce(&local, &maxLoad, 1, MPI_LONG, MPI_MAX, comm);
+  MPI_Allreduce(&local, &sumLoad, 1, MPI_LONG, MPI_SUM, comm);
+  if (sumLoad == 0) return 1.0;
+  return static_cast<double>(maxLoad) * wS / static_cast<double>(sumLoad);
+}
+
+/** @brief Returns the slowest rank time of a phase */
+static double maxTime(double t, MPI_Comm comm)
+{
+  double res = 0.0;
+  MPI_Allreduce(&t, &res, 1, MPI_DOUBLE, MPI_MAX, comm);
+  return res;
+}
+
+template <typename FPTypeValue>
+static void run(const std::string& pattern,
+                const std::string& precision,
+                const Options& opts,
+                AMSResourceType resource,
+                Report& report)
+{
+  int rId, wS;
+  MPI_Comm_size(MPI_COMM_WORLD, &wS);
+  MPI_Comm_rank(MPI_COMM_WORLD, &rId);
+
+  const long elements = opts.getInt("elements", 1 << 16);
+  const double factor = opts.getDouble("factor", 4.0);
+  const int inDims = opts.getInt("in-dims", 8);
+  const int outDims = opts.getInt("out-dims", 4);
+  const int iterations = opts.getInt("iterations", 10);
+  const int warmup = opts.getInt("warmup", 2);
+
+  int load = 0;
+  localLoad(pattern, rId, wS, elements, factor, load);
+
+  std::vector<FPTypeValue *> inputs, outputs;
+  for (int i = 0; i < inDims; i++)
+    inputs.push_back(ResourceManager::allocate<FPTypeValue>(load, resource));
+  for (int i = 0; i < outDims; i++)
+    outputs.push_back(ResourceManager::allocate<FPTypeValue>(load, resource));
+
+  std::vector<double> tSetup, tScatter, tGather;
+  int balanced = 0;
+  for (int it = 0; it < warmup + iterations; it++) {
+    MPI_Barrier(MPI_COMM_WORLD);
+    Timer t;
+    AMSLoadBalancer<FPTypeValue> lBalancer(
+        rId, wS, load, MPI_COMM_WORLD, inDims, outDims, resource);
+    double setup = t.elapsed();
+
+    t.reset();
+    lBalancer.scatterInputs(inputs, resource);
+    double scatter = t.elapsed();
+
+    // The "physics" is a copy, we only care about the data movement here.
+    FPTypeValue **lbInputs = lBalancer.inputs();
+    FPTypeValue **lbOutputs = lBalancer.outputs();
+    balanced = lBalancer.getBalancedSize();
+    for (int i = 0; i < outDims; i++)
+      ResourceManager::copy(lbInputs[i % inDims],
+                            lbOutputs[i],
+                            balanced * sizeof(FPTypeValue));
+
+    t.reset();
+    lBalancer.gatherOutputs(outputs, resource);
+    double gather = t.elapsed();
+
+    setup = maxTime(setup, MPI_COMM_WORLD);
+    scatter = maxTime(scatter, MPI_COMM_WORLD);
+    gather = maxTime(gather, MPI_COMM_WORLD);
+    if (it < warmup) continue;
+    tSetup.push_back(setup);
+    tScatter.push_back(scatter);
+    tGather.push_back(gather);
+  }
+
+  // All data travels through root, every other rank sends its local load to
+  // root and receives its balanced load back (and the reverse for outputs).
+  long moved = 0, totalMoved = 0;
+  if (rId != 0)
+    moved = static_cast<long>(load + balanced) * (inDims + outDims) *
+            sizeof(FPTypeValue);
+  MPI_Reduce(&moved, &totalMoved, 1, MPI_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+
+  double before = imbalance(load, MPI_COMM_WORLD, wS);
+  double after = imbalance(balanced, MPI_COMM_WORLD, wS);
+
+  ResourceManager::deallocate(inputs, resource);
+  ResourceManager::deallocate(outputs, resource);
+
+  if (rId != 0) return;
+
+  Stats setup = Stats::compute(tSetup);
+  Stats scatter = Stats::compute(tScatter);
+  Stats gather = Stats::compute(tGather);
+
+  report.add();
+  report.label("pattern", pattern);
+  report.label("precision", precision);
+  report.label("ranks", std::to_string(wS));
+  report.label("elements", std::to_string(elements));
+  report.label("dims", std::to_string(inDims) + "x" + std::to_string(outDims));
+  report.label("device", resource == AMSResourceType::DEVICE ? "1" : "0");
+  report.metric("setup_s", setup);
+  report.metric("scatter_s", scatter);
+  report.metric("gather_s", gather);
+  report.metric("bytes_moved", static_cast<double>(totalMoved));
+  report.metric("imbalance_before", before);
+  report.metric("imbalance_after", after);
+}
+
+int main(int argc, char *argv[])
+{
+  MPI_Init(&argc, &argv);
+  Options opts(argc, argv);
+  int rId;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rId);
+
+  if (opts.has("help")) {
+    if (rId == 0)
+      std::cout << "Usage: mpirun -np P " << argv[0]
+                << " [--pattern uniform|skewed|hot|bimodal|all]"
+                   " [--elements N] [--factor F] [--in-dims I]"
+                   " [--out-dims O] [--iterations R] [--warmup W]"
+                   " [--precision single|double|both] [--device 0|1]"
+                   " [--json <file>]\n";
+    MPI_Finalize();
+    return 0;
+  }
+
+  ams::ResourceManager::init();
+  AMSResourceType resource = AMSResourceType::HOST;
+  if (opts.getInt("device", 0) == 1) {
+#ifdef __ENABLE_CUDA__
+    resource = AMSResourceType::DEVICE;
+#else
+    if (rId == 0) std::cerr << "Device requested but CUDA is not enabled\n";
+    MPI_Finalize();
+    return 1;
+#endif
+  }
+
+  std::vector<std::string> patterns =
+      opts.getList("pattern", "uniform,skewed,hot,bimodal");
+  if (patterns.size() == 1 && patterns[0] == "all")
+    patterns = {"uniform", "skewed", "hot", "bimodal"};
+
+  std::string precision = opts.get("precision", "double");
+  Report report("lb");
+  int ret = 0;
+  for (auto &pattern : patterns) {
+    int load;
+    if (!localLoad(pattern, 0, 1, 0, 1.0, load)) {
+      if (rId == 0) std::cerr << "Unknown pattern '" << pattern << "'\n";
+      ret = 1;
+      continue;
+    }
+    if (precision == "single" || precision == "both")
+      run<float>(pattern, "single", opts, resource, report);
+    if (precision == "double" || precision == "both")
+      run<double>(pattern, "double", opts, resource, report);
+  }
+
+  if (rId == 0) {
+    report.print();
+    if (opts.has("json") && !report.writeJSON(opts.get("json", ""))) ret = 1;
+  }
+
+  MPI_Finalize();
+  return ret;
+}
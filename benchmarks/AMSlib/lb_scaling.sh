@@ -0,0 +1,32 @@
+#!/usr/bin/env bash
+# Copyright 2021-2023 Lawrence Livermore National Security, LLC and other
+# AMSLib Project Developers
+#
+# SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+
+usage="Usage: $(basename "$0") <ams_lb_bench> <output dir> [np sizes ...] [-- bench args] -- Run the load balancer benchmark at several local mpirun sizes."
+
+if [ "$#" -lt 2 ]; then
+  echo "$usage"
+  exit 1
+fi
+
+BENCH=$1
+OUT_DIR=$2
+shift 2
+
+SIZES=()
+while [ "$#" -gt 0 ] && [ "$1" != "--" ]; do
+  SIZES+=("$1")
+  shift
+done
+[ "$1" == "--" ] && shift
+[ "${#SIZES[@]}" -eq 0 ] && SIZES=(2 4 8)
+
+MPIRUN=${MPIRUN:-mpirun}
+mkdir -p "$OUT_DIR"
+
+for np in "${SIZES[@]}"; do
+  echo "[$(date +'%m%d%Y-%T')@$(hostname)] Running $BENCH on $np ranks"
+  $MPIRUN -np "$np" "$BENCH" --json "$OUT_DIR/lb_np${np}.json" "$@" || exit 1
+done
@@ -0,0 +1,193 @@
+/*
+ * Copyright 2021-2023 Lawrence Livermore National Security, LLC and other
+ * AMSLib Project Developers
+ *
+ * SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+ */
+
+/**
+ * Producer side of the RabbitMQ ingest benchmark.
+ *
+ * Every rank publishes '--messages' batches of '--elements' rows through
+ * RabbitMQDB::store. The first input feature of every row holds the wall
+ * clock time (seconds since epoch) at which the batch was handed to store,
+ * which lets the consumer (benchmarks/rmq_ingest.py) compute the end-to-end
+ * latency of every sample. Root reports the store latency, the publishing
+ * rate observed by the application and the time to flush the publisher once
+ * the last batch was stored (max across ranks).
+ *
+ * Usage:
+ *   [mpirun -np P] ams_rmq_bench --rmq-config <json> [--messages M]
+ *                                [--elements N] [--in-dims I] [--out-dims O]
+ *                                [--rate R] [--json <file>]
+ *
+ * '--rate' limits every rank to R batches per second (0, the default, sends
+ * as fast as possible). Timestamps are stored in the inputs, hence the
+ * benchmark always uses double precision.
+ */
+
+#include <AMS.h>
+#ifdef __ENABLE_MPI__
+#include <mpi.h>
+#endif
+
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bench_utils.hpp"
+#include "wf/basedb.hpp"
+#include "wf/resource_manager.hpp"
+
+using namespace ams::bench;
+
+/** @brief Seconds since epoch, comparable across processes of the node */
+static double wallClock()
+{
+  using namespace std::chrono;
+  return duration<double>(system_clock::now().time_since_epoch()).count();
+}
+
+/** @brief Returns the slowest rank value, a no-op without MPI */
+static double maxAcrossRanks(double v)
+{
+#ifdef __ENABLE_MPI__
+  double res = 0.0;
+  MPI_Allreduce(&v, &res, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+  return res;
+#else
+  return v;
+#endif
+}
+
+#ifdef __ENABLE_RMQ__
+static int run(const Options& opts, int rId, int wS, Report& report)
+{
+  const size_t elements = opts.getInt("elements", 1 << 14);
+  const int messages = opts.getInt("messages", 100);
+  const int inDims = opts.getInt("in-dims", 8);
+  const int outDims = opts.getInt("out-dims", 4);
+  const double rate = opts.getDouble("rate", 0.0);
+  std::string config = opts.get("rmq-config", "");
+
+  if (config.empty()) {
+    if (rId == 0) std::cerr << "Missing --rmq-config\n";
+    return 1;
+  }
+
+  std::vector<std::vector<double>> inData(inDims,
+                                          std::vector<double>(elements));
+  std::vector<std::vector<double>> outData(outDims,
+                                           std::vector<double>(elements));
+  std::vector<double*> inputs, outputs;
+  for (int d = 0; d < inDims; d++) {
+    for (size_t i = 0; i < elements; i++)
+      inData[d][i] = rId + d + static_cast<double>(i) / elements;
+    inputs.push_back(inData[d].data());
+  }
+  for (int d = 0; d < outDims; d++) {
+    for (size_t i = 0; i < elements; i++)
+      outData[d][i] = -inData[d % inDims][i];
+    outputs.push_back(outData[d].data());
+  }
+
+  // We own the data base to time its destruction, which flushes the publisher
+  Timer tConnect;
+  std::unique_ptr<BaseDB<double>> db(
+      createDB<double>(const_cast<char*>(config.c_str()), AMSDBType::RMQ, rId));
+  if (!db) {
+    std::cerr << "[rank=" << rId << "] Could not instantiate RabbitMQDB\n";
+    return 1;
+  }
+  double connect = tConnect.elapsed();
+
+#ifdef __ENABLE_MPI__
+  MPI_Barrier(MPI_COMM_WORLD);
+#endif
+
+  std::vector<double> latency;
+  latency.reserve(messages);
+  const double period = rate > 0 ? 1.0 / rate : 0.0;
+  Timer total;
+  for (int m = 0; m < messages; m++) {
+    if (period > 0) {
+      double wait = m * period - total.elapsed();
+      if (wait > 0)
+        std::this_thread::sleep_for(std::chrono::duration<double>(wait));
+    }
+    // The timestamp travels with the data, the consumer derives the latency
+    double now = wallClock();
+    for (size_t i = 0; i < elements; i++)
+      inData[0][i] = now;
+    Timer t;
+    db->store(elements, inputs, outputs);
+    latency.push_back(t.elapsed());
+  }
+  double publish = total.elapsed();
+
+  Timer tFlush;
+  db.reset();
+  double flush = tFlush.elapsed();
+
+  connect = maxAcrossRanks(connect);
+  publish = maxAcrossRanks(publish);
+  flush = maxAcrossRanks(flush);
+  if (rId != 0) return 0;
+
+  const double samples = static_cast<double>(elements) * messages * wS;
+  const double bytes = samples * (inDims + outDims) * sizeof(double);
+  report.add();
+  report.label("ranks", std::to_string(wS));
+  report.label("elements", std::to_string(elements));
+  report.label("messages", std::to_string(messages));
+  report.label("dims", std::to_string(inDims) + "x" + std::to_string(outDims));
+  report.metric("connect_s", connect);
+  report.metric("store_latency_s", Stats::compute(latency));
+  report.metric("publish_s", publish);
+  report.metric("flush_s", flush);
+  report.metric("produce_samples_per_sec", samples / (publish + flush));
+  report.metric("produce_MBps", bytes / (1024.0 * 1024.0) / (publish + flush));
+  return 0;
+}
+#endif
+
+int main(int argc, char* argv[])
+{
+  int rId = 0, wS = 1;
+#ifdef __ENABLE_MPI__
+  MPI_Init(&argc, &argv);
+  MPI_Comm_rank(MPI_COMM_WORLD, &rId);
+  MPI_Comm_size(MPI_COMM_WORLD, &wS);
+#endif
+  Options opts(argc, argv);
+  int ret = 0;
+
+  if (opts.has("help")) {
+    if (rId == 0)
+      std::cout << "Usage: [mpirun -np P] " << argv[0]
+                << " --rmq-config <json> [--messages M] [--elements N]"
+                   " [--in-dims I] [--out-dims O] [--rate R]"
+                   " [--json <file>]\n";
+  } else {
+#ifdef __ENABLE_RMQ__
+    ams::ResourceManager::init();
+    Report report("rmq");
+    ret = run(opts, rId, wS, report);
+    if (rId == 0 && ret == 0) {
+      report.print();
+      if (opts.has("json") && !report.writeJSON(opts.get("json", ""))) ret = 1;
+    }
+#else
+    if (rId == 0) std::cerr << "RabbitMQ is not enabled in this build\n";
+    ret = 1;
+#endif
+  }
+
+#ifdef __ENABLE_MPI__
+  MPI_Finalize();
+#endif
+  return ret;
+}
@@ -0,0 +1,250 @@
+/*
+ * Copyright 2021-2023 Lawrence Livermore National Security, LLC and other
+ * AMSLib Project Developers
+ *
+ * SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+ */
+
+/**
+ * Micro benchmarks of the AMS workflow hot path.
+ *
+ * - pack/unpack      : DataHandler::pack/unpack of a random predicate.
+ * - linearize        : DataHandler::linearize_features, the marshaling step
+ *                      before handing data to the inference engine.
+ * - end-to-end       : AMSExecute with a RandomUQ executor (requires a
+ *                      torch model, '--model'). '--cascade-model' adds a
+ *                      second surrogate tier evaluated on the rejected points,
+ *                      '--reorder-min' evaluates calls of at least that many
+ *                      points in Morton order, '--physics-threads' splits
+ *                      the physics in chunks evaluated concurrently and
+ *                      '--tune-calls' lets the executor pick among them.
+ *
+ * Usage:
+ *   ams_workflow_bench [--elements N] [--in-dims I] [--out-dims O]
+ *                      [--fraction F] [--iterations R] [--warmup W]
+ *                      [--precision single|double|both] [--device 0|1]
+ *                      [--model <torchscript>]
+ *                      [--cascade-model <torchscript>] [--reorder-min N]
+ *                      [--physics-threads T] [--tune-calls K]
+ *                      [--tune-cache <file>] [--json <file>]
+ *
+ * With '--model' the dimensions must match the ones of the model.
+ */
+
+#include <AMS.h>
+
+#include <functional>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "bench_utils.hpp"
+#include "wf/data_handler.hpp"
+#include "wf/resource_manager.hpp"
+
+using namespace ams;
+using namespace ams::bench;
+
+/** @brief The physics of the end-to-end benchmark, copies inputs to outputs */
+template <typename FPTypeValue>
+static void copyPhysics(void *cls,
+                        long elements,
+                        const void *const *inputs,
+                        void *const *outputs)
+{
+  const int *dims = static_cast<const int *>(cls);
+  for (int o = 0; o < dims[1]; o++) {
+    auto *src = static_cast<const FPTypeValue *>(inputs[o % dims[0]]);
+    auto *dest = static_cast<FPTypeValue *>(outputs[o]);
+    for (long i = 0; i < elements; i++)
+      dest[i] = src[i];
+  }
+}
+
+/** @brief Runs 'fn' warmup + iterations times, recording the latter */
+static void timeIt(int warmup,
+                   int iterations,
+                   std::vector<double> &samples,
+                   const std::function<void()> &fn)
+{
+  for (int i = 0; i < warmup; i++)
+    fn();
+  for (int i = 0; i < iterations; i++) {
+    Timer t;
+    fn();
+    samples.push_back(t.elapsed());
+  }
+}
+
+template <typename FPTypeValue>
+static void run(const std::string &precision,
+                const Options &opts,
+                AMSResourceType resource,
+                Report &report)
+{
+  using data_handler = DataHandler<FPTypeValue>;
+
+  const size_t elements = opts.getInt("elements", 1 << 20);
+  const int inDims = opts.getInt("in-dims", 2);
+  const int outDims = opts.getInt("out-dims", 4);
+  const double fraction = opts.getDouble("fraction", 0.5);
+  const int iterations = opts.getInt("iterations", 20);
+  const int warmup = opts.getInt("warmup", 2);
+
+  // Initialize on the host and move to the requested resource
+  std::mt19937 gen(42);
+  std::uniform_real_distribution<double> dist(0, 1);
+  bool *hPredicate =
+      ResourceManager::allocate<bool>(elements, AMSResourceType::HOST);
+  FPTypeValue *hData =
+      ResourceManager::allocate<FPTypeValue>(elements, AMSResourceType::HOST);
+  for (size_t i = 0; i < elements; i++) {
+    hPredicate[i] = dist(gen) < fraction;
+    hData[i] = static_cast<FPTypeValue>(dist(gen));
+  }
+
+  bool *predicate = hPredicate;
+  if (resource != AMSResourceType::HOST) {
+    predicate = ResourceManager::allocate<bool>(elements, resource);
+    ResourceManager::copy(hPredicate, predicate, elements * sizeof(bool));
+  }
+
+  std::vector<FPTypeValue *> sparseIn, sparseOut, denseIn, denseOut;
+  for (int i = 0; i < inDims; i++) {
+    sparseIn.push_back(ResourceManager::allocate<FPTypeValue>(elements, resource));
+    denseIn.push_back(ResourceManager::allocate<FPTypeValue>(elements, resource));
+    ResourceManager::copy(hData, sparseIn.back(), elements * sizeof(FPTypeValue));
+  }
+  for (int i = 0; i < outDims; i++) {
+    sparseOut.push_back(ResourceManager::allocate<FPTypeValue>(elements, resource));
+    denseOut.push_back(ResourceManager::allocate<FPTypeValue>(elements, resource));
+  }
+  std::vector<const FPTypeValue *> cSparseIn(sparseIn.begin(), sparseIn.end());
+
+  std::vector<double> tPack, tUnpack, tLinearize, tE2E;
+  size_t packed = 0;
+
+  timeIt(warmup, iterations, tPack, [&]() {
+    packed = data_handler::pack(resource, predicate, elements, cSparseIn, denseIn);
+  });
+
+  timeIt(warmup, iterations, tUnpack, [&]() {
+    data_handler::unpack(resource, predicate, elements, denseOut, sparseOut);
+  });
+
+  std::vector<const FPTypeValue *> cDenseIn(denseIn.begin(), denseIn.end());
+  timeIt(warmup, iterations, tLinearize, [&]() {
+    FPTypeValue *data =
+        data_handler::linearize_features(resource, packed, cDenseIn);
+    ResourceManager::deallocate(data, resource);
+  });
+
+  std::string model = opts.get("model", "");
+  std::string cascadeModel = opts.get("cascade-model", "");
+  if (!model.empty()) {
+    int dims[2] = {inDims, outDims};
+    AMSConfig conf = {AMSExecPolicy::UBALANCED,
+                      isDouble<FPTypeValue>::default_value() ? AMSDType::Double
+                                                             : AMSDType::Single,
+                      resource,
+                      AMSDBType::None,
+                      copyPhysics<FPTypeValue>,
+                      const_cast<char *>(model.c_str()),
+                      nullptr,
+                      nullptr,
+                      fraction,
+                      AMSUQPolicy::RandomUQ,
+                      0,
+                      0,
+                      1,
+                      cascadeModel.empty()
+                          ? nullptr
+                          : const_cast<char *>(cascadeModel.c_str()),
+                      nullptr,
+                      fraction,
+                      0.0,
+                      0,
+                      opts.getInt("reorder-min", 0)};
+    if (opts.has("physics-threads")) {
+      conf.reentrantPhysics = 1;
+      conf.physicsThreads = opts.getInt("physics-threads", 0);
+    }
+    std::string tuneCache = opts.get("tune-cache", "");
+    conf.tuneCalls = opts.getInt("tune-calls", 0);
+    if (!tuneCache.empty())
+      conf.tuneCachePath = const_cast<char *>(tuneCache.c_str());
+    AMSExecutor wf = AMSCreateExecutor(conf);
+    timeIt(warmup, iterations, tE2E, [&]() {
+      AMSExecute(wf,
+                 static_cast<void *>(dims),
+                 elements,
+                 reinterpret_cast<const void **>(cSparseIn.data()),
+                 reinterpret_cast<void **>(sparseOut.data()),
+                 inDims,
+                 outDims);
+    });
+  }
+
+  ResourceManager::deallocate(sparseIn, resource);
+  ResourceManager::deallocate(denseIn, resource);
+  ResourceManager::deallocate(sparseOut, resource);
+  ResourceManager::deallocate(denseOut, resource);
+  if (predicate != hPredicate) ResourceManager::deallocate(predicate, resource);
+  ResourceManager::deallocate(hPredicate, AMSResourceType::HOST);
+  ResourceManager::deallocate(hData, AMSResourceType::HOST);
+
+  report.add();
+  report.label("precision", precision);
+  report.label("elements", std::to_string(elements));
+  report.label("dims", std::to_string(inDims) + "x" + std::to_string(outDims));
+  report.label("device", resource == AMSResourceType::DEVICE ? "1" : "0");
+  report.metric("pack_s", Stats::compute(tPack));
+  report.metric("unpack_s", Stats::compute(tUnpack));
+  report.metric("linearize_s", Stats::compute(tLinearize));
+  if (!tE2E.empty()) report.metric("e2e_s", Stats::compute(tE2E));
+  if (!cascadeModel.empty()) report.label("cascade", "1");
+  if (opts.has("reorder-min"))
+    report.label("reorder_min", opts.get("reorder-min", "0"));
+  if (opts.has("physics-threads"))
+    report.label("physics_threads", opts.get("physics-threads", "0"));
+  if (opts.has("tune-calls"))
+    report.label("tune_calls", opts.get("tune-calls", "0"));
+}
+
+int main(int argc, char *argv[])
+{
+  Options opts(argc, argv);
+  if (opts.has("help")) {
+    std::cout << "Usage: " << argv[0]
+              << " [--elements N] [--in-dims I] [--out-dims O]"
+                 " [--fraction F] [--iterations R] [--warmup W]"
+                 " [--precision single|double|both] [--device 0|1]"
+                 " [--model <torchscript>] [--cascade-model <torchscript>]"
+                 " [--reorder-min N] [--physics-threads T]"
+                 " [--tune-calls K] [--tune-cache <file>] [--json <file>]\n";
+    return 0;
+  }
+
+  ams::ResourceManager::init();
+  AMSResourceType resource = AMSResourceType::HOST;
+  if (opts.getInt("device", 0) == 1) {
+#ifdef __ENABLE_CUDA__
+    resource = AMSResourceType::DEVICE;
+#else
+    std::cerr << "Device requested but CUDA is not enabled\n";
+    return 1;
+#endif
+  }
+
+  std::string precision = opts.get("precision", "double");
+  Report report("workflow");
+  if (precision == "single" || precision == "both")
+    run<float>("single", opts, resource, report);
+  if (precision == "double" || precision == "both")
+    run<double>("double", opts, resource, report);
+
+  report.print();
+  if (opts.has("json") && !report.writeJSON(opts.get("json", ""))) return 1;
+  return 0;
+}
@@ -0,0 +1,146 @@
+#!/usr/bin/env python3
+# Copyright 2021-2023 Lawrence Livermore National Security, LLC and other
+# AMSLib Project Developers
+#
+# SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+
+"""Compares the file formats of the staging pipeline (ams.faccessors).
+
+Every format writes the same batches, as FSWriteTask does, and reads them back
+either as a whole (training) or in blocks (FSLoaderTask). Read throughput is
+measured on the page cache, drop the caches between the phases with
+'--drop-caches' (requires root) to measure the storage instead.
+
+    python3 benchmarks/file_formats.py --path /tmp/ams_formats --rows 4194304 \\
+        --batch-rows 16384 --in-dims 8 --out-dims 4 --formats dhdf5,shdf5,columnar
+"""
+
+import argparse
+import json
+import os
+import shutil
+import subprocess
+import time
+from pathlib import Path
+
+import numpy as np
+
+from ams.faccessors import get_reader, get_writer
+
+BLOCK_SIZE = 64 * 1024 * 1024
+
+
+def stats(prefix, values):
+    values = np.array(values)
+    return {
+        f"{prefix}_mean": float(values.mean()),
+        f"{prefix}_p50": float(np.percentile(values, 50)),
+        f"{prefix}_max": float(values.max()),
+    }
+
+
+def drop_caches():
+    subprocess.call(["sync"])
+    with open("/proc/sys/vm/drop_caches", "w") as fd:
+        fd.write("3\n")
+
+
+def run(fmt, path, inputs, outputs, batch_rows, iterations, chunk_rows, cold):
+    fn = str(path / f"data.{get_writer(fmt).get_file_format_suffix()}")
+    opts = {"chunk_rows": chunk_rows} if fmt != "csv" else {}
+    nbytes = inputs.nbytes + outputs.nbytes
+    write, load, blocks = list(), list(), list()
+    for _ in range(iterations):
+        if os.path.exists(fn):
+            os.remove(fn)
+        start = time.perf_counter()
+        with get_writer(fmt)(fn, **opts) as fd:
+            for s in range(0, len(inputs), batch_rows):
+                fd.store(inputs[s : s + batch_rows], outputs[s : s + batch_rows])
+        with open(fn, "rb+") as fd:
+            os.fsync(fd.fileno())
+        write.append(time.perf_counter() - start)
+
+        if cold:
+            drop_caches()
+        start = time.perf_counter()
+        with get_reader(fmt)(fn) as fd:
+            i, o = fd.load()
+            # Memory mapped data are only read when touched
+            checksum = float(i.sum() + o.sum())
+        load.append(time.perf_counter() - start)
+        assert len(i) == len(inputs)
+
+        if cold:
+            drop_caches()
+        start = time.perf_counter()
+        rows = 0
+        with get_reader(fmt)(fn) as fd:
+            for i, o in fd.load_blocks(BLOCK_SIZE):
+                rows += len(i)
+                checksum -= float(i.sum() + o.sum())
+        blocks.append(time.perf_counter() - start)
+        assert rows == len(inputs)
+
+    size = os.path.getsize(fn)
+    metrics = {
+        "write_MBps": nbytes / (1024 * 1024) / float(np.median(write)),
+        "load_MBps": nbytes / (1024 * 1024) / float(np.median(load)),
+        "load_blocks_MBps": nbytes / (1024 * 1024) / float(np.median(blocks)),
+        "file_MB": size / (1024 * 1024),
+    }
+    metrics.update(stats("write_s", write))
+    metrics.update(stats("load_s", load))
+    metrics.update(stats("load_blocks_s", blocks))
+    return metrics
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="AMS staging file formats benchmark", formatter_class=argparse.ArgumentDefaultsHelpFormatter
+    )
+    parser.add_argument("--path", required=True, help="Directory the files are written to")
+    parser.add_argument("--formats", default="dhdf5,shdf5,columnar", help="Comma separated list of formats")
+    parser.add_argument("--rows", type=int, default=1 << 22, help="Rows of a file")
+    parser.add_argument("--batch-rows", dest="batch_rows", type=int, default=1 << 14, help="Rows of a stored batch")
+    parser.add_argument("--chunk-rows", dest="chunk_rows", type=int, default=64 * 1024, help="Rows of a chunk")
+    parser.add_argument("--in-dims", dest="in_dims", type=int, default=8, help="Input features")
+    parser.add_argument("--out-dims", dest="out_dims", type=int, default=4, help="Output features")
+    parser.add_argument("--precision", choices=["single", "double"], default="double")
+    parser.add_argument("--iterations", type=int, default=5, help="Repetitions of every measurement")
+    parser.add_argument("--drop-caches", dest="cold", action="store_true", help="Read from storage (requires root)")
+    parser.add_argument("--json", default=None, help="Write the results to this file")
+    args = parser.parse_args()
+
+    dtype = np.float32 if args.precision == "single" else np.float64
+    rng = np.random.default_rng(0)
+    inputs = rng.random((args.rows, args.in_dims), dtype=dtype)
+    outputs = rng.random((args.rows, args.out_dims), dtype=dtype)
+
+    records = list()
+    for fmt in args.formats.split(","):
+        path = Path(args.path) / fmt
+        path.mkdir(parents=True, exist_ok=True)
+        try:
+            metrics = run(fmt, path, inputs, outputs, args.batch_rows, args.iterations, args.chunk_rows, args.cold)
+        finally:
+            shutil.rmtree(path, ignore_errors=True)
+        labels = {
+            "format": fmt,
+            "rows": str(args.rows),
+            "batch_rows": str(args.batch_rows),
+            "dims": f"{args.in_dims}x{args.out_dims}",
+            "precision": args.precision,
+        }
+        records.append({"labels": labels, "metrics": metrics})
+        print("[file_formats] " + " ".join(f"{k}={v}" for k, v in labels.items()))
+        for k, v in metrics.items():
+            print(f"    {k} : {v:.6g}")
+
+    if args.json:
+        with open(args.json, "w") as fd:
+            json.dump({"benchmark": "file_formats", "records": records}, fd, indent=2)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,246 @@
+#!/usr/bin/env python3
+# Copyright 2021-2023 Lawrence Livermore National Security, LLC and other
+# AMSLib Project Developers
+#
+# SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+
+"""Performance regression harness of AMS.
+
+Runs the benchmark suite described by a JSON file, stores the results keyed by
+the commit and a fingerprint of the machine and compares them against a stored
+baseline. The script exits with a non zero code when any checked metric regresses
+more than its tolerance.
+"""
+
+import argparse
+import hashlib
+import json
+import os
+import platform
+import shutil
+import subprocess
+import sys
+import tempfile
+import time
+from pathlib import Path
+
+# Metrics for which larger values are better, everything else is a time.
+HIGHER_IS_BETTER = ("MBps", "per_sec")
+
+
+def git_commit(src_dir):
+    """Returns the commit hash of the source tree and whether it has local modifications"""
+    try:
+        commit = subprocess.check_output(["git", "rev-parse", "HEAD"], cwd=src_dir, text=True).strip()
+        dirty = subprocess.call(["git", "diff", "--quiet", "HEAD"], cwd=src_dir) != 0
+    except (OSError, subprocess.CalledProcessError):
+        return "unknown", False
+    return commit, dirty
+
+
+def cpu_model():
+    try:
+        with open("/proc/cpuinfo", "r") as fd:
+            for line in fd:
+                if line.startswith("model name"):
+                    return line.split(":", 1)[1].strip()
+    except OSError:
+        pass
+    return platform.processor()
+
+
+def machine_fingerprint():
+    """Describes the machine, results are only comparable across identical fingerprints"""
+    fp = {
+        "hostname": platform.node(),
+        "system": platform.system(),
+        "machine": platform.machine(),
+        "cpu": cpu_model(),
+        "cores": os.cpu_count(),
+    }
+    fp_id = hashlib.sha1(json.dumps(fp, sort_keys=True).encode()).hexdigest()[:12]
+    return fp, fp_id
+
+
+def resolve_command(bench, bin_dir, subs):
+    """Expands a suite entry to a command line, returns None when it cannot run on this build"""
+    for req in bench.get("requires", []):
+        if not subs.get(req):
+            print(f"[{bench['name']}] Missing '{req}', skipping")
+            return None
+
+    bin_dir = Path(bin_dir).resolve()
+    cmd = list()
+    for token in bench["command"]:
+        token = token.format(**subs)
+        exe = bin_dir / token
+        if exe.is_file() and os.access(exe, os.X_OK):
+            token = str(exe)
+        cmd.append(token)
+
+    # The executable is the first token that was found in the binary directory.
+    if not any(Path(t).parent == bin_dir for t in cmd):
+        print(f"[{bench['name']}] Benchmark is not part of this build, skipping")
+        return None
+
+    for key, args in bench.get("optional_args", {}).items():
+        if subs.get(key):
+            cmd.extend(a.format(**subs) for a in args)
+    return cmd
+
+
+def run_suite(suite, bin_dir, work_dir, subs):
+    results = dict()
+    failures = 0
+    for bench in suite["benchmarks"]:
+        cmd = resolve_command(bench, bin_dir, subs)
+        if cmd is None:
+            continue
+        out = Path(work_dir) / f"{bench['name']}.json"
+        cmd.extend(["--json", str(out)])
+        print(f"[{bench['name']}] Running: {' '.join(cmd)}")
+        start = time.time()
+        rc = subprocess.call(cmd)
+        print(f"[{bench['name']}] Finished in {time.time() - start:.2f}s with return code {rc}")
+        if rc != 0 or not out.exists():
+            failures += 1
+            continue
+        with open(out, "r") as fd:
+            results[bench["name"]] = json.load(fd)["records"]
+    return results, failures
+
+
+def record_key(bench, record):
+    return (bench, tuple(sorted(record["labels"].items())))
+
+
+def is_regression(metric, base, curr, tolerance):
+    """Returns the relative slowdown when above tolerance, otherwise None"""
+    if base <= 0:
+        return None
+    if any(k in metric for k in HIGHER_IS_BETTER):
+        change = (base - curr) / base
+    else:
+        change = (curr - base) / base
+    return change if change > tolerance else None
+
+
+def compare(baseline, current, suite):
+    """Compares the metrics listed in the suite tolerances, returns the list of regressions"""
+    tolerances = suite.get("tolerances", {})
+
+    if baseline["fingerprint_id"] != current["fingerprint_id"]:
+        print(
+            "[Warning] Baseline was recorded on a different machine "
+            f"({baseline['fingerprint']['hostname']}, {baseline['fingerprint']['cpu']}), "
+            "comparisons may not be meaningful"
+        )
+
+    base_records = dict()
+    for bench, records in baseline["benchmarks"].items():
+        for r in records:
+            base_records[record_key(bench, r)] = r["metrics"]
+
+    regressions = list()
+    checked = 0
+    for bench, records in current["benchmarks"].items():
+        for r in records:
+            key = record_key(bench, r)
+            if key not in base_records:
+                continue
+            base_metrics = base_records[key]
+            for metric, value in r["metrics"].items():
+                if metric not in tolerances or metric not in base_metrics:
+                    continue
+                checked += 1
+                tol = tolerances[metric]
+                change = is_regression(metric, base_metrics[metric], value, tol)
+                labels = ",".join(f"{k}={v}" for k, v in key[1])
+                if change is not None:
+                    regressions.append((bench, labels, metric, base_metrics[metric], value, change, tol))
+    print(f"Compared {checked} metrics against baseline commit {baseline['commit']}")
+    return regressions
+
+
+def main():
+    parser = argparse.ArgumentParser(description="AMS performance regression harness")
+    parser.add_argument("--bin-dir", required=True, help="Directory containing the benchmark executables")
+    parser.add_argument(
+        "--suite", default=str(Path(__file__).parent / "perf_suite.json"), help="JSON description of the suite"
+    )
+    parser.add_argument("--results-dir", default="perf_results", help="Directory to store the result documents")
+    parser.add_argument("--baseline", help="Result document to compare against")
+    parser.add_argument(
+        "--update-baseline", action="store_true", help="Store the current results as the baseline (--baseline path)"
+    )
+    parser.add_argument("--current", help="Do not run the suite, compare the given result document instead")
+    parser.add_argument("--model", default="", help="Torch model used by the end-to-end benchmark")
+    parser.add_argument("--mpirun", default=shutil.which("mpirun") or "", help="MPI launcher for MPI benchmarks")
+    args = parser.parse_args()
+
+    if args.update_baseline and not args.baseline:
+        parser.error("--update-baseline requires --baseline")
+    # A missing baseline is only created on request, a typo must not turn the check into a no-op
+    if args.baseline and not args.update_baseline and not Path(args.baseline).exists():
+        print(f"[Error] Baseline {args.baseline} does not exist, record it with --update-baseline")
+        return 2
+
+    with open(args.suite, "r") as fd:
+        suite = json.load(fd)
+
+    if args.current:
+        with open(args.current, "r") as fd:
+            current = json.load(fd)
+    else:
+        commit, dirty = git_commit(Path(__file__).parent)
+        fp, fp_id = machine_fingerprint()
+        work_dir = tempfile.mkdtemp(prefix="ams_perf_")
+        subs = {"work_dir": work_dir, "model": args.model, "mpirun": args.mpirun}
+        benchmarks, failures = run_suite(suite, args.bin_dir, work_dir, subs)
+        shutil.rmtree(work_dir, ignore_errors=True)
+        if failures:
+            print(f"[Error] {failures} benchmarks failed to run")
+            return 2
+
+        current = {
+            "commit": commit,
+            "dirty": dirty,
+            "fingerprint": fp,
+            "fingerprint_id": fp_id,
+            "timestamp": time.strftime("%Y-%m-%dT%H:%M:%S"),
+            "benchmarks": benchmarks,
+        }
+        results_dir = Path(args.results_dir)
+        results_dir.mkdir(parents=True, exist_ok=True)
+        fn = results_dir / f"{commit[:12]}{'-dirty' if dirty else ''}-{fp_id}.json"
+        with open(fn, "w") as fd:
+            json.dump(current, fd, indent=2)
+        print(f"Results written to {fn}")
+
+    if not args.baseline:
+        return 0
+
+    if args.update_baseline:
+        Path(args.baseline).parent.mkdir(parents=True, exist_ok=True)
+        with open(args.baseline, "w") as fd:
+            json.dump(current, fd, indent=2)
+        print(f"Baseline stored in {args.baseline}")
+        return 0
+
+    with open(args.baseline, "r") as fd:
+        baseline = json.load(fd)
+
+    regressions = compare(baseline, current, suite)
+    for bench, labels, metric, base, curr, change, tol in regressions:
+        print(
+            f"[Regression] {bench} ({labels}) {metric}: {base:.6g} -> {curr:.6g} "
+            f"({change * 100:.1f}% worse, tolerance {tol * 100:.1f}%)"
+        )
+    if regressions:
+        return 1
+    print("No performance regressions detected")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
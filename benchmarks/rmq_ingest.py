@@ -0,0 +1,265 @@
+#!/usr/bin/env python3
+# Copyright 2021-2023 Lawrence Livermore National Security, LLC and other
+# AMSLib Project Developers
+#
+# SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+
+"""End-to-end ingest benchmark of the RabbitMQ data path of AMS.
+
+Runs P producer ranks of 'ams_rmq_bench' (RabbitMQDB::store) against a broker while
+the staging pipeline (RMQPipeline through AMSDBStage) consumes and writes the data.
+The producers store their send time in the first input feature, the 'LatencyProbe'
+action of the pipeline derives the latency of every sample. The script reports the
+end-to-end samples/s and the latency percentiles next to the producer metrics, so
+producer and consumer optimizations are measured together.
+
+A local broker without TLS is started with docker/rabbitmq/local_broker.sh:
+
+    docker/rabbitmq/local_broker.sh start /tmp/rmq.json
+    python3 benchmarks/rmq_ingest.py --bench build/benchmarks/AMSlib/ams_rmq_bench \\
+        --rmq-config /tmp/rmq.json --ranks 4 --messages 200 --elements 16384 -- --writers 2
+    docker/rabbitmq/local_broker.sh stop
+
+Arguments after '--' are forwarded to the pipeline (see 'AMSDBStage -m network --help').
+"""
+
+import argparse
+import json
+import os
+import signal
+import subprocess
+import sys
+import tempfile
+import time
+from pathlib import Path
+
+import numpy as np
+
+from ams.action import UserAction
+
+# Log spaced latency histogram, from 1us to 1000s (~3.5% resolution)
+LATENCY_BINS = np.logspace(-6, 3, 601)
+
+
+class LatencyProbe(UserAction):
+    """
+    Pipeline action measuring the end-to-end latency of the samples published by ams_rmq_bench,
+    the first input feature of every row holds the wall clock time it was stored at.
+
+    Attributes:
+        status_file: JSON file the progress and the final statistics are written to
+        interval: Minimum number of seconds between two progress updates
+    """
+
+    def __init__(self, status_file, interval=0.5):
+        self.status_file = status_file
+        self.interval = interval
+        self.rows = 0
+        self.first_sent = None
+        self.first_received = None
+        self.last_received = None
+        self.histogram = np.zeros(len(LATENCY_BINS) + 1, dtype=np.int64)
+        self.latency_sum = 0.0
+        self.latency_max = 0.0
+        self._last_update = 0.0
+
+    def __call__(self, inputs, outputs):
+        now = time.time()
+        if inputs.shape[0] == 0:
+            return inputs, outputs
+        sent = inputs[:, 0]
+        latency = now - sent
+        self.rows += inputs.shape[0]
+        self.first_sent = min(self.first_sent or np.inf, float(sent.min()))
+        self.first_received = self.first_received or now
+        self.last_received = now
+        self.histogram += np.bincount(np.searchsorted(LATENCY_BINS, latency), minlength=len(self.histogram))
+        self.latency_sum += float(latency.sum())
+        self.latency_max = max(self.latency_max, float(latency.max()))
+        if now - self._last_update > self.interval:
+            self._write(False)
+            self._last_update = now
+        return inputs, outputs
+
+    def _percentile(self, pct):
+        rank = np.searchsorted(np.cumsum(self.histogram), pct / 100.0 * self.rows)
+        return float(LATENCY_BINS[min(rank, len(LATENCY_BINS) - 1)])
+
+    def _write(self, final):
+        status = {"final": final, "rows": self.rows}
+        if self.rows:
+            elapsed = max(self.last_received - self.first_sent, 1e-9)
+            status["metrics"] = {
+                "e2e_samples_per_sec": self.rows / elapsed,
+                "e2e_s": elapsed,
+                "e2e_latency_s_mean": self.latency_sum / self.rows,
+                "e2e_latency_s_p50": self._percentile(50),
+                "e2e_latency_s_p90": self._percentile(90),
+                "e2e_latency_s_p99": self._percentile(99),
+                "e2e_latency_s_max": self.latency_max,
+            }
+        tmp = f"{self.status_file}.tmp"
+        with open(tmp, "w") as fd:
+            json.dump(status, fd)
+        os.replace(tmp, self.status_file)
+
+    def finalize(self):
+        self._write(True)
+
+    @staticmethod
+    def add_cli_args(parser):
+        parser.add_argument("--probe-status", dest="probe_status", help="Progress file of the probe", required=True)
+
+    @classmethod
+    def from_cli(cls, args):
+        return cls(args.probe_status)
+
+
+def read_status(fn):
+    try:
+        with open(fn, "r") as fd:
+            return json.load(fd)
+    except (OSError, ValueError):
+        return {"final": False, "rows": 0}
+
+
+def create_store(path):
+    from ams.config import AMSInstance
+
+    config = AMSInstance.create_config(str(path), "ams_store.sql", "rmq_ingest")
+    with open(path / "ams_config.json", "w") as fd:
+        json.dump(config, fd, indent=4)
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="AMS RabbitMQ ingest benchmark", formatter_class=argparse.ArgumentDefaultsHelpFormatter
+    )
+    parser.add_argument("--bench", required=True, help="Path of the ams_rmq_bench executable")
+    parser.add_argument("--rmq-config", dest="rmq_config", required=True, help="RabbitMQ credentials (JSON)")
+    parser.add_argument("--ranks", type=int, default=1, help="Number of producer ranks")
+    parser.add_argument("--mpirun", default="mpirun", help="MPI launcher, used when --ranks > 1")
+    parser.add_argument("--messages", type=int, default=100, help="Batches stored by every rank")
+    parser.add_argument("--elements", type=int, default=1 << 14, help="Rows of every batch")
+    parser.add_argument("--in-dims", dest="in_dims", type=int, default=8, help="Input features")
+    parser.add_argument("--out-dims", dest="out_dims", type=int, default=4, help="Output features")
+    parser.add_argument("--rate", type=float, default=0.0, help="Batches per second per rank (0 is unbounded)")
+    parser.add_argument("--timeout", type=float, default=600, help="Seconds to wait for the consumer")
+    parser.add_argument("--work-dir", dest="work_dir", default=None, help="Directory of the pipeline output")
+    parser.add_argument("--json", default=None, help="Write the results to this file")
+    args, pipeline_args = parser.parse_known_args()
+    if pipeline_args and pipeline_args[0] == "--":
+        pipeline_args = pipeline_args[1:]
+
+    with open(args.rmq_config, "r") as fd:
+        rmq_config = json.load(fd)
+    expected = args.ranks * args.messages * args.elements
+
+    work_dir = Path(args.work_dir if args.work_dir else tempfile.mkdtemp(prefix="ams_rmq_ingest_"))
+    (work_dir / "data").mkdir(parents=True, exist_ok=True)
+    create_store(work_dir)
+    status_file = work_dir / "probe.json"
+    if status_file.exists():
+        status_file.unlink()
+
+    consumer_cmd = [
+        sys.executable,
+        "-m",
+        "ams_wf.AMSDBStage",
+        "--load",
+        str(Path(__file__).resolve()),
+        "--class",
+        "LatencyProbe",
+        "--policy",
+        "process",
+        "-m",
+        "network",
+        "--probe-status",
+        str(status_file),
+        "-db",
+        str(work_dir),
+        "--dest",
+        str(work_dir / "data"),
+        "--no-store",
+        "-c",
+        args.rmq_config,
+        "-q",
+        rmq_config["rabbitmq-outbound-queue"],
+    ] + pipeline_args
+    if rmq_config.get("rabbitmq-tls", True) and rmq_config.get("rabbitmq-cert"):
+        consumer_cmd += ["-t", rmq_config["rabbitmq-cert"]]
+
+    producer_json = work_dir / "producer.json"
+    producer_cmd = [
+        args.bench,
+        "--rmq-config",
+        args.rmq_config,
+        "--messages",
+        str(args.messages),
+        "--elements",
+        str(args.elements),
+        "--in-dims",
+        str(args.in_dims),
+        "--out-dims",
+        str(args.out_dims),
+        "--rate",
+        str(args.rate),
+        "--json",
+        str(producer_json),
+    ]
+    if args.ranks > 1:
+        producer_cmd = [args.mpirun, "-np", str(args.ranks)] + producer_cmd
+
+    print(f"Consumer: {' '.join(consumer_cmd)}")
+    consumer = subprocess.Popen(consumer_cmd, start_new_session=True, stdout=subprocess.DEVNULL)
+    try:
+        print(f"Producers: {' '.join(producer_cmd)}")
+        rc = subprocess.call(producer_cmd)
+        if rc != 0:
+            print(f"[Error] Producers failed with return code {rc}")
+            return 2
+
+        deadline = time.time() + args.timeout
+        while read_status(status_file)["rows"] < expected and time.time() < deadline:
+            if consumer.poll() is not None:
+                print(f"[Error] Consumer exited with return code {consumer.returncode}")
+                return 2
+            time.sleep(0.1)
+    finally:
+        # The loaders terminate on SIGINT, the rest of the pipeline drains and the probe writes its final status
+        if consumer.poll() is None:
+            os.killpg(consumer.pid, signal.SIGINT)
+            try:
+                consumer.wait(60)
+            except subprocess.TimeoutExpired:
+                os.killpg(consumer.pid, signal.SIGKILL)
+
+    status = read_status(status_file)
+    if status["rows"] != expected:
+        print(f"[Error] Consumer received {status['rows']} samples out of {expected}")
+        return 1
+
+    record = {
+        "labels": {
+            "ranks": str(args.ranks),
+            "elements": str(args.elements),
+            "messages": str(args.messages),
+            "dims": f"{args.in_dims}x{args.out_dims}",
+        },
+        "metrics": dict(status["metrics"]),
+    }
+    if producer_json.exists():
+        with open(producer_json, "r") as fd:
+            record["metrics"].update(json.load(fd)["records"][0]["metrics"])
+
+    print("[rmq_ingest] " + " ".join(f"{k}={v}" for k, v in record["labels"].items()))
+    for k, v in record["metrics"].items():
+        print(f"    {k} : {v:.6g}")
+    if args.json:
+        with open(args.json, "w") as fd:
+            json.dump({"benchmark": "rmq_ingest", "records": [record]}, fd, indent=2)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
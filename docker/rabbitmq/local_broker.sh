@@ -0,0 +1,89 @@
+#!/usr/bin/env bash
+# Copyright 2021-2023 Lawrence Livermore National Security, LLC and other
+# AMSLib Project Developers
+#
+# SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+
+usage="Usage: $(basename "$0") start <credentials.json> [port] | stop -- Run a RabbitMQ broker on localhost for tests and benchmarks.
+
+The broker listens for plain AMQP (no TLS) on 127.0.0.1 only. 'start' waits until the broker
+accepts connections and writes the JSON credentials understood by RabbitMQDB and the AMS
+staging pipeline (\"rabbitmq-tls\": false). The container runtime defaults to docker,
+set CONTAINER_RT=podman to use podman instead."
+
+CONTAINER_RT=${CONTAINER_RT:-docker}
+NAME=${AMS_BROKER_NAME:-ams-local-broker}
+IMAGE=${AMS_BROKER_IMAGE:-rabbitmq:3.10}
+QUEUE=${AMS_BROKER_QUEUE:-ams-local-queue}
+
+start() {
+  local creds=$1
+  local port=${2:-5672}
+  local user="ams-user"
+  local password
+  password=$(< /dev/urandom tr -dc A-Za-z0-9 | head -c32)
+
+  local conf
+  conf=$(mktemp -d)/20-ams.conf
+  # Same limits as the TLS broker of the Dockerfile, AMS messages can be large
+  echo -e "channel_max = 2047\nmax_message_size = 134217728" > "$conf"
+  chmod 644 "$conf"
+
+  $CONTAINER_RT run -d --rm --name "$NAME" \
+    -p "127.0.0.1:${port}:5672" \
+    -e RABBITMQ_DEFAULT_USER="$user" \
+    -e RABBITMQ_DEFAULT_PASS="$password" \
+    -v "$conf:/etc/rabbitmq/conf.d/20-ams.conf:ro" \
+    "$IMAGE" > /dev/null || exit 1
+
+  echo "[$(date +'%m%d%Y-%T')@$(hostname)] Waiting for broker $NAME on 127.0.0.1:${port}"
+  for i in $(seq 120); do
+    $CONTAINER_RT exec "$NAME" rabbitmq-diagnostics -q check_port_listener 5672 > /dev/null 2>&1 && break
+    sleep 1
+  done
+  if ! $CONTAINER_RT exec "$NAME" rabbitmq-diagnostics -q check_port_listener 5672 > /dev/null 2>&1; then
+    echo "Broker $NAME did not start"
+    $CONTAINER_RT logs "$NAME" | tail -20
+    stop
+    exit 1
+  fi
+
+  cat > "$creds" << EOF
+{
+    "rabbitmq-name": "$NAME",
+    "rabbitmq-password": "$password",
+    "rabbitmq-user": "$user",
+    "rabbitmq-vhost": "/",
+    "service-port": $port,
+    "service-host": "127.0.0.1",
+    "rabbitmq-tls": false,
+    "rabbitmq-cert": "",
+    "rabbitmq-inbound-queue": "$QUEUE-inbound",
+    "rabbitmq-outbound-queue": "$QUEUE"
+}
+EOF
+  chmod 600 "$creds"
+  echo "[$(date +'%m%d%Y-%T')@$(hostname)] Broker $NAME is ready, credentials written to $creds"
+}
+
+stop() {
+  $CONTAINER_RT stop "$NAME" > /dev/null 2>&1
+  echo "[$(date +'%m%d%Y-%T')@$(hostname)] Broker $NAME stopped"
+}
+
+case "$1" in
+  start)
+    if [ "$#" -lt 2 ]; then
+      echo "$usage"
+      exit 1
+    fi
+    start "$2" "$3"
+    ;;
+  stop)
+    stop
+    ;;
+  *)
+    echo "$usage"
+    exit 1
+    ;;
+esac
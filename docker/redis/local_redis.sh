@@ -0,0 +1,87 @@
+#!/usr/bin/env bash
+# Copyright 2021-2023 Lawrence Livermore National Security, LLC and other
+# AMSLib Project Developers
+#
+# SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+
+usage="Usage: $(basename "$0") start <config.json> [port] | stop -- Run a Redis server on localhost for tests and benchmarks.
+
+RedisDB always connects through TLS, the server listens for TLS connections on 127.0.0.1 only
+with a throw-away self-signed certificate. 'start' waits until the server answers and writes the
+JSON configuration understood by RedisDB (host, service-port, database-password, cert). The
+container runtime defaults to docker, set CONTAINER_RT=podman to use podman instead."
+
+CONTAINER_RT=${CONTAINER_RT:-docker}
+NAME=${AMS_REDIS_NAME:-ams-local-redis}
+IMAGE=${AMS_REDIS_IMAGE:-redis:7}
+
+start() {
+  local config=$1
+  local port=${2:-6379}
+  local password
+  password=$(< /dev/urandom tr -dc A-Za-z0-9 | head -c32)
+
+  # The certificate is its own CA, the key must be readable by the redis user of the container
+  local tls
+  tls=$(mktemp -d)
+  openssl req -x509 -newkey rsa:2048 -nodes -days 30 -subj "/CN=127.0.0.1" \
+    -addext "subjectAltName=IP:127.0.0.1" \
+    -keyout "$tls/redis.key" -out "$tls/redis.crt" > /dev/null 2>&1 || exit 1
+  chmod 755 "$tls"
+  chmod 644 "$tls/redis.key" "$tls/redis.crt"
+
+  $CONTAINER_RT run -d --rm --name "$NAME" \
+    -p "127.0.0.1:${port}:6379" \
+    -v "$tls:/tls:ro" \
+    "$IMAGE" redis-server --port 0 --tls-port 6379 \
+    --tls-cert-file /tls/redis.crt --tls-key-file /tls/redis.key \
+    --tls-ca-cert-file /tls/redis.crt --tls-auth-clients no \
+    --requirepass "$password" --save "" --appendonly no > /dev/null || exit 1
+
+  local ping="redis-cli --tls --cacert /tls/redis.crt --no-auth-warning -a $password ping"
+  echo "[$(date +'%m%d%Y-%T')@$(hostname)] Waiting for Redis $NAME on 127.0.0.1:${port}"
+  for i in $(seq 60); do
+    $CONTAINER_RT exec "$NAME" $ping 2> /dev/null | grep -q PONG && break
+    sleep 1
+  done
+  if ! $CONTAINER_RT exec "$NAME" $ping 2> /dev/null | grep -q PONG; then
+    echo "Redis $NAME did not start"
+    $CONTAINER_RT logs "$NAME" | tail -20
+    stop
+    exit 1
+  fi
+
+  # RedisDB parses one "key": value per line
+  cat > "$config" << EOF
+{
+    "host": "127.0.0.1",
+    "service-port": $port,
+    "database-password": "$password",
+    "cert": "$tls/redis.crt"
+}
+EOF
+  chmod 600 "$config"
+  echo "[$(date +'%m%d%Y-%T')@$(hostname)] Redis $NAME is ready, configuration written to $config"
+}
+
+stop() {
+  $CONTAINER_RT stop "$NAME" > /dev/null 2>&1
+  echo "[$(date +'%m%d%Y-%T')@$(hostname)] Redis $NAME stopped"
+}
+
+case "$1" in
+  start)
+    if [ "$#" -lt 2 ]; then
+      echo "$usage"
+      exit 1
+    fi
+    start "$2" "$3"
+    ;;
+  stop)
+    stop
+    ;;
+  *)
+    echo "$usage"
+    exit 1
+    ;;
+esac
@@ -0,0 +1,362 @@
+/*
+ * Copyright 2021-2023 Lawrence Livermore National Security, LLC and other
+ * AMSLib Project Developers
+ *
+ * SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+ */
+
+#ifndef _TABULATED_EOS_HPP_
+#define _TABULATED_EOS_HPP_
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "eos.hpp"
+
+//! Tabulated EOS
+//! A 2-D (density, energy) table of (pressure, soundspeed2, bulkmod,
+//! temperature) interpolated either bilinearly or bicubically. This mimics
+//! the cost profile of production EOS libraries (table lookups, irregular
+//! memory accesses and interpolation) and evaluates on the host only.
+template <typename FPType>
+class TabulatedEOS : public EOS<FPType>
+{
+  //! Number of tabulated quantities per table node
+  static constexpr int NQ = 4;
+  //! Points processed per block, the index/weight computation of a block is
+  //! vectorized and kept in cache for the gathering phase
+  static constexpr int BLOCK = 256;
+
+  int nd_, ne_;
+  int order_;
+  double d_min_, d_max_, e_min_, e_max_;
+  double d_step_inv_, e_step_inv_;
+  //! Row stride (in nodes) of the padded table
+  int stride_;
+  //! Quantities are interleaved per node so that all outputs of a node share
+  //! the same cache lines. The table is padded with one ghost node on every
+  //! side (linear extrapolation) so the bicubic stencil never needs clamping.
+  //! Node (i, j), with i, j in [-1, nd_] x [-1, ne_], lives at
+  //! table_[((j + 1) * stride_ + (i + 1)) * NQ].
+  std::vector<FPType> table_;
+
+  inline size_t node(int i, int j) const
+  {
+    return (static_cast<size_t>(j + 1) * stride_ + (i + 1)) * NQ;
+  }
+
+  //! Fills the table from values ordered as (energy, density, quantity)
+  template <typename T>
+  void fill(const T *values)
+  {
+    stride_ = nd_ + 2;
+    table_.assign(static_cast<size_t>(stride_) * (ne_ + 2) * NQ, 0);
+    for (int j = 0; j < ne_; ++j)
+      for (int i = 0; i < nd_; ++i)
+        for (int q = 0; q < NQ; ++q)
+          table_[node(i, j) + q] = static_cast<FPType>(
+              values[(static_cast<size_t>(j) * nd_ + i) * NQ + q]);
+
+    // ghost columns first, then ghost rows (which also fills the corners)
+    for (int j = 0; j < ne_; ++j)
+      for (int q = 0; q < NQ; ++q) {
+        table_[node(-1, j) + q] =
+            2 * table_[node(0, j) + q] - table_[node(1, j) + q];
+        table_[node(nd_, j) + q] =
+            2 * table_[node(nd_ - 1, j) + q] - table_[node(nd_ - 2, j) + q];
+      }
+    for (int i = -1; i <= nd_; ++i)
+      for (int q = 0; q < NQ; ++q) {
+        table_[node(i, -1) + q] =
+            2 * table_[node(i, 0) + q] - table_[node(i, 1) + q];
+        table_[node(i, ne_) + q] =
+            2 * table_[node(i, ne_ - 1) + q] - table_[node(i, ne_ - 2) + q];
+      }
+  }
+
+  void setup_steps()
+  {
+    if (nd_ < 4 || ne_ < 4)
+      throw std::runtime_error("Tabulated EOS requires at least 4x4 nodes");
+    if (order_ != 1 && order_ != 3)
+      throw std::runtime_error("Tabulated EOS supports orders 1 and 3");
+    // Written as negations so that NaN bounds are rejected as well
+    if (!(std::isfinite(d_min_) && std::isfinite(d_max_) && d_max_ > d_min_) ||
+        !(std::isfinite(e_min_) && std::isfinite(e_max_) && e_max_ > e_min_))
+      throw std::runtime_error(
+          "Tabulated EOS requires finite bounds with max > min");
+    d_step_inv_ = (nd_ - 1) / (d_max_ - d_min_);
+    e_step_inv_ = (ne_ - 1) / (e_max_ - e_min_);
+  }
+
+  //! Synthetic but non-trivial analytic EOS used to fill generated tables:
+  //! an ideal gas with a cold-compression term and an energy dependent
+  //! adiabatic index.
+  static void analytic(double d, double e, double *q)
+  {
+    const double gamma = 1.4 + 0.2 * std::tanh(2.0 * e - 1.0);
+    const double cold = 0.5 * (std::exp(1.5 * (d - 0.5)) - 1.0);
+    const double p = (gamma - 1.0) * d * e + cold * d;
+    q[0] = p;
+    q[1] = gamma * (gamma - 1.0) * e + 0.75 * std::exp(1.5 * (d - 0.5));
+    q[2] = gamma * p + 0.75 * d * d * std::exp(1.5 * (d - 0.5));
+    q[3] = e / (1.0 + 0.25 * std::sqrt(d + 1e-3));
+  }
+
+  //! Cubic convolution (Catmull-Rom) weights of parameter t in [0, 1)
+  static inline void cubic_weights(FPType t, FPType *w)
+  {
+    const FPType t2 = t * t;
+    const FPType t3 = t2 * t;
+    w[0] = FPType(0.5) * (-t3 + 2 * t2 - t);
+    w[1] = FPType(0.5) * (3 * t3 - 5 * t2 + 2);
+    w[2] = FPType(0.5) * (-3 * t3 + 4 * t2 + t);
+    w[3] = FPType(0.5) * (t3 - t2);
+  }
+
+  //! Computes the lower cell index and fractional offset of each point of
+  //! a block along one axis. Inputs outside the table are clamped, NaNs
+  //! map to the first cell.
+  static inline void locate(const int n,
+                            const FPType *x,
+                            const double x_min,
+                            const double step_inv,
+                            const int nodes,
+                            int *idx,
+                            FPType *frac)
+  {
+#pragma omp simd
+    for (int k = 0; k < n; ++k) {
+      double s = (static_cast<double>(x[k]) - x_min) * step_inv;
+      // std::max(0.0, NaN) is 0.0, the cell index is always valid
+      s = std::min(std::max(0.0, s), static_cast<double>(nodes - 1) - 1e-9);
+      const int c = static_cast<int>(s);
+      idx[k] = c;
+      frac[k] = static_cast<FPType>(s - c);
+    }
+  }
+
+  void eval_block(const int n,
+                  const FPType *density,
+                  const FPType *energy,
+                  FPType *pressure,
+                  FPType *soundspeed2,
+                  FPType *bulkmod,
+                  FPType *temperature) const
+  {
+    int di[BLOCK], ei[BLOCK];
+    FPType dt[BLOCK], et[BLOCK];
+    locate(n, density, d_min_, d_step_inv_, nd_, di, dt);
+    locate(n, energy, e_min_, e_step_inv_, ne_, ei, et);
+
+    FPType *out[NQ] = {pressure, soundspeed2, bulkmod, temperature};
+    const FPType *T = table_.data();
+
+    if (order_ == 1) {
+      for (int k = 0; k < n; ++k) {
+        const FPType *n00 = &T[node(di[k], ei[k])];
+        const FPType *n01 = n00 + NQ;
+        const FPType *n10 = n00 + stride_ * NQ;
+        const FPType *n11 = n10 + NQ;
+        const FPType wd = dt[k], we = et[k];
+        for (int q = 0; q < NQ; ++q) {
+          const FPType lo = n00[q] + wd * (n01[q] - n00[q]);
+          const FPType hi = n10[q] + wd * (n11[q] - n10[q]);
+          out[q][k] = lo + we * (hi - lo);
+        }
+      }
+      return;
+    }
+
+    for (int k = 0; k < n; ++k) {
+      FPType wd[4], we[4];
+      cubic_weights(dt[k], wd);
+      cubic_weights(et[k], we);
+      FPType acc[NQ] = {0, 0, 0, 0};
+      // The 4x4 stencil starts at the ghost layer for border cells
+      const FPType *row = &T[node(di[k] - 1, ei[k] - 1)];
+      for (int b = 0; b < 4; ++b, row += stride_ * NQ) {
+        for (int a = 0; a < 4; ++a) {
+          const FPType w = wd[a] * we[b];
+          for (int q = 0; q < NQ; ++q)
+            acc[q] += w * row[a * NQ + q];
+        }
+      }
+      for (int q = 0; q < NQ; ++q)
+        out[q][k] = acc[q];
+    }
+  }
+
+public:
+  /**
+   * @brief Generates a table of nd x ne nodes from an analytic EOS over the
+   * (density, energy) domain [d_min, d_max] x [e_min, e_max].
+   * @param[in] nd number of density nodes
+   * @param[in] ne number of energy nodes
+   * @param[in] order interpolation order (1: bilinear, 3: bicubic)
+   */
+  TabulatedEOS(int nd,
+               int ne,
+               int order,
+               double d_min = 0.0,
+               double d_max = 1.0,
+               double e_min = 0.0,
+               double e_max = 1.0)
+      : nd_(nd),
+        ne_(ne),
+        order_(order),
+        d_min_(d_min),
+        d_max_(d_max),
+        e_min_(e_min),
+        e_max_(e_max)
+  {
+    setup_steps();
+    std::vector<double> values(static_cast<size_t>(nd_) * ne_ * NQ);
+    for (int j = 0; j < ne_; ++j) {
+      const double e = e_min_ + j * (e_max_ - e_min_) / (ne_ - 1);
+      for (int i = 0; i < nd_; ++i) {
+        const double d = d_min_ + i * (d_max_ - d_min_) / (nd_ - 1);
+        analytic(d, e, &values[(static_cast<size_t>(j) * nd_ + i) * NQ]);
+      }
+    }
+    fill(values.data());
+  }
+
+  /**
+   * @brief Loads a table from a binary file with the layout:
+   * int32 nd, int32 ne, float64 d_min, d_max, e_min, e_max followed by
+   * nd * ne * 4 float64 values ordered as (energy, density, quantity).
+   * @param[in] path the table file
+   * @param[in] order interpolation order (1: bilinear, 3: bicubic)
+   */
+  TabulatedEOS(const std::string &path, int order) : order_(order)
+  {
+    std::ifstream fd(path, std::ios::binary);
+    if (!fd.is_open())
+      throw std::runtime_error("Cannot open EOS table: " + path);
+
+    int32_t dims[2];
+    double bounds[4];
+    fd.read(reinterpret_cast<char *>(dims), sizeof(dims));
+    fd.read(reinterpret_cast<char *>(bounds), sizeof(bounds));
+    if (!fd) throw std::runtime_error("Truncated EOS table header: " + path);
+    nd_ = dims[0];
+    ne_ = dims[1];
+    d_min_ = bounds[0];
+    d_max_ = bounds[1];
+    e_min_ = bounds[2];
+    e_max_ = bounds[3];
+    setup_steps();
+
+    // Check the size of the file before allocating the nodes, a corrupted
+    // header would request an arbitrary amount of memory
+    const std::streampos header = fd.tellg();
+    fd.seekg(0, std::ios::end);
+    const uint64_t bytes = static_cast<uint64_t>(fd.tellg() - header);
+    fd.seekg(header);
+    const uint64_t nodes = static_cast<uint64_t>(nd_) * ne_ * NQ;
+    if (bytes != nodes * sizeof(double))
+      throw std::runtime_error("EOS table " + path + " holds " +
+                               std::to_string(bytes) + " bytes of nodes, " +
+                               std::to_string(nodes * sizeof(double)) +
+                               " expected");
+
+    std::vector<double> values(nodes);
+    fd.read(reinterpret_cast<char *>(values.data()),
+            values.size() * sizeof(double));
+    if (!fd) throw std::runtime_error("Truncated EOS table: " + path);
+    fill(values.data());
+  }
+
+  /** @brief Stores the table in the format read by the file constructor */
+  void save(const std::string &path) const
+  {
+    std::ofstream fd(path, std::ios::binary);
+    if (!fd.is_open())
+      throw std::runtime_error("Cannot write EOS table: " + path);
+    int32_t dims[2] = {nd_, ne_};
+    double bounds[4] = {d_min_, d_max_, e_min_, e_max_};
+    std::vector<double> values;
+    values.reserve(static_cast<size_t>(nd_) * ne_ * NQ);
+    for (int j = 0; j < ne_; ++j)
+      for (int i = 0; i < nd_; ++i)
+        for (int q = 0; q < NQ; ++q)
+          values.push_back(table_[node(i, j) + q]);
+    fd.write(reinterpret_cast<const char *>(dims), sizeof(dims));
+    fd.write(reinterpret_cast<const char *>(bounds), sizeof(bounds));
+    fd.write(reinterpret_cast<const char *>(values.data()),
+             values.size() * sizeof(double));
+  }
+
+#ifdef __ENABLE_PERFFLOWASPECT__
+  __attribute__((annotate("@critical_path(pointcut='around')")))
+#endif
+  void
+  Eval(const int length,
+       const FPType *density,
+       const FPType *energy,
+       FPType *pressure,
+       FPType *soundspeed2,
+       FPType *bulkmod,
+       FPType *temperature) const override
+  {
+#pragma omp parallel for schedule(static)
+    for (int s = 0; s < length; s += BLOCK) {
+      const int n = std::min(BLOCK, length - s);
+      eval_block(n,
+                 density + s,
+                 energy + s,
+                 pressure + s,
+                 soundspeed2 + s,
+                 bulkmod + s,
+                 temperature + s);
+    }
+  }
+
+#ifdef __ENABLE_PERFFLOWASPECT__
+  __attribute__((annotate("@critical_path(pointcut='around')")))
+#endif
+  void
+  Eval_with_filter(const int length,
+                   const FPType *density,
+                   const FPType *energy,
+                   const bool *filter,
+                   FPType *pressure,
+                   FPType *soundspeed2,
+                   FPType *bulkmod,
+                   FPType *temperature) const override
+  {
+#pragma omp parallel for schedule(static)
+    for (int s = 0; s < length; s += BLOCK) {
+      const int n = std::min(BLOCK, length - s);
+      FPType out[NQ][BLOCK];
+      eval_block(n,
+                 density + s,
+                 energy + s,
+                 out[0],
+                 out[1],
+                 out[2],
+                 out[3]);
+      for (int k = 0; k < n; ++k) {
+        if (filter[s + k]) {
+          pressure[s + k] = out[0][k];
+          soundspeed2[s + k] = out[1][k];
+          bulkmod[s + k] = out[2][k];
+          temperature[s + k] = out[3][k];
+        }
+      }
+    }
+  }
+};
+
+// std::min binds BLOCK by reference, C++14 requires the definitions
+template <typename FPType>
+constexpr int TabulatedEOS<FPType>::NQ;
+template <typename FPType>
+constexpr int TabulatedEOS<FPType>::BLOCK;
+#endif
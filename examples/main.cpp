@@ -21,6 +21,7 @@
 #include "app/eos.hpp"
 #include "app/eos_constant_on_host.hpp"
 #include "app/eos_idealgas.hpp"
+#include "app/eos_tabulated.hpp"
 #include "app/utils_mfem.hpp"
 #include "app/eos_ams.hpp"
 // clang-format on
@@ -124,7 +125,9 @@ int computeNumElements(int globalNumElements, int id, int numRanks)
   return lElements;
 }
 
-const std::unordered_set<std::string> eos_options{"ideal_gas", "constant_host"};
+const std::unordered_set<std::string> eos_options{"ideal_gas",
+                                                   "constant_host",
+                                                   "tabulated"};
 
 double unitrand() { return (double)rand() / RAND_MAX; }
 
@@ -160,8 +163,12 @@ int run(const char *device_name,
         double empty_element_ratio,
         bool verbose,
         const char *eos_name,
+        const char *eos_table,
+        int table_res,
+        int table_order,
         int stop_cycle,
         bool pack_sparse_mats,
+        bool batch_mats,
         const char *hdcache_path,
         const char *model_path,
         const char *db_config,
@@ -197,6 +204,8 @@ int run(const char *device_name,
     uq_policy = AMSUQPolicy::DeltaUQ_Mean;
   else if (strcmp(uq_policy_opt, "random") == 0)
     uq_policy = AMSUQPolicy::RandomUQ;
+  else if (strcmp(uq_policy_opt, "occupancy") == 0)
+    uq_policy = AMSUQPolicy::OccupancyGrid;
   else
     throw std::runtime_error("Invalid UQ policy");
 
@@ -324,6 +333,9 @@ int run(const char *device_name,
 #ifdef __ENABLE_FAISS__
   uq_path = (strlen(hdcache_path) > 0) ? hdcache_path : nullptr;
 #endif
+  // Occupancy grids do not depend on FAISS
+  if (uq_policy == AMSUQPolicy::OccupancyGrid)
+    uq_path = (strlen(hdcache_path) > 0) ? hdcache_path : nullptr;
 
   std::cout << "surrogate Path is : " << model_path << "\n";
 #ifdef __ENABLE_TORCH__
@@ -350,6 +362,15 @@ int run(const char *device_name,
       base = new IdealGas<TypeValue>(1.6, 1.4);
     } else if (eos_name == std::string("constant_host")) {
       base = new ConstantEOSOnHost<TypeValue>(physics_host_alloc.c_str(), 1.0);
+    } else if (eos_name == std::string("tabulated")) {
+      if (use_device) {
+        std::cerr << "The tabulated eos only evaluates on the host" << std::endl;
+        return 1;
+      }
+      if (std::strlen(eos_table) > 0)
+        base = new TabulatedEOS<TypeValue>(eos_table, table_order);
+      else
+        base = new TabulatedEOS<TypeValue>(table_res, table_res, table_order);
     } else {
       std::cerr << "unknown eos `" << eos_name << "'" << std::endl;
       return 1;
@@ -397,6 +418,35 @@ int run(const char *device_name,
     }
     sparse_elem_indices[mat_idx] = sparse_elem_indices.Size();
   }
+
+  // ---------------------------------------------------------------------
+  // setup pooled dense buffers
+  // ---------------------------------------------------------------------
+  // sparsity is static after setup, so the dense (packed) buffers are
+  // allocated once and re-used across cycles. All packed materials share a
+  // single buffer per quantity; material 'mat_idx' owns the elements
+  // [dense_offsets[mat_idx], dense_offsets[mat_idx + 1]). In batched mode
+  // every material is packed so that all of them are evaluated in one call.
+  std::vector<bool> is_packed(num_mats, false);
+  std::vector<int> dense_offsets(num_mats + 1, 0);
+  for (int mat_idx = 0; mat_idx < num_mats; ++mat_idx) {
+    const int offset_curr =
+        mat_idx == 0 ? num_mats : sparse_elem_indices[mat_idx - 1];
+    const int num_elems_for_mat = sparse_elem_indices[mat_idx] - offset_curr;
+    is_packed[mat_idx] =
+        batch_mats || (pack_sparse_mats && num_elems_for_mat < num_elems);
+    dense_offsets[mat_idx + 1] =
+        dense_offsets[mat_idx] + (is_packed[mat_idx] ? num_elems_for_mat : 0);
+  }
+  const int num_dense_elems = dense_offsets[num_mats];
+
+  // NOTE: In blast we allocate these in a temporary memory pool
+  mfem::Array<TypeValue> dense_density(num_dense_elems * num_qpts);
+  mfem::Array<TypeValue> dense_energy(num_dense_elems * num_qpts);
+  mfem::Array<TypeValue> dense_pressure(num_dense_elems * num_qpts);
+  mfem::Array<TypeValue> dense_soundspeed2(num_dense_elems * num_qpts);
+  mfem::Array<TypeValue> dense_bulkmod(num_dense_elems * num_qpts);
+  mfem::Array<TypeValue> dense_temperature(num_dense_elems * num_qpts);
   CALIPER(CALI_MARK_END("Setup");)
 
   // -------------------------------------------------------------------------
@@ -453,6 +503,24 @@ int run(const char *device_name,
       auto d_temperature =
           mfemReshapeArray3(temperature, Write, num_qpts, num_elems, num_mats);
 
+      // dense (packed) views of the pooled buffers
+      auto d_dense_density =
+          mfemReshapeArray2(dense_density, Write, num_qpts, num_dense_elems);
+      auto d_dense_energy =
+          mfemReshapeArray2(dense_energy, Write, num_qpts, num_dense_elems);
+      auto d_dense_pressure =
+          mfemReshapeArray2(dense_pressure, Write, num_qpts, num_dense_elems);
+      auto d_dense_soundspeed2 = mfemReshapeArray2(dense_soundspeed2,
+                                                   Write,
+                                                   num_qpts,
+                                                   num_dense_elems);
+      auto d_dense_bulkmod =
+          mfemReshapeArray2(dense_bulkmod, Write, num_qpts, num_dense_elems);
+      auto d_dense_temperature = mfemReshapeArray2(dense_temperature,
+                                                   Write,
+                                                   num_qpts,
+                                                   num_dense_elems);
+
       // ---------------------------------------------------------------------
       // for each material
       for (int mat_idx = 0; mat_idx < num_mats; ++mat_idx) {
@@ -470,51 +538,21 @@ int run(const char *device_name,
         // CPUs the dense packing->looked->unpacking is better if we're using
         // expensive eoses. in the future we may just use dense representations
         // everywhere but for now we use sparse ones.
-        if (pack_sparse_mats && num_elems_for_mat < num_elems) {
+        if (is_packed[mat_idx]) {
           std::cout << " material " << mat_idx << ": using sparse packing for "
                     << num_elems_for_mat << " elems" << std::endl;
 
           // -------------------------------------------------------------
-          // TODO: I think Tom mentiond we can allocate these outside the loop
-          // check again
-          // NOTE: In blast we allocate these in a temporary memory pool
-          mfem::Array<TypeValue> dense_density(num_elems_for_mat * num_qpts);
-          mfem::Array<TypeValue> dense_energy(num_elems_for_mat * num_qpts);
-          mfem::Array<TypeValue> dense_pressure(num_elems_for_mat * num_qpts);
-          mfem::Array<TypeValue> dense_soundspeed2(num_elems_for_mat *
-                                                   num_qpts);
-          mfem::Array<TypeValue> dense_bulkmod(num_elems_for_mat * num_qpts);
-          mfem::Array<TypeValue> dense_temperature(num_elems_for_mat *
-                                                   num_qpts);
-
-          // these are device tensors!
-          auto d_dense_density = mfemReshapeArray2(dense_density,
-                                                   Write,
-                                                   num_qpts,
-                                                   num_elems_for_mat);
-          auto d_dense_energy = mfemReshapeArray2(dense_energy,
-                                                  Write,
-                                                  num_qpts,
-                                                  num_elems_for_mat);
-          auto d_dense_pressure = mfemReshapeArray2(dense_pressure,
-                                                    Write,
-                                                    num_qpts,
-                                                    num_elems_for_mat);
-          auto d_dense_soundspeed2 = mfemReshapeArray2(dense_soundspeed2,
-                                                       Write,
-                                                       num_qpts,
-                                                       num_elems_for_mat);
-          auto d_dense_bulkmod = mfemReshapeArray2(dense_bulkmod,
-                                                   Write,
-                                                   num_qpts,
-                                                   num_elems_for_mat);
-          auto d_dense_temperature = mfemReshapeArray2(dense_temperature,
-                                                       Write,
-                                                       num_qpts,
-                                                       num_elems_for_mat);
+          // sparse -> dense, into the slice of the pooled buffers owned by
+          // this material
+          const int dense_offset = dense_offsets[mat_idx];
+          auto d_mat_density = mfem::Reshape(&d_dense_density(0, dense_offset),
+                                             num_qpts,
+                                             num_elems_for_mat);
+          auto d_mat_energy = mfem::Reshape(&d_dense_energy(0, dense_offset),
+                                            num_qpts,
+                                            num_elems_for_mat);
 
-          // -------------------------------------------------------------
-          // sparse -> dense
           CALIPER(CALI_MARK_BEGIN("SPARSE_TO_DENSE");)
           pack_ij(mat_idx,
                   num_qpts,
@@ -522,37 +560,22 @@ int run(const char *device_name,
                   offset_curr,
                   d_sparse_elem_indices,
                   d_density,
-                  d_dense_density,
+                  d_mat_density,
                   d_energy,
-                  d_dense_energy);
+                  d_mat_energy);
           CALIPER(CALI_MARK_END("SPARSE_TO_DENSE");)
-          // -------------------------------------------------------------
-          eoses[mat_idx]->Eval(num_elems_for_mat * num_qpts,
-                               &d_dense_density(0, 0),
-                               &d_dense_energy(0, 0),
-                               &d_dense_pressure(0, 0),
-                               &d_dense_soundspeed2(0, 0),
-                               &d_dense_bulkmod(0, 0),
-                               &d_dense_temperature(0, 0));
 
           // -------------------------------------------------------------
-          // dense -> sparse
-          CALIPER(CALI_MARK_BEGIN("DENSE_TO_SPARSE");)
-          unpack_ij(mat_idx,
-                    num_qpts,
-                    num_elems_for_mat,
-                    offset_curr,
-                    d_sparse_elem_indices,
-                    d_dense_pressure,
-                    d_pressure,
-                    d_dense_soundspeed2,
-                    d_soundspeed2,
-                    d_dense_bulkmod,
-                    d_bulkmod,
-                    d_dense_temperature,
-                    d_temperature);
-          CALIPER(CALI_MARK_END("DENSE_TO_SPARSE");)
-          // -------------------------------------------------------------
+          // In batched mode all materials are evaluated at once below
+          if (batch_mats) continue;
+
+          eoses[mat_idx]->Eval(num_elems_for_mat * num_qpts,
+                               &d_dense_density(0, dense_offset),
+                               &d_dense_energy(0, dense_offset),
+                               &d_dense_pressure(0, dense_offset),
+                               &d_dense_soundspeed2(0, dense_offset),
+                               &d_dense_bulkmod(0, dense_offset),
+                               &d_dense_temperature(0, dense_offset));
         } else {
           std::cout << " material " << mat_idx << ": using dense packing for "
                     << num_elems << " elems" << std::endl;
@@ -566,6 +589,63 @@ int run(const char *device_name,
                                &d_temperature(0, 0, mat_idx));
         }
       }
+
+      // ---------------------------------------------------------------------
+      // batched mode: a single evaluation (AMS call) covering all materials.
+      // All materials use the same EOS model, so the first one can evaluate
+      // the whole buffer.
+      if (batch_mats && num_dense_elems > 0) {
+        std::cout << " all materials: evaluating " << num_dense_elems
+                  << " packed elems in a single call" << std::endl;
+        eoses[0]->Eval(num_dense_elems * num_qpts,
+                       &d_dense_density(0, 0),
+                       &d_dense_energy(0, 0),
+                       &d_dense_pressure(0, 0),
+                       &d_dense_soundspeed2(0, 0),
+                       &d_dense_bulkmod(0, 0),
+                       &d_dense_temperature(0, 0));
+      }
+
+      // ---------------------------------------------------------------------
+      // dense -> sparse
+      CALIPER(CALI_MARK_BEGIN("DENSE_TO_SPARSE");)
+      for (int mat_idx = 0; mat_idx < num_mats; ++mat_idx) {
+        const int offset_curr =
+            mat_idx == 0 ? num_mats : h_sparse_elem_indices[mat_idx - 1];
+        const int num_elems_for_mat =
+            dense_offsets[mat_idx + 1] - dense_offsets[mat_idx];
+        if (!is_packed[mat_idx] || num_elems_for_mat == 0) continue;
+
+        const int dense_offset = dense_offsets[mat_idx];
+        auto d_mat_pressure = mfem::Reshape(&d_dense_pressure(0, dense_offset),
+                                            num_qpts,
+                                            num_elems_for_mat);
+        auto d_mat_soundspeed2 =
+            mfem::Reshape(&d_dense_soundspeed2(0, dense_offset),
+                          num_qpts,
+                          num_elems_for_mat);
+        auto d_mat_bulkmod = mfem::Reshape(&d_dense_bulkmod(0, dense_offset),
+                                           num_qpts,
+                                           num_elems_for_mat);
+        auto d_mat_temperature =
+            mfem::Reshape(&d_dense_temperature(0, dense_offset),
+                          num_qpts,
+                          num_elems_for_mat);
+        unpack_ij(mat_idx,
+                  num_qpts,
+                  num_elems_for_mat,
+                  offset_curr,
+                  d_sparse_elem_indices,
+                  d_mat_pressure,
+                  d_pressure,
+                  d_mat_soundspeed2,
+                  d_soundspeed2,
+                  d_mat_bulkmod,
+                  d_bulkmod,
+                  d_mat_temperature,
+                  d_temperature);
+      }
+      CALIPER(CALI_MARK_END("DENSE_TO_SPARSE");)
     }
     CALIPER(CALI_MARK_END("Cycle");)
     MPI_CALL(MPI_Barrier(MPI_COMM_WORLD));
@@ -607,6 +687,9 @@ int main(int argc, char **argv)
 
   const char *device_name = "cpu";
   const char *eos_name = "ideal_gas";
+  const char *eos_table = "";
+  int table_res = 256;
+  int table_order = 1;
   const char *model_path = "";
   const char *hdcache_path = "";
   const char *db_config = "";
@@ -627,6 +710,7 @@ int main(int argc, char **argv)
   int num_elems = 10000;
   int num_qpts = 64;
   bool pack_sparse_mats = true;
+  bool batch_mats = false;
 
   bool imbalance = false;
   bool lbalance = false;
@@ -656,10 +740,25 @@ int main(int argc, char **argv)
 
   // surrogate model
   args.AddOption(&model_path, "-S", "--surrogate", "Path to surrogate model");
-  args.AddOption(&hdcache_path, "-H", "--hdcache", "Path to hdcache index");
+  args.AddOption(&hdcache_path,
+                 "-H",
+                 "--hdcache",
+                 "Path to hdcache index (FAISS or KD-tree) or occupancy grid");
 
   // eos model and length of simulation
   args.AddOption(&eos_name, "-z", "--eos", "EOS model type");
+  args.AddOption(&eos_table,
+                 "-zt",
+                 "--eos-table",
+                 "Table file of the tabulated eos (generated if empty)");
+  args.AddOption(&table_res,
+                 "-zr",
+                 "--table-res",
+                 "Nodes per axis of the generated eos table");
+  args.AddOption(&table_order,
+                 "-zo",
+                 "--table-order",
+                 "Interpolation order of the tabulated eos (1 or 3)");
   args.AddOption(&stop_cycle, "-c", "--stop-cycle", "Stop cycle");
 
   // data parameters
@@ -684,6 +783,13 @@ int main(int argc, char **argv)
                  "--do-not-pack-sparse",
                  "pack sparse material data before evals (cpu only)");
 
+  args.AddOption(&batch_mats,
+                 "-bm",
+                 "--batch-mats",
+                 "-nbm",
+                 "--no-batch-mats",
+                 "pack all materials and evaluate them in a single call");
+
   args.AddOption(&imbalance,
                  "-i",
                  "--with-imbalance",
@@ -747,7 +853,9 @@ int main(int argc, char **argv)
                  "k'st cluster \n"
                  "\t 'deltauq-mean': Uncertainty through DUQ using mean\n"
                  "\t 'deltauq-max': Uncertainty through DUQ using max\n"
-                 "\t 'random': Uncertainty throug a random model\n");
+                 "\t 'random': Uncertainty throug a random model\n"
+                 "\t 'occupancy': Uncertainty through the occupancy grid "
+                 "of the training data given with -H\n");
 
   args.AddOption(
       &verbose, "-v", "--verbose", "-qu", "--quiet", "Print extra stuff");
@@ -838,8 +946,12 @@ int main(int argc, char **argv)
                      empty_element_ratio,
                      verbose,
                      eos_name,
+                     eos_table,
+                     table_res,
+                     table_order,
                      stop_cycle,
                      pack_sparse_mats,
+                     batch_mats,
                      hdcache_path,
                      model_path,
                      db_config,
@@ -864,8 +976,12 @@ int main(int argc, char **argv)
                       empty_element_ratio,
                       verbose,
                       eos_name,
+                      eos_table,
+                      table_res,
+                      table_order,
                       stop_cycle,
                       pack_sparse_mats,
+                      batch_mats,
                       hdcache_path,
                       model_path,
                       db_config,
@@ -4,7 +4,12 @@
 #
 # SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
 
+import json
+import os
 from abc import ABC, abstractmethod
+from pathlib import Path
+
+import numpy as np
 
 
 class UserAction(ABC):
@@ -31,3 +36,266 @@ class UserAction(ABC):
     @abstractmethod
     def from_cli(cls, args):
         pass
+
+
+def _parse_columns(spec):
+    """Parses a comma separated list of column indices, an empty spec selects all columns"""
+    if not spec:
+        return None
+    return [int(c) for c in spec.split(",")]
+
+
+def _columns_mask(data, columns, predicate):
+    """
+    Returns the rows for which 'predicate' holds on every selected column. Columns are tested one
+    at a time into a reused buffer, which is much faster than reducing a 2D boolean array over its rows.
+    """
+    mask = np.ones(data.shape[0], dtype=bool)
+    tmp = np.empty(data.shape[0], dtype=bool)
+    for c in range(data.shape[1]) if columns is None else columns:
+        for p in predicate(data[:, c], tmp):
+            mask &= p
+    return mask
+
+
+class DataAction(ABC):
+    """
+    A built-in action of the staging pipeline. Actions operate on whole batches with numpy
+    vectorized kernels and are configured from the CLI through a 'SIDE:...' specification,
+    SIDE being 'inputs' or 'outputs'.
+    """
+
+    sides = ("inputs", "outputs")
+
+    @abstractmethod
+    def __call__(self, inputs, outputs):
+        pass
+
+    def finalize(self):
+        """Called once the pipeline terminated and no more data will be delivered"""
+        pass
+
+    @classmethod
+    def _check_side(cls, side):
+        if side not in cls.sides:
+            raise ValueError(f"{cls.__name__} applies to one of {cls.sides}, got '{side}'")
+        return side
+
+
+class DropNonFinite(DataAction):
+    """Drops the rows with a NaN or an Inf value in either the inputs or the outputs"""
+
+    def __call__(self, inputs, outputs):
+        def finite(col, tmp):
+            yield np.isfinite(col, out=tmp)
+
+        mask = _columns_mask(inputs, None, finite)
+        mask &= _columns_mask(outputs, None, finite)
+        if mask.all():
+            return inputs, outputs
+        return inputs[mask], outputs[mask]
+
+
+class BoundsFilter(DataAction):
+    """
+    Keeps the rows whose selected columns are all within [lower, upper].
+
+    Attributes:
+        side: Whether the bounds apply to the 'inputs' or the 'outputs'
+        lower: The lower bound
+        upper: The upper bound
+        columns: The indices of the columns checked, None for all of them
+    """
+
+    def __init__(self, side, lower, upper, columns=None):
+        self.side = self._check_side(side)
+        self.lower = lower
+        self.upper = upper
+        self.columns = columns
+
+    def __call__(self, inputs, outputs):
+        def in_bounds(col, tmp):
+            yield np.greater_equal(col, self.lower, out=tmp)
+            yield np.less_equal(col, self.upper, out=tmp)
+
+        mask = _columns_mask(inputs if self.side == "inputs" else outputs, self.columns, in_bounds)
+        if mask.all():
+            return inputs, outputs
+        return inputs[mask], outputs[mask]
+
+    @classmethod
+    def from_spec(cls, spec):
+        """Creates the filter from a 'SIDE:LOWER:UPPER[:COLUMNS]' specification"""
+        fields = spec.split(":")
+        if len(fields) not in (3, 4):
+            raise ValueError(f"Bounds specification '{spec}' is not of the form SIDE:LOWER:UPPER[:COLUMNS]")
+        return cls(fields[0], float(fields[1]), float(fields[2]), _parse_columns(fields[3] if len(fields) == 4 else ""))
+
+
+class ElementwiseTransform(DataAction):
+    """
+    Base of the transformations applied in place on the selected columns of the inputs or the outputs.
+    Integer data are converted to floating point.
+    """
+
+    def __init__(self, side, columns=None):
+        self.side = self._check_side(side)
+        self.columns = columns
+
+    @abstractmethod
+    def _apply(self, data):
+        """Transforms 'data' in place"""
+        pass
+
+    def __call__(self, inputs, outputs):
+        data = inputs if self.side == "inputs" else outputs
+        if not np.issubdtype(data.dtype, np.floating):
+            data = data.astype(np.float64)
+        elif not data.flags.writeable:
+            data = data.copy()
+
+        if self.columns is None:
+            self._apply(data)
+        else:
+            selected = data[:, self.columns]
+            self._apply(selected)
+            data[:, self.columns] = selected
+
+        if self.side == "inputs":
+            return data, outputs
+        return inputs, data
+
+
+class AffineTransform(ElementwiseTransform):
+    """
+    Computes scale * x + offset
+
+    Attributes:
+        scale: The multiplicative factor
+        offset: The additive term
+    """
+
+    def __init__(self, side, scale, offset, columns=None):
+        super().__init__(side, columns)
+        self.scale = scale
+        self.offset = offset
+
+    def _apply(self, data):
+        np.multiply(data, self.scale, out=data)
+        np.add(data, self.offset, out=data)
+
+    @classmethod
+    def from_spec(cls, spec):
+        """Creates the transformation from a 'SIDE:SCALE:OFFSET[:COLUMNS]' specification"""
+        fields = spec.split(":")
+        if len(fields) not in (3, 4):
+            raise ValueError(f"Affine specification '{spec}' is not of the form SIDE:SCALE:OFFSET[:COLUMNS]")
+        return cls(fields[0], float(fields[1]), float(fields[2]), _parse_columns(fields[3] if len(fields) == 4 else ""))
+
+
+class LogTransform(ElementwiseTransform):
+    """
+    Computes log(x + shift), values not larger than -shift become NaN or -Inf and can be dropped by a
+    subsequent DropNonFinite.
+
+    Attributes:
+        shift: The value added before taking the logarithm
+    """
+
+    def __init__(self, side, shift=0.0, columns=None):
+        super().__init__(side, columns)
+        self.shift = shift
+
+    def _apply(self, data):
+        if self.shift != 0.0:
+            np.add(data, self.shift, out=data)
+        with np.errstate(divide="ignore", invalid="ignore"):
+            np.log(data, out=data)
+
+    @classmethod
+    def from_spec(cls, spec):
+        """Creates the transformation from a 'SIDE[:SHIFT[:COLUMNS]]' specification"""
+        fields = spec.split(":")
+        if len(fields) > 3:
+            raise ValueError(f"Log specification '{spec}' is not of the form SIDE[:SHIFT[:COLUMNS]]")
+        shift = float(fields[1]) if len(fields) > 1 and fields[1] else 0.0
+        return cls(fields[0], shift, _parse_columns(fields[2] if len(fields) == 3 else ""))
+
+
+class RunningStats(DataAction):
+    """
+    Maintains the per column mean and variance of the inputs and the outputs flowing through the
+    pipeline, batches are merged with the parallel algorithm of Chan et al. The statistics are
+    written as JSON to 'file_name' once the pipeline terminates.
+
+    Attributes:
+        file_name: The JSON file to write the statistics to
+        rows: The number of rows seen so far
+    """
+
+    def __init__(self, file_name):
+        self.file_name = file_name
+        self.rows = 0
+        self._mean = dict()
+        self._m2 = dict()
+
+    def _merge(self, side, data):
+        n = data.shape[0]
+        # Column sums through a matrix-vector product run at memory bandwidth, unlike numpy reductions
+        mean = (np.ones(n, dtype=data.dtype) @ data).astype(np.float64) / n
+        centered = data - mean.astype(data.dtype)
+        m2 = np.einsum("ij,ij->j", centered, centered).astype(np.float64)
+        if side not in self._mean:
+            self._mean[side] = mean
+            self._m2[side] = m2
+            return
+        total = self.rows + n
+        delta = mean - self._mean[side]
+        self._mean[side] += delta * (n / total)
+        self._m2[side] += m2 + np.square(delta) * (self.rows * n / total)
+
+    def __call__(self, inputs, outputs):
+        if inputs.shape[0] == 0:
+            return inputs, outputs
+        self._merge("inputs", inputs)
+        self._merge("outputs", outputs)
+        self.rows += inputs.shape[0]
+        return inputs, outputs
+
+    def stats(self):
+        """Returns the number of rows and the per column mean and variance of the inputs and outputs"""
+        stats = {"rows": self.rows}
+        for side in self.sides:
+            if side not in self._mean:
+                continue
+            var = self._m2[side] / max(self.rows, 1)
+            stats[side] = {"mean": self._mean[side].tolist(), "var": var.tolist(), "std": np.sqrt(var).tolist()}
+        return stats
+
+    def finalize(self):
+        tmp = Path(f"{self.file_name}.tmp")
+        with open(tmp, "w") as fd:
+            json.dump(self.stats(), fd, indent=4)
+        os.replace(tmp, self.file_name)
+        print(f"Wrote statistics of {self.rows} rows to {self.file_name}")
+
+
+class ActionChain(DataAction):
+    """
+    Applies a sequence of actions within a single pipeline stage, avoiding a queue (and a process)
+    per action.
+    """
+
+    def __init__(self, actions):
+        self.actions = list(actions)
+
+    def __call__(self, inputs, outputs):
+        for a in self.actions:
+            inputs, outputs = a(inputs, outputs)
+            if inputs.shape[0] == 0:
+                break
+        return inputs, outputs
+
+    def finalize(self):
+        for a in self.actions:
+            a.finalize()
@@ -0,0 +1,262 @@
+#!/usr/bin/env python3
+# Copyright 2021-2023 Lawrence Livermore National Security, LLC and other
+# AMSLib Project Developers
+#
+# SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+
+"""
+Compaction of the many small per-rank files produced by AMSlib into large, fixed-size and shuffled
+training shards.
+
+Training data loaders open every file of the store, with one file per rank per run opening the files
+dominates the loading time. The compactor merges them into shards of 'shard_rows' rows (the last one may
+be smaller) stored in the packed HDF5 format ("inputs", "outputs" datasets) and described by a single
+'index.json' file.
+
+The source files are shuffled and concatenated, every shard takes the next 'shard_rows' rows of this
+sequence and shuffles them. The plan only depends on the sources, the shard size and the seed, so an
+interrupted compaction is resumed by running it again: shards are written to a temporary file and renamed
+once complete, existing shards are skipped.
+"""
+
+import json
+import os
+import time
+from multiprocessing import get_context
+from pathlib import Path
+
+import numpy as np
+
+from ams.faccessors import get_reader, get_writer
+
+INDEX_NAME = "index.json"
+INDEX_VERSION = 1
+
+
+def shard_name(shard_id):
+    return f"shard_{shard_id:06d}.h5"
+
+
+def _count_rows(args):
+    fn, reader_type = args
+    with get_reader(reader_type)(fn) as fd:
+        return fd.num_rows()
+
+
+def plan_shards(rows, shard_rows, seed):
+    """
+    Splits the shuffled concatenation of the sources in shards of 'shard_rows' rows.
+
+    Args:
+        rows: The number of rows of every source file
+        shard_rows: The number of rows of a shard
+        seed: The seed of the shuffling
+
+    Returns:
+        A list of shards, every shard is a list of [source index, start row, end row] pieces
+    """
+    order = np.random.default_rng(seed).permutation(len(rows))
+    shards = list()
+    pieces = list()
+    filled = 0
+    for src in order:
+        src = int(src)
+        start = 0
+        while start < rows[src]:
+            take = min(rows[src] - start, shard_rows - filled)
+            pieces.append([src, start, start + take])
+            start += take
+            filled += take
+            if filled == shard_rows:
+                shards.append(pieces)
+                pieces = list()
+                filled = 0
+    if pieces:
+        shards.append(pieces)
+    return shards
+
+
+def _write_shard(args):
+    """Reads the pieces of a shard, shuffles the rows and atomically writes the shard file"""
+    dest_dir, shard_id, pieces, sources, reader_type, seed, writer_opts = args
+    start_time = time.time()
+    num_rows = sum(end - start for _, start, end in pieces)
+
+    inputs = None
+    outputs = None
+    offset = 0
+    reader = get_reader(reader_type)
+    for src, start, end in pieces:
+        with reader(sources[src]) as fd:
+            i, o = fd.load_range(start, end)
+        if inputs is None:
+            inputs = np.empty((num_rows, *i.shape[1:]), dtype=i.dtype)
+            outputs = np.empty((num_rows, *o.shape[1:]), dtype=o.dtype)
+        inputs[offset : offset + len(i)] = i
+        outputs[offset : offset + len(o)] = o
+        offset += len(i)
+
+    perm = np.random.default_rng([seed, shard_id]).permutation(num_rows)
+    dest = Path(dest_dir) / shard_name(shard_id)
+    tmp = dest.with_suffix(".tmp")
+    if tmp.exists():
+        tmp.unlink()
+
+    writer = get_writer("dhdf5")
+    block = writer_opts.get("chunk_rows", 64 * 1024)
+    with writer(str(tmp), **writer_opts) as fd:
+        # Gather the permuted rows block by block, we never hold a second copy of the shard
+        for b in range(0, num_rows, block):
+            idx = perm[b : b + block]
+            fd.store(inputs[idx], outputs[idx])
+    os.replace(tmp, dest)
+    return shard_id, num_rows, time.time() - start_time
+
+
+class Compactor:
+    """
+    Merges per-rank AMS files into shuffled shards of fixed size.
+
+    Attributes:
+        sources: The files to compact
+        dest_dir: The directory of the shards and of the index
+        shard_rows: The number of rows of every shard (but the last one)
+        reader_type: The file format of the sources (see faccessors.get_reader)
+        seed: The seed of the shuffling
+        workers: The number of processes reading and writing shards
+        writer_opts: Options forwarded to the shard writer (chunk_rows, compression, ...)
+    """
+
+    def __init__(self, sources, dest_dir, shard_rows, reader_type="shdf5", seed=0, workers=1, writer_opts=None):
+        if shard_rows <= 0:
+            raise ValueError(f"Shard size must be positive, got {shard_rows}")
+        self.sources = sorted(str(Path(s).resolve()) for s in sources)
+        self.dest_dir = Path(dest_dir)
+        self.shard_rows = shard_rows
+        self.reader_type = reader_type
+        self.seed = seed
+        self.workers = max(1, workers)
+        self.writer_opts = dict(writer_opts) if writer_opts else dict()
+        self.writer_opts.setdefault("chunk_rows", min(64 * 1024, shard_rows))
+        self.index = None
+
+    @property
+    def index_file(self):
+        return self.dest_dir / INDEX_NAME
+
+    def _map(self, fn, tasks):
+        if self.workers == 1:
+            yield from map(fn, tasks)
+            return
+        with get_context("spawn").Pool(self.workers) as pool:
+            yield from pool.imap_unordered(fn, tasks, chunksize=1)
+
+    def plan(self):
+        """
+        Loads the index of a previous (possibly interrupted) compaction or creates it. Counting the rows
+        opens every source once, this is done in parallel.
+        """
+        if self.index_file.exists():
+            with open(self.index_file, "r") as fd:
+                index = json.load(fd)
+            if (
+                index["sources"] != self.sources
+                or index["shard_rows"] != self.shard_rows
+                or index["seed"] != self.seed
+                or index["reader_type"] != self.reader_type
+            ):
+                raise ValueError(f"{self.index_file} describes a different compaction, use another directory")
+            self.index = index
+            return index
+
+        self.dest_dir.mkdir(parents=True, exist_ok=True)
+        start = time.time()
+        if self.workers == 1:
+            rows = [_count_rows((s, self.reader_type)) for s in self.sources]
+        else:
+            with get_context("spawn").Pool(self.workers) as pool:
+                rows = pool.map(_count_rows, [(s, self.reader_type) for s in self.sources], chunksize=16)
+        print(f"Counted {sum(rows)} rows in {len(rows)} files in {time.time() - start:.2f}s")
+
+        shards = plan_shards(rows, self.shard_rows, self.seed)
+        self.index = {
+            "version": INDEX_VERSION,
+            "complete": False,
+            "reader_type": self.reader_type,
+            "seed": self.seed,
+            "shard_rows": self.shard_rows,
+            "num_rows": int(sum(rows)),
+            "sources": self.sources,
+            "source_rows": [int(r) for r in rows],
+            "shards": [
+                {"file": shard_name(i), "rows": sum(e - s for _, s, e in p), "pieces": p} for i, p in enumerate(shards)
+            ],
+        }
+        self._write_index()
+        return self.index
+
+    def _write_index(self):
+        tmp = self.index_file.with_suffix(".tmp")
+        with open(tmp, "w") as fd:
+            json.dump(self.index, fd)
+        os.replace(tmp, self.index_file)
+
+    def pending(self):
+        """Returns the ids of the shards not written yet"""
+        if self.index is None:
+            self.plan()
+        return [i for i, s in enumerate(self.index["shards"]) if not (self.dest_dir / s["file"]).exists()]
+
+    def __call__(self):
+        """
+        Writes all pending shards and marks the index as complete.
+
+        Returns:
+            The paths of all the shards
+        """
+        self.plan()
+        pending = self.pending()
+        total = len(self.index["shards"])
+        print(f"Compacting {len(self.sources)} files into {total} shards, {total - len(pending)} already written")
+
+        tasks = [
+            (
+                str(self.dest_dir),
+                i,
+                self.index["shards"][i]["pieces"],
+                self.sources,
+                self.reader_type,
+                self.seed,
+                self.writer_opts,
+            )
+            for i in pending
+        ]
+        start = time.time()
+        rows = 0
+        for shard_id, num_rows, secs in self._map(_write_shard, tasks):
+            rows += num_rows
+            print(f"Wrote {shard_name(shard_id)} ({num_rows} rows) in {secs:.2f}s")
+        elapsed = time.time() - start
+        if pending:
+            print(f"Compacted {rows} rows in {elapsed:.2f}s ({rows / max(elapsed, 1e-9):.0f} rows/s)")
+
+        self.index["complete"] = True
+        self._write_index()
+        return shard_files(self.dest_dir)
+
+
+def load_index(dest_dir):
+    """Loads the index describing the shards of a compaction"""
+    with open(Path(dest_dir) / INDEX_NAME, "r") as fd:
+        index = json.load(fd)
+    if index.get("version") != INDEX_VERSION:
+        raise ValueError(f"Unsupported shard index version {index.get('version')}")
+    return index
+
+
+def shard_files(dest_dir):
+    """Returns the shards of a complete compaction, they can be read through HDF5PackedReader"""
+    index = load_index(dest_dir)
+    if not index["complete"]:
+        raise RuntimeError(f"Compaction in {dest_dir} did not complete, run it again to resume")
+    return [str(Path(dest_dir) / s["file"]) for s in index["shards"]]
@@ -6,12 +6,21 @@
 
 import argparse
 import csv
+import json
+import os
+import time
 from abc import ABC, abstractmethod
 from pathlib import Path
 
 import h5py
 import numpy as np
 
+# Layout of the columnar files: a fixed size header followed by chunks of 'chunk_rows' rows, every chunk
+# stores the little endian [rows x features] block of the inputs followed by the one of the outputs.
+# Only the last chunk may hold less rows.
+COLUMNAR_MAGIC = b"AMSCOL1\n"
+COLUMNAR_HEADER_SIZE = 4096
+
 
 class FileReader(ABC):
     @classmethod
@@ -56,6 +65,37 @@ class FileReader(ABC):
         """
         raise NotImplementedError
 
+    @staticmethod
+    def _rows_per_block(row_bytes, block_size):
+        return max(1, block_size // max(row_bytes, 1))
+
+    def load_blocks(self, block_size: int):
+        """
+        Iterates over the data of the file in blocks of rows of at most 'block_size' bytes (at least one row).
+        Readers that cannot stream the file load it completely and split it.
+
+        Yields:
+            Pairs of input, output blocks
+        """
+        inputs, outputs = self.load()
+        if inputs is None or len(inputs) == 0:
+            return
+        rows = self._rows_per_block(inputs[0].nbytes + outputs[0].nbytes, block_size)
+        for start in range(0, len(inputs), rows):
+            yield inputs[start : start + rows], outputs[start : start + rows]
+
+    def num_rows(self) -> int:
+        """Returns the number of rows stored in the file"""
+        inputs, _ = self.load()
+        return 0 if inputs is None else len(inputs)
+
+    def load_range(self, start: int, end: int) -> tuple:
+        """
+        load rows [start, end) of the file and return a tupple of the inputs, outputs
+        """
+        inputs, outputs = self.load()
+        return inputs[start:end], outputs[start:end]
+
 
 class CSVReader(FileReader):
     """
@@ -137,9 +177,22 @@ class HDF5CLibReader(FileReader):
     def __exit__(self, exc_type, exc_val, exc_tb):
         self.close()
 
-    def _pack_dsets_to_list(self, dsets, selector):
-        data = [dsets[k[0]] for k in selector]
-        data = [data[k[1]] for k in selector]
+    def _ordered_dsets(self, name):
+        """Returns the datasets of the features 'name' ordered by their index"""
+        selector = self._map_name_to_index(self.fd.keys(), name)
+        return [self.fd[k] for k, _ in sorted(selector, key=lambda k: k[1])]
+
+    @staticmethod
+    def _read_columns(dsets, start, end):
+        """
+        Reads rows [start, end) of per feature datasets into a [rows x features] buffer. Every
+        dataset is read as a hyperslab directly into its column, avoiding a transposition.
+        """
+        dtype = np.result_type(*[d.dtype for d in dsets]) if dsets else np.float64
+        data = np.empty((end - start, len(dsets)), dtype=dtype)
+        if end > start:
+            for j, d in enumerate(dsets):
+                d.read_direct(data, source_sel=np.s_[start:end], dest_sel=np.s_[:, j])
         return data
 
     def load(self) -> tuple:
@@ -153,14 +206,39 @@ class HDF5CLibReader(FileReader):
             A pair of input, output data values
         """
 
-        dsets = self.fd.keys()
-        input_map = self._map_name_to_index(dsets, "input")
-        output_map = self._map_name_to_index(dsets, "output")
+        inputs = self._ordered_dsets("input")
+        outputs = self._ordered_dsets("output")
+        rows = inputs[0].shape[0] if inputs else 0
 
-        input_data = np.array(self._pack_dsets_to_list(self.fd, input_map)).T
-        output_data = np.array(self._pack_dsets_to_list(self.fd, output_map)).T
+        return self._read_columns(inputs, 0, rows), self._read_columns(outputs, 0, rows)
 
-        return input_data, output_data
+    def load_blocks(self, block_size: int):
+        """
+        Iterates over the file in blocks of rows of at most 'block_size' bytes. Only a block is in
+        memory at a time.
+
+        Yields:
+            Pairs of input, output blocks
+        """
+        inputs = self._ordered_dsets("input")
+        outputs = self._ordered_dsets("output")
+        if not inputs:
+            return
+        num_rows = inputs[0].shape[0]
+        row_bytes = sum(d.dtype.itemsize for d in inputs + outputs)
+        rows = self._rows_per_block(row_bytes, block_size)
+        for start in range(0, num_rows, rows):
+            end = min(start + rows, num_rows)
+            yield self._read_columns(inputs, start, end), self._read_columns(outputs, start, end)
+
+    def num_rows(self) -> int:
+        inputs = self._ordered_dsets("input")
+        return inputs[0].shape[0] if inputs else 0
+
+    def load_range(self, start: int, end: int) -> tuple:
+        return self._read_columns(self._ordered_dsets("input"), start, end), self._read_columns(
+            self._ordered_dsets("output"), start, end
+        )
 
     @classmethod
     def get_file_format_suffix(cls):
@@ -206,7 +284,154 @@ class HDF5PackedReader(FileReader):
         input_data = self.fd["inputs"]
         output_data = self.fd["outputs"]
 
-        return np.array(input_data), np.array(output_data)
+        return input_data[()], output_data[()]
+
+    @staticmethod
+    def _read_rows(dset, start, end):
+        """Reads rows [start, end) of a dataset as a hyperslab into a new buffer"""
+        data = np.empty((end - start, *dset.shape[1:]), dtype=dset.dtype)
+        if end > start:
+            dset.read_direct(data, source_sel=np.s_[start:end])
+        return data
+
+    def load_blocks(self, block_size: int):
+        """
+        Iterates over the file in blocks of rows of at most 'block_size' bytes. Only a block is in
+        memory at a time.
+
+        Yields:
+            Pairs of input, output blocks
+        """
+        inputs = self.fd["inputs"]
+        outputs = self.fd["outputs"]
+        num_rows = inputs.shape[0]
+        row_bytes = (
+            np.prod(inputs.shape[1:], dtype=int) * inputs.dtype.itemsize
+            + np.prod(outputs.shape[1:], dtype=int) * outputs.dtype.itemsize
+        )
+        rows = self._rows_per_block(int(row_bytes), block_size)
+        for start in range(0, num_rows, rows):
+            end = min(start + rows, num_rows)
+            yield self._read_rows(inputs, start, end), self._read_rows(outputs, start, end)
+
+    def num_rows(self) -> int:
+        return self.fd["inputs"].shape[0]
+
+    def load_range(self, start: int, end: int) -> tuple:
+        return self._read_rows(self.fd["inputs"], start, end), self._read_rows(self.fd["outputs"], start, end)
+
+    @classmethod
+    def get_file_format_suffix(cls):
+        return cls.suffix
+
+
+class ColumnarReader(FileReader):
+    """
+    A reader of the columnar files written by ColumnarWriter.
+
+    The file is memory mapped, the inputs and outputs of a chunk are returned as read-only views of the mapping
+    and are only copied when a request spans several chunks.
+    """
+
+    suffix = "amsc"
+
+    def __init__(self, file_name: str):
+        super().__init__()
+        self.file_name = file_name
+        self.header = None
+        self._mm = None
+
+    def open(self):
+        with open(self.file_name, "rb") as fd:
+            raw = fd.read(COLUMNAR_HEADER_SIZE)
+        if len(raw) != COLUMNAR_HEADER_SIZE or not raw.startswith(COLUMNAR_MAGIC):
+            raise RuntimeError(f"{self.file_name} is not a columnar AMS file")
+        self.header = json.loads(raw[len(COLUMNAR_MAGIC) :].decode("utf-8"))
+        if not self.header.get("complete", False):
+            raise RuntimeError(f"{self.file_name} was not closed properly")
+        if self.header["rows"] > 0:
+            self._mm = np.memmap(self.file_name, dtype=np.uint8, mode="r").view(np.ndarray)
+        return self
+
+    def close(self):
+        # Views returned to the caller keep the mapping alive
+        self._mm = None
+        self.header = None
+
+    def __enter__(self):
+        return self.open()
+
+    def __exit__(self, exc_type, exc_val, exc_tb):
+        self.close()
+
+    def _layout(self, name):
+        desc = self.header[name]
+        dtype = np.dtype(desc["dtype"])
+        return dtype, tuple(desc["shape"]), int(np.prod(desc["shape"], dtype=int)) * dtype.itemsize
+
+    def _chunk(self, index):
+        """Returns zero copy views of the inputs and outputs of chunk 'index'"""
+        chunk_rows = self.header["chunk_rows"]
+        rows = min(chunk_rows, self.header["rows"] - index * chunk_rows)
+        i_dtype, i_shape, i_bytes = self._layout("inputs")
+        o_dtype, o_shape, o_bytes = self._layout("outputs")
+        start = COLUMNAR_HEADER_SIZE + index * chunk_rows * (i_bytes + o_bytes)
+        inputs = self._mm[start : start + rows * i_bytes].view(i_dtype).reshape(rows, *i_shape)
+        start += rows * i_bytes
+        outputs = self._mm[start : start + rows * o_bytes].view(o_dtype).reshape(rows, *o_shape)
+        return inputs, outputs
+
+    def _empty(self):
+        if self.header["inputs"] is None:
+            return np.empty((0, 0)), np.empty((0, 0))
+        i_dtype, i_shape, _ = self._layout("inputs")
+        o_dtype, o_shape, _ = self._layout("outputs")
+        return np.empty((0, *i_shape), dtype=i_dtype), np.empty((0, *o_shape), dtype=o_dtype)
+
+    def num_rows(self) -> int:
+        return self.header["rows"]
+
+    def load_range(self, start: int, end: int) -> tuple:
+        """
+        load rows [start, end) of the file, the data are views of the file when they belong to a single chunk
+        """
+        end = min(end, self.num_rows())
+        if end <= start:
+            return self._empty()
+        chunk_rows = self.header["chunk_rows"]
+        first, last = start // chunk_rows, (end - 1) // chunk_rows
+        parts = list()
+        for c in range(first, last + 1):
+            i, o = self._chunk(c)
+            lo = max(start - c * chunk_rows, 0)
+            hi = min(end - c * chunk_rows, len(i))
+            parts.append((i[lo:hi], o[lo:hi]))
+        if len(parts) == 1:
+            return parts[0]
+        return np.concatenate([p[0] for p in parts]), np.concatenate([p[1] for p in parts])
+
+    def load(self) -> tuple:
+        """
+        load the data in the file and return a tupple of the inputs, outputs
+        """
+        return self.load_range(0, self.num_rows())
+
+    def load_blocks(self, block_size: int):
+        """
+        Iterates over the file in blocks of rows of at most 'block_size' bytes. Blocks never span chunks, thus
+        they are always views of the file.
+
+        Yields:
+            Pairs of input, output blocks
+        """
+        if self.num_rows() == 0:
+            return
+        rows = self._rows_per_block(self._layout("inputs")[2] + self._layout("outputs")[2], block_size)
+        chunk_rows = self.header["chunk_rows"]
+        for c in range((self.num_rows() + chunk_rows - 1) // chunk_rows):
+            inputs, outputs = self._chunk(c)
+            for start in range(0, len(inputs), rows):
+                yield inputs[start : start + rows], outputs[start : start + rows]
 
     @classmethod
     def get_file_format_suffix(cls):
@@ -326,29 +551,98 @@ class CSVWriter(FileWriter):
         return cls.suffix
 
 
+class RowBuffer:
+    """
+    A growable in-memory buffer of rows. Rows are appended at the end and consumed from the front.
+
+    Attributes:
+        data: The underlying storage, only the first 'size' rows are valid
+        size: The number of valid rows
+    """
+
+    def __init__(self, row_shape, dtype, capacity=1024):
+        self.data = np.empty((capacity, *row_shape), dtype=dtype)
+        self.size = 0
+
+    def __len__(self):
+        return self.size
+
+    @property
+    def nbytes(self):
+        return self.size * self.data[0].nbytes
+
+    def append(self, rows: np.array):
+        n = rows.shape[0]
+        if self.size + n > self.data.shape[0]:
+            capacity = max(self.data.shape[0] * 2, self.size + n)
+            data = np.empty((capacity, *self.data.shape[1:]), dtype=self.data.dtype)
+            data[: self.size] = self.data[: self.size]
+            self.data = data
+        self.data[self.size : self.size + n] = rows
+        self.size += n
+
+    def rows(self, n: int) -> np.array:
+        """Returns a view of the first 'n' rows, valid until the next 'consume'"""
+        return self.data[:n]
+
+    def consume(self, n: int):
+        """Drops the first 'n' rows, the remainder is moved to the front"""
+        remainder = self.size - n
+        self.data[:remainder] = self.data[n : self.size]
+        self.size = remainder
+
+
 class HDF5Writer(FileWriter):
     """
     A simple hdf5 backend.
+
+    Incoming rows are accumulated in memory and written in bulk once more than 'buffer_size' bytes are
+    buffered. Every flush writes a multiple of 'chunk_rows' rows so that writes stay aligned to the chunks
+    of the datasets, the remainder is written when the file is closed.
+
+    Attributes:
+        chunk_rows: The number of rows of a dataset chunk
+        compression: The h5py compression filter ("gzip", "lzf" or None)
+        compression_opts: The options of the compression filter (the level for gzip)
+        buffer_size: The number of bytes to accumulate before flushing
+        flushes: A list of (rows, bytes, seconds) describing every flush
     """
 
     suffix = "h5"
 
-    def __init__(self, file_name: str):
+    def __init__(
+        self,
+        file_name: str,
+        chunk_rows: int = 64 * 1024,
+        compression: str = None,
+        compression_opts: int = None,
+        buffer_size: int = 64 * 1024 * 1024,
+    ):
         super().__init__()
         self.file_name = file_name
         self.fd = None
         self.datasets = dict()
+        self.chunk_rows = chunk_rows
+        self.compression = compression
+        self.compression_opts = compression_opts
+        self.buffer_size = buffer_size
+        self.flushes = list()
+        self._inputs = None
+        self._outputs = None
 
     def __str__(self) -> str:
-        return f"{__class__.__name__}(file_name={self.filename}, fd={self.fd})"
+        return f"{__class__.__name__}(file_name={self.file_name}, fd={self.fd})"
 
     def open(self):
         self.fd = h5py.File(self.file_name, "a")
         return self
 
     def close(self):
+        self._flush(final=True)
         self.fd.close()
         self.datasets.clear()
+        self._inputs = None
+        self._outputs = None
         self.fd = None
 
     def __enter__(self):
@@ -361,23 +655,84 @@ class HDF5Writer(FileWriter):
         if dset_name not in self.fd:
             max_shape = list(data.shape)
             max_shape[0] = None
-            self.datasets[dset_name] = self.fd.create_dataset(dset_name, data=data, chunks=True, maxshape=max_shape)
+            chunks = list(data.shape)
+            chunks[0] = max(min(self.chunk_rows, data.shape[0]), 1)
+            self.datasets[dset_name] = self.fd.create_dataset(
+                dset_name,
+                data=data,
+                chunks=tuple(chunks),
+                maxshape=max_shape,
+                compression=self.compression,
+                compression_opts=self.compression_opts,
+            )
             return
         self.fd[dset_name].resize(size=self.fd[dset_name].shape[0] + data.shape[0], axis=0)
         self.fd[dset_name][-data.shape[0] :] = data
 
-    def store(self, inputs: np.array, outputs: np.array) -> int:
-        """Store the two arrays in a hdf5 file"""
-        assert len(inputs) == len(outputs)
+    def _stored_rows(self) -> int:
+        """The number of rows already in the file, used to keep flushes chunk aligned"""
+        if "input_0" not in self.fd:
+            return 0
+        return self.fd["input_0"].shape[0]
 
-        if self.fd is None:
-            raise RuntimeError("HDF5 file {self.file_name} is not open")
+    def _write(self, inputs: np.array, outputs: np.array):
         for i in range(inputs.shape[-1]):
             self._store_dataset(f"input_{i}", inputs[..., i])
 
         for i in range(outputs.shape[-1]):
             self._store_dataset(f"output_{i}", outputs[..., i])
 
+    def _flush(self, final=False):
+        if self._inputs is None or len(self._inputs) == 0:
+            return
+
+        buffered = len(self._inputs)
+        if final:
+            rows = buffered
+        else:
+            # Flush up to the last chunk boundary reachable with the buffered rows
+            stored = self._stored_rows()
+            rows = ((stored + buffered) // self.chunk_rows) * self.chunk_rows - stored
+            if rows <= 0:
+                return
+
+        nbytes = self._inputs.rows(rows).nbytes + self._outputs.rows(rows).nbytes
+        start = time.time()
+        self._write(self._inputs.rows(rows), self._outputs.rows(rows))
+        self.flushes.append((rows, nbytes, time.time() - start))
+        self._inputs.consume(rows)
+        self._outputs.consume(rows)
+
+    def store(self, inputs: np.array, outputs: np.array) -> int:
+        """Store the two arrays in a hdf5 file"""
+        assert len(inputs) == len(outputs)
+
+        if self.fd is None:
+            raise RuntimeError(f"HDF5 file {self.file_name} is not open")
+
+        if self._inputs is None:
+            self._inputs = RowBuffer(inputs.shape[1:], inputs.dtype)
+            self._outputs = RowBuffer(outputs.shape[1:], outputs.dtype)
+        self._inputs.append(inputs)
+        self._outputs.append(outputs)
+
+        if self._inputs.nbytes + self._outputs.nbytes >= self.buffer_size:
+            self._flush()
+        return len(inputs)
+
+    def flush_stats(self) -> str:
+        """Returns a summary of the throughput of the flushes performed so far"""
+        if not self.flushes:
+            return "no flushes"
+        rates = [b / t / (1024 * 1024) for _, b, t in self.flushes if t > 0]
+        total_bytes = sum(b for _, b, _ in self.flushes)
+        total_time = sum(t for _, _, t in self.flushes)
+        summary = f"{len(self.flushes)} flushes, {total_bytes / (1024 * 1024):.2f} MB in {total_time:.3f}s"
+        if rates:
+            avg = total_bytes / total_time / (1024 * 1024)
+            summary += f" ({min(rates):.1f}/{avg:.1f}/{max(rates):.1f} MB/s min/avg/max)"
+        return summary
+
     @classmethod
     def get_file_format_suffix(cls):
         return cls.suffix
@@ -390,21 +745,158 @@ class HDF5PackedWriter(HDF5Writer):
 
     suffix = "h5"
 
-    def __init__(self, file_name: str):
-        super().__init__(file_name)
+    def __init__(self, file_name: str, **kwargs):
+        super().__init__(file_name, **kwargs)
+
+    def __str__(self) -> str:
+        return f"{__class__.__name__}(file_name={self.file_name}, fd={self.fd})"
+
+    def _stored_rows(self) -> int:
+        if "inputs" not in self.fd:
+            return 0
+        return self.fd["inputs"].shape[0]
+
+    def _write(self, inputs: np.array, outputs: np.array):
+        super()._store_dataset("inputs", inputs)
+        super()._store_dataset("outputs", outputs)
+
+    @classmethod
+    def get_file_format_suffix(cls):
+        return cls.suffix
+
+
+class ColumnarWriter(FileWriter):
+    """
+    A writer of raw binary files meant to be memory mapped by the training (see ColumnarReader).
+
+    Rows are copied into preallocated buffers of 'chunk_rows' rows, every full chunk is appended to the file with
+    os.write, which releases the GIL. Batches starting at a chunk boundary are written directly without any copy.
+    The header describing the data is written when the file is closed, a file is always created from scratch.
+
+    Attributes:
+        chunk_rows: The number of rows of a chunk
+        flushes: A list of (rows, bytes, seconds) describing every flush
+    """
+
+    suffix = "amsc"
+
+    def __init__(self, file_name: str, chunk_rows: int = 64 * 1024):
+        super().__init__()
+        self.file_name = file_name
+        self.chunk_rows = chunk_rows
+        self.fd = None
+        self.rows = 0
+        self.flushes = list()
+        self._inputs = None
+        self._outputs = None
+        self._fill = 0
 
     def __str__(self) -> str:
-        return f"{__class__.__name__}(file_name={self.filename}, fd={self.fd})"
+        return f"{__class__.__name__}(file_name={self.file_name}, fd={self.fd})"
+
+    def open(self):
+        self.fd = os.open(self.file_name, os.O_WRONLY | os.O_CREAT | os.O_TRUNC, 0o644)
+        os.lseek(self.fd, COLUMNAR_HEADER_SIZE, os.SEEK_SET)
+        self.rows = 0
+        self._fill = 0
+        return self
+
+    def close(self):
+        if self._fill > 0:
+            self._write(self._inputs[: self._fill], self._outputs[: self._fill])
+            self._fill = 0
+        self._write_header()
+        os.close(self.fd)
+        self.fd = None
+        self._inputs = None
+        self._outputs = None
+
+    def __enter__(self):
+        return self.open()
+
+    def __exit__(self, exc_type, exc_val, exc_tb):
+        self.close()
+
+    @staticmethod
+    def _describe(buf):
+        return None if buf is None else {"dtype": buf.dtype.str, "shape": list(buf.shape[1:])}
+
+    def _write_header(self):
+        header = {
+            "version": 1,
+            "complete": True,
+            "rows": self.rows,
+            "chunk_rows": self.chunk_rows,
+            "inputs": self._describe(self._inputs),
+            "outputs": self._describe(self._outputs),
+        }
+        raw = COLUMNAR_MAGIC + json.dumps(header).encode("utf-8")
+        if len(raw) >= COLUMNAR_HEADER_SIZE:
+            raise RuntimeError(f"Header of {self.file_name} does not fit in {COLUMNAR_HEADER_SIZE} bytes")
+        os.pwrite(self.fd, raw.ljust(COLUMNAR_HEADER_SIZE - 1) + b"\n", 0)
+
+    def _write_all(self, data):
+        view = memoryview(data).cast("B")
+        while len(view):
+            view = view[os.write(self.fd, view) :]
+
+    def _write(self, inputs, outputs):
+        start = time.time()
+        self._write_all(inputs)
+        self._write_all(outputs)
+        self.rows += len(inputs)
+        self.flushes.append((len(inputs), inputs.nbytes + outputs.nbytes, time.time() - start))
 
     def store(self, inputs: np.array, outputs: np.array) -> int:
-        """Store the two arrays in a hdf5 file"""
+        """Store the two arrays in the file"""
         assert len(inputs) == len(outputs)
 
         if self.fd is None:
-            raise RuntimeError("HDF5 file {self.file_name} is not open")
-
-        super()._store_dataset("inputs", inputs)
-        super()._store_dataset("outputs", outputs)
+            raise RuntimeError(f"Columnar file {self.file_name} is not open")
+
+        if self._inputs is None:
+            self._inputs = np.empty((self.chunk_rows, *inputs.shape[1:]), dtype=inputs.dtype.newbyteorder("<"))
+            self._outputs = np.empty((self.chunk_rows, *outputs.shape[1:]), dtype=outputs.dtype.newbyteorder("<"))
+        # Every batch must have the row shape of the file, on both the buffered and the direct paths
+        if inputs.shape[1:] != self._inputs.shape[1:] or outputs.shape[1:] != self._outputs.shape[1:]:
+            raise ValueError(
+                f"Rows of shape {inputs.shape[1:]} -> {outputs.shape[1:]} do not match the rows of {self.file_name} "
+                f"({self._inputs.shape[1:]} -> {self._outputs.shape[1:]})"
+            )
+        # Full chunks are written from the caller's arrays when they have the layout of the file
+        direct = (
+            inputs.dtype == self._inputs.dtype
+            and outputs.dtype == self._outputs.dtype
+            and inputs.flags.c_contiguous
+            and outputs.flags.c_contiguous
+        )
+        start = 0
+        while start < len(inputs):
+            if direct and self._fill == 0 and len(inputs) - start >= self.chunk_rows:
+                end = start + self.chunk_rows
+                self._write(inputs[start:end], outputs[start:end])
+                start = end
+                continue
+            n = min(self.chunk_rows - self._fill, len(inputs) - start)
+            self._inputs[self._fill : self._fill + n] = inputs[start : start + n]
+            self._outputs[self._fill : self._fill + n] = outputs[start : start + n]
+            self._fill += n
+            start += n
+            if self._fill == self.chunk_rows:
+                self._write(self._inputs, self._outputs)
+                self._fill = 0
+        return len(inputs)
+
+    def flush_stats(self) -> str:
+        """Returns a summary of the throughput of the chunks written so far"""
+        if not self.flushes:
+            return "no flushes"
+        total_bytes = sum(b for _, b, _ in self.flushes)
+        total_time = sum(t for _, _, t in self.flushes)
+        summary = f"{len(self.flushes)} chunks, {total_bytes / (1024 * 1024):.2f} MB in {total_time:.3f}s"
+        if total_time > 0:
+            summary += f" ({total_bytes / total_time / (1024 * 1024):.1f} MB/s)"
+        return summary
 
     @classmethod
     def get_file_format_suffix(cls):
@@ -416,7 +908,7 @@ def get_reader(ftype="dhdf5"):
     Factory method return a AMS file reader depending on the requested filetype
     """
 
-    readers = {"shdf5": HDF5CLibReader, "dhdf5": HDF5PackedReader, "csv": CSVReader}
+    readers = {"shdf5": HDF5CLibReader, "dhdf5": HDF5PackedReader, "csv": CSVReader, "columnar": ColumnarReader}
     return readers[ftype]
 
 
@@ -425,7 +917,7 @@ def get_writer(ftype="shdf5"):
     Factory method return a AMS file writer depending on the requested filetype
     """
 
-    writers = {"shdf5": HDF5Writer, "dhdf5": HDF5PackedWriter, "csv": CSVWriter}
+    writers = {"shdf5": HDF5Writer, "dhdf5": HDF5PackedWriter, "csv": CSVWriter, "columnar": ColumnarWriter}
     return writers[ftype]
 
 
@@ -0,0 +1,73 @@
+#!/usr/bin/env python3
+# Copyright 2021-2023 Lawrence Livermore National Security, LLC and other
+# AMSLib Project Developers
+#
+# SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+
+"""
+KD-tree files of the training inputs, HDCaches of AMSlib loaded from them search the exact nearest neighbors.
+
+The file format matches ml/kdtree.hpp: b"AMSKDTRE", uint32 version, dims, leaf_size, value_size (4 or 8),
+uint64 points, uint64 nodes, the points (row major), uint32 split_dim[nodes] and the split_value[nodes], in
+native byte order. The files written here hold no nodes, AMSlib builds the tree when it loads them.
+"""
+
+import os
+
+import numpy as np
+
+from ams.faccessors import get_reader
+
+MAGIC = b"AMSKDTRE"
+VERSION = 1
+
+
+def save(path, points, leaf_size=32, dtype=np.float64):
+    """Writes the (rows, dims) 'points' to a temporary file renamed to 'path' once complete"""
+    x = np.ascontiguousarray(np.asarray(points, dtype=dtype).reshape(len(points), -1))
+    if x.shape[1] == 0:
+        raise ValueError("The points need at least one dimension")
+    if x.itemsize not in (4, 8):
+        raise ValueError(f"Unsupported value type {x.dtype}")
+    tmp = f"{path}.tmp"
+    with open(tmp, "wb") as fd:
+        fd.write(MAGIC)
+        np.array([VERSION, x.shape[1], max(1, int(leaf_size)), x.itemsize], dtype=np.uint32).tofile(fd)
+        np.array([x.shape[0], 0], dtype=np.uint64).tofile(fd)
+        x.tofile(fd)
+    os.replace(tmp, path)
+
+
+def load(path):
+    """Returns the points of a KD-tree file, in the order of its leaves when AMSlib built the tree"""
+    with open(path, "rb") as fd:
+        if fd.read(len(MAGIC)) != MAGIC:
+            raise ValueError(f"{path} is not a KD-tree")
+        version, dims, _, value_size = np.fromfile(fd, dtype=np.uint32, count=4).tolist()
+        if version > VERSION:
+            raise ValueError(f"Unsupported KD-tree version {version}")
+        points, _ = np.fromfile(fd, dtype=np.uint64, count=2).tolist()
+        dtype = np.float32 if value_size == 4 else np.float64
+        return np.fromfile(fd, dtype=dtype, count=points * dims).reshape(points, dims)
+
+
+def from_files(sources, path, reader_type="shdf5", leaf_size=32, dtype=np.float64, block_size=1 << 26):
+    """
+    Writes the KD-tree file of the inputs stored in AMS database files, read in blocks of 'block_size' bytes.
+
+    Returns:
+        The number of points
+    """
+    reader = get_reader(reader_type)
+    blocks = list()
+    for fn in sources:
+        with reader(fn) as fd:
+            for inputs, _ in fd.load_blocks(block_size):
+                inputs = inputs.reshape(len(inputs), -1)
+                # Rows with NaNs have no distance to the queries
+                blocks.append(inputs[~np.any(np.isnan(inputs), axis=1)].astype(dtype))
+    if sum(len(b) for b in blocks) == 0:
+        raise ValueError("The files hold no training data")
+    points = np.concatenate(blocks)
+    save(path, points, leaf_size, dtype)
+    return len(points)
@@ -0,0 +1,163 @@
+#!/usr/bin/env python3
+# Copyright 2021-2023 Lawrence Livermore National Security, LLC and other
+# AMSLib Project Developers
+#
+# SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+
+"""
+Multi-resolution occupancy grids of the training inputs, the UQ model of the OccupancyGrid policy of AMSlib.
+
+The inputs are normalized with the bounds of the training data and every level of 'bits' bits splits a
+dimension in 2^bits cells. The grid records the number of training points of every occupied cell, AMSlib
+accepts the points whose cell holds at least 'min_count' of them at the level selected by its threshold.
+
+The file format matches ml/occupancy_grid.hpp: b"AMSOGRID", uint32 version, dims, levels, min_count,
+float64 lo[dims], hi[dims], then per level uint32 bits, uint64 cells, uint64 keys[cells] (sorted) and uint32
+counts[cells], in native byte order. The key of a cell is sum_d q_d << (bits * d).
+"""
+
+import os
+
+import numpy as np
+
+from ams.faccessors import get_reader
+
+MAGIC = b"AMSOGRID"
+VERSION = 1
+
+
+class OccupancyGrid:
+    """
+    Accumulates the cells of the training inputs at several resolutions.
+
+    Attributes:
+        lo: The lower bounds of the inputs
+        hi: The upper bounds of the inputs
+        bits: The bits per dimension of every level
+        min_count: The number of training points a cell needs to be in distribution
+    """
+
+    def __init__(self, lo, hi, bits=(4, 6, 8), min_count=1):
+        self.lo = np.asarray(lo, dtype=np.float64)
+        self.hi = np.asarray(hi, dtype=np.float64)
+        if self.lo.ndim != 1 or self.lo.shape != self.hi.shape or len(self.lo) == 0:
+            raise ValueError("The bounds must be two vectors of the same length")
+        self.bits = sorted(int(b) for b in bits)
+        for b in self.bits:
+            if b <= 0 or b * self.dims > 63:
+                raise ValueError(f"A level of {b} bits does not fit a 63 bit key in {self.dims} dimensions")
+        self.min_count = max(1, int(min_count))
+        self.levels = {b: dict() for b in self.bits}
+
+    @property
+    def dims(self):
+        return len(self.lo)
+
+    def _scale(self, bits):
+        # The same floating point operations as OccupancyGrid::scaleOf
+        width = self.hi - self.lo
+        return np.where(width > 0, np.ldexp(1.0, bits) / np.where(width > 0, width, 1.0), 0.0)
+
+    def keys(self, inputs, bits):
+        """
+        Computes the cell keys of the (rows, dims) 'inputs' at the level of 'bits' bits.
+
+        Returns:
+            The keys and a mask of the rows inside the bounds
+        """
+        x = np.asarray(inputs, dtype=np.float64).reshape(len(inputs), -1)
+        if x.shape[1] != self.dims:
+            raise ValueError(f"The grid has {self.dims} dimensions, got {x.shape[1]}")
+        inside = np.all((x >= self.lo) & (x <= self.hi), axis=1)
+        q = np.floor((x - self.lo) * self._scale(bits))
+        q = np.clip(np.nan_to_num(q), 0, (1 << bits) - 1).astype(np.uint64)
+        shifts = (np.arange(self.dims, dtype=np.uint64) * np.uint64(bits)).astype(np.uint64)
+        keys = np.bitwise_or.reduce(q << shifts, axis=1)
+        return keys, inside
+
+    def add(self, inputs):
+        """Counts the rows of 'inputs' inside the bounds in every level"""
+        for b in self.bits:
+            keys, inside = self.keys(inputs, b)
+            cells, counts = np.unique(keys[inside], return_counts=True)
+            level = self.levels[b]
+            for c, n in zip(cells.tolist(), counts.tolist()):
+                level[c] = min(level.get(c, 0) + n, np.iinfo(np.uint32).max)
+
+    def contains(self, inputs, bits):
+        """Returns the mask of the rows of 'inputs' in distribution at the level of 'bits' bits"""
+        keys, inside = self.keys(inputs, bits)
+        level = self.levels[bits]
+        accepted = np.array([level.get(k, 0) >= self.min_count for k in keys.tolist()], dtype=bool)
+        return inside & accepted
+
+    def save(self, path):
+        """Writes the grid to a temporary file renamed to 'path' once complete"""
+        tmp = f"{path}.tmp"
+        with open(tmp, "wb") as fd:
+            fd.write(MAGIC)
+            np.array([VERSION, self.dims, len(self.bits), self.min_count], dtype=np.uint32).tofile(fd)
+            self.lo.tofile(fd)
+            self.hi.tofile(fd)
+            for b in self.bits:
+                cells = sorted(self.levels[b].items())
+                np.array([b], dtype=np.uint32).tofile(fd)
+                np.array([len(cells)], dtype=np.uint64).tofile(fd)
+                np.array([c for c, _ in cells], dtype=np.uint64).tofile(fd)
+                np.array([n for _, n in cells], dtype=np.uint32).tofile(fd)
+        os.replace(tmp, path)
+
+    @classmethod
+    def load(cls, path):
+        with open(path, "rb") as fd:
+            if fd.read(len(MAGIC)) != MAGIC:
+                raise ValueError(f"{path} is not an occupancy grid")
+            version, dims, levels, min_count = np.fromfile(fd, dtype=np.uint32, count=4).tolist()
+            if version > VERSION:
+                raise ValueError(f"Unsupported occupancy grid version {version}")
+            lo = np.fromfile(fd, dtype=np.float64, count=dims)
+            hi = np.fromfile(fd, dtype=np.float64, count=dims)
+            bits, cells = list(), list()
+            for _ in range(levels):
+                b = int(np.fromfile(fd, dtype=np.uint32, count=1)[0])
+                n = int(np.fromfile(fd, dtype=np.uint64, count=1)[0])
+                keys = np.fromfile(fd, dtype=np.uint64, count=n).tolist()
+                counts = np.fromfile(fd, dtype=np.uint32, count=n).tolist()
+                bits.append(b)
+                cells.append(dict(zip(keys, counts)))
+        grid = cls(lo, hi, bits, min_count)
+        for b, level in zip(bits, cells):
+            grid.levels[b] = level
+        return grid
+
+    @classmethod
+    def from_files(cls, sources, reader_type="shdf5", bits=(4, 6, 8), min_count=1, lo=None, hi=None, block_size=1 << 26):
+        """
+        Builds the grid of the inputs stored in AMS database files. Without bounds a first pass over the files
+        computes them, the files are streamed in blocks of 'block_size' bytes.
+        """
+        reader = get_reader(reader_type)
+
+        def blocks():
+            for fn in sources:
+                with reader(fn) as fd:
+                    for inputs, _ in fd.load_blocks(block_size):
+                        yield inputs.reshape(len(inputs), -1)
+
+        if lo is None or hi is None:
+            blo, bhi = None, None
+            for inputs in blocks():
+                if len(inputs) == 0:
+                    continue
+                mn, mx = np.nanmin(inputs, axis=0), np.nanmax(inputs, axis=0)
+                blo = mn if blo is None else np.minimum(blo, mn)
+                bhi = mx if bhi is None else np.maximum(bhi, mx)
+            if blo is None:
+                raise ValueError("The files hold no training data")
+            lo = blo if lo is None else lo
+            hi = bhi if hi is None else hi
+
+        grid = cls(lo, hi, bits, min_count)
+        for inputs in blocks():
+            grid.add(inputs)
+        return grid
@@ -11,11 +11,61 @@ import logging
 import re
 import copy
 import functools
+import time
 import pika
 from pika.exchange_type import ExchangeType
 from typing import Callable
 import numpy as np
 
+
+class ConsumerStats(object):
+    """
+    Throughput counters of a RMQConsumer.
+
+    Attributes:
+        messages: Number of messages received
+        bytes: Number of payload bytes received
+        acks: Number of Basic.Ack frames sent to the broker
+        start: Time the first message was received
+        last: Time the last message was received
+    """
+
+    def __init__(self):
+        self.messages = 0
+        self.bytes = 0
+        self.acks = 0
+        self.start = None
+        self.last = None
+
+    def record(self, nbytes):
+        now = time.time()
+        if self.start is None:
+            self.start = now
+        self.last = now
+        self.messages += 1
+        self.bytes += nbytes
+
+    @property
+    def elapsed(self):
+        if self.start is None:
+            return 0.0
+        return self.last - self.start
+
+    @property
+    def msgs_per_sec(self):
+        return self.messages / self.elapsed if self.elapsed > 0 else 0.0
+
+    @property
+    def bytes_per_sec(self):
+        return self.bytes / self.elapsed if self.elapsed > 0 else 0.0
+
+    def __str__(self):
+        return (
+            f"{self.messages} messages, {self.bytes / (1024 * 1024):.2f} MB in {self.elapsed:.2f}s "
+            f"({self.msgs_per_sec:.1f} msgs/s, {self.bytes_per_sec / (1024 * 1024):.2f} MB/s, {self.acks} acks)"
+        )
+
+
 class RMQConsumer(object):
     """
     Asynchronous RMQ consumer.
@@ -29,16 +79,20 @@ class RMQConsumer(object):
         queue: str,
         on_message_cb: Callable = None,
         on_close_cb: Callable = None,
-        prefetch_count: int = 1):
+        prefetch_count: int = 1,
+        ack_every: int = 1,
+        ack_interval_ms: int = 0):
         """Create a new instance of the consumer class, passing in the AMQP
         URL used to connect to RabbitMQ.
 
         :param str credentials: The credentials file in JSON
-        :param str cacert: The TLS certificate
+        :param str cacert: The TLS certificate, None requires "rabbitmq-tls": false in the credentials
         :param str queue: The queue to listen to
         :param Callable: on_message_cb this function will be called each time Pika receive a message
         :param Callable: on_message_cb this function will be called when Pika will close the connection
         :param int: prefetch_count Define consumer throughput, should be relative to resource and number of messages expected 
+        :param int: ack_every Acknowledge cumulatively (multiple=True) once that many messages have been handed off
+        :param int: ack_interval_ms Acknowledge pending messages at most that many milliseconds after the hand-off (0 disables the timer)
 
         """
         self.should_reconnect = False
@@ -54,11 +108,27 @@ class RMQConsumer(object):
         self._consumer_tag = None
         self._consuming = False
         self._prefetch_count = prefetch_count
+        # The broker stops delivering once 'prefetch_count' messages are unacknowledged,
+        # so we can never wait for more than that before acknowledging.
+        if prefetch_count > 0:
+            ack_every = min(ack_every, prefetch_count)
+        self._ack_every = max(1, ack_every)
+        self._ack_interval = ack_interval_ms / 1000.0
+        self._ack_timer = None
+        self._pending_tag = None
+        self._pending_acks = 0
+        self.stats = ConsumerStats()
         self._on_message_cb = on_message_cb 
         self._on_close_cb = on_close_cb 
 
         self._credentials = self._parse_credentials(credentials)
         self._cacert = cacert
+        # A missing certificate is not an opt-out of TLS, the broker of the credentials may expect it
+        if self._cacert is None and self.use_tls:
+            raise ValueError(
+                f"No TLS certificate given to connect to {self._credentials.get('service-host')}, "
+                'set "rabbitmq-tls": false in the credentials to connect through plain AMQP'
+            )
         self._queue = queue 
 
     def __enter__(self):
@@ -75,16 +145,26 @@ class RMQConsumer(object):
             data = json.load(f)
         return data
 
+    @property
+    def use_tls(self) -> bool:
+        """TLS is used unless the credentials set "rabbitmq-tls" to false"""
+        return str(self._credentials.get("rabbitmq-tls", True)).lower() != "false"
+
     def create_credentials(self):
         """
-        Create the pika credentials using TLS needed to connect to RabbitMQ.
+        Create the pika credentials (using TLS unless disabled) needed to connect to RabbitMQ.
 
         :rtype: pika.ConnectionParameters
 
         """
-        ssl_context = ssl.SSLContext(ssl.PROTOCOL_TLSv1_2)
-        ssl_context.verify_mode = ssl.CERT_REQUIRED
-        ssl_context.load_verify_locations(self._cacert)
+        ssl_options = None
+        if self.use_tls:
+            ssl_context = ssl.SSLContext(ssl.PROTOCOL_TLSv1_2)
+            ssl_context.verify_mode = ssl.CERT_REQUIRED
+            ssl_context.load_verify_locations(self._cacert)
+            ssl_options = pika.SSLOptions(ssl_context)
+        else:
+            print(f"warning: TLS is disabled, credentials and data are sent in clear")
 
         pika_credentials = pika.PlainCredentials(self._credentials["rabbitmq-user"], self._credentials["rabbitmq-password"])
         return pika.ConnectionParameters(
@@ -92,7 +172,7 @@ class RMQConsumer(object):
             port=self._credentials["service-port"],
             virtual_host=self._credentials["rabbitmq-vhost"],
             credentials=pika_credentials,
-            ssl_options=pika.SSLOptions(ssl_context)
+            ssl_options=ssl_options
         )
 
     def connect(self):
@@ -189,6 +269,8 @@ class RMQConsumer(object):
 
         """
         self._channel = channel
+        self._pending_tag = None
+        self._pending_acks = 0
         print(f"Channel opened {self._channel}")
         self.add_on_channel_close_callback()
         # we do not set up exchange first here, we use the default exchange ''
@@ -214,6 +296,10 @@ class RMQConsumer(object):
 
         """
         print(f"warning: Channel {channel} was closed: {reason}")
+        # Unacknowledged messages are requeued by the broker once the channel is closed
+        self._cancel_ack_timer()
+        self._pending_tag = None
+        self._pending_acks = 0
         if isinstance(self._on_close_cb, Callable):
             self._on_close_cb() # running user callback
         self.close_connection()
@@ -246,10 +332,9 @@ class RMQConsumer(object):
         self.set_qos()
 
     def set_qos(self):
-        """This method sets up the consumer prefetch to only be delivered
-        one message at a time. The consumer must acknowledge this message
-        before RabbitMQ will deliver another one. You should experiment
-        with different prefetch values to achieve desired performance.
+        """This method sets up the consumer prefetch window, RabbitMQ delivers
+        up to 'prefetch_count' messages before waiting for an acknowledgement.
+        Large windows hide the broker round trip, 0 means unlimited.
 
         """
         self._channel.basic_qos(
@@ -265,7 +350,7 @@ class RMQConsumer(object):
         :param pika.frame.Method _unused_frame: The Basic.QosOk response frame
 
         """
-        print(f"QOS set to: {self._prefetch_count}")
+        print(f"QOS set to: {self._prefetch_count}, acknowledging every {self._ack_every} messages or {self._ack_interval * 1000:.0f} ms")
         self.start_consuming()
 
     def start_consuming(self):
@@ -320,20 +405,49 @@ class RMQConsumer(object):
         :param bytes body: The message body
 
         """
-        print(f"Received message #{basic_deliver.delivery_tag} from {properties}")
+        self.stats.record(len(body))
         if isinstance(self._on_message_cb, Callable):
             self._on_message_cb(_unused_channel, basic_deliver, properties, body)
+        # The data has been handed off, the message can be acknowledged
         self.acknowledge_message(basic_deliver.delivery_tag)
 
     def acknowledge_message(self, delivery_tag):
-        """Acknowledge the message delivery from RabbitMQ by sending a
-        Basic.Ack RPC method for the delivery tag.
+        """Mark the message as handled. Acknowledgements are cumulative, a
+        single Basic.Ack with multiple=True is sent once 'ack_every' messages
+        are pending or 'ack_interval_ms' after the first pending one.
 
         :param int delivery_tag: The delivery tag from the Basic.Deliver frame
 
         """
-        print(f"Acknowledging message {delivery_tag}")
-        self._channel.basic_ack(delivery_tag)
+        self._pending_tag = delivery_tag
+        self._pending_acks += 1
+        if self._pending_acks >= self._ack_every:
+            self.flush_acks()
+        elif self._ack_interval > 0 and self._ack_timer is None:
+            self._ack_timer = self._connection.ioloop.call_later(self._ack_interval, self._on_ack_timer)
+
+    def _on_ack_timer(self):
+        self._ack_timer = None
+        self.flush_acks()
+
+    def _cancel_ack_timer(self):
+        if self._ack_timer is not None:
+            self._connection.ioloop.remove_timeout(self._ack_timer)
+            self._ack_timer = None
+
+    def flush_acks(self):
+        """Acknowledge all the messages up to the last handled delivery tag
+        by sending a single Basic.Ack RPC method with multiple=True.
+
+        """
+        self._cancel_ack_timer()
+        if self._pending_tag is None:
+            return
+        if self._channel and self._channel.is_open:
+            self._channel.basic_ack(self._pending_tag, multiple=True)
+            self.stats.acks += 1
+        self._pending_tag = None
+        self._pending_acks = 0
 
     def stop_consuming(self):
         """Tell RabbitMQ that you would like to stop consuming by sending the
@@ -341,6 +455,7 @@ class RMQConsumer(object):
 
         """
         if self._channel:
+            self.flush_acks()
             print(f"Sending a Basic.Cancel RPC command to RabbitMQ")
             cb = functools.partial(
                 self.on_cancelok, userdata = self._consumer_tag)
@@ -396,6 +511,6 @@ class RMQConsumer(object):
             else:
                 if self._connection:
                     self._connection.ioloop.stop()
-            print("Stopped RabbitMQ connection")
+            print(f"Stopped RabbitMQ connection: {self.stats}")
         else:
             print("Already closed?")
@@ -4,6 +4,7 @@
 #
 # SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
 
+import argparse
 import glob
 import shutil
 import time
@@ -11,15 +12,18 @@ from abc import ABC, abstractclassmethod, abstractmethod
 from enum import Enum
 from multiprocessing import Process, current_process
 from multiprocessing import Queue as mp_queue
+from multiprocessing import shared_memory
 from pathlib import Path
 from queue import Queue as ser_queue
 from threading import Thread
 from typing import Callable, List, Tuple
 import struct
 import signal
+import zlib
 
 import numpy as np
 
+from ams.action import ActionChain, AffineTransform, BoundsFilter, DropNonFinite, LogTransform, RunningStats
 from ams.config import AMSInstance
 from ams.faccessors import get_reader, get_writer
 from ams.store import AMSDataStore
@@ -64,13 +68,15 @@ class QueueMessage:
     Attributes:
         msg_type: The type of the message. We currently support 3 types Process, NewModel, Terminate
         blob: The contents of the message
+        key: An optional key identifying the origin of the data (used to route messages to shards)
     """
 
-    def __init__(self, msg_type, blob):
+    def __init__(self, msg_type, blob, key=None):
         if not isinstance(msg_type, MessageType):
             raise TypeError("Message Type should be of type MessageType")
         self.msg_type = msg_type
         self.blob = blob
+        self.key = key
 
     def is_terminate(self):
         return self.msg_type == MessageType.Terminate
@@ -85,6 +91,197 @@ class QueueMessage:
         return self.blob
 
 
+class RoutedQueue:
+    """
+    Fans out the messages put on it to a set of queues, one per shard of the next stage.
+    Process messages are routed to a single queue, every other message (e.g. Terminate) is
+    broadcasted to all of them.
+
+    Attributes:
+        queues: The queues of the shards
+        routing: Either "round-robin" or "hash". The latter sends all messages with the same
+            key to the same shard (messages without a key are distributed round-robin).
+    """
+
+    supported_routings = ("round-robin", "hash")
+
+    def __init__(self, queues, routing="round-robin"):
+        if routing not in self.__class__.supported_routings:
+            raise RuntimeError(f"Unknown routing {routing}, please select from {RoutedQueue.supported_routings}")
+        self.queues = queues
+        self.routing = routing
+        self._next = 0
+
+    def _route(self, msg):
+        if self.routing == "hash" and msg.key is not None:
+            # crc32 is stable across processes contrary to hash()
+            return zlib.crc32(str(msg.key).encode()) % len(self.queues)
+        shard = self._next
+        self._next = (self._next + 1) % len(self.queues)
+        return shard
+
+    def put(self, msg, block=True):
+        if not msg.is_process():
+            for q in self.queues:
+                q.put(msg, block=block)
+            return
+        self.queues[self._route(msg)].put(msg, block=block)
+
+
+class QueueTransport:
+    """
+    Moves DataBlobs by value through the queues of the pipeline. Under the 'process' policy
+    every blob is pickled and copied through a pipe at every stage boundary.
+    """
+
+    def pack(self, blob):
+        """Returns the payload of a QueueMessage carrying 'blob'"""
+        return blob
+
+    def unpack(self, payload):
+        """Returns the DataBlob carried by a payload"""
+        return payload
+
+    def repack(self, payload, blob):
+        """Returns the payload carrying 'blob', which replaces the data of a consumed 'payload'"""
+        return blob
+
+    def release(self, payload):
+        """Informs the transport that the data of the payload are no longer accessed"""
+        pass
+
+    def close(self):
+        pass
+
+
+class SlotDescriptor:
+    """
+    Describes a DataBlob stored in a slot of a SharedMemoryTransport.
+
+    Attributes:
+        slot: The index of the slot in the arena
+        in_shape, in_dtype: The shape and type of the inputs, stored at the beginning of the slot
+        out_shape, out_dtype: The shape and type of the outputs
+        out_offset: The offset of the outputs in the slot
+    """
+
+    def __init__(self, slot, in_shape, in_dtype, out_shape, out_dtype, out_offset):
+        self.slot = slot
+        self.in_shape = in_shape
+        self.in_dtype = in_dtype
+        self.out_shape = out_shape
+        self.out_dtype = out_dtype
+        self.out_offset = out_offset
+
+
+class SharedMemoryTransport(QueueTransport):
+    """
+    Moves DataBlobs between processes through a shared memory arena. The arena is a ring of fixed
+    size slots, producers copy a blob into a free slot and only the SlotDescriptor travels through the
+    queues. Consumers access the blob in place and return the slot to the ring once done with it.
+    A producer blocks while all slots are in use, which throttles the pipeline to the speed of the
+    slowest stage. Blobs larger than a slot are sent by value.
+
+    Attributes:
+        num_slots: The number of slots of the arena
+        slot_size: The size of every slot in bytes
+    """
+
+    alignment = 64
+
+    def __init__(self, num_slots, slot_size):
+        self.num_slots = num_slots
+        self.slot_size = self._align(slot_size)
+        self._shm = shared_memory.SharedMemory(create=True, size=self.num_slots * self.slot_size)
+        self._owner = True
+        self._free = mp_queue()
+        for i in range(self.num_slots):
+            self._free.put(i)
+
+    def __getstate__(self):
+        return {"num_slots": self.num_slots, "slot_size": self.slot_size, "name": self._shm.name, "free": self._free}
+
+    def __setstate__(self, state):
+        self.num_slots = state["num_slots"]
+        self.slot_size = state["slot_size"]
+        self._free = state["free"]
+        self._shm = shared_memory.SharedMemory(name=state["name"])
+        self._owner = False
+
+    @classmethod
+    def _align(cls, size):
+        return (size + cls.alignment - 1) // cls.alignment * cls.alignment
+
+    def _fits(self, blob):
+        return self._align(blob.inputs.nbytes) + blob.outputs.nbytes <= self.slot_size
+
+    def _view(self, slot, shape, dtype, offset=0):
+        return np.ndarray(shape, dtype=dtype, buffer=self._shm.buf, offset=slot * self.slot_size + offset)
+
+    def _write(self, slot, blob):
+        out_offset = self._align(blob.inputs.nbytes)
+        desc = SlotDescriptor(
+            slot, blob.inputs.shape, blob.inputs.dtype.str, blob.outputs.shape, blob.outputs.dtype.str, out_offset
+        )
+        np.copyto(self._view(slot, desc.in_shape, desc.in_dtype), blob.inputs)
+        np.copyto(self._view(slot, desc.out_shape, desc.out_dtype, out_offset), blob.outputs)
+        return desc
+
+    def pack(self, blob):
+        if not self._fits(blob):
+            return blob
+        # This is a blocking call, it waits for a consumer to release a slot
+        slot = self._free.get(block=True)
+        return self._write(slot, blob)
+
+    def unpack(self, payload):
+        if not isinstance(payload, SlotDescriptor):
+            return payload
+        return DataBlob(
+            self._view(payload.slot, payload.in_shape, payload.in_dtype),
+            self._view(payload.slot, payload.out_shape, payload.out_dtype, payload.out_offset),
+        )
+
+    def repack(self, payload, blob):
+        # Re-use the slot of the consumed payload. Acquiring a new slot here could deadlock
+        # when all slots are queued before this stage.
+        if not isinstance(payload, SlotDescriptor):
+            return blob
+        if not self._fits(blob):
+            self.release(payload)
+            return blob
+        slot = self._view(payload.slot, (self.slot_size,), np.uint8)
+        base = slot.__array_interface__["data"][0]
+
+        def unchanged(array, shape, dtype, offset):
+            return (
+                array.__array_interface__["data"][0] == base + offset
+                and array.shape == tuple(shape)
+                and array.dtype.str == dtype
+                and array.flags.c_contiguous
+            )
+
+        # Actions that kept every row return the unpacked views, the slot already holds them
+        if unchanged(blob.inputs, payload.in_shape, payload.in_dtype, 0) and unchanged(
+            blob.outputs, payload.out_shape, payload.out_dtype, payload.out_offset
+        ):
+            return payload
+        # may_share_memory only compares the bounds of the arrays, np.shares_memory solves an exact
+        # (possibly exponential) problem and a false positive only costs a copy
+        inputs = blob.inputs.copy() if np.may_share_memory(blob.inputs, slot) else blob.inputs
+        outputs = blob.outputs.copy() if np.may_share_memory(blob.outputs, slot) else blob.outputs
+        return self._write(payload.slot, DataBlob(inputs, outputs))
+
+    def release(self, payload):
+        if isinstance(payload, SlotDescriptor):
+            self._free.put(payload.slot)
+
+    def close(self):
+        self._shm.close()
+        if self._owner:
+            self._shm.unlink()
+
+
 class Task(ABC):
     """
     An abstract interface encapsulating a
@@ -106,9 +303,11 @@ class ForwardTask(Task):
         i_queue: The input queue to read input message
         o_queue: The output queue to write the transformed messages
         callback: A callback to be applied on every message before pushing it to the next stage.
+        transport: The transport moving DataBlobs through the queues.
+        num_producers: The number of tasks writing to i_queue, the task terminates once all of them terminated.
     """
 
-    def __init__(self, i_queue, o_queue, callback):
+    def __init__(self, i_queue, o_queue, callback, transport=None, num_producers=1):
         """
         initializes a ForwardTask class with the queues and the callback.
         """
@@ -119,6 +318,8 @@ class ForwardTask(Task):
         self.i_queue = i_queue
         self.o_queue = o_queue
         self.callback = callback
+        self.transport = transport if transport is not None else QueueTransport()
+        self.num_producers = num_producers
 
     def _action(self, data):
         """
@@ -141,17 +342,30 @@ class ForwardTask(Task):
         A busy loop reading messages from the i_queue, acting on those messages and forwarding
         the output to the output queue. In the case of receiving a 'termination' messages informs
         the tasks waiting on the output queues about the terminations and returns from the function.
+        Batches emptied by the action (e.g. filters) are not forwarded.
         """
 
+        producers = self.num_producers
         while True:
             # This is a blocking call
             item = self.i_queue.get(block=True)
             if item.is_terminate():
+                producers -= 1
+                if producers > 0:
+                    continue
+                finalize = getattr(self.callback, "finalize", None)
+                if callable(finalize):
+                    finalize()
                 self.o_queue.put(QueueMessage(MessageType.Terminate, None))
                 break
             elif item.is_process():
-                inputs, outputs = self._action(item.data())
-                self.o_queue.put(QueueMessage(MessageType.Process, DataBlob(inputs, outputs)))
+                payload = item.data()
+                inputs, outputs = self._action(self.transport.unpack(payload))
+                if inputs.shape[0] == 0:
+                    self.transport.release(payload)
+                    continue
+                payload = self.transport.repack(payload, DataBlob(inputs, outputs))
+                self.o_queue.put(QueueMessage(MessageType.Process, payload, item.key))
             elif item.is_new_model():
                 # This is not handled yet
                 continue
@@ -168,12 +382,18 @@ class FSLoaderTask(Task):
         o_queue: The output queue to write the transformed messages
         loader: A child class inheriting from FileReader that loads data from the filesystem.
         pattern: The (glob-)pattern of the files to be read.
+        transport: The transport moving DataBlobs through the queues.
+        shard: The index of this loader among 'num_shards' loaders reading the files of the pattern
+        num_shards: The number of loaders, every loader reads a disjoint subset of the files.
     """
 
-    def __init__(self, o_queue, loader, pattern):
+    def __init__(self, o_queue, loader, pattern, transport=None, shard=0, num_shards=1):
         self.o_queue = o_queue
         self.pattern = pattern
         self.loader = loader
+        self.transport = transport if transport is not None else QueueTransport()
+        self.shard = shard
+        self.num_shards = num_shards
 
     def __call__(self):
         """
@@ -183,16 +403,12 @@ class FSLoaderTask(Task):
         """
 
         start = time.time()
-        for fn in glob.glob(self.pattern):
+        files = sorted(glob.glob(self.pattern))
+        for fn in files[self.shard :: self.num_shards]:
             with self.loader(fn) as fd:
-                input_data, output_data = fd.load()
-                row_size = input_data[0, :].nbytes + output_data[0, :].nbytes
-                rows_per_batch = int(np.ceil(BATCH_SIZE / row_size))
-                num_batches = int(np.ceil(input_data.shape[0] / rows_per_batch))
-                input_batches = np.array_split(input_data, num_batches)
-                output_batches = np.array_split(output_data, num_batches)
-                for j, (i, o) in enumerate(zip(input_batches, output_batches)):
-                    self.o_queue.put(QueueMessage(MessageType.Process, DataBlob(i, o)))
+                # Blocks are forwarded as soon as they are read, the file is never loaded as a whole
+                for i, o in fd.load_blocks(BATCH_SIZE):
+                    self.o_queue.put(QueueMessage(MessageType.Process, self.transport.pack(DataBlob(i, o)), fn))
         self.o_queue.put(QueueMessage(MessageType.Terminate, None))
 
         end = time.time()
@@ -209,6 +425,7 @@ class RMQMessage(object):
 
     def __init__(self, body: str):
         self.body = body
+        self.mpi_rank = None
 
     def header_format(self) -> str:
         """
@@ -254,16 +471,15 @@ class RMQMessage(object):
         msg_format = f"{header_format}{data.size}{dt}"
         return struct.pack(msg_format, *header_content, *data)
 
-    def _parse_header(self, body: str) -> dict:
+    def _parse_header(self, body: memoryview, offset: int = 0) -> dict:
         """
-        Parse the header to extract information about data.
+        Parse the header of the AMS message starting at 'offset' to extract information about data.
         """
         fmt = self.endianness() + self.header_format()
-        if len(body) == 0:
-            print(f"Empty message. skipping")
-            return {}
-
         hsize = struct.calcsize(fmt)
+        if len(body) - offset < hsize:
+            raise ValueError(f"Incomplete message of size {len(body) - offset}. Header should be of size {hsize}")
+
         res = {}
         # Parse header
         (
@@ -274,56 +490,68 @@ class RMQMessage(object):
             res["input_dim"],
             res["output_dim"],
             res["padding"],
-        ) = struct.unpack(fmt, body[:hsize])
-        assert hsize == res["hsize"]
-        assert res["datatype"] in [4, 8]
-        if len(body) < hsize:
-            print(f"Incomplete message of size {len(body)}. Header should be of size {hsize}. skipping")
-            return {}
+        ) = struct.unpack_from(fmt, body, offset)
+        if hsize != res["hsize"] or res["datatype"] not in [4, 8]:
+            raise ValueError(f"Corrupted AMS message header at offset {offset}: {res}")
 
         # Theoritical size in Bytes for the incoming message (without the header)
         # Int() is needed otherwise we might overflow here (because of uint16 / uint8)
         res["dsize"] = int(res["datatype"]) * int(res["num_element"]) * (int(res["input_dim"]) + int(res["output_dim"]))
         res["msg_size"] = hsize + res["dsize"]
-        res["multiple_msg"] = len(body) != res["msg_size"]
+        if len(body) - offset < res["msg_size"]:
+            raise ValueError(
+                f"Incomplete message of size {len(body) - offset} at offset {offset}, expected {res['msg_size']}"
+            )
+        res["offset"] = offset
         return res
 
-    def _parse_data(self, body: str, header_info: dict) -> np.array:
-        data = np.array([])
-        if len(body) == 0:
-            return data
-        hsize = header_info["hsize"]
-        dsize = header_info["dsize"]
-        try:
-            if header_info["datatype"] == 4:  # if datatype takes 4 bytes (float)
-                data = np.frombuffer(body[hsize : hsize + dsize], dtype=np.float32)
-            else:
-                data = np.frombuffer(body[hsize : hsize + dsize], dtype=np.float64)
-        except ValueError as e:
-            print(f"Error: {e} => {header_info}")
-            return np.array([])
-
-        idim = header_info["input_dim"]
-        odim = header_info["output_dim"]
-        data = data.reshape((-1, idim + odim))
-        # Return input, output
-        return data[:, :idim], data[:, idim:]
-
-    def _decode(self, body: str) -> Tuple[np.array]:
-        input = []
-        output = []
-        # Multiple AMS messages could be packed in one RMQ message
-        while body:
-            header_info = self._parse_header(body)
-            temp_input, temp_output = self._parse_data(body, header_info)
-            print(f"input shape {temp_input.shape} outpute shape {temp_output.shape}")
-            # total size of byte we read for that message
-            chunk_size = header_info["hsize"] + header_info["dsize"]
-            input.append(temp_input)
-            output.append(temp_output)
-            # We remove the current message and keep going
-            body = body[chunk_size:]
-        return np.concatenate(input), np.concatenate(output)
+    def _scan_headers(self, body: memoryview) -> List[dict]:
+        """
+        Walks the AMS messages coalesced in a RMQ message and returns their headers.
+        Only the headers are touched, the data is not read.
+        """
+        headers = []
+        offset = 0
+        while offset < len(body):
+            header = self._parse_header(body, offset)
+            headers.append(header)
+            offset += header["msg_size"]
+        return headers
+
+    def _decode(self, body: bytes) -> Tuple[np.array]:
+        """
+        Decodes all the AMS messages packed in one RMQ message. A first pass collects the headers
+        to size the outputs, a second pass copies every message through a zero-copy view of the body
+        directly into its slice of the outputs.
+        """
+        view = memoryview(body).cast("B")
+        headers = self._scan_headers(view)
+        if not headers:
+            return np.empty((0, 0)), np.empty((0, 0))
+        self.mpi_rank = headers[0]["mpirank"]
+
+        idim = headers[0]["input_dim"]
+        odim = headers[0]["output_dim"]
+        if any(h["input_dim"] != idim or h["output_dim"] != odim for h in headers):
+            raise ValueError("AMS messages with different dimensions in the same RMQ message")
+        dtype = np.float32 if all(h["datatype"] == 4 for h in headers) else np.float64
+
+        num_rows = sum(int(h["num_element"]) for h in headers)
+        input = np.empty((num_rows, idim), dtype=dtype)
+        output = np.empty((num_rows, odim), dtype=dtype)
+        row = 0
+        for h in headers:
+            n = int(h["num_element"])
+            data = np.frombuffer(
+                view,
+                dtype=np.float32 if h["datatype"] == 4 else np.float64,
+                count=n * (idim + odim),
+                offset=h["offset"] + h["hsize"],
+            ).reshape((n, idim + odim))
+            input[row : row + n] = data[:, :idim]
+            output[row : row + n] = data[:, idim:]
+            row += n
+        return input, output
 
     def decode(self) -> Tuple[np.array]:
         return self._decode(self.body)
@@ -338,24 +566,43 @@ class RMQLoaderTask(Task):
     Attributes:
         o_queue: The output queue to write the transformed messages
         credentials: A JSON file with the credentials to log on the RabbitMQ server.
-        certificates: TLS certificates
+        certificates: TLS certificates, None requires "rabbitmq-tls": false in the credentials
         rmq_queue: The RabbitMQ queue to listen to.
         prefetch_count: Number of messages prefected by RMQ (impact performance)
+        ack_every: Number of handed off messages acknowledged by a single cumulative ack
+        ack_interval_ms: Maximum delay (ms) before acknowledging handed off messages
+        transport: The transport moving DataBlobs through the queues.
     """
 
-    def __init__(self, o_queue, credentials, cacert, rmq_queue, prefetch_count=1):
+    # Loaders consuming in this process, all of them are stopped upon a signal
+    _running = list()
+
+    def __init__(
+        self,
+        o_queue,
+        credentials,
+        cacert,
+        rmq_queue,
+        prefetch_count=1,
+        transport=None,
+        ack_every=1,
+        ack_interval_ms=0,
+    ):
         self.o_queue = o_queue
         self.credentials = credentials
         self.cacert = cacert
         self.rmq_queue = rmq_queue
         self.prefetch_count = prefetch_count
-
-        # Installing signal callbacks
-        p = current_process()
-        print(f"pid = {p.pid}")
-        signal.signal(signal.SIGTERM, self.signal_wrapper(self.__class__.__name__, p.pid))
-        signal.signal(signal.SIGINT, self.signal_wrapper(self.__class__.__name__, p.pid))
+        self.ack_every = ack_every
+        self.ack_interval_ms = ack_interval_ms
+        self.transport = transport if transport is not None else QueueTransport()
+
+        # Installing signal callbacks. Several loaders may be created by the same (main) thread,
+        # so the handler stops all the loaders running in the process receiving the signal.
+        signal.signal(signal.SIGTERM, RMQLoaderTask.signal_handler)
+        signal.signal(signal.SIGINT, RMQLoaderTask.signal_handler)
         self.total_time = 0
+        self._terminated = False
 
         self.rmq_consumer = RMQConsumer(
             credentials=self.credentials,
@@ -364,15 +611,27 @@ class RMQLoaderTask(Task):
             on_message_cb=self.callback_message,
             on_close_cb=self.callback_close,
             prefetch_count=self.prefetch_count,
+            ack_every=self.ack_every,
+            ack_interval_ms=self.ack_interval_ms,
         )
 
+    def _terminate(self):
+        """
+        Informs the next stage that this loader terminated. Tasks downstream count terminate messages
+        to know when all loaders are done, so every loader must send exactly one.
+        """
+        if self._terminated:
+            return
+        self._terminated = True
+        print(f"Sending Terminate to QueueMessage")
+        self.o_queue.put(QueueMessage(MessageType.Terminate, None))
+
     def callback_close(self):
         """
         Callback that will be called when RabbitMQ will close
         the connection (or if a problem happened with the connection).
         """
-        print(f"Sending Terminate to QueueMessage")
-        self.o_queue.put(QueueMessage(MessageType.Terminate, None))
+        self._terminate()
 
     def callback_message(self, ch, basic_deliver, properties, body):
         """
@@ -380,7 +639,10 @@ class RMQLoaderTask(Task):
         the connection (or if a problem happened with the connection).
         """
         start_time = time.time()
-        input_data, output_data = RMQMessage(body).decode()
+        msg = RMQMessage(body)
+        input_data, output_data = msg.decode()
+        if input_data.shape[0] == 0:
+            return
         row_size = input_data[0, :].nbytes + output_data[0, :].nbytes
         rows_per_batch = int(np.ceil(BATCH_SIZE / row_size))
         num_batches = int(np.ceil(input_data.shape[0] / rows_per_batch))
@@ -388,18 +650,20 @@ class RMQLoaderTask(Task):
         output_batches = np.array_split(output_data, num_batches)
 
         for j, (i, o) in enumerate(zip(input_batches, output_batches)):
-            self.o_queue.put(QueueMessage(MessageType.Process, DataBlob(i, o)))
+            self.o_queue.put(QueueMessage(MessageType.Process, self.transport.pack(DataBlob(i, o)), msg.mpi_rank))
 
         self.total_time += time.time() - start_time
 
-    def signal_wrapper(self, name, pid):
-        def handler(signum, frame):
-            print(f"Received SIGNUM={signum} for {name}[pid={pid}]: stopping process")
-            self.rmq_consumer.stop()
-            self.o_queue.put(QueueMessage(MessageType.Terminate, None))
-            print(f"Spend {self.total_time} at {self.__class__.__name__}")
+    def stop(self, signum):
+        print(f"Received SIGNUM={signum} for {self.__class__.__name__}[pid={current_process().pid}]: stopping process")
+        self.rmq_consumer.stop()
+        self._terminate()
+        print(f"Spend {self.total_time} at {self.__class__.__name__}")
 
-        return handler
+    @classmethod
+    def signal_handler(cls, signum, frame):
+        for task in list(cls._running):
+            task.stop(signum)
 
     def __call__(self):
         """
@@ -407,7 +671,11 @@ class RMQLoaderTask(Task):
         '100' batches which will be pushed on the queue. Upon reading all files
         the Task pushes a 'Terminate' message to the queue and returns.
         """
-        self.rmq_consumer.run()
+        RMQLoaderTask._running.append(self)
+        try:
+            self.rmq_consumer.run()
+        finally:
+            RMQLoaderTask._running.remove(self)
 
 
 class FSWriteTask(Task):
@@ -419,15 +687,21 @@ class FSWriteTask(Task):
         o_queue: The output queue to write the path of the saved file.
         writer_cls: A child class inheriting from FileWriter that writes to the specified file.
         out_dir: The directory to write data to.
+        writer_opts: Keyword arguments forwarded to the writer_cls constructor.
+        transport: The transport moving DataBlobs through the queues.
+        num_producers: The number of tasks writing to i_queue, the task terminates once all of them terminated.
     """
 
-    def __init__(self, i_queue, o_queue, writer_cls, out_dir):
+    def __init__(self, i_queue, o_queue, writer_cls, out_dir, writer_opts=None, transport=None, num_producers=1):
         """
         initializes the writer task to read data from the i_queue write them using
         the writer_cls and store the data in the out_dir.
         """
         self.data_writer_cls = writer_cls
         self.out_dir = out_dir
+        self.writer_opts = writer_opts if writer_opts is not None else dict()
+        self.transport = transport if transport is not None else QueueTransport()
+        self.num_producers = num_producers
         self.i_queue = i_queue
         self.o_queue = o_queue
         self.suffix = writer_cls.get_file_format_suffix()
@@ -440,31 +714,42 @@ class FSWriteTask(Task):
         """
 
         start = time.time()
+        producers = self.num_producers
+        total_bytes_written = 0
         while True:
             fn = get_unique_fn()
             fn = f"{self.out_dir}/{fn}.{self.suffix}"
             is_terminate = False
-            total_bytes_written = 0
-            with self.data_writer_cls(fn) as fd:
+            with self.data_writer_cls(fn, **self.writer_opts) as fd:
                 bytes_written = 0
                 while True:
                     # This is a blocking call
                     item = self.i_queue.get(block=True)
                     if item.is_terminate():
-                        is_terminate = True
+                        producers -= 1
+                        is_terminate = producers == 0
                     elif item.is_process():
-                        data = item.data()
+                        payload = item.data()
+                        data = self.transport.unpack(payload)
                         bytes_written += data.inputs.size * data.inputs.itemsize
                         bytes_written += data.outputs.size * data.outputs.itemsize
                         fd.store(data.inputs, data.outputs)
                         total_bytes_written += data.inputs.size * data.inputs.itemsize
                         total_bytes_written += data.outputs.size * data.outputs.itemsize
+                        # The writer copied the data, the slot can be re-used
+                        self.transport.release(payload)
                     # FIXME: We currently decide to chunk files to 2GB
                     # of contents. Is this a good size?
                     if is_terminate or bytes_written >= 2 * 1024 * 1024 * 1024:
                         break
 
-            self.o_queue.put(QueueMessage(MessageType.Process, fn))
+            if bytes_written == 0:
+                # Shards may receive no data at all, do not publish empty files
+                Path(fn).unlink(missing_ok=True)
+            else:
+                if hasattr(fd, "flush_stats"):
+                    print(f"Wrote {fn}: {fd.flush_stats()}")
+                self.o_queue.put(QueueMessage(MessageType.Process, fn))
             if is_terminate:
                 self.o_queue.put(QueueMessage(MessageType.Terminate, None))
                 break
@@ -483,9 +768,10 @@ class PushToStore(Task):
         i_queue: The queue to read file locations from
         dir: The directory of the database
         store: The Kosh Store
+        num_producers: The number of tasks writing to i_queue, the task terminates once all of them terminated.
     """
 
-    def __init__(self, i_queue, ams_config, db_path, store):
+    def __init__(self, i_queue, ams_config, db_path, store, num_producers=1):
         """
         Tnitializes the PushToStore Task. It reads files from i_queue, if the file
         is not under db_path, it copies the file to this location and if store defined
@@ -496,6 +782,7 @@ class PushToStore(Task):
         self.i_queue = i_queue
         self.dir = Path(db_path).absolute()
         self._store = store
+        self.num_producers = num_producers
         if not self.dir.exists():
             self.dir.mkdir(parents=True, exist_ok=True)
 
@@ -509,10 +796,13 @@ class PushToStore(Task):
                 self.ams_config.db_path, self.ams_config.db_store, self.ams_config.name, False
             ).open()
 
+        producers = self.num_producers
         while True:
             item = self.i_queue.get(block=True)
             if item.is_terminate():
-                break
+                producers -= 1
+                if producers == 0:
+                    break
             elif item.is_process():
                 src_fn = Path(item.data())
                 dest_file = self.dir / src_fn.name
@@ -526,6 +816,15 @@ class PushToStore(Task):
         print(f"Spend {end - start} at {self.__class__.__name__}")
 
 
+class _AppendAction(argparse.Action):
+    """Appends (option, value) pairs to a list shared by several options, preserving their order"""
+
+    def __call__(self, parser, namespace, values, option_string=None):
+        specs = list(getattr(namespace, self.dest, None) or list())
+        specs.append((option_string.lstrip("-").replace("-", "_"), values if values != [] else None))
+        setattr(namespace, self.dest, specs)
+
+
 class Pipeline(ABC):
     """
     An interface class representing a sequence of transformations/actions to be performed
@@ -540,12 +839,27 @@ class Pipeline(ABC):
         actions: A list of actions to be performed before storing the data in the filesystem
         db_type: The file format of the data to be stored
         writer: The class to be used to write data to the filesystem.
+        writer_opts: Keyword arguments of the writer (chunking, compression and buffering of HDF5 files).
+        transport_opts: Number and size of the slots of the shared memory transport, None to send data
+            through the queues.
+        parallel_opts: The number of loaders ('num_loaders'), the number of writers ('num_writers') and how
+            data are routed to the writers ('routing').
     """
 
     supported_policies = {"sequential", "thread", "process"}
-    supported_writers = {"shdf5", "dhdf5", "csv"}
-
-    def __init__(self, db_dir, store, dest_dir=None, stage_dir=None, db_type="hdf5"):
+    supported_writers = {"shdf5", "dhdf5", "csv", "columnar"}
+
+    def __init__(
+        self,
+        db_dir,
+        store,
+        dest_dir=None,
+        stage_dir=None,
+        db_type="hdf5",
+        writer_opts=None,
+        transport_opts=None,
+        parallel_opts=None,
+    ):
         """
         initializes the Pipeline class to write the final data in the 'dest_dir' using a file writer of type 'db_type'
         and optionally caching the data in the 'stage_dir' before making them available in the cache store.
@@ -569,6 +883,23 @@ class Pipeline(ABC):
 
         self._writer = get_writer(self.db_type)
 
+        # Only the HDF5 writers buffer and chunk their output, the columnar writer is only chunked
+        self._writer_opts = dict()
+        if writer_opts is not None and "hdf5" in self.db_type:
+            self._writer_opts = writer_opts
+        elif writer_opts is not None and self.db_type == "columnar":
+            self._writer_opts = {"chunk_rows": writer_opts.get("chunk_rows", 64 * 1024)}
+
+        self._transport_opts = transport_opts
+        self._transport = QueueTransport()
+
+        parallel_opts = parallel_opts if parallel_opts is not None else dict()
+        self.num_loaders = parallel_opts.get("num_loaders", 1)
+        self.num_writers = parallel_opts.get("num_writers", 1)
+        self.routing = parallel_opts.get("routing", "round-robin")
+        if self.num_loaders < 1 or self.num_writers < 1:
+            raise RuntimeError("Pipeline requires at least one loader and one writer")
+
         self.store = store
 
     def add_data_action(self, callback):
@@ -583,6 +914,32 @@ class Pipeline(ABC):
 
         self.actions.append(callback)
 
+    def add_builtin_actions(self, specs):
+        """
+        Adds the built-in vectorized actions described by 'specs' as a single stage of the pipeline.
+
+        Args:
+            specs: A list of (action, specification) pairs in the order they are applied, as returned by
+                'data_actions_from_cli'
+        """
+        if not specs:
+            return
+        actions = list()
+        for kind, spec in specs:
+            if kind == "drop_non_finite":
+                actions.append(DropNonFinite())
+            elif kind == "bounds":
+                actions.append(BoundsFilter.from_spec(spec))
+            elif kind == "affine":
+                actions.append(AffineTransform.from_spec(spec))
+            elif kind == "log":
+                actions.append(LogTransform.from_spec(spec))
+            elif kind == "running_stats":
+                actions.append(RunningStats(spec if spec else str(Path(self.dest_dir) / "running_stats.json")))
+            else:
+                raise ValueError(f"Unknown built-in action {kind}")
+        self.add_data_action(ActionChain(actions))
+
     def _seq_execute(self):
         """
         Executes all tasks sequentially. Every task starts after all incoming messages
@@ -633,21 +990,40 @@ class Pipeline(ABC):
             policy: The policy to be used to execute the pipeline
         """
         _qType = self.get_q_type(policy)
-        # We need 1 queue to copy incoming data to the pipeline
-        # Every action requires 1 input and one output q. But the output
-        # q is used as an inut q on the next action thus we need num actions -1.
-        # 2 extra queues to store to data-store and publish on kosh
-        num_queues = 1 + len(self.actions) - 1 + 2
-        self._queues = [_qType() for i in range(num_queues)]
-
-        self._tasks = [self.get_load_task(self._queues[0])]
+        # Only processes need shared memory, threads share the blobs already
+        if policy == "process" and self._transport_opts is not None:
+            self._transport = SharedMemoryTransport(**self._transport_opts)
+        else:
+            self._transport = QueueTransport()
+
+        # Every action reads from its own queue. Loaders write to the queue of the first action,
+        # the last action (or the loaders when there are no actions) fans out to the writers
+        # through a RoutedQueue. All writers report their files to a single PushToStore task.
+        action_queues = [_qType() for i in range(len(self.actions))]
+        writer_queues = [_qType() for i in range(self.num_writers)]
+        store_queue = _qType()
+        writers_input = RoutedQueue(writer_queues, self.routing)
+        self._queues = action_queues + writer_queues + [store_queue]
+
+        loaders_output = action_queues[0] if self.actions else writers_input
+        self._tasks = [self.get_load_task(loaders_output, i, self.num_loaders) for i in range(self.num_loaders)]
+
+        # Every task waits for the termination of all the tasks writing to its input queue
+        producers = self.num_loaders
         for i, a in enumerate(self.actions):
-            self._tasks.append(ForwardTask(self._queues[i], self._queues[i + 1], a))
+            o_queue = action_queues[i + 1] if i + 1 < len(self.actions) else writers_input
+            self._tasks.append(ForwardTask(action_queues[i], o_queue, a, self._transport, producers))
+            producers = 1
 
         # After user actions we store into a file
-        self._tasks.append(FSWriteTask(self._queues[-2], self._queues[-1], self._writer, self.stage_dir))
+        for q in writer_queues:
+            self._tasks.append(
+                FSWriteTask(
+                    q, store_queue, self._writer, self.stage_dir, self._writer_opts, self._transport, producers
+                )
+            )
         # After storing the file we make it public to the kosh store.
-        self._tasks.append(PushToStore(self._queues[-1], self.ams_config, self.dest_dir, self.store))
+        self._tasks.append(PushToStore(store_queue, self.ams_config, self.dest_dir, self.store, self.num_writers))
 
     def execute(self, policy):
         """
@@ -664,12 +1040,16 @@ class Pipeline(ABC):
         # Create a pipeline of actions and link them with appropriate queues
         self._link_pipeline(policy)
         # Execute them
-        self._execute_tasks(policy)
+        try:
+            self._execute_tasks(policy)
+        finally:
+            self._transport.close()
 
     @abstractmethod
-    def get_load_task(self, o_queue):
+    def get_load_task(self, o_queue, shard=0, num_shards=1):
         """
         Callback to the child class to return the task that loads data from some unspecified entry-point.
+        The pipeline creates 'num_shards' load tasks, 'shard' is the index of the requested one.
         """
         pass
 
@@ -693,6 +1073,99 @@ class Pipeline(ABC):
             help="File format to store the data to",
             default="dhdf5",
         )
+        parser.add_argument(
+            "--chunk-rows",
+            dest="chunk_rows",
+            type=int,
+            help="Number of rows of an HDF5 dataset chunk (flushes are aligned to it) or of a columnar file chunk",
+            default=64 * 1024,
+        )
+        parser.add_argument(
+            "--compression",
+            choices=["none", "gzip", "lzf"],
+            help="Compression filter of the HDF5 datasets",
+            default="none",
+        )
+        parser.add_argument(
+            "--compression-level", dest="compression_level", type=int, help="gzip compression level", default=None
+        )
+        parser.add_argument(
+            "--loaders", dest="num_loaders", type=int, help="Number of parallel tasks loading data", default=1
+        )
+        parser.add_argument(
+            "--writers", dest="num_writers", type=int, help="Number of parallel tasks writing files", default=1
+        )
+        parser.add_argument(
+            "--routing",
+            choices=RoutedQueue.supported_routings,
+            help="How data are distributed to the writers, 'hash' keeps data of the same source "
+            "(file or MPI rank) in the same writer",
+            default="round-robin",
+        )
+        parser.add_argument(
+            "--transport",
+            choices=["queue", "shm"],
+            help="How data move between the processes of the pipeline, either pickled through the queues "
+            "or through a shared memory ring of slots ('process' policy only)",
+            default="queue",
+        )
+        parser.add_argument(
+            "--shm-slots", dest="shm_slots", type=int, help="Number of slots of the shared memory ring", default=8
+        )
+        parser.add_argument(
+            "--shm-slot-size",
+            dest="shm_slot_size",
+            type=int,
+            help="Size (MB) of a slot of the shared memory ring, larger batches are sent through the queues",
+            default=2 * BATCH_SIZE // (1024 * 1024),
+        )
+        parser.add_argument(
+            "--write-buffer",
+            dest="write_buffer",
+            type=int,
+            help="Size (MB) of the in-memory buffer accumulating rows before writing them to an HDF5 file",
+            default=64,
+        )
+        # Built-in actions keep the order of the command line
+        actions = parser.add_argument_group("built-in actions", "Vectorized actions applied in command line order")
+        actions.add_argument(
+            "--drop-non-finite",
+            dest="data_actions",
+            action=_AppendAction,
+            nargs=0,
+            help="Drop the rows holding a NaN or an Inf value",
+        )
+        actions.add_argument(
+            "--bounds",
+            dest="data_actions",
+            action=_AppendAction,
+            metavar="SIDE:LOWER:UPPER[:COLUMNS]",
+            help="Keep the rows whose inputs/outputs (optionally only the comma separated COLUMNS) are in bounds",
+        )
+        actions.add_argument(
+            "--affine",
+            dest="data_actions",
+            action=_AppendAction,
+            metavar="SIDE:SCALE:OFFSET[:COLUMNS]",
+            help="Transform the inputs/outputs to SCALE * x + OFFSET",
+        )
+        actions.add_argument(
+            "--log",
+            dest="data_actions",
+            action=_AppendAction,
+            metavar="SIDE[:SHIFT[:COLUMNS]]",
+            help="Transform the inputs/outputs to log(x + SHIFT)",
+        )
+        actions.add_argument(
+            "--running-stats",
+            dest="data_actions",
+            action=_AppendAction,
+            nargs="?",
+            metavar="FILE",
+            help="Compute the per column mean and variance of the stored data and write them to FILE "
+            "(defaults to running_stats.json in the destination directory)",
+        )
+        parser.set_defaults(data_actions=list())
         # parser.add_argument("--db-dir", "-d", help="path to the AMS store directory", required=True)
         parser.add_argument("--persistent-db-path", "-db", help="The path of the AMS database", required=True)
         parser.add_argument("--store", dest="store", action="store_true")
@@ -704,6 +1177,41 @@ class Pipeline(ABC):
     def from_cli(cls):
         pass
 
+    @staticmethod
+    def writer_opts_from_cli(args):
+        """
+        Returns the keyword arguments of the writer described by the user provided CLI.
+        """
+        return {
+            "chunk_rows": args.chunk_rows,
+            "compression": None if args.compression == "none" else args.compression,
+            "compression_opts": args.compression_level,
+            "buffer_size": args.write_buffer * 1024 * 1024,
+        }
+
+    @staticmethod
+    def data_actions_from_cli(args):
+        """
+        Returns the built-in actions described by the user provided CLI.
+        """
+        return list(args.data_actions)
+
+    @staticmethod
+    def transport_opts_from_cli(args):
+        """
+        Returns the options of the transport described by the user provided CLI.
+        """
+        if args.transport == "queue":
+            return None
+        return {"num_slots": args.shm_slots, "slot_size": args.shm_slot_size * 1024 * 1024}
+
+    @staticmethod
+    def parallel_opts_from_cli(args):
+        """
+        Returns the parallelism of the pipeline described by the user provided CLI.
+        """
+        return {"num_loaders": args.num_loaders, "num_writers": args.num_writers, "routing": args.routing}
+
     @staticmethod
     def get_q_type(policy):
         """
@@ -724,29 +1232,51 @@ class FSPipeline(Pipeline):
         src_type: The file format of the source data
     """
 
-    supported_readers = ("shdf5", "dhdf5", "csv")
-
-    def __init__(self, db_dir, store, dest_dir, stage_dir, db_type, src, src_type, pattern):
+    supported_readers = ("shdf5", "dhdf5", "csv", "columnar")
+
+    def __init__(
+        self,
+        db_dir,
+        store,
+        dest_dir,
+        stage_dir,
+        db_type,
+        src,
+        src_type,
+        pattern,
+        writer_opts=None,
+        transport_opts=None,
+        parallel_opts=None,
+    ):
         """
         Initialize a FSPipeline that will write data to the 'dest_dir' and optionally publish
         these files to the kosh-store 'store' by using the stage_dir as an intermediate directory.
         """
-        super().__init__(db_dir, store, dest_dir, stage_dir, db_type)
+        super().__init__(db_dir, store, dest_dir, stage_dir, db_type, writer_opts, transport_opts, parallel_opts)
         self._src = Path(src)
         self._pattern = pattern
         self._src_type = src_type
 
-    def get_load_task(self, o_queue):
+    def get_load_task(self, o_queue, shard=0, num_shards=1):
         """
         Return a Task that loads data from the filesystem
 
         Args:
             o_queue: The queue the load task will push read data.
+            shard: The index of the loader, files matching the pattern are distributed across loaders.
+            num_shards: The number of loaders
 
         Returns: An FSLoaderTask instance reading data from the filesystem and forwarding the values to the o_queue.
         """
         loader = get_reader(self._src_type)
-        return FSLoaderTask(o_queue, loader, pattern=str(self._src) + "/" + self._pattern)
+        return FSLoaderTask(
+            o_queue,
+            loader,
+            pattern=str(self._src) + "/" + self._pattern,
+            transport=self._transport,
+            shard=shard,
+            num_shards=num_shards,
+        )
 
     @staticmethod
     def add_cli_args(parser):
@@ -764,7 +1294,7 @@ class FSPipeline(Pipeline):
         """
         Create FSPipeline from the user provided CLI.
         """
-        return cls(
+        pipeline = cls(
             args.persistent_db_path,
             args.store,
             args.dest_dir,
@@ -773,7 +1303,12 @@ class FSPipeline(Pipeline):
             args.src,
             args.src_type,
             args.pattern,
+            Pipeline.writer_opts_from_cli(args),
+            Pipeline.transport_opts_from_cli(args),
+            Pipeline.parallel_opts_from_cli(args),
         )
+        pipeline.add_builtin_actions(Pipeline.data_actions_from_cli(args))
+        return pipeline
 
 
 class RMQPipeline(Pipeline):
@@ -782,30 +1317,60 @@ class RMQPipeline(Pipeline):
 
     Attributes:
         credentials: The JSON credentials to connect to RMQ Server
-        cacert: The TLS certificate
+        cacert: The TLS certificate, None requires "rabbitmq-tls": false in the credentials (local brokers)
         rmq_queue: The RMQ queue to listen to.
     """
 
-    def __init__(self, db_dir, store, dest_dir, stage_dir, db_type, credentials, cacert, rmq_queue):
+    def __init__(
+        self,
+        db_dir,
+        store,
+        dest_dir,
+        stage_dir,
+        db_type,
+        credentials,
+        cacert,
+        rmq_queue,
+        writer_opts=None,
+        transport_opts=None,
+        parallel_opts=None,
+        prefetch_count=1,
+        ack_every=1,
+        ack_interval_ms=0,
+    ):
         """
         Initialize a RMQPipeline that will write data to the 'dest_dir' and optionally publish
         these files to the kosh-store 'store' by using the stage_dir as an intermediate directory.
         """
-        super().__init__(db_dir, store, dest_dir, stage_dir, db_type)
+        super().__init__(db_dir, store, dest_dir, stage_dir, db_type, writer_opts, transport_opts, parallel_opts)
         self._credentials = Path(credentials)
-        self._cacert = Path(cacert)
+        self._cacert = Path(cacert) if cacert else None
         self._rmq_queue = rmq_queue
+        self._prefetch_count = prefetch_count
+        self._ack_every = ack_every
+        self._ack_interval_ms = ack_interval_ms
 
-    def get_load_task(self, o_queue):
+    def get_load_task(self, o_queue, shard=0, num_shards=1):
         """
         Return a Task that loads data from the filesystem
 
         Args:
             o_queue: The queue the load task will push read data.
+            shard: The index of the loader, all loaders consume from the same RMQ queue.
+            num_shards: The number of loaders
 
         Returns: An RMQLoaderTask instance reading data from the filesystem and forwarding the values to the o_queue.
         """
-        return RMQLoaderTask(o_queue, self._credentials, self._cacert, self._rmq_queue)
+        return RMQLoaderTask(
+            o_queue,
+            self._credentials,
+            self._cacert,
+            self._rmq_queue,
+            prefetch_count=self._prefetch_count,
+            transport=self._transport,
+            ack_every=self._ack_every,
+            ack_interval_ms=self._ack_interval_ms,
+        )
 
     @staticmethod
     def add_cli_args(parser):
@@ -814,8 +1379,34 @@ class RMQPipeline(Pipeline):
         """
         Pipeline.add_cli_args(parser)
         parser.add_argument("-c", "--creds", help="Credentials file (JSON)", required=True)
-        parser.add_argument("-t", "--cert", help="TLS certificate file", required=True)
+        parser.add_argument(
+            "-t",
+            "--cert",
+            help='TLS certificate file, required unless the credentials set "rabbitmq-tls": false (local brokers)',
+            default=None,
+        )
         parser.add_argument("-q", "--queue", help="On which queue to receive messages", required=True)
+        parser.add_argument(
+            "--prefetch-count",
+            dest="prefetch_count",
+            type=int,
+            help="Number of unacknowledged messages RabbitMQ delivers to every loader",
+            default=64,
+        )
+        parser.add_argument(
+            "--ack-every",
+            dest="ack_every",
+            type=int,
+            help="Acknowledge messages cumulatively once that many have been handed off (capped by --prefetch-count)",
+            default=16,
+        )
+        parser.add_argument(
+            "--ack-interval",
+            dest="ack_interval_ms",
+            type=int,
+            help="Maximum delay in milliseconds before acknowledging handed off messages (0 disables the timer)",
+            default=50,
+        )
         return
 
     @classmethod
@@ -824,7 +1415,7 @@ class RMQPipeline(Pipeline):
         Create RMQPipeline from the user provided CLI.
         """
         print("Creating database from here", args.persistent_db_path)
-        return cls(
+        pipeline = cls(
             args.persistent_db_path,
             args.store,
             args.dest_dir,
@@ -833,7 +1424,15 @@ class RMQPipeline(Pipeline):
             args.creds,
             args.cert,
             args.queue,
+            Pipeline.writer_opts_from_cli(args),
+            Pipeline.transport_opts_from_cli(args),
+            Pipeline.parallel_opts_from_cli(args),
+            args.prefetch_count,
+            args.ack_every,
+            args.ack_interval_ms,
         )
+        pipeline.add_builtin_actions(Pipeline.data_actions_from_cli(args))
+        return pipeline
 
 
 def get_pipeline(src_mechanism="fs"):
@@ -0,0 +1,83 @@
+#!/usr/bin/env python3
+# Copyright 2021-2023 Lawrence Livermore National Security, LLC and other
+# AMSLib Project Developers
+#
+# SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+
+import argparse
+import glob
+import time
+
+from ams.compact import Compactor
+from ams.config import AMSInstance
+from ams.store import AMSDataStore
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        formatter_class=argparse.ArgumentDefaultsHelpFormatter,
+        description="AMS compaction mechanism. Merges many small per-rank files into large shuffled training shards",
+    )
+    parser.add_argument("--src", "-s", help="Directory containing the files to compact", required=True)
+    parser.add_argument("--pattern", help="Glob pattern of the files to compact", default="*.h5")
+    parser.add_argument("--dest", "-d", help="Directory to store the shards and their index", required=True)
+    parser.add_argument(
+        "--src-type",
+        dest="src_type",
+        choices=["shdf5", "dhdf5", "csv", "columnar"],
+        help="File format of the files to compact",
+        default="shdf5",
+    )
+    parser.add_argument("--shard-rows", dest="shard_rows", type=int, help="Number of rows of a shard", default=1 << 20)
+    parser.add_argument("--seed", type=int, help="Seed used to shuffle the data", default=0)
+    parser.add_argument("--workers", "-w", type=int, help="Number of processes compacting shards", default=1)
+    parser.add_argument(
+        "--chunk-rows",
+        dest="chunk_rows",
+        type=int,
+        help="Number of rows of an HDF5 chunk of a shard",
+        default=64 * 1024,
+    )
+    parser.add_argument(
+        "--compression", choices=["none", "gzip", "lzf"], help="HDF5 compression filter of the shards", default="none"
+    )
+    parser.add_argument(
+        "--persistent-db-path",
+        "-p",
+        dest="persistent_db_path",
+        help="The path of the AMS store to register the shards in (not registered when omitted)",
+        default=None,
+    )
+    parser.add_argument("--version", "-v", help="Version assigned to the shards in the store", default=None)
+    args = parser.parse_args()
+
+    sources = glob.glob(f"{args.src}/{args.pattern}")
+    if not sources:
+        raise argparse.ArgumentTypeError(f"No files matching {args.pattern} in {args.src}")
+
+    writer_opts = {"chunk_rows": min(args.chunk_rows, args.shard_rows)}
+    if args.compression != "none":
+        writer_opts["compression"] = args.compression
+
+    start = time.time()
+    compactor = Compactor(
+        sources,
+        args.dest,
+        args.shard_rows,
+        args.src_type,
+        seed=args.seed,
+        workers=args.workers,
+        writer_opts=writer_opts,
+    )
+    shards = compactor()
+    print(f"Compaction of {len(sources)} files into {len(shards)} shards took {time.time() - start:.2f}s")
+
+    if args.persistent_db_path is not None:
+        ams_config = AMSInstance.from_path(args.persistent_db_path)
+        with AMSDataStore(ams_config.db_path, ams_config.db_store, ams_config.name, False) as store:
+            store.add_data(shards, version=args.version)
+        print(f"Registered {len(shards)} shards in the AMS store {ams_config.db_path}")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,49 @@
+#!/usr/bin/env python3
+# Copyright 2021-2023 Lawrence Livermore National Security, LLC and other
+# AMSLib Project Developers
+#
+# SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+
+import argparse
+import glob
+import time
+
+import numpy as np
+
+from ams import kdtree
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        formatter_class=argparse.ArgumentDefaultsHelpFormatter,
+        description="Writes the KD-tree of the inputs of AMS database files, an HDCache searching the exact "
+        "nearest neighbors",
+    )
+    parser.add_argument("--src", "-s", help="Directory containing the database files", required=True)
+    parser.add_argument("--pattern", help="Glob pattern of the database files", default="*.h5")
+    parser.add_argument(
+        "--src-type",
+        dest="src_type",
+        choices=["shdf5", "dhdf5", "csv", "columnar"],
+        help="File format of the database files",
+        default="shdf5",
+    )
+    parser.add_argument("--output", "-o", help="Path of the KD-tree", required=True)
+    parser.add_argument("--leaf-size", dest="leaf_size", type=int, help="Points per leaf of the tree", default=32)
+    parser.add_argument(
+        "--precision", choices=["single", "double"], help="Precision of the stored points", default="double"
+    )
+    args = parser.parse_args()
+
+    sources = sorted(glob.glob(f"{args.src}/{args.pattern}"))
+    if not sources:
+        raise argparse.ArgumentTypeError(f"No files matching {args.pattern} in {args.src}")
+
+    start = time.time()
+    dtype = np.float32 if args.precision == "single" else np.float64
+    points = kdtree.from_files(sources, args.output, args.src_type, args.leaf_size, dtype)
+    print(f"KD-tree of {points} points of {len(sources)} files written in {time.time() - start:.2f}s")
+
+
+if __name__ == "__main__":
+    main()
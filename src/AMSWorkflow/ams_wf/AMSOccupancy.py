@@ -0,0 +1,56 @@
+#!/usr/bin/env python3
+# Copyright 2021-2023 Lawrence Livermore National Security, LLC and other
+# AMSLib Project Developers
+#
+# SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+
+import argparse
+import glob
+import time
+
+from ams.occupancy import OccupancyGrid
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        formatter_class=argparse.ArgumentDefaultsHelpFormatter,
+        description="Builds the occupancy grid of the inputs of AMS database files, the UQ model of the "
+        "OccupancyGrid policy",
+    )
+    parser.add_argument("--src", "-s", help="Directory containing the database files", required=True)
+    parser.add_argument("--pattern", help="Glob pattern of the database files", default="*.h5")
+    parser.add_argument(
+        "--src-type",
+        dest="src_type",
+        choices=["shdf5", "dhdf5", "csv", "columnar"],
+        help="File format of the database files",
+        default="shdf5",
+    )
+    parser.add_argument("--output", "-o", help="Path of the occupancy grid", required=True)
+    parser.add_argument(
+        "--bits", type=int, nargs="+", help="Bits per dimension of every level of the grid", default=[4, 6, 8]
+    )
+    parser.add_argument(
+        "--min-count",
+        dest="min_count",
+        type=int,
+        help="Number of training points a cell needs to be in distribution",
+        default=1,
+    )
+    parser.add_argument("--lo", type=float, nargs="+", help="Lower bounds of the inputs (default: of the data)")
+    parser.add_argument("--hi", type=float, nargs="+", help="Upper bounds of the inputs (default: of the data)")
+    args = parser.parse_args()
+
+    sources = sorted(glob.glob(f"{args.src}/{args.pattern}"))
+    if not sources:
+        raise argparse.ArgumentTypeError(f"No files matching {args.pattern} in {args.src}")
+
+    start = time.time()
+    grid = OccupancyGrid.from_files(sources, args.src_type, args.bits, args.min_count, args.lo, args.hi)
+    grid.save(args.output)
+    cells = ", ".join(f"{len(grid.levels[b])} cells of {b} bits" for b in grid.bits)
+    print(f"Occupancy grid of {len(sources)} files ({cells}) built in {time.time() - start:.2f}s")
+
+
+if __name__ == "__main__":
+    main()
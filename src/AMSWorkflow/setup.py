@@ -13,7 +13,10 @@ setuptools.setup(
     entry_points={
         "console_scripts": [
             "AMSBroker=ams_wf.AMSBroker:main",
+            "AMSCompact=ams_wf.AMSCompact:main",
             "AMSDBStage=ams_wf.AMSDBStage:main",
+            "AMSKDTree=ams_wf.AMSKDTree:main",
+            "AMSOccupancy=ams_wf.AMSOccupancy:main",
             "AMSOrchestrator=ams_wf.AMSOrchestrator:main",
             "AMSStore=ams_wf.AMSStore:main",
             "AMSTrain=ams_wf.AMSTrain:main",
@@ -30,6 +30,12 @@ struct AMSWrap {
 
 static AMSWrap _amsWrap;
 
+static void _AMSInit()
+{
+  static std::once_flag flag;
+  std::call_once(flag, [&]() { ams::ResourceManager::init(); });
+}
+
 void _AMSExecute(AMSExecutor executor,
                  void *probDescr,
                  const int numElements,
@@ -39,8 +45,7 @@ void _AMSExecute(AMSExecutor executor,
                  int outputDim,
                  MPI_Comm Comm = 0)
 {
-  static std::once_flag flag;
-  std::call_once(flag, [&]() { ams::ResourceManager::init(); });
+  _AMSInit();
 
   uint64_t index = reinterpret_cast<uint64_t>(executor);
 
@@ -48,6 +53,8 @@ void _AMSExecute(AMSExecutor executor,
     throw std::runtime_error("AMS Executor identifier does not exist\n");
 
   auto currExec = _amsWrap.executors[index];
+  if (currExec.second == nullptr)
+    throw std::runtime_error("AMS Executor has been destroyed\n");
   if (currExec.first == AMSDType::Double) {
     ams::AMSWorkflow<double> *dWF =
         reinterpret_cast<ams::AMSWorkflow<double> *>(currExec.second);
@@ -74,6 +81,36 @@ void _AMSExecute(AMSExecutor executor,
   }
 }
 
+static size_t _shadowCapacity(const AMSConfig &config)
+{
+  return config.shadowCapacity > 0 ? config.shadowCapacity : 1 << 20;
+}
+
+template <typename FPTypeValue>
+static ams::AMSWorkflow<FPTypeValue> *getWorkflow(AMSExecutor executor)
+{
+  uint64_t index = reinterpret_cast<uint64_t>(executor);
+
+  if (index >= _amsWrap.executors.size())
+    throw std::runtime_error("AMS Executor identifier does not exist\n");
+
+  if (_amsWrap.executors[index].second == nullptr)
+    throw std::runtime_error("AMS Executor has been destroyed\n");
+
+  return reinterpret_cast<ams::AMSWorkflow<FPTypeValue> *>(
+      _amsWrap.executors[index].second);
+}
+
+static AMSDType getDType(AMSExecutor executor)
+{
+  uint64_t index = reinterpret_cast<uint64_t>(executor);
+
+  if (index >= _amsWrap.executors.size())
+    throw std::runtime_error("AMS Executor identifier does not exist\n");
+
+  return _amsWrap.executors[index].first;
+}
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -95,6 +132,30 @@ AMSExecutor AMSCreateExecutor(const AMSConfig config)
                                      config.wSize,
                                      config.ePolicy);
 
+    if (!isNullOrEmpty(config.cascadeSPath))
+      dWF->setCascade(isNullOrEmpty(config.cascadeUQPath)
+                          ? config.UQPath
+                          : config.cascadeUQPath,
+                      config.cascadeSPath,
+                      config.cascadeThreshold,
+                      config.nClusters);
+    if (config.shadowFraction > 0)
+      dWF->setShadow(config.shadowFraction, _shadowCapacity(config));
+    if (config.reorderMinElements > 0)
+      dWF->setReorder(config.reorderMinElements);
+    if (config.inputScale || config.outputScale)
+      dWF->setNormalization(config.nInputs,
+                            config.inputScale,
+                            config.inputOffset,
+                            config.nOutputs,
+                            config.outputScale,
+                            config.outputOffset);
+    if (config.reentrantPhysics)
+      dWF->setReentrantPhysics(config.physicsThreads);
+    if (config.tuneCalls > 0)
+      dWF->setAutoTune(config.tuneCachePath, config.SPath, config.tuneCalls);
+    if (config.uqThreads != 0) dWF->setUQThreads(config.uqThreads);
+
     _amsWrap.executors.push_back(
         std::make_pair(config.dType, static_cast<void *>(dWF)));
     return reinterpret_cast<AMSExecutor>(_amsWrap.executors.size() - 1L);
@@ -112,6 +173,29 @@ AMSExecutor AMSCreateExecutor(const AMSConfig config)
                                     config.pId,
                                     config.wSize,
                                     config.ePolicy);
+    if (!isNullOrEmpty(config.cascadeSPath))
+      sWF->setCascade(isNullOrEmpty(config.cascadeUQPath)
+                          ? config.UQPath
+                          : config.cascadeUQPath,
+                      config.cascadeSPath,
+                      static_cast<float>(config.cascadeThreshold),
+                      config.nClusters);
+    if (config.shadowFraction > 0)
+      sWF->setShadow(config.shadowFraction, _shadowCapacity(config));
+    if (config.reorderMinElements > 0)
+      sWF->setReorder(config.reorderMinElements);
+    if (config.inputScale || config.outputScale)
+      sWF->setNormalization(config.nInputs,
+                            config.inputScale,
+                            config.inputOffset,
+                            config.nOutputs,
+                            config.outputScale,
+                            config.outputOffset);
+    if (config.reentrantPhysics)
+      sWF->setReentrantPhysics(config.physicsThreads);
+    if (config.tuneCalls > 0)
+      sWF->setAutoTune(config.tuneCachePath, config.SPath, config.tuneCalls);
+    if (config.uqThreads != 0) sWF->setUQThreads(config.uqThreads);
     _amsWrap.executors.push_back(
         std::make_pair(config.dType, static_cast<void *>(sWF)));
 
@@ -160,6 +244,34 @@ void AMSDistributedExecute(AMSExecutor executor,
 }
 #endif
 
+void AMSDestroyExecutor(AMSExecutor executor)
+{
+  // The workflow destructor waits for the pending shadow physics, the last
+  // use of the problem descriptors of the calls
+  if (getDType(executor) == AMSDType::Double)
+    delete getWorkflow<double>(executor);
+  else
+    delete getWorkflow<float>(executor);
+  _amsWrap.executors[reinterpret_cast<uint64_t>(executor)].second = nullptr;
+}
+
+void AMSSaveExecutorState(AMSExecutor executor, const char *path)
+{
+  if (getDType(executor) == AMSDType::Double)
+    getWorkflow<double>(executor)->saveState(path);
+  else
+    getWorkflow<float>(executor)->saveState(path);
+}
+
+void AMSLoadExecutorState(AMSExecutor executor, const char *path)
+{
+  _AMSInit();
+
+  if (getDType(executor) == AMSDType::Double)
+    getWorkflow<double>(executor)->loadState(path);
+  else
+    getWorkflow<float>(executor)->loadState(path);
+}
 
 const char *AMSGetAllocatorName(AMSResourceType device)
 {
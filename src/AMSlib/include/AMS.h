@@ -65,6 +65,7 @@ enum struct AMSUQPolicy {
   DeltaUQ_Mean,
   DeltaUQ_Max,
   RandomUQ,
+  OccupancyGrid,
   AMSUQPolicy_END
 };
 
@@ -82,6 +83,53 @@ typedef struct ams_conf {
   const int nClusters;
   int pId;
   int wSize;
+  /* Optional second surrogate of a two-tier cascade, it evaluates only the
+   * points the first one rejects. The cascade is disabled when SPath is null,
+   * its UQ uses uqPolicy and defaults to the UQPath of the first tier. */
+  char *cascadeSPath;
+  char *cascadeUQPath;
+  double cascadeThreshold;
+  /* Fraction of the accepted points the physics evaluates in the background
+   * to monitor the surrogate error and label data, 0 disables it. At most
+   * shadowCapacity points are pending (0 selects a default). Requires host
+   * data and a physics callback that can run concurrently with the app. The
+   * shadow physics is called with the probDescr of the sampled call after
+   * AMSExecute returned: probDescr and the state it points to must remain
+   * valid until AMSDestroyExecutor, which waits for the pending points. */
+  double shadowFraction;
+  int shadowCapacity;
+  /* Calls of at least this many points evaluate the physics and search the
+   * HDCache in the Morton order of their inputs (host data only), 0 disables
+   * the reordering. */
+  long reorderMinElements;
+  /* Optional standardization of the surrogate features, fused with the
+   * marshaling of the data to and from the models: they evaluate
+   * (x - inputOffset) / inputScale and return y * outputScale + outputOffset.
+   * Arrays hold nInputs and nOutputs values, null offsets are 0. When the
+   * scales are null, the ams_input_scale, ams_input_offset, ams_output_scale
+   * and ams_output_offset attributes of the TorchScript modules are used. */
+  const double *inputScale;
+  const double *inputOffset;
+  int nInputs;
+  const double *outputScale;
+  const double *outputOffset;
+  int nOutputs;
+  /* Declares the physics callback reentrant: host calls are then split in
+   * chunks of independent points evaluated concurrently by physicsThreads
+   * threads (0 selects the number of hardware threads). */
+  int reentrantPhysics;
+  int physicsThreads;
+  /* Tunes the reordering and the number of physics threads (among the
+   * configured ones) during the first calls, tuneCalls calls per candidate, 0
+   * disables the tuner. The winner is persisted to tuneCachePath (optional)
+   * per host type, model, call dimensions and physics thread limit, runs
+   * finding theirs there start tuned. */
+  int tuneCalls;
+  char *tuneCachePath;
+  /* Threads searching HDCaches stored as KD-trees (see ml/kdtree.hpp), 0
+   * searches on the calling thread and a negative value on all the hardware
+   * threads. */
+  int uqThreads;
 } AMSConfig;
 
 AMSExecutor AMSCreateExecutor(const AMSConfig config);
@@ -104,8 +152,18 @@ void AMSExecute(AMSExecutor executor,
                 int inputDim,
                 int outputDim);
 
+/* Releases an executor, once the pending shadow physics completed. */
 void AMSDestroyExecutor(AMSExecutor executor);
 
+/* Writes the runtime state of an executor (statistics, workspace sizing hints
+ * and UQ state such as the points added to the HDCache) to 'path', typically
+ * next to the application checkpoint. Every rank must use its own path. */
+void AMSSaveExecutorState(AMSExecutor executor, const char *path);
+
+/* Restores a state written by AMSSaveExecutorState into an executor created
+ * with the same configuration, restarted jobs resume at steady state. */
+void AMSLoadExecutorState(AMSExecutor executor, const char *path);
+
 #ifdef __AMS_ENABLE_MPI__
 int AMSSetCommunicator(MPI_Comm Comm);
 #endif
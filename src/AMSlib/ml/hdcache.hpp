@@ -17,11 +17,13 @@
 #include <stdexcept>
 #include <string>
 #include <type_traits>
+#include <unordered_map>
 #include <vector>
 
 #ifdef __ENABLE_FAISS__
 #include <faiss/IndexFlat.h>
 #include <faiss/index_factory.h>
+#include <faiss/impl/io.h>
 #include <faiss/index_io.h>
 
 #ifdef __ENABLE_CUDA__
@@ -33,13 +35,20 @@
 #endif
 
 #include "AMS.h"
+#include "ml/kdtree.hpp"
 #include "wf/data_handler.hpp"
+#include "wf/reorder.hpp"
 #include "wf/resource_manager.hpp"
 #include "wf/utils.hpp"
 
 //! ----------------------------------------------------------------------------
 //! An implementation of FAISS-based HDCache
 //! ----------------------------------------------------------------------------
+/**
+ * Cache paths holding a KD-tree (see ml/kdtree.hpp) are searched by the exact
+ * KD-tree instead of FAISS, with the same squared L2 distances and policies.
+ * The KD-tree does not need FAISS and searches host copies of device data.
+ */
 template <typename TypeInValue>
 class HDCache
 {
@@ -64,6 +73,8 @@ class HDCache
   using data_handler =
       ams::DataHandler<TypeValue>;  // utils to handle float data
 
+  /** @brief The exact index of KD-tree caches, m_index is null then */
+  std::unique_ptr<KDTree<TypeValue>> m_kdtree;
   Index *m_index = nullptr;
   const uint8_t m_dim;
 
@@ -74,6 +85,17 @@ class HDCache
 
   const TypeValue acceptable_error;
 
+  /** @brief Number of points of the index when it was loaded, the index is
+   * part of the executor state only when points were added afterwards */
+  size_t m_loaded_points = 0;
+
+  /** @brief Searches of at least this many host points are done in the
+   * Morton order of the points, 0 disables the reordering */
+  size_t m_reorder_elements = 0;
+
+  /** @brief Threads searching the blocks of queries of a KD-tree, the calling
+   * thread takes part in the search */
+  std::unique_ptr<ams::ThreadPool> m_pool;
 
 #ifdef __ENABLE_FAISS__
   const char *index_key = "IVF4096,Flat";
@@ -101,8 +123,9 @@ protected:
           const AMSUQPolicy uqPolicy,
           int knbrs,
           TypeInValue threshold = 0.5)
-      : m_index(load_cache(cache_path)),
-        m_dim(m_index->d),
+      : m_kdtree(load_kdtree(cache_path)),
+        m_index(m_kdtree ? nullptr : load_cache(cache_path)),
+        m_dim(m_kdtree ? m_kdtree->dim() : m_index->d),
         m_knbrs(knbrs),
         m_policy(uqPolicy),
         cache_location(resource),
@@ -110,12 +133,13 @@ protected:
   {
 #ifdef __ENABLE_CUDA__
     // Copy index to device side
-    if (cache_location == AMSResourceType::DEVICE) {
+    if (m_index && cache_location == AMSResourceType::DEVICE) {
       faiss::gpu::GpuClonerOptions copyOptions;
       faiss::gpu::ToGpuCloner cloner(&res, 0, copyOptions);
       m_index = cloner.clone_Index(m_index);
     }
 #endif
+    m_loaded_points = count();
     print();
   }
 #else  // Disabled FAISS
@@ -124,14 +148,18 @@ protected:
           const AMSUQPolicy uqPolicy,
           int knbrs,
           TypeInValue threshold = 0.5)
-      : m_index(load_cache(cache_path)),
-        m_dim(0),
+      : m_kdtree(load_kdtree(cache_path)),
+        m_index(load_cache(cache_path)),
+        m_dim(m_kdtree ? m_kdtree->dim() : 0),
         m_knbrs(knbrs),
         m_policy(uqPolicy),
         cache_location(resource),
         acceptable_error(threshold)
   {
-    WARNING(UQModule, "Ignoring cache path because FAISS is not available")
+    if (m_kdtree)
+      m_loaded_points = count();
+    else
+      WARNING(UQModule, "Ignoring cache path because FAISS is not available")
     print();
   }
 #endif
@@ -240,6 +268,7 @@ public:
 
   inline bool has_index() const
   {
+    if (m_kdtree) return true;
 #ifdef __ENABLE_FAISS__
     return m_index != nullptr && m_index->is_trained;
 #endif
@@ -248,6 +277,7 @@ public:
 
   inline size_t count() const
   {
+    if (m_kdtree) return m_kdtree->size();
 #ifdef __ENABLE_FAISS__
     return m_index->ntotal;
 #endif
@@ -269,8 +299,23 @@ public:
 #endif
   }
 
+  /** @brief Loads the KD-tree at 'filename', null when it holds none */
+  static inline std::unique_ptr<KDTree<TypeValue>> load_kdtree(
+      const std::string &filename)
+  {
+    if (!KDTree<TypeValue>::isKDTree(filename)) return nullptr;
+    DBG(UQModule, "Loading KD-tree HDCache: %s", filename.c_str());
+    return KDTree<TypeValue>::load(filename);
+  }
+
   inline void save_cache(const std::string &filename) const
   {
+    if (m_kdtree) {
+      print();
+      DBG(UQModule, "Saving KD-tree HDCache to: %s", filename.c_str());
+      m_kdtree->save(filename);
+      return;
+    }
 #ifdef __ENABLE_FAISS__
     print();
     DBG(UQModule, "Saving HDCache to: %s", filename.c_str());
@@ -278,6 +323,92 @@ public:
 #endif
   }
 
+  /** @brief Searches calls of at least 'minElements' host points in the
+   * Morton order of the points. Consecutive queries then probe the same
+   * inverted lists of IVF indices */
+  inline void setReorder(size_t minElements)
+  {
+    m_reorder_elements = minElements;
+  }
+
+  /** @brief Searches KD-tree caches with 'numThreads' threads, one block of
+   * queries per thread at a time. FAISS indices are not affected */
+  inline void setThreads(int numThreads)
+  {
+    m_pool.reset(numThreads > 1 ? new ams::ThreadPool(numThreads - 1)
+                                : nullptr);
+  }
+
+  //! ------------------------------------------------------------------------
+  //! executor state snapshots
+  //! ------------------------------------------------------------------------
+  /** @brief Whether points were added to the index since it was loaded */
+  inline bool modified() const
+  {
+    return has_index() && count() != m_loaded_points;
+  }
+
+  /** @brief Serializes the index in memory (FAISS or KD-tree format) */
+  std::string serialize() const
+  {
+    if (m_kdtree) return m_kdtree->serialize();
+#ifdef __ENABLE_FAISS__
+    const Index *index = m_index;
+#ifdef __ENABLE_CUDA__
+    std::unique_ptr<Index> host;
+    if (cache_location == AMSResourceType::DEVICE) {
+      host.reset(faiss::gpu::index_gpu_to_cpu(m_index));
+      index = host.get();
+    }
+#endif
+    faiss::VectorIOWriter writer;
+    faiss::write_index(index, &writer);
+    DBG(UQModule,
+        "Serialized HDCache (%lu points, %lu bytes)",
+        count(),
+        writer.data.size());
+    return std::string(writer.data.begin(), writer.data.end());
+#else
+    return std::string();
+#endif
+  }
+
+  /** @brief Replaces the index with a serialized one of the same dimension */
+  void deserialize(const std::string &bytes)
+  {
+    if (m_kdtree) {
+      auto tree = KDTree<TypeValue>::deserialize(bytes);
+      if (tree->dim() != m_dim)
+        THROW(std::runtime_error,
+              "Mismatch in the dimensionality of the restored HDCache");
+      m_kdtree = std::move(tree);
+      DBG(UQModule, "Restored KD-tree HDCache with %lu points", count());
+      return;
+    }
+#ifdef __ENABLE_FAISS__
+    faiss::VectorIOReader reader;
+    reader.data.assign(bytes.begin(), bytes.end());
+    Index *index = faiss::read_index(&reader);
+    if (index->d != m_dim) {
+      delete index;
+      THROW(std::runtime_error,
+            "Mismatch in the dimensionality of the restored HDCache");
+    }
+#ifdef __ENABLE_CUDA__
+    if (cache_location == AMSResourceType::DEVICE) {
+      faiss::gpu::ToGpuCloner cloner(&res, 0, copyOptions);
+      Index *host = index;
+      index = cloner.clone_Index(host);
+      delete host;
+    }
+#endif
+    // Device indices are never deleted, see the destructor
+    if (m_index && cache_location != AMSResourceType::DEVICE) delete m_index;
+    m_index = index;
+    DBG(UQModule, "Restored HDCache with %lu points", count());
+#endif
+  }
+
   //! -----------------------------------------------------------------------
   //! add points to the faiss cache
   //! -----------------------------------------------------------------------
@@ -291,7 +422,10 @@ public:
            !has_index(),
            "HDCache does not have a valid and trained index!")
 
-    _add(ndata, data);
+    if (m_kdtree)
+      _kdAdd(ndata, data);
+    else
+      _add(ndata, data);
   }
 
   //! add the data that comes as separate features (a vector of pointers)
@@ -306,9 +440,14 @@ public:
            !has_index(),
            "HDCache does not have a valid and trained index!")
 
-    TypeValue *lin_data =
-        data_handler::linearize_features(cache_location, ndata, inputs);
-    _add(ndata, lin_data);
+    TypeValue *lin_data = data_handler::linearize_features(
+        cache_location,
+        ndata,
+        std::vector<const TypeInValue *>(inputs.begin(), inputs.end()));
+    if (m_kdtree)
+      _kdAdd(ndata, lin_data);
+    else
+      _add(ndata, lin_data);
     ams::ResourceManager::deallocate(lin_data, cache_location);
   }
 
@@ -325,6 +464,10 @@ public:
            !has_index(),
            "HDCache does not have a valid and trained index!")
 
+    if (m_kdtree) {
+      DBG(UQModule, "KD-tree HDCaches need no training");
+      return;
+    }
     _train(ndata, data);
     DBG(UQModule, "Successfully Trained HDCache");
   }
@@ -333,8 +476,14 @@ public:
   PERFFASPECT()
   void train(const size_t ndata, const std::vector<TypeInValue *> &inputs)
   {
-    TypeValue *lin_data =
-        data_handler::linearize_features(cache_location, ndata, inputs);
+    if (m_kdtree) {
+      DBG(UQModule, "KD-tree HDCaches need no training");
+      return;
+    }
+    TypeValue *lin_data = data_handler::linearize_features(
+        cache_location,
+        ndata,
+        std::vector<const TypeInValue *>(inputs.begin(), inputs.end()));
     _train(ndata, lin_data);
     ams::ResourceManager::deallocate(lin_data, cache_location);
   }
@@ -361,7 +510,7 @@ public:
 
     CFATAL(UQModule, (d != m_dim), "Mismatch in data dimensionality!")
 
-    _evaluate(ndata, data, is_acceptable);
+    _search(ndata, data, is_acceptable);
 
     if (cache_location == AMSResourceType::DEVICE) {
       deviceCheckErrors(__FILE__, __LINE__);
@@ -392,14 +541,113 @@ public:
            (inputs.size() != m_dim),
            "Mismatch in data dimensionality!")
 
-    TypeValue *lin_data =
-        data_handler::linearize_features(cache_location, ndata, inputs);
-    _evaluate(ndata, lin_data, is_acceptable);
-    ams::ResourceManager::deallocate(lin_data, cache_location);
+    using morton = ams::MortonOrder<TypeInValue>;
+    if (cache_location == AMSResourceType::HOST &&
+        morton::profitable(ndata, m_reorder_elements)) {
+      std::vector<uint32_t> order;
+      morton::compute(ndata, inputs, order);
+      std::vector<TypeInValue *> sorted;
+      for (size_t d = 0; d < inputs.size(); d++)
+        sorted.push_back(
+            ams::ResourceManager::allocate<TypeInValue>(ndata, cache_location));
+      morton::gather(order,
+                     const_cast<TypeInValue *const *>(inputs.data()),
+                     sorted.data(),
+                     inputs.size());
+      bool *sorted_acceptable =
+          ams::ResourceManager::allocate<bool>(ndata, cache_location);
+      TypeValue *lin_data = data_handler::linearize_features(
+          cache_location,
+          ndata,
+          std::vector<const TypeInValue *>(sorted.begin(), sorted.end()));
+      _search(ndata, lin_data, sorted_acceptable);
+      for (size_t i = 0; i < ndata; i++)
+        is_acceptable[order[i]] = sorted_acceptable[i];
+      ams::ResourceManager::deallocate(lin_data, cache_location);
+      ams::ResourceManager::deallocate(sorted_acceptable, cache_location);
+      ams::ResourceManager::deallocate(sorted, cache_location);
+    } else {
+      TypeValue *lin_data =
+          data_handler::linearize_features(cache_location, ndata, inputs);
+      _search(ndata, lin_data, is_acceptable);
+      ams::ResourceManager::deallocate(lin_data, cache_location);
+    }
     DBG(UQModule, "Done with evalution of uq");
   }
 
 private:
+  template <typename T>
+  inline void _search(const size_t ndata, T *data, bool *is_acceptable) const
+  {
+    if (m_kdtree)
+      _kdEvaluate(ndata, data, is_acceptable);
+    else
+      _evaluate(ndata, data, is_acceptable);
+  }
+
+  //! ------------------------------------------------------------------------
+  //! KD-tree functionality, searched on the host
+  //! ------------------------------------------------------------------------
+  /** @brief Returns a host copy of 'n' values of device data, 'data' itself
+   * otherwise. Copies are released by releaseHost */
+  template <typename T>
+  inline T *toHost(const size_t n, T *data) const
+  {
+    if (cache_location != AMSResourceType::DEVICE) return data;
+    using U = std::remove_const_t<T>;
+    U *host = ams::ResourceManager::allocate<U>(n, AMSResourceType::HOST);
+    ams::ResourceManager::copy(const_cast<U *>(data), host, n * sizeof(T));
+    return host;
+  }
+
+  template <typename T>
+  inline void releaseHost(T *host) const
+  {
+    if (cache_location == AMSResourceType::DEVICE)
+      ams::ResourceManager::deallocate(const_cast<std::remove_const_t<T> *>(
+                                           host),
+                                       AMSResourceType::HOST);
+  }
+
+  template <typename T>
+  PERFFASPECT()
+  inline void _kdAdd(const size_t ndata, const T *data)
+  {
+    const T *points = toHost(ndata * m_dim, data);
+    m_kdtree->add(ndata, points);
+    releaseHost(points);
+  }
+
+  template <typename T>
+  PERFFASPECT()
+  void _kdEvaluate(const size_t ndata, T *data, bool *is_acceptable) const
+  {
+    const size_t knbrs = static_cast<size_t>(m_knbrs);
+    const T *points = toHost(ndata * m_dim, data);
+    bool *predicate = toHost(ndata, is_acceptable);
+
+    std::vector<TypeValue> kdists(ndata * knbrs);
+    m_kdtree->search(ndata, points, knbrs, kdists.data(), m_pool.get());
+    for (size_t i = 0; i < ndata; ++i) {
+      const TypeValue *dists = &kdists[i * knbrs];
+      // The distances are sorted, the last one is the furthest
+      const TypeValue dist = m_policy == AMSUQPolicy::FAISS_Max
+                                 ? dists[knbrs - 1]
+                                 : std::accumulate(dists,
+                                                   dists + knbrs,
+                                                   TypeValue(0)) /
+                                       TypeValue(knbrs);
+      predicate[i] = dist < acceptable_error;
+    }
+
+    if (predicate != is_acceptable)
+      ams::ResourceManager::copy(predicate,
+                                 is_acceptable,
+                                 ndata * sizeof(bool));
+    releaseHost(points);
+    releaseHost(predicate);
+  }
+
 #ifdef __ENABLE_FAISS__
   //! ------------------------------------------------------------------------
   //! core faiss functionality.
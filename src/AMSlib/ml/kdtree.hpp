@@ -0,0 +1,435 @@
+/*
+ * Copyright 2021-2023 Lawrence Livermore National Security, LLC and other
+ * AMSLib Project Developers
+ *
+ * SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+ */
+
+#ifndef __AMS_KDTREE_HPP__
+#define __AMS_KDTREE_HPP__
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "wf/debug.h"
+#include "wf/dims.hpp"
+#include "wf/thread_pool.hpp"
+
+//! ----------------------------------------------------------------------------
+//! An exact k-nearest neighbors index for low dimensional data
+//! ----------------------------------------------------------------------------
+/**
+ * @brief An implicit KD-tree returning the exact squared L2 distances of the
+ * k nearest neighbors, the distances of a FAISS flat index.
+ *
+ * The points are split at the median of the dimension of largest spread
+ * until at most 'leafSize' of them are left. The tree is implicit: node i has
+ * children 2i + 1 and 2i + 2 and covers a range of points fixed by the
+ * number of points, only the split dimension and value of the inner nodes
+ * are stored. The points are stored contiguously in the order of the leaves.
+ *
+ * Queries are searched in blocks: the queries of a block traverse the tree
+ * together, every one visiting its near child first, and the points of a
+ * leaf are loaded once for all the queries of the block reaching it. Queries
+ * sorted in Morton order share most of their path. Blocks are distributed
+ * over the threads of an optional ams::ThreadPool.
+ *
+ * File format (native endianness): char[8] "AMSKDTRE", uint32 version,
+ * uint32 dims, uint32 leafSize, uint32 valueSize (4 or 8), uint64 points,
+ * uint64 nodes, value points[points * dims], uint32 splitDim[nodes], value
+ * splitValue[nodes]. With nodes == 0 the points are in any order and the
+ * tree is built when loaded.
+ */
+template <typename TypeValue>
+class KDTree
+{
+  static_assert(std::is_floating_point<TypeValue>::value,
+                "KDTree supports floating-point values only!");
+
+  static constexpr size_t magicSize = 8;
+  static const char *magic() { return "AMSKDTRE"; }
+  static uint32_t version() { return 1; }
+
+  /** @brief Queries searched together */
+  static constexpr uint32_t blockSize = 64;
+
+  const uint32_t m_dim;
+  const uint32_t m_leaf_size;
+  std::vector<TypeValue> m_points;
+  std::vector<uint32_t> m_split_dim;
+  std::vector<TypeValue> m_split_value;
+  uint32_t m_levels = 0;
+
+public:
+  KDTree(uint32_t dims, uint32_t leafSize = 32)
+      : m_dim(dims), m_leaf_size(std::max(1u, leafSize))
+  {
+    if (dims == 0)
+      THROW(std::invalid_argument, "A KD-tree needs at least one dimension");
+  }
+
+  uint32_t dim() const { return m_dim; }
+  size_t size() const { return m_points.size() / m_dim; }
+
+  /** @brief Whether the file at 'path' is a KD-tree */
+  static bool isKDTree(const std::string &path)
+  {
+    std::ifstream fd(path, std::ios::binary);
+    char header[magicSize];
+    return fd.read(header, magicSize) &&
+           std::memcmp(header, magic(), magicSize) == 0;
+  }
+
+  static bool isKDTreeBytes(const std::string &bytes)
+  {
+    return bytes.size() >= magicSize &&
+           std::memcmp(bytes.data(), magic(), magicSize) == 0;
+  }
+
+  /** @brief Adds 'n' points (row major, dim() values each) and rebuilds the
+   * tree, O(N log N) in the total number of points */
+  template <typename T>
+  void add(size_t n, const T *points)
+  {
+    m_points.reserve(m_points.size() + n * m_dim);
+    for (size_t i = 0; i < n * m_dim; i++)
+      m_points.push_back(static_cast<TypeValue>(points[i]));
+    build();
+  }
+
+  /** @brief Writes in 'distances' the k smallest squared distances of each of
+   * the 'n' queries (row major) in increasing order. Missing neighbors, when
+   * the tree has less than k points, have the largest distance */
+  template <typename T>
+  void search(size_t n,
+              const T *queries,
+              size_t k,
+              TypeValue *distances,
+              ams::ThreadPool *pool = nullptr) const
+  {
+    if (n == 0 || k == 0) return;
+    const size_t blocks = (n + blockSize - 1) / blockSize;
+    auto block = [&](size_t b) {
+      const size_t start = b * blockSize;
+      const uint32_t count = std::min<size_t>(blockSize, n - start);
+      ams::dims::dispatch(m_dim, [&](auto extent) {
+        searchBlock(extent,
+                    count,
+                    queries + start * m_dim,
+                    k,
+                    distances + start * k);
+      });
+    };
+    if (pool && blocks > 1)
+      pool->parallelFor(blocks, block);
+    else
+      for (size_t b = 0; b < blocks; b++)
+        block(b);
+  }
+
+  std::string serialize() const
+  {
+    std::string bytes(magic(), magicSize);
+    auto put = [&](const void *src, size_t n) {
+      bytes.append(static_cast<const char *>(src), n);
+    };
+    const uint32_t header[4] = {
+        version(), m_dim, m_leaf_size, sizeof(TypeValue)};
+    const uint64_t counts[2] = {size(), m_split_dim.size()};
+    put(header, sizeof(header));
+    put(counts, sizeof(counts));
+    put(m_points.data(), m_points.size() * sizeof(TypeValue));
+    put(m_split_dim.data(), m_split_dim.size() * sizeof(uint32_t));
+    put(m_split_value.data(), m_split_value.size() * sizeof(TypeValue));
+    return bytes;
+  }
+
+  static std::unique_ptr<KDTree<TypeValue>> deserialize(
+      const std::string &bytes)
+  {
+    size_t offset = 0;
+    auto take = [&](void *dst, size_t n) {
+      if (offset + n > bytes.size())
+        THROW(std::runtime_error, "Truncated KD-tree");
+      std::memcpy(dst, bytes.data() + offset, n);
+      offset += n;
+    };
+    if (!isKDTreeBytes(bytes)) THROW(std::runtime_error, "Not a KD-tree");
+    offset = magicSize;
+    uint32_t header[4];
+    uint64_t counts[2];
+    take(header, sizeof(header));
+    take(counts, sizeof(counts));
+    if (header[0] > version())
+      THROW(std::runtime_error,
+            "Unsupported KD-tree version " + std::to_string(header[0]));
+    const uint32_t valueSize = header[3];
+    if (valueSize != sizeof(float) && valueSize != sizeof(double))
+      THROW(std::runtime_error,
+            "Invalid KD-tree value size " + std::to_string(valueSize));
+
+    auto tree = std::make_unique<KDTree<TypeValue>>(header[1], header[2]);
+    auto values = [&](std::vector<TypeValue> &dst, size_t n) {
+      dst.resize(n);
+      if (valueSize == sizeof(TypeValue)) {
+        take(dst.data(), n * sizeof(TypeValue));
+      } else if (valueSize == sizeof(float)) {
+        std::vector<float> tmp(n);
+        take(tmp.data(), n * sizeof(float));
+        std::copy(tmp.begin(), tmp.end(), dst.begin());
+      } else {
+        std::vector<double> tmp(n);
+        take(tmp.data(), n * sizeof(double));
+        std::copy(tmp.begin(), tmp.end(), dst.begin());
+      }
+    };
+    values(tree->m_points, counts[0] * header[1]);
+    if (counts[1] == 0) {
+      tree->build();
+      return tree;
+    }
+    tree->m_split_dim.resize(counts[1]);
+    take(tree->m_split_dim.data(), counts[1] * sizeof(uint32_t));
+    values(tree->m_split_value, counts[1]);
+    tree->m_levels = levels(tree->size(), tree->m_leaf_size);
+    if (counts[1] != (1ull << tree->m_levels) - 1)
+      THROW(std::runtime_error, "The KD-tree does not match its points");
+    for (uint32_t d : tree->m_split_dim)
+      if (d >= tree->m_dim) THROW(std::runtime_error, "Corrupted KD-tree");
+    return tree;
+  }
+
+  void save(const std::string &path) const
+  {
+    const std::string bytes = serialize();
+    std::ofstream fd(path, std::ios::binary | std::ios::trunc);
+    if (!fd) THROW(std::runtime_error, "Cannot open " + path);
+    fd.write(bytes.data(), bytes.size());
+    if (!fd) THROW(std::runtime_error, "Cannot write " + path);
+  }
+
+  static std::unique_ptr<KDTree<TypeValue>> load(const std::string &path)
+  {
+    std::ifstream fd(path, std::ios::binary);
+    if (!fd) THROW(std::runtime_error, "Cannot open KD-tree " + path);
+    const std::string bytes((std::istreambuf_iterator<char>(fd)),
+                            std::istreambuf_iterator<char>());
+    return deserialize(bytes);
+  }
+
+private:
+  /** @brief The number of levels of inner nodes over 'n' points */
+  static uint32_t levels(size_t n, uint32_t leafSize)
+  {
+    uint32_t l = 0;
+    for (; n > leafSize; n = (n + 1) / 2)
+      l++;
+    return l;
+  }
+
+  void build()
+  {
+    const size_t n = size();
+    m_levels = levels(n, m_leaf_size);
+    const size_t nodes = (size_t(1) << m_levels) - 1;
+    m_split_dim.assign(nodes, 0);
+    m_split_value.assign(nodes, 0);
+    std::vector<uint32_t> order(n);
+    std::iota(order.begin(), order.end(), 0);
+    buildNode(0, 0, n, order);
+
+    std::vector<TypeValue> sorted(m_points.size());
+    for (size_t i = 0; i < n; i++)
+      std::copy_n(&m_points[size_t(order[i]) * m_dim],
+                  m_dim,
+                  &sorted[i * m_dim]);
+    m_points.swap(sorted);
+    DBG(UQModule,
+        "Built KD-tree of %lu points, %u levels, leaves of at most %u",
+        n,
+        m_levels,
+        m_leaf_size);
+  }
+
+  void buildNode(size_t node,
+                 size_t lo,
+                 size_t hi,
+                 std::vector<uint32_t> &order)
+  {
+    if (hi - lo <= m_leaf_size) return;
+    // Split the dimension of largest spread at the median
+    uint32_t dim = 0;
+    TypeValue spread = -1;
+    for (uint32_t d = 0; d < m_dim; d++) {
+      TypeValue mn = std::numeric_limits<TypeValue>::max();
+      TypeValue mx = std::numeric_limits<TypeValue>::lowest();
+      for (size_t i = lo; i < hi; i++) {
+        const TypeValue v = m_points[size_t(order[i]) * m_dim + d];
+        mn = std::min(mn, v);
+        mx = std::max(mx, v);
+      }
+      if (mx - mn > spread) {
+        spread = mx - mn;
+        dim = d;
+      }
+    }
+    const size_t mid = lo + (hi - lo) / 2;
+    std::nth_element(order.begin() + lo,
+                     order.begin() + mid,
+                     order.begin() + hi,
+                     [&](uint32_t a, uint32_t b) {
+                       return m_points[size_t(a) * m_dim + dim] <
+                              m_points[size_t(b) * m_dim + dim];
+                     });
+    m_split_dim[node] = dim;
+    m_split_value[node] = m_points[size_t(order[mid]) * m_dim + dim];
+    buildNode(2 * node + 1, lo, mid, order);
+    buildNode(2 * node + 2, mid, hi, order);
+  }
+
+  /** @brief The state of the queries of a block. 'offset' is the per
+   * dimension distance of a query to the cell of the current node and
+   * 'bound' its squared norm, a lower bound of the distance to the points of
+   * the cell. Every level of the traversal owns a slice of the lists */
+  struct Block {
+    uint32_t count;
+    size_t k;
+    std::vector<TypeValue> queries;
+    std::vector<TypeValue> offset;
+    std::vector<TypeValue> bound;
+    TypeValue *best;
+    std::vector<uint32_t> lists;
+    std::vector<TypeValue> saved;
+
+    TypeValue kth(uint32_t q) const { return best[q * k + k - 1]; }
+
+    void insert(uint32_t q, TypeValue dist)
+    {
+      TypeValue *b = best + q * k;
+      size_t i = k - 1;
+      for (; i > 0 && b[i - 1] > dist; i--)
+        b[i] = b[i - 1];
+      b[i] = dist;
+    }
+  };
+
+  template <typename E, typename T>
+  void searchBlock(E extent,
+                   uint32_t count,
+                   const T *queries,
+                   size_t k,
+                   TypeValue *distances) const
+  {
+    Block block;
+    block.count = count;
+    block.k = k;
+    block.queries.assign(queries, queries + count * m_dim);
+    block.offset.assign(count * m_dim, 0);
+    block.bound.assign(count, 0);
+    block.best = distances;
+    std::fill(distances,
+              distances + count * k,
+              std::numeric_limits<TypeValue>::max());
+    block.lists.resize((m_levels + 1) * 2 * blockSize);
+    block.saved.resize((m_levels + 1) * 2 * blockSize);
+    if (size() == 0) return;
+
+    uint32_t *active = &block.lists[m_levels * 2 * blockSize];
+    for (uint32_t q = 0; q < count; q++)
+      active[q] = q;
+    visit(extent, block, 0, 0, size(), 0, active, count);
+  }
+
+  template <typename E>
+  void visit(E extent,
+             Block &block,
+             size_t node,
+             size_t lo,
+             size_t hi,
+             uint32_t level,
+             const uint32_t *active,
+             uint32_t nActive) const
+  {
+    const TypeValue *qv = block.queries.data();
+    if (hi - lo <= m_leaf_size) {
+      for (uint32_t a = 0; a < nActive; a++) {
+        const uint32_t q = active[a];
+        const TypeValue *x = qv + q * m_dim;
+        for (size_t p = lo; p < hi; p++) {
+          const TypeValue *y = &m_points[p * m_dim];
+          TypeValue dist = 0;
+          ams::dims::forEach(extent, [&](int d) {
+            const TypeValue diff = x[d] - y[d];
+            dist += diff * diff;
+          });
+          if (dist < block.kth(q)) block.insert(q, dist);
+        }
+      }
+      return;
+    }
+
+    const uint32_t dim = m_split_dim[node];
+    const TypeValue split = m_split_value[node];
+    const size_t mid = lo + (hi - lo) / 2;
+    uint32_t *left = &block.lists[level * 2 * blockSize];
+    uint32_t *right = left + blockSize;
+    uint32_t nLeft = 0, nRight = 0;
+    for (uint32_t a = 0; a < nActive; a++) {
+      const uint32_t q = active[a];
+      if (!(block.bound[q] < block.kth(q))) continue;
+      if (qv[q * m_dim + dim] < split)
+        left[nLeft++] = q;
+      else
+        right[nRight++] = q;
+    }
+
+    // Every query visits its near child first
+    if (nLeft)
+      visit(extent, block, 2 * node + 1, lo, mid, level + 1, left, nLeft);
+    if (nRight)
+      visit(extent, block, 2 * node + 2, mid, hi, level + 1, right, nRight);
+
+    // Then the far one, unless the distance to its cell exceeds the current
+    // k-th neighbor. The lists of this level are filtered in place.
+    auto far = [&](uint32_t *list,
+                   uint32_t n,
+                   size_t child,
+                   size_t clo,
+                   size_t chi) {
+      TypeValue *saved = &block.saved[level * 2 * blockSize];
+      uint32_t kept = 0;
+      for (uint32_t a = 0; a < n; a++) {
+        const uint32_t q = list[a];
+        const TypeValue diff = qv[q * m_dim + dim] - split;
+        TypeValue &off = block.offset[q * m_dim + dim];
+        const TypeValue bound = block.bound[q] - off * off + diff * diff;
+        if (!(bound < block.kth(q))) continue;
+        saved[2 * kept] = off;
+        saved[2 * kept + 1] = block.bound[q];
+        off = diff;
+        block.bound[q] = bound;
+        list[kept++] = q;
+      }
+      if (kept) visit(extent, block, child, clo, chi, level + 1, list, kept);
+      for (uint32_t a = 0; a < kept; a++) {
+        const uint32_t q = list[a];
+        block.offset[q * m_dim + dim] = saved[2 * a];
+        block.bound[q] = saved[2 * a + 1];
+      }
+    };
+    far(left, nLeft, 2 * node + 2, mid, hi);
+    far(right, nRight, 2 * node + 1, lo, mid);
+  }
+};
+
+#endif
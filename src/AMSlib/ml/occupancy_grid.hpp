@@ -0,0 +1,423 @@
+/*
+ * Copyright 2021-2023 Lawrence Livermore National Security, LLC and other
+ * AMSLib Project Developers
+ *
+ * SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+ */
+
+#ifndef __AMS_OCCUPANCY_GRID_HPP__
+#define __AMS_OCCUPANCY_GRID_HPP__
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include "AMS.h"
+#include "wf/debug.h"
+#include "wf/dims.hpp"
+#include "wf/resource_manager.hpp"
+
+//! ----------------------------------------------------------------------------
+//! A multi-resolution occupancy grid over the normalized input space
+//! ----------------------------------------------------------------------------
+/**
+ * @brief Records the cells of a regular grid holding training points, at
+ * several resolutions.
+ *
+ * Inputs are normalized to [0, 1] with the bounds of the training data and a
+ * level of 'bits' bits splits every dimension in 2^bits cells. A point is in
+ * distribution when its cell holds at least 'minCount' training points. The
+ * UQ threshold is the size of the neighborhood, in normalized units, the
+ * finest level whose cells are at least that wide answers the queries (0
+ * selects the finest level). Points outside the bounds are rejected.
+ *
+ * A query is one array lookup (or one hash probe when the level has more than
+ * 2^24 cells) per point, independent of the number of training points.
+ *
+ * File format (native endianness, written by ams.occupancy as well):
+ *   char[8] "AMSOGRID", uint32 version, uint32 dims, uint32 levels,
+ *   uint32 minCount, double lo[dims], double hi[dims], then per level:
+ *   uint32 bits, uint64 cells, uint64 keys[cells] (sorted), uint32
+ *   counts[cells]. The key of a cell is sum_d q_d << (bits * d).
+ */
+template <typename TypeInValue>
+class OccupancyGrid
+{
+  static_assert(std::is_floating_point<TypeInValue>::value,
+                "OccupancyGrid supports floating-point values (floats, "
+                "doubles, and long doubles) only!");
+
+  static constexpr size_t magicSize = 8;
+  static const char *magic() { return "AMSOGRID"; }
+  static uint32_t version() { return 1; }
+
+  /** @brief Levels with at most that many cells are dense arrays */
+  static constexpr uint64_t maxDenseCells = 1ull << 24;
+  static constexpr uint64_t emptyKey = std::numeric_limits<uint64_t>::max();
+
+  struct Level {
+    uint32_t bits;
+    std::unordered_map<uint64_t, uint32_t> counts;
+  };
+
+  const int m_dim;
+  std::vector<double> m_lo;
+  std::vector<double> m_hi;
+  std::vector<Level> m_levels;
+  uint32_t m_min_count;
+
+  AMSResourceType m_location = AMSResourceType::HOST;
+
+  // The level answering the queries and its lookup structure: a flag per
+  // cell or an open addressing hash set of the accepted cells
+  int m_active = -1;
+  std::vector<uint8_t> m_dense;
+  std::vector<uint64_t> m_hashed;
+
+public:
+  /** @brief An empty grid over the box [lo, hi] with a level per entry of
+   * 'bits', points are added with add */
+  OccupancyGrid(std::vector<double> lo,
+                std::vector<double> hi,
+                const std::vector<uint32_t> &bits,
+                uint32_t minCount = 1)
+      : m_dim(lo.size()),
+        m_lo(std::move(lo)),
+        m_hi(std::move(hi)),
+        m_min_count(std::max(1u, minCount))
+  {
+    if (m_dim == 0 || m_hi.size() != static_cast<size_t>(m_dim))
+      THROW(std::invalid_argument, "Invalid bounds of the occupancy grid");
+    for (uint32_t b : bits) {
+      // b > 63 / m_dim rather than b * m_dim > 63, bits read from a file
+      // must not wrap around
+      if (b == 0 || b > 63u / static_cast<uint32_t>(m_dim))
+        THROW(std::invalid_argument,
+              "An occupancy grid level of " + std::to_string(b) +
+                  " bits does not fit a 63 bit key in " +
+                  std::to_string(m_dim) + " dimensions");
+      m_levels.push_back({b, {}});
+    }
+    std::sort(m_levels.begin(),
+              m_levels.end(),
+              [](const Level &a, const Level &b) { return a.bits < b.bits; });
+  }
+
+  static std::shared_ptr<OccupancyGrid<TypeInValue>> load(
+      const std::string &path,
+      AMSResourceType resource,
+      TypeInValue threshold)
+  {
+    std::ifstream fd(path, std::ios::binary);
+    if (!fd) THROW(std::runtime_error, "Cannot open occupancy grid " + path);
+    const std::string data((std::istreambuf_iterator<char>(fd)),
+                           std::istreambuf_iterator<char>());
+    size_t offset = 0;
+    // Sizes read from the file are checked against the remaining bytes
+    // before allocating, a corrupted size must not request arbitrary memory
+    auto fits = [&](uint64_t count, size_t size) {
+      if (count > (data.size() - offset) / size)
+        THROW(std::runtime_error, "Truncated occupancy grid " + path);
+    };
+    auto take = [&](void *dst, size_t n) {
+      if (n > data.size() - offset)
+        THROW(std::runtime_error, "Truncated occupancy grid " + path);
+      std::memcpy(dst, data.data() + offset, n);
+      offset += n;
+    };
+
+    char header[magicSize];
+    take(header, magicSize);
+    if (std::memcmp(header, magic(), magicSize) != 0)
+      THROW(std::runtime_error, path + " is not an occupancy grid");
+    uint32_t fileVersion, dims, levels, minCount;
+    take(&fileVersion, sizeof(fileVersion));
+    if (fileVersion > version())
+      THROW(std::runtime_error,
+            "Unsupported occupancy grid version " +
+                std::to_string(fileVersion));
+    take(&dims, sizeof(dims));
+    take(&levels, sizeof(levels));
+    take(&minCount, sizeof(minCount));
+    fits(dims, 2 * sizeof(double));
+    std::vector<double> lo(dims), hi(dims);
+    take(lo.data(), dims * sizeof(double));
+    take(hi.data(), dims * sizeof(double));
+
+    fits(levels, sizeof(uint32_t) + sizeof(uint64_t));
+    std::vector<uint32_t> bits(levels);
+    std::vector<std::vector<uint64_t>> keys(levels);
+    std::vector<std::vector<uint32_t>> counts(levels);
+    for (uint32_t l = 0; l < levels; l++) {
+      uint64_t cells;
+      take(&bits[l], sizeof(uint32_t));
+      take(&cells, sizeof(cells));
+      fits(cells, sizeof(uint64_t) + sizeof(uint32_t));
+      keys[l].resize(cells);
+      counts[l].resize(cells);
+      take(keys[l].data(), cells * sizeof(uint64_t));
+      take(counts[l].data(), cells * sizeof(uint32_t));
+    }
+
+    auto grid = std::make_shared<OccupancyGrid<TypeInValue>>(
+        std::move(lo), std::move(hi), bits, minCount);
+    for (uint32_t l = 0; l < levels; l++) {
+      Level &level = grid->levelOf(bits[l]);
+      // Keys index the dense levels, a corrupted one must not reach select
+      const uint64_t cells = 1ull << (bits[l] * dims);
+      level.counts.reserve(keys[l].size());
+      for (size_t c = 0; c < keys[l].size(); c++) {
+        if (keys[l][c] >= cells)
+          THROW(std::runtime_error,
+                "Invalid cell " + std::to_string(keys[l][c]) + " of level " +
+                    std::to_string(bits[l]) + " in occupancy grid " + path);
+        level.counts[keys[l][c]] += counts[l][c];
+      }
+    }
+    grid->m_location = resource;
+    grid->select(threshold);
+    DBG(UQModule,
+        "Loaded occupancy grid %s (%d dims, %u levels, %u bits active)",
+        path.c_str(),
+        grid->m_dim,
+        levels,
+        grid->m_levels[grid->m_active].bits);
+    return grid;
+  }
+
+  void save(const std::string &path) const
+  {
+    std::ofstream fd(path, std::ios::binary | std::ios::trunc);
+    if (!fd) THROW(std::runtime_error, "Cannot open " + path);
+    auto put = [&](const void *src, size_t n) {
+      fd.write(static_cast<const char *>(src), n);
+    };
+    const uint32_t dims = m_dim, levels = m_levels.size();
+    put(magic(), magicSize);
+    const uint32_t v = version();
+    put(&v, sizeof(v));
+    put(&dims, sizeof(dims));
+    put(&levels, sizeof(levels));
+    put(&m_min_count, sizeof(m_min_count));
+    put(m_lo.data(), dims * sizeof(double));
+    put(m_hi.data(), dims * sizeof(double));
+    for (const Level &level : m_levels) {
+      std::vector<std::pair<uint64_t, uint32_t>> cells(level.counts.begin(),
+                                                       level.counts.end());
+      std::sort(cells.begin(), cells.end());
+      const uint64_t n = cells.size();
+      put(&level.bits, sizeof(level.bits));
+      put(&n, sizeof(n));
+      for (const auto &c : cells)
+        put(&c.first, sizeof(uint64_t));
+      for (const auto &c : cells)
+        put(&c.second, sizeof(uint32_t));
+    }
+    if (!fd) THROW(std::runtime_error, "Cannot write " + path);
+  }
+
+  int dim() const { return m_dim; }
+
+  /** @brief Counts the host points inside the bounds in every level. The
+   * active level is rebuilt when one was selected */
+  void add(const size_t n, const std::vector<const TypeInValue *> &features)
+  {
+    checkDims(features);
+    for (Level &level : m_levels)
+      for (size_t i = 0; i < n; i++) {
+        uint64_t key;
+        if (cellOf(features, i, level.bits, key)) {
+          uint32_t &c = level.counts[key];
+          if (c != std::numeric_limits<uint32_t>::max()) c++;
+        }
+      }
+    if (m_active >= 0) activate(m_active);
+  }
+
+  /** @brief Selects the finest level whose cells are at least 'threshold'
+   * wide in normalized units, the coarsest one when none is */
+  void select(TypeInValue threshold)
+  {
+    if (m_levels.empty())
+      THROW(std::runtime_error, "The occupancy grid has no level");
+    int active = 0;
+    for (size_t l = 0; l < m_levels.size(); l++)
+      if (std::ldexp(1.0, -static_cast<int>(m_levels[l].bits)) >=
+          static_cast<double>(threshold))
+        active = l;
+    activate(active);
+  }
+
+  /** @brief Sets is_acceptable[i] when the cell of point i holds at least
+   * minCount training points */
+  PERFFASPECT()
+  void evaluate(const size_t n,
+                const std::vector<const TypeInValue *> &features,
+                bool *is_acceptable) const
+  {
+    checkDims(features);
+    if (m_active < 0)
+      THROW(std::runtime_error, "No occupancy grid level was selected");
+
+    if (m_location == AMSResourceType::DEVICE) {
+      // The lookups are memory bound and the grid lives on the host, the
+      // features are brought to the host once and the predicate sent back
+      std::vector<TypeInValue *> hFeatures;
+      for (const TypeInValue *f : features) {
+        hFeatures.push_back(ams::ResourceManager::allocate<TypeInValue>(
+            n, AMSResourceType::HOST));
+        ams::ResourceManager::copy(const_cast<TypeInValue *>(f),
+                                   hFeatures.back(),
+                                   n * sizeof(TypeInValue));
+      }
+      bool *hAcceptable =
+          ams::ResourceManager::allocate<bool>(n, AMSResourceType::HOST);
+      lookup(n,
+             std::vector<const TypeInValue *>(hFeatures.begin(),
+                                              hFeatures.end()),
+             hAcceptable);
+      ams::ResourceManager::copy(hAcceptable, is_acceptable, n * sizeof(bool));
+      ams::ResourceManager::deallocate(hAcceptable, AMSResourceType::HOST);
+      ams::ResourceManager::deallocate(hFeatures, AMSResourceType::HOST);
+      return;
+    }
+    lookup(n, features, is_acceptable);
+  }
+
+private:
+  Level &levelOf(uint32_t bits)
+  {
+    for (Level &level : m_levels)
+      if (level.bits == bits) return level;
+    THROW(std::runtime_error,
+          "The occupancy grid has no level of " + std::to_string(bits) +
+              " bits");
+  }
+
+  void checkDims(const std::vector<const TypeInValue *> &features) const
+  {
+    if (features.size() != static_cast<size_t>(m_dim))
+      THROW(std::invalid_argument,
+            "The occupancy grid has " + std::to_string(m_dim) +
+                " dimensions, got " + std::to_string(features.size()));
+  }
+
+  /** @brief The key of the cell of point i, false outside the bounds */
+  bool cellOf(const std::vector<const TypeInValue *> &features,
+              size_t i,
+              uint32_t bits,
+              uint64_t &key) const
+  {
+    const uint64_t last = (1ull << bits) - 1;
+    key = 0;
+    for (int d = 0; d < m_dim; d++) {
+      const double x = features[d][i];
+      if (!(x >= m_lo[d] && x <= m_hi[d])) return false;
+      const uint64_t q = std::min<uint64_t>(
+          static_cast<uint64_t>((x - m_lo[d]) * scaleOf(d, bits)), last);
+      key |= q << (bits * d);
+    }
+    return true;
+  }
+
+  /** @brief Cells per unit of dimension d, the builders of the grid compute
+   * the cells with the same floating point operations */
+  double scaleOf(int d, uint32_t bits) const
+  {
+    return m_hi[d] > m_lo[d] ? std::ldexp(1.0, bits) / (m_hi[d] - m_lo[d])
+                             : 0.0;
+  }
+
+  static uint64_t hash(uint64_t key)
+  {
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdull;
+    key ^= key >> 33;
+    return key;
+  }
+
+  /** @brief Builds the lookup structure of the accepted cells of a level */
+  void activate(int l)
+  {
+    m_active = l;
+    const Level &level = m_levels[l];
+    const uint64_t cells = 1ull << (level.bits * m_dim);
+    m_dense.clear();
+    m_hashed.clear();
+    if (cells <= maxDenseCells) {
+      m_dense.assign(cells, 0);
+      for (const auto &c : level.counts)
+        m_dense[c.first] = c.second >= m_min_count;
+      return;
+    }
+    // Linear probing at a load factor of at most one half
+    size_t capacity = 16;
+    while (capacity < 2 * level.counts.size())
+      capacity <<= 1;
+    m_hashed.assign(capacity, static_cast<uint64_t>(emptyKey));
+    for (const auto &c : level.counts) {
+      if (c.second < m_min_count) continue;
+      size_t slot = hash(c.first) & (capacity - 1);
+      while (m_hashed[slot] != emptyKey)
+        slot = (slot + 1) & (capacity - 1);
+      m_hashed[slot] = c.first;
+    }
+  }
+
+  bool contains(uint64_t key) const
+  {
+    const size_t mask = m_hashed.size() - 1;
+    for (size_t slot = hash(key) & mask;; slot = (slot + 1) & mask) {
+      if (m_hashed[slot] == key) return true;
+      if (m_hashed[slot] == emptyKey) return false;
+    }
+  }
+
+  /** @brief The lookups of the active level. Keys are computed branch free
+   * over the unrolled dimensions, the cells of points outside the bounds
+   * (and NaNs) are clamped to the grid and the points masked out */
+  void lookup(const size_t n,
+              const std::vector<const TypeInValue *> &features,
+              bool *is_acceptable) const
+  {
+    const uint32_t bits = m_levels[m_active].bits;
+    const double last = static_cast<double>((1ull << bits) - 1);
+    std::vector<double> scale(m_dim);
+    for (int d = 0; d < m_dim; d++)
+      scale[d] = scaleOf(d, bits);
+    const TypeInValue *const *f = features.data();
+    const double *lo = m_lo.data();
+    const double *hi = m_hi.data();
+
+    ams::dims::dispatch(m_dim, [&](auto extent) {
+      for (size_t i = 0; i < n; i++) {
+        uint64_t key = 0;
+        bool inside = true;
+        ams::dims::forEach(extent, [&](int d) {
+          const double x = f[d][i];
+          inside &= (x >= lo[d]) & (x <= hi[d]);
+          double u = (x - lo[d]) * scale[d];
+          u = u > 0.0 ? u : 0.0;
+          u = u < last ? u : last;
+          key |= static_cast<uint64_t>(u) << (bits * d);
+        });
+        if (!m_dense.empty())
+          is_acceptable[i] = inside & (m_dense[key] != 0);
+        else
+          is_acceptable[i] = inside && contains(key);
+      }
+    });
+  }
+};
+
+#endif
@@ -8,10 +8,12 @@
 #ifndef __AMS_SURROGATE_HPP__
 #define __AMS_SURROGATE_HPP__
 
+#include <cmath>
 #include <memory>
 #include <stdexcept>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 #ifdef __ENABLE_TORCH__
 #include <ATen/core/interned_strings.h>
@@ -41,6 +43,12 @@ private:
   AMSResourceType model_resource;
   const bool _is_DeltaUQ;
 
+  /** @brief Affine transforms (x * scale + offset) of every input feature,
+   * applied while marshaling the inputs to the model, and of every output,
+   * applied while scattering the outputs back. Empty vectors disable them */
+  std::vector<TypeInValue> inScale, inOffset;
+  std::vector<TypeInValue> outScale, outOffset, outStdevScale;
+
 #ifdef __ENABLE_TORCH__
   // -------------------------------------------------------------------------
   // variables to store the torch model
@@ -48,6 +56,38 @@ private:
   torch::jit::script::Module module;
   c10::TensorOptions tensorOptions;
 
+  // The transforms as {1, features} tensors on the device of the model
+  at::Tensor inScaleT, inOffsetT, outScaleT, outOffsetT, outStdevScaleT;
+
+  inline at::Tensor toTensor(const std::vector<TypeInValue>& v)
+  {
+    if (v.empty()) return at::Tensor();
+    return torch::from_blob(const_cast<TypeInValue*>(v.data()),
+                            {1, static_cast<long>(v.size())},
+                            tensorOptions.device(torch::kCPU))
+        .to(tensorOptions.device());
+  }
+
+  inline void updateTransformTensors()
+  {
+    inScaleT = toTensor(inScale);
+    inOffsetT = toTensor(inOffset);
+    outScaleT = toTensor(outScale);
+    outOffsetT = toTensor(outOffset);
+    outStdevScaleT = toTensor(outStdevScale);
+  }
+
+  /** @brief Reads a per-feature vector attribute of the module, if any */
+  inline std::vector<double> moduleVector(const char* name)
+  {
+    std::vector<double> values;
+    if (!module.hasattr(name)) return values;
+    at::Tensor t = module.attr(name).toTensor().to(torch::kCPU, torch::kFloat64);
+    t = t.contiguous().view(-1);
+    values.assign(t.data_ptr<double>(), t.data_ptr<double>() + t.numel());
+    return values;
+  }
+
 
   // -------------------------------------------------------------------------
   // conversion to and from torch
@@ -72,6 +112,19 @@ private:
                                   long numCols,
                                   const TypeInValue** array)
   {
+    // On the host the features are transposed (and normalized) in a single
+    // pass over the data, directly in the input tensor of the model
+    if (model_resource == AMSResourceType::HOST) {
+      at::Tensor tensor = torch::empty({numRows, numCols}, tensorOptions);
+      data_handler::linearize_features(
+          numRows,
+          std::vector<const TypeInValue*>(array, array + numCols),
+          tensor.data_ptr<TypeInValue>(),
+          inScale.empty() ? nullptr : inScale.data(),
+          inOffset.empty() ? nullptr : inOffset.data());
+      return tensor;
+    }
+
     c10::SmallVector<at::Tensor, 8> Tensors;
     for (int i = 0; i < numCols; i++) {
       Tensors.push_back(torch::from_blob((TypeInValue*)array[i],
@@ -79,6 +132,7 @@ private:
                                          tensorOptions));
     }
     at::Tensor tensor = at::reshape(at::cat(Tensors, 1), {numRows, numCols});
+    if (!inScale.empty()) tensor.mul_(inScaleT).add_(inOffsetT);
     return tensor;
   }
 
@@ -88,6 +142,21 @@ private:
                             long numCols,
                             TypeInValue** array)
   {
+    // On the host the outputs are scattered (and de-normalized) in a single
+    // pass over the row-major output of the model
+    if (model_resource == AMSResourceType::HOST) {
+      tensor = tensor.contiguous();
+      std::vector<TypeInValue*> columns(array, array + numCols);
+      data_handler::delinearize_features(
+          numRows,
+          tensor.data_ptr<TypeInValue>(),
+          columns,
+          outScale.empty() ? nullptr : outScale.data(),
+          outOffset.empty() ? nullptr : outOffset.data());
+      return;
+    }
+    if (!outScale.empty()) tensor.mul_(outScaleT).add_(outOffsetT);
+
     // Transpose to get continuous memory and
     // perform single memcpy.
     tensor = tensor.transpose(1, 0);
@@ -112,6 +181,19 @@ private:
                                 long numCols,
                                 TypeInValue** array)
   {
+    // The standard deviation of the outputs only scales
+    if (model_resource == AMSResourceType::HOST) {
+      tensor = tensor.contiguous();
+      std::vector<TypeInValue*> columns(array, array + numCols);
+      data_handler::delinearize_features(
+          numRows,
+          tensor.data_ptr<TypeInValue>(),
+          columns,
+          outStdevScale.empty() ? nullptr : outStdevScale.data());
+      return;
+    }
+    if (!outStdevScale.empty()) tensor.mul_(outStdevScaleT);
+
     // Transpose to get continuous memory and
     // perform single memcpy.
     tensor = tensor.transpose(1, 0);
@@ -145,6 +227,17 @@ private:
       tensorOptions =
           torch::TensorOptions().dtype(dType).device(device).requires_grad(
               false);
+      // Standardization stored with the model by the training scripts
+      auto iScale = moduleVector("ams_input_scale");
+      auto iOffset = moduleVector("ams_input_offset");
+      auto oScale = moduleVector("ams_output_scale");
+      auto oOffset = moduleVector("ams_output_offset");
+      setNormalization(iScale.size(),
+                       iScale.empty() ? nullptr : iScale.data(),
+                       iOffset.empty() ? nullptr : iOffset.data(),
+                       oScale.size(),
+                       oScale.empty() ? nullptr : oScale.data(),
+                       oOffset.empty() ? nullptr : oOffset.data());
     } catch (const c10::Error& e) {
       FATAL("Error loding torch model:%s", model_path.c_str())
     }
@@ -183,6 +276,11 @@ private:
   {
     //torch::NoGradGuard no_grad;
     c10::InferenceMode guard(true);
+    CFATAL(Surrogate,
+           (!inScale.empty() && inScale.size() != num_in) ||
+               (!outScale.empty() && outScale.size() != num_out),
+           "The normalization of %s does not match its dimensions",
+           model_path.c_str());
     auto input = arrayToTensor(num_elements, num_in, inputs);
     input.set_requires_grad(false);
     if (_is_DeltaUQ) {
@@ -374,6 +472,52 @@ public:
   }
 
   bool is_DeltaUQ() { return _is_DeltaUQ; }
+
+  /**
+   * @brief Sets the standardization of the features of the model, fused with
+   * the marshaling of the data. The model evaluates (x - inOffset) / inScale
+   * and its outputs y are returned as y * outScale + outOffset. A null scale
+   * disables the respective transform, a null offset is 0. The normalization
+   * belongs to the model, it is shared by the executors using it.
+   */
+  void setNormalization(size_t numIn,
+                        const double* inputScale,
+                        const double* inputOffset,
+                        size_t numOut,
+                        const double* outputScale,
+                        const double* outputOffset)
+  {
+    inScale.clear();
+    inOffset.clear();
+    outScale.clear();
+    outOffset.clear();
+    outStdevScale.clear();
+    if (inputScale) {
+      for (size_t i = 0; i < numIn; i++) {
+        if (inputScale[i] == 0)
+          THROW(std::invalid_argument, "Input scales must not be zero");
+        const double offset = inputOffset ? inputOffset[i] : 0.0;
+        inScale.push_back(1.0 / inputScale[i]);
+        inOffset.push_back(-offset / inputScale[i]);
+      }
+    }
+    if (outputScale) {
+      for (size_t i = 0; i < numOut; i++) {
+        outScale.push_back(outputScale[i]);
+        outOffset.push_back(outputOffset ? outputOffset[i] : 0.0);
+        outStdevScale.push_back(std::abs(outputScale[i]));
+      }
+    }
+#ifdef __ENABLE_TORCH__
+    updateTransformTensors();
+#endif
+    CINFO(Surrogate,
+          inputScale || outputScale,
+          "Normalizing %ld inputs and %ld outputs of %s",
+          inScale.size(),
+          outScale.size(),
+          model_path.c_str());
+  }
 };
 
 template <typename T>
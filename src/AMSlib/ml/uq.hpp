@@ -13,8 +13,11 @@
 
 #include "AMS.h"
 #include "ml/hdcache.hpp"
+#include "ml/occupancy_grid.hpp"
 #include "ml/random_uq.hpp"
 #include "ml/surrogate.hpp"
+#include "wf/dims.hpp"
+#include "wf/state.hpp"
 #include "wf/resource_manager.hpp"
 
 static inline bool isNullOrEmpty(const char *p) {
@@ -60,6 +63,14 @@ public:
 
     if (uqPolicy == AMSUQPolicy::RandomUQ)
       randomUQ = std::make_unique<RandomUQ>(resourceLocation, threshold);
+
+    if (uqPolicy == AMSUQPolicy::OccupancyGrid) {
+      if (isNullOrEmpty(uqPath))
+        THROW(std::runtime_error, "Missing file path to an occupancy grid");
+
+      grid = OccupancyGrid<FPTypeValue>::load(
+          uqPath, resourceLocation, threshold);
+    }
   }
 
   PERFFASPECT()
@@ -85,26 +96,28 @@ public:
       surrogate->evaluate(totalElements, inputs, outputs, outputs_stdev);
       CALIPER(CALI_MARK_END("SURROGATE");)
 
+      const FPTypeValue *const *stdev = outputs_stdev.data();
       if (uqPolicy == AMSUQPolicy::DeltaUQ_Mean) {
-        for (size_t i = 0; i < totalElements; ++i) {
-          // Use double for increased precision, range in the calculation
-          double mean = 0.0;
-          for (size_t dim = 0; dim < ndims; ++dim)
-            mean += outputs_stdev[dim][i];
-          mean /= ndims;
-          p_ml_acceptable[i] = (mean < threshold);
-        }
+        ams::dims::dispatch(ndims, [&](auto extent) {
+          for (size_t i = 0; i < totalElements; ++i) {
+            // Use double for increased precision, range in the calculation
+            double mean = 0.0;
+            ams::dims::forEach(extent, [&](int dim) { mean += stdev[dim][i]; });
+            mean /= extent.size();
+            p_ml_acceptable[i] = (mean < threshold);
+          }
+        });
       } else if (uqPolicy == AMSUQPolicy::DeltaUQ_Max) {
-        for (size_t i = 0; i < totalElements; ++i) {
-          bool is_acceptable = true;
-          for (size_t dim = 0; dim < ndims; ++dim)
-            if (outputs_stdev[dim][i] >= threshold) {
-              is_acceptable = false;
-              break;
-            }
-
-          p_ml_acceptable[i] = is_acceptable;
-        }
+        // No early exit, a branch-free reduction over the unrolled dimensions
+        ams::dims::dispatch(ndims, [&](auto extent) {
+          for (size_t i = 0; i < totalElements; ++i) {
+            bool is_acceptable = true;
+            ams::dims::forEach(extent, [&](int dim) {
+              is_acceptable &= !(stdev[dim][i] >= threshold);
+            });
+            p_ml_acceptable[i] = is_acceptable;
+          }
+        });
       } else {
         THROW(std::runtime_error, "Invalid UQ policy");
       }
@@ -119,6 +132,15 @@ public:
       hdcache->evaluate(totalElements, inputs, p_ml_acceptable);
       CALIPER(CALI_MARK_END("HDCACHE");)
 
+      CALIPER(CALI_MARK_BEGIN("SURROGATE");)
+      DBG(Workflow, "Model exists, I am calling surrogate (for all data)");
+      surrogate->evaluate(totalElements, inputs, outputs);
+      CALIPER(CALI_MARK_END("SURROGATE");)
+    } else if (uqPolicy == AMSUQPolicy::OccupancyGrid) {
+      CALIPER(CALI_MARK_BEGIN("OCCUPANCY_GRID");)
+      grid->evaluate(totalElements, inputs, p_ml_acceptable);
+      CALIPER(CALI_MARK_END("OCCUPANCY_GRID");)
+
       CALIPER(CALI_MARK_BEGIN("SURROGATE");)
       DBG(Workflow, "Model exists, I am calling surrogate (for all data)");
       surrogate->evaluate(totalElements, inputs, outputs);
@@ -135,11 +157,95 @@ public:
 
   bool hasSurrogate() { return (surrogate ? true : false); }
 
+  /** @brief Sets the standardization of the features of the surrogate, see
+   * SurrogateModel::setNormalization */
+  void setNormalization(size_t numIn,
+                        const double *inputScale,
+                        const double *inputOffset,
+                        size_t numOut,
+                        const double *outputScale,
+                        const double *outputOffset)
+  {
+    surrogate->setNormalization(
+        numIn, inputScale, inputOffset, numOut, outputScale, outputOffset);
+  }
+
+  /** @brief Searches the HDCache in the Morton order of the inputs for calls
+   * of at least 'minElements' points */
+  void setReorder(size_t minElements)
+  {
+    if (hdcache) hdcache->setReorder(minElements);
+  }
+
+  /** @brief Searches KD-tree HDCaches with 'numThreads' threads */
+  void setThreads(int numThreads)
+  {
+    if (hdcache) hdcache->setThreads(numThreads);
+  }
+
+  /** @brief Whether this module and 'other' search the same HDCache */
+  bool sharesHDCache(const UQ &other) const
+  {
+    return hdcache && hdcache == other.hdcache;
+  }
+
+  /** @brief Adds the UQ sections to an executor state snapshot, under
+   * 'uqTag' and 'cacheTag'. The HDCache is skipped when 'withCache' is false,
+   * e.g. a cache shared with a module that saves it already */
+  void saveState(ams::AMSState &state,
+                 ams::AMSStateSection uqTag = ams::AMSStateSection::UQ,
+                 ams::AMSStateSection cacheTag = ams::AMSStateSection::HDCache,
+                 bool withCache = true) const
+  {
+    ams::StateBuffer buffer;
+    buffer.put(static_cast<int32_t>(uqPolicy));
+    buffer.put(static_cast<double>(threshold));
+    state.set(uqTag, std::move(buffer));
+
+    if (withCache && hdcache && hdcache->modified()) {
+      ams::StateBuffer index;
+      index.putBytes(hdcache->serialize());
+      state.set(cacheTag, std::move(index));
+    }
+  }
+
+  /** @brief Restores the UQ state of a snapshot saved under 'uqTag' and
+   * 'cacheTag'. The configuration of the executor is authoritative, snapshots
+   * of another policy are rejected */
+  void loadState(const ams::AMSState &state,
+                 ams::AMSStateSection uqTag = ams::AMSStateSection::UQ,
+                 ams::AMSStateSection cacheTag = ams::AMSStateSection::HDCache)
+  {
+    if (const std::string *section = state.get(uqTag)) {
+      ams::StateView view(*section);
+      const auto policy = static_cast<AMSUQPolicy>(view.get<int32_t>());
+      const double savedThreshold = view.get<double>();
+      if (policy != uqPolicy)
+        THROW(std::runtime_error,
+              "The executor state was saved with a different UQ policy");
+      CWARNING(UQModule,
+               savedThreshold != static_cast<double>(threshold),
+               "The executor state was saved with threshold %f, using the "
+               "configured one (%f)",
+               savedThreshold,
+               static_cast<double>(threshold));
+    }
+
+    if (const std::string *section = state.get(cacheTag)) {
+      if (!hdcache)
+        THROW(std::runtime_error,
+              "The executor state holds an HDCache but the executor has none");
+      ams::StateView view(*section);
+      hdcache->deserialize(view.getBytes());
+    }
+  }
+
 private:
   AMSUQPolicy uqPolicy;
   FPTypeValue threshold;
   std::unique_ptr<RandomUQ> randomUQ;
   std::shared_ptr<HDCache<FPTypeValue>> hdcache;
+  std::shared_ptr<OccupancyGrid<FPTypeValue>> grid;
   std::shared_ptr<SurrogateModel<FPTypeValue>> surrogate;
 };
 
@@ -25,6 +25,7 @@
 #include "resource_manager.hpp"
 #include "wf/debug.h"
 #include "wf/device.hpp"
+#include "wf/dims.hpp"
 #include "wf/resource_manager.hpp"
 #include "wf/utils.hpp"
 
@@ -889,18 +890,23 @@ public:
     size_t offset = 0;
     size_t x_dim = _input_dim + _output_dim;
     if (!data_blob) return 0;
-    // Creating the body part of the messages
-    for (size_t i = 0; i < _num_elements; i++) {
-      for (size_t j = 0; j < _input_dim; j++) {
-        data_blob[i * x_dim + j] = inputs[j][i];
+    // Creating the body part of the messages, every row holds the inputs
+    // followed by the outputs. Both loops are unrolled over the dimensions.
+    TypeValue* const* in = inputs.data();
+    ams::dims::dispatch(_input_dim, [&](auto extent) {
+      for (size_t i = 0; i < _num_elements; i++) {
+        TypeValue* row = &data_blob[i * x_dim];
+        ams::dims::forEach(extent, [&](int j) { row[j] = in[j][i]; });
       }
-    }
+    });
 
-    for (size_t i = 0; i < _num_elements; i++) {
-      for (size_t j = 0; j < _output_dim; j++) {
-        data_blob[i * x_dim + _input_dim + j] = outputs[j][i];
+    TypeValue* const* out = outputs.data();
+    ams::dims::dispatch(_output_dim, [&](auto extent) {
+      for (size_t i = 0; i < _num_elements; i++) {
+        TypeValue* row = &data_blob[i * x_dim + _input_dim];
+        ams::dims::forEach(extent, [&](int j) { row[j] = out[j][i]; });
       }
-    }
+    });
 
     return (x_dim * _num_elements) * sizeof(TypeValue);
   }
@@ -1839,6 +1845,10 @@ public:
  *    "rabbitmq-outbound-queue": "test3"
  *  }
  *
+ * Connections use TLS (amqps://) by default. Setting "rabbitmq-tls": false
+ * selects plain AMQP, which is meant for brokers running on the local node
+ * (e.g. docker/rabbitmq/local_broker.sh), "rabbitmq-cert" is then ignored.
+ *
  * The TLS certificate must be generated by the user and the absolute paths are preferred.
  * A TLS certificate can be generated with the following command:
  *
@@ -1912,6 +1922,7 @@ private:
         {"service-port", ""},
         {"service-host", ""},
         {"rabbitmq-cert", ""},
+        {"rabbitmq-tls", "true"},
         {"rabbitmq-inbound-queue", ""},
         {"rabbitmq-outbound-queue", ""},
     };
@@ -1959,7 +1970,7 @@ public:
         rmq_config["rabbitmq-outbound-queue"];  // Queue to send data to
     _queue_receiver =
         rmq_config["rabbitmq-inbound-queue"];  // Queue to receive data from PDS
-    bool is_secure = true;
+    bool is_secure = rmq_config["rabbitmq-tls"] != "false";
 
     if (rmq_config["service-port"].empty()) {
       CFATAL(RabbitMQDB,
@@ -1995,6 +2006,14 @@ public:
                           is_secure);
 
     std::string cacert = rmq_config["rabbitmq-cert"];
+    CFATAL(RabbitMQDB,
+           is_secure && cacert.empty(),
+           "rabbitmq-cert is empty, a TLS certificate is required unless "
+           "rabbitmq-tls is false")
+    CWARNING(RabbitMQDB,
+             !is_secure,
+             "TLS is disabled, credentials and data are sent in clear to %s",
+             rmq_config["service-host"].c_str())
     _publisher = std::make_shared<RMQPublisher>(address, cacert, _queue_sender);
 
     _publisher_thread = std::thread([&]() { _publisher->start(); });
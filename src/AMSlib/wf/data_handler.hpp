@@ -13,6 +13,7 @@
 #include <vector>
 
 #include "wf/device.hpp"
+#include "wf/dims.hpp"
 #include "wf/resource_manager.hpp"
 #include "wf/utils.hpp"
 
@@ -22,6 +23,9 @@ namespace ams
  * @brief A "utility" class that transforms data into
  * various formats. For example moving from sparse to dense
  * representations
+ *
+ * The host kernels are instantiated for the common numbers of features (see
+ * dims::dispatch), the loops over the features are then unrolled.
  */
 template <typename TypeValue>
 class DataHandler
@@ -146,17 +150,85 @@ PERFFASPECT()
     TypeValue* data = ams::ResourceManager::allocate<TypeValue>(nvalues, resource);
 
     if (resource == AMSResourceType::HOST) {
-      for (size_t d = 0; d < nfeatures; d++) {
-        for (size_t i = 0; i < n; i++) {
-          data[i * nfeatures + d] = static_cast<TypeValue>(features[d][i]);
-        }
-      }
+      linearize_features(n, features, data);
     } else {
       ams::Device::linearize(data, features.data(), nfeatures, n);
     }
     return data;
   }
 
+  /* @brief linearize host resident features in the row-major 'data',
+   * optionally applying the affine transform data = x * scale + offset of
+   * every feature on the fly (e.g., the standardization of the inputs of a
+   * surrogate), the transform costs no extra pass over the data.
+   *
+   * @param[in] n The number of elements of the vectors.
+   * @param[in] features A vector containing C-vector of feature values.
+   * @param[out] data A C-vector of n * features.size() values.
+   * @param[in] scale The scale of every feature, nullptr for the identity.
+   * @param[in] offset The offset of every feature, nullptr for none.
+   */
+  template <typename TypeInValue>
+  PERFFASPECT()
+  static inline void linearize_features(
+      const size_t n,
+      const std::vector<const TypeInValue*>& features,
+      TypeValue* data,
+      const TypeValue* scale = nullptr,
+      const TypeValue* offset = nullptr)
+  {
+    const TypeInValue* const* src = features.data();
+    dims::dispatch(features.size(), [&](auto extent) {
+      // Rows are written contiguously, the features of a row are unrolled
+      if (!scale && !offset) {
+        for (size_t i = 0; i < n; i++) {
+          TypeValue* row = &data[i * extent.size()];
+          dims::forEach(extent, [&](int d) {
+            row[d] = static_cast<TypeValue>(src[d][i]);
+          });
+        }
+        return;
+      }
+      for (size_t i = 0; i < n; i++) {
+        TypeValue* row = &data[i * extent.size()];
+        dims::forEach(extent, [&](int d) {
+          row[d] = static_cast<TypeValue>(src[d][i]) * (scale ? scale[d] : 1) +
+                   (offset ? offset[d] : 0);
+        });
+      }
+    });
+  }
+
+  /* @brief The inverse of linearize_features for host resident data, scatters
+   * the row-major 'data' to the C-vectors of 'features', optionally applying
+   * the affine transform x = data * scale + offset of every feature on the fly
+   * (e.g., the de-normalization of the outputs of a surrogate).
+   *
+   * @param[in] n The number of rows of 'data'.
+   * @param[in] data A C-vector of n * features.size() values.
+   * @param[out] features A vector containing C-vector of feature values.
+   * @param[in] scale The scale of every feature, nullptr for the identity.
+   * @param[in] offset The offset of every feature, nullptr for none.
+   */
+  PERFFASPECT()
+  static inline void delinearize_features(const size_t n,
+                                          const TypeValue* data,
+                                          std::vector<TypeValue*>& features,
+                                          const TypeValue* scale = nullptr,
+                                          const TypeValue* offset = nullptr)
+  {
+    TypeValue* const* dst = features.data();
+    dims::dispatch(features.size(), [&](auto extent) {
+      for (size_t i = 0; i < n; i++) {
+        const TypeValue* row = &data[i * extent.size()];
+        dims::forEach(extent, [&](int d) {
+          dst[d][i] =
+              row[d] * (scale ? scale[d] : 1) + (offset ? offset[d] : 0);
+        });
+      }
+    });
+  }
+
   /* @brief The function stores all elements of the sparse
    * vector in the dense vector if the respective index
    * of the predicate vector is equal to 'denseVal.
@@ -186,13 +258,18 @@ PERFFASPECT()
     size_t dims = sparse.size();
 
     if (dataLocation != AMSResourceType::DEVICE) {
-      for (size_t i = 0; i < n; i++) {
-        if (predicate[i] == denseVal) {
-          for (size_t j = 0; j < dims; j++)
-            dense[j][npacked] = sparse[j][i];
-          npacked++;
+      const TypeValue* const* src = sparse.data();
+      TypeValue* const* dst = dense.data();
+      npacked = dims::dispatch(dims, [&](auto extent) {
+        size_t k = 0;
+        for (size_t i = 0; i < n; i++) {
+          if (predicate[i] == denseVal) {
+            dims::forEach(extent, [&](int j) { dst[j][k] = src[j][i]; });
+            k++;
+          }
         }
-      }
+        return k;
+      });
     } else {
       npacked = ams::Device::pack(denseVal,
                                   predicate,
@@ -229,23 +306,22 @@ PERFFASPECT()
     if (sparse.size() != dense.size())
       throw std::invalid_argument("Packing arrays size mismatch");
 
-    size_t npacked = 0;
     size_t dims = sparse.size();
     if (dataLocation != AMSResourceType::DEVICE) {
-      for (size_t i = 0; i < n; i++) {
-        if (predicate[i] == denseVal) {
-          for (size_t j = 0; j < dims; j++)
-            sparse[j][i] = dense[j][npacked];
-          npacked++;
+      const TypeValue* const* src = dense.data();
+      TypeValue* const* dst = sparse.data();
+      dims::dispatch(dims, [&](auto extent) {
+        size_t k = 0;
+        for (size_t i = 0; i < n; i++) {
+          if (predicate[i] == denseVal) {
+            dims::forEach(extent, [&](int j) { dst[j][i] = src[j][k]; });
+            k++;
+          }
         }
-      }
+      });
     } else {
-      npacked = ams::Device::unpack(denseVal,
-                                    predicate,
-                                    n,
-                                    sparse.data(),
-                                    dense.data(),
-                                    dims);
+      ams::Device::unpack(
+          denseVal, predicate, n, sparse.data(), dense.data(), dims);
     }
     return;
   }
@@ -282,13 +358,18 @@ PERFFASPECT()
     int dims = sparse.size();
 
     if (dataLocation != AMSResourceType::DEVICE) {
-      for (size_t i = 0; i < n; i++) {
-        if (predicate[i] == denseVal) {
-          for (size_t j = 0; j < dims; j++)
-            dense[j][npacked] = sparse[j][i];
-          sparse_indices[npacked++] = i;
+      const TypeValue* const* src = sparse.data();
+      TypeValue* const* dst = dense.data();
+      npacked = dims::dispatch(dims, [&](auto extent) {
+        size_t k = 0;
+        for (size_t i = 0; i < n; i++) {
+          if (predicate[i] == denseVal) {
+            dims::forEach(extent, [&](int j) { dst[j][k] = src[j][i]; });
+            sparse_indices[k++] = i;
+          }
         }
-      }
+        return k;
+      });
     } else {
       npacked = ams::Device::pack(denseVal,
                                   predicate,
@@ -330,9 +411,14 @@ PERFFASPECT()
     int dims = sparse.size();
 
     if (dataLocation != AMSResourceType::DEVICE) {
-      for (size_t i = 0; i < nPacked; i++)
-        for (size_t j = 0; j < dims; j++)
-          sparse[j][sparse_indices[i]] = dense[j][i];
+      const TypeValue* const* src = dense.data();
+      TypeValue* const* dst = sparse.data();
+      dims::dispatch(dims, [&](auto extent) {
+        for (size_t i = 0; i < nPacked; i++) {
+          const int idx = sparse_indices[i];
+          dims::forEach(extent, [&](int j) { dst[j][idx] = src[j][i]; });
+        }
+      });
     } else {
       ams::Device::unpack(
           denseVal, nPacked, sparse.data(), dense.data(), sparse_indices, dims);
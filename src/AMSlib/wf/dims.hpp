@@ -0,0 +1,93 @@
+/*
+ * Copyright 2021-2023 Lawrence Livermore National Security, LLC and other
+ * AMSLib Project Developers
+ *
+ * SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+ */
+
+#ifndef __AMS_DIMS_HPP__
+#define __AMS_DIMS_HPP__
+
+#include <cstddef>
+#include <utility>
+
+namespace ams
+{
+namespace dims
+{
+
+/** @brief The dimension of the generic kernels, only known at run time */
+static constexpr int Dynamic = 0;
+
+/**
+ * @brief The number of features a kernel iterates over. The dimension is a
+ * compile time constant for D != Dynamic, so loops over it are fully unrolled.
+ */
+template <int D>
+struct Extent {
+  explicit constexpr Extent(int) {}
+  static constexpr int size() { return D; }
+};
+
+template <>
+struct Extent<Dynamic> {
+  explicit Extent(int n) : n(n) {}
+  int size() const { return n; }
+  const int n;
+};
+
+template <typename F, std::size_t... I>
+static inline void unrolled(F&& f, std::index_sequence<I...>)
+{
+  int expand[] = {0, (f(static_cast<int>(I)), 0)...};
+  (void)expand;
+}
+
+/** @brief Calls f(d) for every feature d, as straight-line code when the
+ * extent is static */
+template <int D, typename F>
+static inline void forEach(Extent<D>, F&& f)
+{
+  unrolled(f, std::make_index_sequence<D>{});
+}
+
+template <typename F>
+static inline void forEach(Extent<Dynamic> e, F&& f)
+{
+  for (int d = 0; d < e.size(); d++)
+    f(d);
+}
+
+/**
+ * @brief Calls kernel(Extent<D>(n)) with D == n when n is one of the
+ * specialized dimensions and D == Dynamic otherwise. 'kernel' is a generic
+ * lambda, the dimension is resolved once per call and not per element.
+ */
+template <typename K>
+static inline auto dispatch(int n, K&& kernel)
+    -> decltype(kernel(Extent<Dynamic>(n)))
+{
+  switch (n) {
+    case 1:
+      return kernel(Extent<1>(n));
+    case 2:
+      return kernel(Extent<2>(n));
+    case 3:
+      return kernel(Extent<3>(n));
+    case 4:
+      return kernel(Extent<4>(n));
+    case 5:
+      return kernel(Extent<5>(n));
+    case 6:
+      return kernel(Extent<6>(n));
+    case 8:
+      return kernel(Extent<8>(n));
+    default:
+      return kernel(Extent<Dynamic>(n));
+  }
+}
+
+}  // namespace dims
+}  // namespace ams
+
+#endif
@@ -0,0 +1,175 @@
+/*
+ * Copyright 2021-2023 Lawrence Livermore National Security, LLC and other
+ * AMSLib Project Developers
+ *
+ * SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+ */
+
+#ifndef __AMS_REORDER_HPP__
+#define __AMS_REORDER_HPP__
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace ams
+{
+
+/**
+ * @brief Locality-aware ordering of the points of a call.
+ *
+ * Points arrive in mesh order. Sorting them by the Morton key of their
+ * quantized features makes neighboring points in input space adjacent, table
+ * lookups of the physics and the inverted lists of the HDCache are then
+ * reused by consecutive points. The keys are sorted with an LSD radix sort,
+ * the caller gathers the features in that order, evaluates them and scatters
+ * the results back.
+ */
+template <typename FPTypeValue>
+class MortonOrder
+{
+public:
+  /** @brief The cost model: computing the keys, sorting them and permuting
+   * the data is linear in 'n' but only pays off when the working set of the
+   * evaluation no longer fits in the caches, that is above 'minElements'
+   * points (0 disables the reordering) */
+  static bool profitable(size_t n, size_t minElements)
+  {
+    return minElements > 0 && n >= minElements && n > 1 &&
+           n <= std::numeric_limits<uint32_t>::max();
+  }
+
+  /** @brief Computes in 'order' the indices of the 'n' points sorted by the
+   * Morton key of their features */
+  static void compute(size_t n,
+                      const std::vector<const FPTypeValue *> &features,
+                      std::vector<uint32_t> &order)
+  {
+    // 24 bit keys (two radix passes), at most 24 features contribute to the
+    // key with at least one bit each and at most 12 bits per feature. Finer
+    // keys do not improve the locality of the evaluation.
+    const int dims = std::min<int>(features.size(), keyBits);
+    const int bits = dims ? std::min(12, keyBits / dims) : 0;
+    std::vector<uint32_t> keys(n, 0);
+    for (int d = 0; d < dims; d++) {
+      const FPTypeValue *f = features[d];
+      // The range of the finite values, an infinity would make the scale 0
+      // and collapse the keys of all the points
+      FPTypeValue lo = std::numeric_limits<FPTypeValue>::max();
+      FPTypeValue hi = std::numeric_limits<FPTypeValue>::lowest();
+      for (size_t i = 0; i < n; i++) {
+        if (!std::isfinite(f[i])) continue;
+        lo = std::min(lo, f[i]);
+        hi = std::max(hi, f[i]);
+      }
+      const double maxq = static_cast<double>((1u << bits) - 1);
+      const double scale = hi > lo ? maxq / (double(hi) - double(lo)) : 0.0;
+      const Spread spread(bits, dims);
+      for (size_t i = 0; i < n; i++) {
+        double q = (double(f[i]) - double(lo)) * scale;
+        // NaN and infinities fall at the ends of the order
+        q = std::isnan(q) ? 0.0 : std::min(std::max(q, 0.0), maxq);
+        keys[i] |= spread(static_cast<uint32_t>(q)) << d;
+      }
+    }
+    sort(keys, order, bits * dims);
+  }
+
+  /** @brief dst[d][i] = src[d][order[i]] */
+  static void gather(const std::vector<uint32_t> &order,
+                     FPTypeValue *const *src,
+                     FPTypeValue *const *dst,
+                     int dims)
+  {
+    const size_t n = order.size();
+    for (int d = 0; d < dims; d++)
+      for (size_t i = 0; i < n; i++)
+        dst[d][i] = src[d][order[i]];
+  }
+
+  /** @brief dst[d][order[i]] = src[d][i] */
+  static void scatter(const std::vector<uint32_t> &order,
+                      FPTypeValue *const *src,
+                      FPTypeValue *const *dst,
+                      int dims)
+  {
+    const size_t n = order.size();
+    for (int d = 0; d < dims; d++)
+      for (size_t i = 0; i < n; i++)
+        dst[d][order[i]] = src[d][i];
+  }
+
+private:
+  static constexpr int keyBits = 24;
+  static constexpr int digitBits = 12;
+
+  /** @brief Places bit b of a quantized feature at bit b * stride of the key,
+   * one table lookup per byte */
+  struct Spread {
+    Spread(int bits, int stride) : high(bits > 8 ? 8 * stride : 0)
+    {
+      for (uint32_t v = 0; v < 256; v++) {
+        table[v] = 0;
+        for (int b = 0; b < std::min(bits, 8); b++)
+          table[v] |= ((v >> b) & 1u) << (b * stride);
+      }
+    }
+
+    uint32_t operator()(uint32_t v) const
+    {
+      return high ? table[v & 0xff] | (table[v >> 8] << high)
+                  : table[v & 0xff];
+    }
+
+    const int high;
+    uint32_t table[256];
+  };
+
+  /** @brief LSD radix sort of the indices of 'keys', 'digitBits' per pass.
+   * The histograms of all passes are computed at once, passes over digits all
+   * the keys share are skipped */
+  static void sort(std::vector<uint32_t> &keys,
+                   std::vector<uint32_t> &order,
+                   int usedBits)
+  {
+    const size_t n = keys.size();
+    order.resize(n);
+    for (size_t i = 0; i < n; i++)
+      order[i] = i;
+
+    constexpr uint32_t radix = 1u << digitBits;
+    constexpr uint32_t mask = radix - 1;
+    const int passes = (usedBits + digitBits - 1) / digitBits;
+    std::vector<uint32_t> count(passes * radix, 0);
+    for (size_t i = 0; i < n; i++)
+      for (int p = 0; p < passes; p++)
+        count[p * radix + ((keys[i] >> (p * digitBits)) & mask)]++;
+
+    std::vector<uint32_t> tmpKeys(n);
+    std::vector<uint32_t> tmpOrder(n);
+    for (int p = 0; p < passes; p++) {
+      const int shift = p * digitBits;
+      uint32_t *offset = &count[p * radix];
+      if (*std::max_element(offset, offset + radix) == n) continue;
+      uint32_t sum = 0;
+      for (uint32_t b = 0; b < radix; b++) {
+        const uint32_t c = offset[b];
+        offset[b] = sum;
+        sum += c;
+      }
+      for (size_t i = 0; i < n; i++) {
+        const uint32_t pos = offset[(keys[i] >> shift) & mask]++;
+        tmpKeys[pos] = keys[i];
+        tmpOrder[pos] = order[i];
+      }
+      keys.swap(tmpKeys);
+      order.swap(tmpOrder);
+    }
+  }
+};
+
+}  // namespace ams
+
+#endif
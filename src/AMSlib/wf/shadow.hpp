@@ -0,0 +1,248 @@
+/*
+ * Copyright 2021-2023 Lawrence Livermore National Security, LLC and other
+ * AMSLib Project Developers
+ *
+ * SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+ */
+
+#ifndef __AMS_SHADOW_HPP__
+#define __AMS_SHADOW_HPP__
+
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "AMS.h"
+#include "wf/debug.h"
+
+namespace ams
+{
+
+/**
+ * @brief Evaluates the physics on a sample of the points the surrogate
+ * accepted, off the critical path of AMSWorkflow::evaluate.
+ *
+ * The evaluate call only copies the inputs and the surrogate outputs of the
+ * sampled points into a side buffer. A background thread calls the physics on
+ * them, accumulates the error of the surrogate and stores the physics results
+ * to the database. The side buffer holds at most 'capacity' points, samples
+ * are dropped (and counted) when the physics cannot keep up.
+ */
+template <typename FPTypeValue>
+class ShadowSampler
+{
+public:
+  using StoreFn = std::function<void(size_t,
+                                     std::vector<FPTypeValue *> &,
+                                     std::vector<FPTypeValue *> &)>;
+
+  /** @brief Error of the surrogate on the shadow points, per output */
+  struct ErrorStats {
+    uint64_t points = 0;
+    double sumAbs = 0.0;
+    double sumSquared = 0.0;
+    double maxAbs = 0.0;
+  };
+
+  ShadowSampler(AMSPhysicFn AppCall,
+                double fraction,
+                size_t capacity,
+                StoreFn store,
+                int seed = 0)
+      : AppCall(AppCall),
+        fraction(fraction),
+        capacity(capacity),
+        store(store),
+        gen(seed),
+        done(false),
+        worker(&ShadowSampler::run, this)
+  {
+  }
+
+  static void validate(double fraction)
+  {
+    if (!(fraction > 0.0 && fraction <= 1.0))
+      THROW(std::invalid_argument,
+            "The shadow fraction must be in (0, 1], got " +
+                std::to_string(fraction));
+  }
+
+  ~ShadowSampler()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      done = true;
+    }
+    cv.notify_all();
+    worker.join();
+  }
+
+  /** @brief Copies a sample of the accepted points (predicate[i] == true) of
+   * host resident data to the side buffer, returns the number of points
+   * queued for the background physics. The physics is called with
+   * 'probDescr' later on, it must remain valid until drain returns or the
+   * sampler is destroyed */
+  long sample(void *probDescr,
+              const size_t n,
+              const bool *predicate,
+              const std::vector<const FPTypeValue *> &inputs,
+              const std::vector<FPTypeValue *> &outputs)
+  {
+    Batch batch;
+    batch.probDescr = probDescr;
+    batch.inputs.resize(inputs.size());
+    batch.outputs.resize(outputs.size());
+
+    // Geometric skips draw one random number per sampled point instead of one
+    // per accepted point. The distribution requires p < 1, a fraction of 1
+    // samples every accepted point.
+    const bool all = fraction >= 1.0;
+    std::geometric_distribution<size_t> geometric(all ? 0.5 : fraction);
+    auto skip = [&]() -> size_t { return all ? 0 : geometric(gen); };
+    size_t next = skip();
+    for (size_t i = 0; i < n; i++) {
+      if (!predicate[i]) continue;
+      if (next-- != 0) continue;
+      for (size_t d = 0; d < inputs.size(); d++)
+        batch.inputs[d].push_back(inputs[d][i]);
+      for (size_t d = 0; d < outputs.size(); d++)
+        batch.outputs[d].push_back(outputs[d][i]);
+      next = skip();
+    }
+
+    const size_t sampled = batch.size();
+    if (sampled == 0) return 0;
+
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (pendingPoints + sampled > capacity) {
+        dropped += sampled;
+        return 0;
+      }
+      pendingPoints += sampled;
+      queue.push_back(std::move(batch));
+    }
+    cv.notify_one();
+    return sampled;
+  }
+
+  /** @brief Blocks until the background thread evaluated all queued points */
+  void drain()
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    cv.wait(lock, [&]() { return pendingPoints == 0; });
+  }
+
+  std::vector<ErrorStats> errors() const
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats;
+  }
+
+  uint64_t droppedPoints() const
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    return dropped;
+  }
+
+private:
+  struct Batch {
+    void *probDescr;
+    std::vector<std::vector<FPTypeValue>> inputs;
+    std::vector<std::vector<FPTypeValue>> outputs;
+    size_t size() const { return inputs.empty() ? 0 : inputs[0].size(); }
+  };
+
+  void run()
+  {
+    while (true) {
+      Batch batch;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait(lock, [&]() { return done || !queue.empty(); });
+        if (queue.empty()) return;
+        batch = std::move(queue.front());
+        queue.pop_front();
+      }
+      evaluate(batch);
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        pendingPoints -= batch.size();
+      }
+      cv.notify_all();
+    }
+  }
+
+  void evaluate(Batch &batch)
+  {
+    const size_t n = batch.size();
+    std::vector<FPTypeValue *> inputs, outputs;
+    std::vector<std::vector<FPTypeValue>> physics(batch.outputs.size());
+    for (auto &in : batch.inputs)
+      inputs.push_back(in.data());
+    for (auto &out : physics) {
+      out.resize(n);
+      outputs.push_back(out.data());
+    }
+
+    AppCall(batch.probDescr,
+            n,
+            reinterpret_cast<const void *const *>(inputs.data()),
+            reinterpret_cast<void *const *>(outputs.data()));
+
+    std::vector<ErrorStats> batchStats(physics.size());
+    for (size_t d = 0; d < physics.size(); d++) {
+      ErrorStats &s = batchStats[d];
+      for (size_t i = 0; i < n; i++) {
+        const double err = std::abs(static_cast<double>(batch.outputs[d][i]) -
+                                    static_cast<double>(physics[d][i]));
+        s.sumAbs += err;
+        s.sumSquared += err * err;
+        s.maxAbs = std::max(s.maxAbs, err);
+      }
+      s.points = n;
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stats.resize(std::max(stats.size(), batchStats.size()));
+      for (size_t d = 0; d < batchStats.size(); d++) {
+        stats[d].points += batchStats[d].points;
+        stats[d].sumAbs += batchStats[d].sumAbs;
+        stats[d].sumSquared += batchStats[d].sumSquared;
+        stats[d].maxAbs = std::max(stats[d].maxAbs, batchStats[d].maxAbs);
+      }
+    }
+
+    if (store) store(n, inputs, outputs);
+  }
+
+  AMSPhysicFn AppCall;
+  const double fraction;
+  const size_t capacity;
+  StoreFn store;
+  std::mt19937_64 gen;
+
+  mutable std::mutex mutex;
+  std::condition_variable cv;
+  std::deque<Batch> queue;
+  size_t pendingPoints = 0;
+  uint64_t dropped = 0;
+  std::vector<ErrorStats> stats;
+  bool done;
+
+  // Last member, the thread starts once the rest of the sampler is built
+  std::thread worker;
+};
+
+}  // namespace ams
+
+#endif
@@ -0,0 +1,185 @@
+/*
+ * Copyright 2021-2023 Lawrence Livermore National Security, LLC and other
+ * AMSLib Project Developers
+ *
+ * SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+ */
+
+#ifndef __AMS_STATE_HPP__
+#define __AMS_STATE_HPP__
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+
+#include "wf/debug.h"
+
+namespace ams
+{
+
+/**
+ * @brief Sections of an executor state snapshot.
+ *
+ * A snapshot starts with a magic string, a version and the size of the
+ * floating point type of the executor, followed by a sequence of (tag, length,
+ * payload) sections. Readers skip the sections they do not know, new state is
+ * added as new sections without breaking older snapshots.
+ */
+enum class AMSStateSection : uint32_t {
+  Workflow = 1,  //!< Statistics and workspace sizing hints of the workflow
+  UQ = 2,        //!< Policy and threshold of the UQ module
+  HDCache = 3,   //!< The FAISS index, only when points were added online
+  CascadeUQ = 4,       //!< UQ section of the cascade surrogate
+  CascadeHDCache = 5,  //!< HDCache of the cascade, unless shared with the UQ
+};
+
+/** @brief Serializes trivially copyable values in a byte buffer */
+class StateBuffer
+{
+public:
+  template <typename T>
+  void put(const T& v)
+  {
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "Only trivially copyable values can be serialized");
+    data.append(reinterpret_cast<const char*>(&v), sizeof(T));
+  }
+
+  void putBytes(const std::string& bytes)
+  {
+    put<uint64_t>(bytes.size());
+    data.append(bytes);
+  }
+
+  std::string data;
+};
+
+/** @brief Reads back the values of a StateBuffer, throws on truncated data */
+class StateView
+{
+public:
+  explicit StateView(const std::string& data) : data(data), offset(0) {}
+
+  template <typename T>
+  T get()
+  {
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "Only trivially copyable values can be deserialized");
+    T v;
+    std::memcpy(&v, take(sizeof(T)), sizeof(T));
+    return v;
+  }
+
+  std::string getBytes()
+  {
+    const size_t n = get<uint64_t>();
+    return std::string(take(n), n);
+  }
+
+private:
+  const char* take(size_t n)
+  {
+    if (offset + n > data.size())
+      THROW(std::runtime_error, "Truncated AMS executor state");
+    const char* ptr = data.data() + offset;
+    offset += n;
+    return ptr;
+  }
+
+  const std::string& data;
+  size_t offset;
+};
+
+/** @brief An executor state snapshot, a map from sections to payloads */
+class AMSState
+{
+  static constexpr size_t magicSize = 8;
+  static const char* magic() { return "AMSSTATE"; }
+  static uint32_t version() { return 1; }
+
+public:
+  explicit AMSState(uint32_t fpSize) : fpSize(fpSize) {}
+
+  void set(AMSStateSection tag, StateBuffer&& buffer)
+  {
+    sections[static_cast<uint32_t>(tag)] = std::move(buffer.data);
+  }
+
+  /** @brief Returns the payload of a section, nullptr when missing */
+  const std::string* get(AMSStateSection tag) const
+  {
+    auto it = sections.find(static_cast<uint32_t>(tag));
+    return it == sections.end() ? nullptr : &it->second;
+  }
+
+  /** @brief Writes the snapshot to a temporary file renamed to 'path' once
+   * complete, a crash never leaves a partial snapshot behind */
+  void save(const std::string& path) const
+  {
+    const std::string tmp = path + ".tmp";
+    {
+      std::ofstream fd(tmp, std::ios::binary | std::ios::trunc);
+      if (!fd) THROW(std::runtime_error, "Cannot open " + tmp);
+      StateBuffer header;
+      header.data.append(magic(), magicSize);
+      header.put(version());
+      header.put(fpSize);
+      header.put<uint32_t>(sections.size());
+      fd.write(header.data.data(), header.data.size());
+      for (const auto& s : sections) {
+        StateBuffer section;
+        section.put(s.first);
+        section.putBytes(s.second);
+        fd.write(section.data.data(), section.data.size());
+      }
+      if (!fd) THROW(std::runtime_error, "Cannot write " + tmp);
+    }
+    if (std::rename(tmp.c_str(), path.c_str()) != 0)
+      THROW(std::runtime_error, "Cannot rename " + tmp + " to " + path);
+  }
+
+  static AMSState load(const std::string& path, uint32_t fpSize)
+  {
+    std::ifstream fd(path, std::ios::binary);
+    if (!fd) THROW(std::runtime_error, "Cannot open " + path);
+    const std::string data((std::istreambuf_iterator<char>(fd)),
+                           std::istreambuf_iterator<char>());
+    if (data.size() < magicSize ||
+        std::memcmp(data.data(), magic(), magicSize) != 0)
+      THROW(std::runtime_error, path + " is not an AMS executor state");
+
+    StateView view(data);
+    for (size_t i = 0; i < magicSize; i++)
+      view.get<char>();
+    const uint32_t fileVersion = view.get<uint32_t>();
+    if (fileVersion > version())
+      THROW(std::runtime_error,
+            "Unsupported AMS executor state version " +
+                std::to_string(fileVersion));
+    if (view.get<uint32_t>() != fpSize)
+      THROW(std::runtime_error,
+            path + " was saved by an executor of a different precision");
+
+    AMSState state(fpSize);
+    const uint32_t numSections = view.get<uint32_t>();
+    for (uint32_t i = 0; i < numSections; i++) {
+      const uint32_t tag = view.get<uint32_t>();
+      state.sections[tag] = view.getBytes();
+    }
+    return state;
+  }
+
+private:
+  uint32_t fpSize;
+  std::unordered_map<uint32_t, std::string> sections;
+};
+
+}  // namespace ams
+
+#endif
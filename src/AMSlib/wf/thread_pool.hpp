@@ -0,0 +1,141 @@
+/*
+ * Copyright 2021-2023 Lawrence Livermore National Security, LLC and other
+ * AMSLib Project Developers
+ *
+ * SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+ */
+
+#ifndef __AMS_THREAD_POOL_HPP__
+#define __AMS_THREAD_POOL_HPP__
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace ams
+{
+
+/**
+ * @brief A fixed set of threads executing the iterations of parallel loops.
+ *
+ * The calling thread takes part in the loop, a pool of N threads thus keeps
+ * N + 1 cores busy. Iterations are handed out dynamically, chunks of uneven
+ * cost are balanced. The first exception thrown by an iteration is rethrown
+ * by parallelFor once all the iterations completed.
+ */
+class ThreadPool
+{
+public:
+  explicit ThreadPool(int numThreads)
+  {
+    for (int i = 0; i < numThreads; i++)
+      workers.emplace_back(&ThreadPool::run, this);
+  }
+
+  ~ThreadPool()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      done = true;
+    }
+    wake.notify_all();
+    for (auto &w : workers)
+      w.join();
+  }
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  /** @brief The number of threads taking part in a loop */
+  int concurrency() const { return workers.size() + 1; }
+
+  /** @brief Calls body(i) for every i in [0, n), concurrently */
+  void parallelFor(size_t n, const std::function<void(size_t)> &body)
+  {
+    if (n == 0) return;
+    std::unique_lock<std::mutex> lock(mutex);
+    // Workers still leaving the previous loop must not see the new one
+    finished.wait(lock, [&]() { return active == 0; });
+    loop = &body;
+    iterations = n;
+    next = 0;
+    pending = n;
+    error = nullptr;
+    generation++;
+    lock.unlock();
+    wake.notify_all();
+
+    work();
+
+    lock.lock();
+    finished.wait(lock, [&]() { return pending == 0 && active == 0; });
+    loop = nullptr;
+    if (error) std::rethrow_exception(error);
+  }
+
+private:
+  /** @brief Executes iterations of the current loop until none is left */
+  void work()
+  {
+    size_t completed = 0;
+    std::exception_ptr failure;
+    for (size_t i = next++; i < iterations; i = next++) {
+      try {
+        (*loop)(i);
+      } catch (...) {
+        if (!failure) failure = std::current_exception();
+      }
+      completed++;
+    }
+    if (completed == 0) return;
+
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (failure && !error) error = failure;
+      pending -= completed;
+    }
+    finished.notify_all();
+  }
+
+  void run()
+  {
+    uint64_t seen = 0;
+    while (true) {
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        wake.wait(lock, [&]() { return done || generation != seen; });
+        if (done) return;
+        seen = generation;
+        active++;
+      }
+      work();
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        active--;
+      }
+      finished.notify_all();
+    }
+  }
+
+  std::vector<std::thread> workers;
+  std::mutex mutex;
+  std::condition_variable wake;
+  std::condition_variable finished;
+
+  const std::function<void(size_t)> *loop = nullptr;
+  size_t iterations = 0;
+  std::atomic<size_t> next{0};
+  size_t pending = 0;
+  int active = 0;
+  std::exception_ptr error;
+  uint64_t generation = 0;
+  bool done = false;
+};
+
+}  // namespace ams
+
+#endif
@@ -0,0 +1,260 @@
+/*
+ * Copyright 2021-2023 Lawrence Livermore National Security, LLC and other
+ * AMSLib Project Developers
+ *
+ * SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+ */
+
+#ifndef __AMS_TUNER_HPP__
+#define __AMS_TUNER_HPP__
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "wf/debug.h"
+
+namespace ams
+{
+
+/** @brief The performance knobs of the workflow the tuner selects */
+struct TunedKnobs {
+  long reorderMinElements = 0;  //!< 0 evaluates calls in the caller order
+  int physicsThreads = 1;       //!< 1 calls the physics serially
+};
+
+/**
+ * @brief Selects the fastest workflow knobs during the first calls of an
+ * executor.
+ *
+ * Each candidate configuration is applied to 'callsPerCandidate' consecutive
+ * calls of the application and the fastest time per point of a call is kept,
+ * the first calls thus run with real data and the real physics and no work is
+ * wasted. The winner is applied for the rest of the run and persisted to a
+ * cache file keyed by the host type, the model, the precision and the
+ * dimensions of the calls, and the largest thread count of the candidates. Later
+ * runs with the same key start tuned, a cached winner that is not one of
+ * their candidates is ignored.
+ *
+ * The cache is a text file, one "key<TAB>reorder<TAB>threads<TAB>seconds"
+ * line per configuration.
+ */
+class AutoTuner
+{
+public:
+  AutoTuner(std::string cachePath,
+            std::string model,
+            int callsPerCandidate,
+            std::vector<TunedKnobs> candidates,
+            bool persist = true)
+      : cachePath(std::move(cachePath)),
+        model(std::move(model)),
+        callsPerCandidate(std::max(1, callsPerCandidate)),
+        persist(persist),
+        candidates(std::move(candidates))
+  {
+    if (this->candidates.empty()) this->candidates.emplace_back();
+    best.assign(this->candidates.size(), std::numeric_limits<double>::max());
+  }
+
+  /** @brief The reorder and thread count candidates, 'reorderMin' is the
+   * configured reordering threshold (0 tries reordering every call) and
+   * 'maxThreads' the configured physics threads, 0 when the physics is not
+   * reentrant */
+  static std::vector<TunedKnobs> candidatesFor(long reorderMin, int maxThreads)
+  {
+    std::vector<int> threads{1};
+    if (maxThreads > 1) {
+      if (maxThreads / 2 > 1) threads.push_back(maxThreads / 2);
+      threads.push_back(maxThreads);
+    }
+    std::vector<TunedKnobs> candidates;
+    for (long reorder : {0L, std::max(1L, reorderMin)})
+      for (int t : threads) {
+        TunedKnobs k;
+        k.reorderMinElements = reorder;
+        k.physicsThreads = t;
+        candidates.push_back(k);
+      }
+    return candidates;
+  }
+
+  bool done() const { return finished; }
+
+  /** @brief The knobs to use for the next call. The first call looks up the
+   * cache, a hit ends the tuning */
+  const TunedKnobs &next(size_t fpSize, int inputDim, int outputDim)
+  {
+    if (key.empty()) {
+      key = hostType() + "|" + model + "|fp" + std::to_string(8 * fpSize) +
+            "|" + std::to_string(inputDim) + "x" + std::to_string(outputDim) +
+            "|t" + std::to_string(maxThreads());
+      auto entries = readCache();
+      auto it = entries.find(key);
+      TunedKnobs cached;
+      if (it != entries.end() && parse(it->second, cached) &&
+          isCandidate(cached)) {
+        winner = cached;
+        finished = true;
+        INFO(Tuner,
+             "Using the tuned configuration of %s: reorder %ld, %d physics "
+             "threads",
+             key.c_str(),
+             winner.reorderMinElements,
+             winner.physicsThreads);
+        return winner;
+      }
+    }
+    return finished ? winner : candidates[current];
+  }
+
+  /** @brief Records the duration of a call of 'elements' points made with the
+   * knobs returned by next. Returns true once the tuning completed, the
+   * knobs of the winner then are the ones of next */
+  bool record(double seconds, long elements)
+  {
+    if (finished) return true;
+    if (elements > 0)
+      best[current] = std::min(best[current], seconds / elements);
+    DBG(Tuner,
+        "Candidate %zu (reorder %ld, %d threads): %.3e s/point",
+        current,
+        candidates[current].reorderMinElements,
+        candidates[current].physicsThreads,
+        elements > 0 ? seconds / elements : 0.0);
+    if (++calls < callsPerCandidate) return false;
+    calls = 0;
+    if (++current < candidates.size()) return false;
+
+    const size_t w = std::min_element(best.begin(), best.end()) - best.begin();
+    winner = candidates[w];
+    finished = true;
+    INFO(Tuner,
+         "Tuned %s: reorder %ld, %d physics threads (%.3e s/point)",
+         key.c_str(),
+         winner.reorderMinElements,
+         winner.physicsThreads,
+         best[w]);
+    if (persist && !cachePath.empty()) writeCache(best[w]);
+    return true;
+  }
+
+private:
+  /** @brief The CPU model and the number of hardware threads, nodes of a
+   * partition share it, the hostname otherwise */
+  static std::string hostType()
+  {
+    std::ifstream cpuinfo("/proc/cpuinfo");
+    std::string line;
+    while (std::getline(cpuinfo, line)) {
+      if (line.compare(0, 10, "model name") != 0) continue;
+      const size_t colon = line.find(':');
+      if (colon == std::string::npos) break;
+      return line.substr(line.find_first_not_of(' ', colon + 1)) + "/" +
+             std::to_string(std::thread::hardware_concurrency());
+    }
+    char name[256] = {0};
+    gethostname(name, sizeof(name) - 1);
+    return std::string(name) + "/" +
+           std::to_string(std::thread::hardware_concurrency());
+  }
+
+  /** @brief The largest physics thread count of the candidates, 1 when the
+   * physics is not reentrant */
+  int maxThreads() const
+  {
+    int threads = 1;
+    for (const auto &c : candidates)
+      threads = std::max(threads, c.physicsThreads);
+    return threads;
+  }
+
+  /** @brief Whether 'knobs' are one of the candidates, a cached winner that
+   * is not must not run more threads than configured, or call a physics that
+   * is not reentrant concurrently */
+  bool isCandidate(const TunedKnobs &knobs) const
+  {
+    return std::any_of(
+        candidates.begin(), candidates.end(), [&](const TunedKnobs &c) {
+          return c.reorderMinElements == knobs.reorderMinElements &&
+                 c.physicsThreads == knobs.physicsThreads;
+        });
+  }
+
+  static bool parse(const std::string &value, TunedKnobs &knobs)
+  {
+    std::istringstream is(value);
+    TunedKnobs k;
+    if (!(is >> k.reorderMinElements >> k.physicsThreads)) return false;
+    knobs = k;
+    return true;
+  }
+
+  /** @brief Maps the keys of the cache to the rest of their line */
+  std::map<std::string, std::string> readCache() const
+  {
+    std::map<std::string, std::string> entries;
+    if (cachePath.empty()) return entries;
+    std::ifstream fd(cachePath);
+    std::string line;
+    while (std::getline(fd, line)) {
+      const size_t tab = line.find('\t');
+      if (tab == std::string::npos) continue;
+      entries[line.substr(0, tab)] = line.substr(tab + 1);
+    }
+    return entries;
+  }
+
+  /** @brief Adds the winner to the cache. The file is rewritten to a
+   * temporary one renamed once complete, concurrent writers lose entries at
+   * worst and never leave a partial file */
+  void writeCache(double secondsPerPoint) const
+  {
+    auto entries = readCache();
+    std::ostringstream value;
+    value << winner.reorderMinElements << '\t' << winner.physicsThreads << '\t'
+          << secondsPerPoint;
+    entries[key] = value.str();
+
+    const std::string tmp = cachePath + "." + std::to_string(getpid());
+    {
+      std::ofstream fd(tmp, std::ios::trunc);
+      for (const auto &e : entries)
+        fd << e.first << '\t' << e.second << '\n';
+      if (!fd) {
+        WARNING(Tuner, "Cannot write the tuning cache %s", tmp.c_str());
+        std::remove(tmp.c_str());
+        return;
+      }
+    }
+    if (std::rename(tmp.c_str(), cachePath.c_str()) != 0) {
+      WARNING(Tuner, "Cannot rename %s to %s", tmp.c_str(), cachePath.c_str());
+      std::remove(tmp.c_str());
+    }
+  }
+
+  const std::string cachePath;
+  const std::string model;
+  const int callsPerCandidate;
+  const bool persist;
+  std::vector<TunedKnobs> candidates;
+  std::vector<double> best;
+
+  std::string key;
+  size_t current = 0;
+  int calls = 0;
+  bool finished = false;
+  TunedKnobs winner;
+};
+
+}  // namespace ams
+
+#endif
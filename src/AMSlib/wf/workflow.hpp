@@ -9,16 +9,23 @@
 #define __AMS_WORKFLOW_HPP__
 
 #include <cassert>
+#include <chrono>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <iostream>
+#include <mutex>
 #include <vector>
 
 #include "AMS.h"
 #include "ml/uq.hpp"
 #include "resource_manager.hpp"
 #include "wf/basedb.hpp"
+#include "wf/reorder.hpp"
+#include "wf/shadow.hpp"
+#include "wf/state.hpp"
+#include "wf/thread_pool.hpp"
+#include "wf/tuner.hpp"
 
 #ifdef __ENABLE_MPI__
 #include "wf/redist_load.hpp"
@@ -51,6 +58,10 @@ class AMSWorkflow
   /** @brief The module that performs uncertainty quantification (UQ) */
   std::unique_ptr<UQ<FPTypeValue>> UQModel;
 
+  /** @brief The optional second tier of a cascade, a larger surrogate and its
+   * UQ evaluated only on the points UQModel rejected */
+  std::unique_ptr<UQ<FPTypeValue>> cascadeUQModel;
+
   /** The metric/type of UQ we will use to select between physics and ml computations **/
   const AMSUQPolicy uqPolicy = AMSUQPolicy::AMSUQPolicy_END;
 
@@ -58,6 +69,28 @@ class AMSWorkflow
    * model */
   std::shared_ptr<BaseDB<FPTypeValue>> DB;
 
+  /** @brief Calls of at least this many points are evaluated in the Morton
+   * order of their inputs, 0 disables the reordering */
+  size_t reorderMinElements = 0;
+
+  /** @brief Evaluates chunks of the physics concurrently, nullptr unless the
+   * application declared its physics reentrant */
+  std::unique_ptr<ThreadPool> physicsPool;
+
+  /** @brief The smallest chunk of points of a concurrent physics call */
+  static constexpr long physicsMinChunk = 1024;
+
+  /** @brief Selects the reordering and the physics threads during the first
+   * calls, nullptr when the knobs are not tuned or once tuned */
+  std::unique_ptr<AutoTuner> tuner;
+
+  /** @brief Serializes the stores of evaluate and of the shadow physics */
+  std::mutex dbMutex;
+
+  /** @brief Evaluates the physics on a sample of the accepted points in the
+   * background, nullptr when shadow sampling is disabled */
+  std::unique_ptr<ShadowSampler<FPTypeValue>> shadow;
+
   /** @brief The type of the database we will use (HDF5, CSV, etc) */
   AMSDBType dbType = AMSDBType::None;
 
@@ -74,6 +107,183 @@ class AMSWorkflow
   /** @brief execution policy of the distributed system. Load balance or not. */
   const AMSExecPolicy ePolicy;
 
+  /** @brief Statistics of the executor, part of its state snapshots. The
+   * largest call and its dimensions size the workspace after a restart */
+  struct {
+    uint64_t calls = 0;
+    uint64_t elements = 0;
+    uint64_t physicsElements = 0;
+    uint64_t maxElements = 0;
+    int32_t inputDim = 0;
+    int32_t outputDim = 0;
+  } stats;
+
+  /** @brief Points evaluated and accepted by a tier of the cascade (0 is the
+   * first surrogate, 1 the cascade one, 2 the physics) and the time spent */
+  struct TierStats {
+    uint64_t evaluated = 0;
+    uint64_t accepted = 0;
+    double seconds = 0.0;
+  } tiers[3];
+
+  using clock = std::chrono::steady_clock;
+
+  static double elapsed(clock::time_point start)
+  {
+    return std::chrono::duration<double>(clock::now() - start).count();
+  }
+
+  void updateTier(int tier, long evaluated, long accepted, double seconds)
+  {
+    tiers[tier].evaluated += evaluated;
+    tiers[tier].accepted += accepted;
+    tiers[tier].seconds += seconds;
+  }
+
+  void updateStats(int totalElements,
+                   long physicsElements,
+                   int inputDim,
+                   int outputDim)
+  {
+    stats.calls++;
+    stats.elements += totalElements;
+    stats.physicsElements += physicsElements;
+    if (static_cast<uint64_t>(totalElements) >= stats.maxElements) {
+      stats.maxElements = totalElements;
+      stats.inputDim = inputDim;
+      stats.outputDim = outputDim;
+    }
+  }
+
+  /** @brief Grows the allocators to the footprint of the largest call seen
+   * before the snapshot, pooled allocators then start at steady state */
+  void reserveWorkspace()
+  {
+    const size_t n = stats.maxElements;
+    if (n == 0) return;
+    bool *predicate = ams::ResourceManager::allocate<bool>(n, appDataLoc);
+    std::vector<FPTypeValue *> buffers;
+    for (int i = 0; i < stats.inputDim + stats.outputDim; i++)
+      buffers.push_back(
+          ams::ResourceManager::allocate<FPTypeValue>(n, appDataLoc));
+    ams::ResourceManager::deallocate(buffers, appDataLoc);
+    ams::ResourceManager::deallocate(predicate, appDataLoc);
+    DBG(Workflow,
+        "Reserved workspace for %lu elements of (%d, %d) dimensions",
+        n,
+        stats.inputDim,
+        stats.outputDim);
+  }
+
+  /** @brief Applies the knobs selected by the tuner */
+  void applyKnobs(const TunedKnobs &knobs)
+  {
+    if (static_cast<size_t>(knobs.reorderMinElements) != reorderMinElements)
+      setReorder(knobs.reorderMinElements);
+    const int threads = physicsPool ? physicsPool->concurrency() : 1;
+    if (knobs.physicsThreads != threads) {
+      physicsPool.reset();
+      if (knobs.physicsThreads > 1)
+        physicsPool = std::make_unique<ThreadPool>(knobs.physicsThreads - 1);
+    }
+  }
+
+  /** @brief Reports the duration of a call to the tuner, the winner is
+   * applied once the tuning completed */
+  void tuneCall(clock::time_point callStart,
+                int totalElements,
+                int inputDim,
+                int outputDim)
+  {
+    if (!tuner) return;
+    if (!tuner->record(elapsed(callStart), totalElements)) return;
+    applyKnobs(tuner->next(sizeof(FPTypeValue), inputDim, outputDim));
+    tuner.reset();
+  }
+
+  /** @brief Invokes the application physics on 'n' points. With a reentrant
+   * physics, host data are split in chunks evaluated concurrently by the
+   * physics thread pool, each call receives pointers offset to its chunk */
+  void invokePhysics(void *probDescr,
+                     long n,
+                     FPTypeValue *const *inputs,
+                     FPTypeValue *const *outputs,
+                     int inputDim,
+                     int outputDim)
+  {
+    if (!physicsPool || appDataLoc != AMSResourceType::HOST ||
+        n < 2 * physicsMinChunk) {
+      AppCall(probDescr,
+              n,
+              reinterpret_cast<const void *const *>(inputs),
+              reinterpret_cast<void *const *>(outputs));
+      return;
+    }
+
+    // A few chunks per thread balance the physics of uneven cost
+    const long chunks = std::min<long>(4 * physicsPool->concurrency(),
+                                       n / physicsMinChunk);
+    const long chunkSize = (n + chunks - 1) / chunks;
+    physicsPool->parallelFor(chunks, [&](size_t c) {
+      const long start = c * chunkSize;
+      const long count = std::min(chunkSize, n - start);
+      if (count <= 0) return;
+      std::vector<const FPTypeValue *> cInputs(inputDim);
+      std::vector<FPTypeValue *> cOutputs(outputDim);
+      for (int i = 0; i < inputDim; i++)
+        cInputs[i] = inputs[i] + start;
+      for (int i = 0; i < outputDim; i++)
+        cOutputs[i] = outputs[i] + start;
+      AppCall(probDescr,
+              count,
+              reinterpret_cast<const void *const *>(cInputs.data()),
+              reinterpret_cast<void *const *>(cOutputs.data()));
+    });
+  }
+
+  /** @brief Calls the physics on 'n' points. Large calls of host data are
+   * evaluated in the Morton order of their inputs and the outputs are
+   * scattered back to the order of the caller */
+  void callPhysics(void *probDescr,
+                   long n,
+                   FPTypeValue **inputs,
+                   FPTypeValue **outputs,
+                   int inputDim,
+                   int outputDim)
+  {
+    if (appDataLoc != AMSResourceType::HOST ||
+        !MortonOrder<FPTypeValue>::profitable(n, reorderMinElements)) {
+      invokePhysics(probDescr, n, inputs, outputs, inputDim, outputDim);
+      return;
+    }
+
+    CALIPER(CALI_MARK_BEGIN("REORDER");)
+    std::vector<uint32_t> order;
+    MortonOrder<FPTypeValue>::compute(
+        n,
+        std::vector<const FPTypeValue *>(inputs, inputs + inputDim),
+        order);
+    std::vector<FPTypeValue *> sInputs, sOutputs;
+    for (int i = 0; i < inputDim; i++)
+      sInputs.push_back(
+          ams::ResourceManager::allocate<FPTypeValue>(n, appDataLoc));
+    for (int i = 0; i < outputDim; i++)
+      sOutputs.push_back(
+          ams::ResourceManager::allocate<FPTypeValue>(n, appDataLoc));
+    MortonOrder<FPTypeValue>::gather(order, inputs, sInputs.data(), inputDim);
+    CALIPER(CALI_MARK_END("REORDER");)
+
+    invokePhysics(
+        probDescr, n, sInputs.data(), sOutputs.data(), inputDim, outputDim);
+
+    CALIPER(CALI_MARK_BEGIN("REORDER");)
+    MortonOrder<FPTypeValue>::scatter(
+        order, sOutputs.data(), outputs, outputDim);
+    ams::ResourceManager::deallocate(sInputs, appDataLoc);
+    ams::ResourceManager::deallocate(sOutputs, appDataLoc);
+    CALIPER(CALI_MARK_END("REORDER");)
+  }
+
   /** \brief Store the data in the database and copies
    * data from the GPU to the CPU and then to the database.
    * To store GPU resident data we use a 1MB of "pinned"
@@ -99,6 +309,7 @@ class AMSWorkflow
     // No database, so just de-allocate and return
     if (!DB) return;
 
+    std::lock_guard<std::mutex> lock(dbMutex);
     std::vector<FPTypeValue *> hInputs, hOutputs;
 
     if (appDataLoc == AMSResourceType::HOST)
@@ -192,7 +403,245 @@ public:
 
   void set_physics(AMSPhysicFn _AppCall) { AppCall = _AppCall; }
 
-  ~AMSWorkflow() { DBG(Workflow, "Destroying Workflow Handler"); }
+  /** @brief Adds a second surrogate tier. The points the first surrogate
+   * rejects are packed and evaluated by this surrogate and its UQ, only the
+   * ones it rejects as well are computed by the physics. The cascade uses the
+   * UQ policy of the executor */
+  void setCascade(char *uq_path,
+                  char *surrogate_path,
+                  FPTypeValue threshold,
+                  const int nClusters)
+  {
+    cascadeUQModel = std::make_unique<UQ<FPTypeValue>>(
+        appDataLoc, uqPolicy, uq_path, nClusters, surrogate_path, threshold);
+    CINFO(Workflow,
+          rId == 0,
+          "Cascading surrogate %s (threshold %f)",
+          surrogate_path,
+          static_cast<double>(threshold));
+  }
+
+  /** @brief Standardizes the features of the surrogates inside the
+   * marshaling of their inputs and outputs: the models evaluate
+   * (x - inputOffset) / inputScale and their outputs y are returned as
+   * y * outputScale + outputOffset */
+  void setNormalization(size_t numIn,
+                        const double *inputScale,
+                        const double *inputOffset,
+                        size_t numOut,
+                        const double *outputScale,
+                        const double *outputOffset)
+  {
+    UQModel->setNormalization(
+        numIn, inputScale, inputOffset, numOut, outputScale, outputOffset);
+    if (cascadeUQModel)
+      cascadeUQModel->setNormalization(
+          numIn, inputScale, inputOffset, numOut, outputScale, outputOffset);
+  }
+
+  /** @brief Evaluates the physics and the HDCache searches of calls of at
+   * least 'minElements' points in the Morton order of their inputs */
+  void setReorder(size_t minElements)
+  {
+    reorderMinElements = minElements;
+    UQModel->setReorder(minElements);
+    if (cascadeUQModel) cascadeUQModel->setReorder(minElements);
+  }
+
+  /** @brief Searches KD-tree HDCaches with 'numThreads' threads (less than
+   * 1 selects the number of hardware threads) */
+  void setUQThreads(int numThreads)
+  {
+    if (numThreads <= 0)
+      numThreads = std::max(1u, std::thread::hardware_concurrency());
+    UQModel->setThreads(numThreads);
+    if (cascadeUQModel) cascadeUQModel->setThreads(numThreads);
+    CINFO(Workflow,
+          rId == 0 && numThreads > 1,
+          "Searching KD-tree HDCaches on %d threads",
+          numThreads);
+  }
+
+  /** @brief Declares the physics reentrant, host calls are then split in
+   * chunks evaluated by 'numThreads' threads (0 selects the number of
+   * hardware threads) */
+  void setReentrantPhysics(int numThreads)
+  {
+    if (numThreads <= 0)
+      numThreads = std::max(1u, std::thread::hardware_concurrency());
+    CWARNING(Workflow,
+             rId == 0 && appDataLoc != AMSResourceType::HOST,
+             "Concurrent physics requires host resident data, calling the "
+             "physics serially");
+    // The calling thread takes part in the physics
+    if (numThreads > 1 && appDataLoc == AMSResourceType::HOST)
+      physicsPool = std::make_unique<ThreadPool>(numThreads - 1);
+    CINFO(Workflow,
+          rId == 0 && physicsPool,
+          "Evaluating the physics on %d threads",
+          numThreads);
+  }
+
+  /** @brief Tunes the reordering and the number of physics threads during
+   * the first calls, 'callsPerCandidate' calls per candidate configuration.
+   * The candidates start from the configured knobs, the winner is persisted
+   * to 'cachePath' (if not null) under a key made of the host type, 'model',
+   * the call dimensions and the physics thread limit, runs finding their key
+   * there start tuned */
+  void setAutoTune(const char *cachePath,
+                   const char *model,
+                   int callsPerCandidate)
+  {
+    if (appDataLoc != AMSResourceType::HOST) {
+      CWARNING(Workflow,
+               rId == 0,
+               "The tunable knobs apply to host resident data, disabling the "
+               "tuner");
+      return;
+    }
+    tuner = std::make_unique<AutoTuner>(
+        cachePath ? cachePath : "",
+        model ? model : "",
+        callsPerCandidate,
+        AutoTuner::candidatesFor(reorderMinElements,
+                                 physicsPool ? physicsPool->concurrency() : 0),
+        rId == 0);
+  }
+
+  /** @brief Enables shadow physics on a 'fraction' of the points the
+   * surrogate accepts. The physics runs on a background thread, concurrently
+   * with the application, and at most 'capacity' points are pending. The
+   * physics results feed the error statistics of the surrogate and the
+   * database. Requires host resident data and a thread safe physics. The
+   * problem descriptors of the calls are used until the workflow is
+   * destroyed, the destructor waits for the pending points. */
+  void setShadow(double fraction, size_t capacity)
+  {
+    ShadowSampler<FPTypeValue>::validate(fraction);
+    if (appDataLoc != AMSResourceType::HOST) {
+      CWARNING(Workflow,
+               rId == 0,
+               "Shadow physics requires host resident data, disabling it");
+      return;
+    }
+    shadow = std::make_unique<ShadowSampler<FPTypeValue>>(
+        AppCall,
+        fraction,
+        capacity,
+        [this](size_t n,
+               std::vector<FPTypeValue *> &inputs,
+               std::vector<FPTypeValue *> &outputs) {
+          if (!DB) return;
+          std::lock_guard<std::mutex> lock(dbMutex);
+          DB->store(n, inputs, outputs);
+        },
+        rId);
+    CINFO(Workflow,
+          rId == 0,
+          "Shadow physics on %.4f of the accepted points (capacity %lu)",
+          fraction,
+          capacity);
+  }
+
+  ~AMSWorkflow()
+  {
+    if (shadow) {
+      shadow->drain();
+      auto errors = shadow->errors();
+      for (size_t d = 0; d < errors.size(); d++) {
+        const auto &e = errors[d];
+        CINFO(Workflow,
+              rId == 0 && e.points,
+              "Shadow error of output %lu: mae %g rmse %g max %g (%lu points)",
+              d,
+              e.sumAbs / e.points,
+              std::sqrt(e.sumSquared / e.points),
+              e.maxAbs,
+              e.points);
+      }
+      CWARNING(Workflow,
+               shadow->droppedPoints() > 0,
+               "Shadow physics dropped %lu points, increase its capacity",
+               shadow->droppedPoints());
+      shadow.reset();
+    }
+    if (cascadeUQModel && tiers[0].evaluated) {
+      const double total = tiers[0].evaluated;
+      CINFO(Workflow,
+            rId == 0,
+            "Cascade: surrogate %.3f (%.3fs), cascade surrogate %.3f "
+            "(%.3fs), physics %.3f (%.3fs) of %lu points",
+            tiers[0].accepted / total,
+            tiers[0].seconds,
+            tiers[1].accepted / total,
+            tiers[1].seconds,
+            tiers[2].accepted / total,
+            tiers[2].seconds,
+            tiers[0].evaluated);
+    }
+    DBG(Workflow, "Destroying Workflow Handler");
+  }
+
+  /** @brief Writes the runtime state of the executor (statistics, workspace
+   * sizing hints and UQ state of both tiers of a cascade, including the
+   * points added to the HDCaches) to 'path'. Every rank is expected to use its
+   * own path. */
+  void saveState(const std::string &path) const
+  {
+    ams::AMSState state(sizeof(FPTypeValue));
+    ams::StateBuffer buffer;
+    buffer.put(stats.calls);
+    buffer.put(stats.elements);
+    buffer.put(stats.physicsElements);
+    buffer.put(stats.maxElements);
+    buffer.put(stats.inputDim);
+    buffer.put(stats.outputDim);
+    state.set(ams::AMSStateSection::Workflow, std::move(buffer));
+    if (UQModel) UQModel->saveState(state);
+    // A cascade searching the HDCache of the first tier does not save it twice
+    if (cascadeUQModel)
+      cascadeUQModel->saveState(state,
+                                ams::AMSStateSection::CascadeUQ,
+                                ams::AMSStateSection::CascadeHDCache,
+                                !cascadeUQModel->sharesHDCache(*UQModel));
+    state.save(path);
+    DBG(Workflow, "Saved executor state to %s", path.c_str());
+  }
+
+  /** @brief Restores a state written by saveState and reserves the workspace
+   * of the largest call it recorded */
+  void loadState(const std::string &path)
+  {
+    ams::AMSState state = ams::AMSState::load(path, sizeof(FPTypeValue));
+    if (const std::string *section =
+            state.get(ams::AMSStateSection::Workflow)) {
+      ams::StateView view(*section);
+      stats.calls = view.get<uint64_t>();
+      stats.elements = view.get<uint64_t>();
+      stats.physicsElements = view.get<uint64_t>();
+      stats.maxElements = view.get<uint64_t>();
+      stats.inputDim = view.get<int32_t>();
+      stats.outputDim = view.get<int32_t>();
+    }
+    if (UQModel) UQModel->loadState(state);
+    if (cascadeUQModel)
+      cascadeUQModel->loadState(state,
+                                ams::AMSStateSection::CascadeUQ,
+                                ams::AMSStateSection::CascadeHDCache);
+    else if (state.get(ams::AMSStateSection::CascadeUQ))
+      THROW(std::runtime_error,
+            "The executor state holds a cascade but the executor has none");
+    reserveWorkspace();
+    CINFO(Workflow,
+          rId == 0,
+          "Restored executor state from %s (%lu calls, %lu elements, %.2f "
+          "physics)",
+          path.c_str(),
+          stats.calls,
+          stats.elements,
+          stats.elements ? (double)stats.physicsElements / stats.elements
+                         : 0.0);
+  }
 
 
   /** @brief This is the main entry point of AMSLib and replaces the original
@@ -263,20 +712,28 @@ public:
 
     REPORT_MEM_USAGE(Workflow, "Start")
 
+    const auto callStart = clock::now();
+    if (tuner)
+      applyKnobs(tuner->next(sizeof(FPTypeValue), inputDim, outputDim));
+
     if (!UQModel->hasSurrogate()) {
       FPTypeValue **tmpInputs = const_cast<FPTypeValue **>(inputs);
 
       std::vector<FPTypeValue *> tmpIn(tmpInputs, tmpInputs + inputDim);
       DBG(Workflow, "No-Model, I am calling Physics code (for all data)");
-      AppCall(probDescr,
-              totalElements,
-              reinterpret_cast<const void **>(origInputs.data()),
-              reinterpret_cast<void **>(origOutputs.data()));
+      callPhysics(probDescr,
+                  totalElements,
+                  tmpInputs,
+                  outputs,
+                  inputDim,
+                  outputDim);
       if (DB) {
         CALIPER(CALI_MARK_BEGIN("DBSTORE");)
         Store(totalElements, tmpIn, origOutputs);
         CALIPER(CALI_MARK_END("DBSTORE");)
       }
+      updateStats(totalElements, totalElements, inputDim, outputDim);
+      tuneCall(callStart, totalElements, inputDim, outputDim);
       return;
     }
     // The predicate with which we will split the data on a later step
@@ -288,7 +745,9 @@ public:
     //         to decide if making a ML inference makes sense
     // -------------------------------------------------------------
     CALIPER(CALI_MARK_BEGIN("UQ_MODULE");)
+    auto start = clock::now();
     UQModel->evaluate(totalElements, origInputs, origOutputs, p_ml_acceptable);
+    const double uqTime = elapsed(start);
     CALIPER(CALI_MARK_END("UQ_MODULE");)
 
     DBG(Workflow, "Computed Predicates")
@@ -313,6 +772,7 @@ public:
     // ---- 3a: we need to pack the sparse data based on the uq flag
     const long packedElements = data_handler::pack(
         appDataLoc, predicate, totalElements, origInputs, packedInputs);
+    updateTier(0, totalElements, totalElements - packedElements, uqTime);
 
     // Pointer values which store output data values
     // to be computed using the eos function.
@@ -323,17 +783,59 @@ public:
                                                       appDataLoc));
     }
 
+    // ---- 3a': the cascade surrogate evaluates the rejected points, the
+    // physics computes the ones it rejects as well. Without a cascade the
+    // physics computes all the packed points.
+    long physicsElements = packedElements;
+    std::vector<FPTypeValue *> physicsInputs = packedInputs;
+    std::vector<FPTypeValue *> physicsOutputs = packedOutputs;
+    bool *p_cascade_acceptable = nullptr;
+    if (cascadeUQModel && packedElements > 0) {
+      CALIPER(CALI_MARK_BEGIN("CASCADE_UQ_MODULE");)
+      start = clock::now();
+      p_cascade_acceptable =
+          ams::ResourceManager::allocate<bool>(packedElements, appDataLoc);
+      std::vector<const FPTypeValue *> cascadeInputs(packedInputs.begin(),
+                                                     packedInputs.end());
+      cascadeUQModel->evaluate(packedElements,
+                               cascadeInputs,
+                               packedOutputs,
+                               p_cascade_acceptable);
+
+      physicsInputs.clear();
+      for (int i = 0; i < inputDim; i++)
+        physicsInputs.emplace_back(
+            ams::ResourceManager::allocate<FPTypeValue>(packedElements,
+                                                        appDataLoc));
+      physicsElements = data_handler::pack(appDataLoc,
+                                           p_cascade_acceptable,
+                                           packedElements,
+                                           cascadeInputs,
+                                           physicsInputs);
+      physicsOutputs.clear();
+      for (int i = 0; i < outputDim; i++)
+        physicsOutputs.emplace_back(
+            ams::ResourceManager::allocate<FPTypeValue>(physicsElements,
+                                                        appDataLoc));
+      updateTier(1,
+                 packedElements,
+                 packedElements - physicsElements,
+                 elapsed(start));
+      CALIPER(CALI_MARK_END("CASCADE_UQ_MODULE");)
+    }
+
+    start = clock::now();
     {
-      void **iPtr = reinterpret_cast<void **>(packedInputs.data());
-      void **oPtr = reinterpret_cast<void **>(packedOutputs.data());
-      long lbElements = packedElements;
+      void **iPtr = reinterpret_cast<void **>(physicsInputs.data());
+      void **oPtr = reinterpret_cast<void **>(physicsOutputs.data());
+      long lbElements = physicsElements;
 
 #ifdef __ENABLE_MPI__
       CALIPER(CALI_MARK_BEGIN("LOAD BALANCE MODULE");)
       AMSLoadBalancer<FPTypeValue> lBalancer(
-          rId, wSize, packedElements, Comm, inputDim, outputDim, appDataLoc);
+          rId, wSize, physicsElements, Comm, inputDim, outputDim, appDataLoc);
       if (ePolicy == AMSExecPolicy::BALANCED && Comm) {
-        lBalancer.scatterInputs(packedInputs, appDataLoc);
+        lBalancer.scatterInputs(physicsInputs, appDataLoc);
         iPtr = reinterpret_cast<void **>(lBalancer.inputs());
         oPtr = reinterpret_cast<void **>(lBalancer.outputs());
         lbElements = lBalancer.getBalancedSize();
@@ -342,33 +844,55 @@ public:
 #endif
 
       // ---- 3b: call the physics module and store in the data base
-      if (packedElements > 0) {
+      if (physicsElements > 0) {
         CALIPER(CALI_MARK_BEGIN("PHYSICS MODULE");)
-        AppCall(probDescr, lbElements, iPtr, oPtr);
+        callPhysics(probDescr,
+                    lbElements,
+                    reinterpret_cast<FPTypeValue **>(iPtr),
+                    reinterpret_cast<FPTypeValue **>(oPtr),
+                    inputDim,
+                    outputDim);
         CALIPER(CALI_MARK_END("PHYSICS MODULE");)
       }
 
 #ifdef __ENABLE_MPI__
       CALIPER(CALI_MARK_BEGIN("LOAD BALANCE MODULE");)
       if (ePolicy == AMSExecPolicy::BALANCED && Comm) {
-        lBalancer.gatherOutputs(packedOutputs, appDataLoc);
+        lBalancer.gatherOutputs(physicsOutputs, appDataLoc);
       }
       CALIPER(CALI_MARK_END("LOAD BALANCE MODULE");)
 #endif
     }
-
-    // ---- 3c: unpack the data
+    updateTier(2, physicsElements, physicsElements, elapsed(start));
+
+    // ---- 3c: unpack the data, first the physics results into the ones of
+    // the cascade surrogate
+    if (p_cascade_acceptable)
+      data_handler::unpack(appDataLoc,
+                           p_cascade_acceptable,
+                           packedElements,
+                           physicsOutputs,
+                           packedOutputs);
     data_handler::unpack(
         appDataLoc, predicate, totalElements, packedOutputs, origOutputs);
 
+    // ---- 3d: queue a sample of the accepted points for the shadow physics,
+    // only the copy to the side buffer is on the critical path
+    if (shadow) {
+      CALIPER(CALI_MARK_BEGIN("SHADOW_SAMPLE");)
+      shadow->sample(
+          probDescr, totalElements, predicate, origInputs, origOutputs);
+      CALIPER(CALI_MARK_END("SHADOW_SAMPLE");)
+    }
+
     DBG(Workflow, "Finished physics evaluation")
 
     if (DB) {
       CALIPER(CALI_MARK_BEGIN("DBSTORE");)
       DBG(Workflow,
           "Storing data (#elements = %d) to database",
-          packedElements);
-      Store(packedElements, packedInputs, packedOutputs);
+          physicsElements);
+      Store(physicsElements, physicsInputs, physicsOutputs);
       CALIPER(CALI_MARK_END("DBSTORE");)
     }
 
@@ -380,16 +904,30 @@ public:
     for (int i = 0; i < outputDim; i++)
       ams::ResourceManager::deallocate(packedOutputs[i], appDataLoc);
 
+    if (p_cascade_acceptable) {
+      ams::ResourceManager::deallocate(physicsInputs, appDataLoc);
+      ams::ResourceManager::deallocate(physicsOutputs, appDataLoc);
+      ams::ResourceManager::deallocate(p_cascade_acceptable, appDataLoc);
+    }
+
     ams::ResourceManager::deallocate(p_ml_acceptable, appDataLoc);
+    updateStats(totalElements, physicsElements, inputDim, outputDim);
+    tuneCall(callStart, totalElements, inputDim, outputDim);
 
     DBG(Workflow, "Finished AMSExecution")
     CINFO(Workflow,
           rId == 0,
           "Computed %ld "
           "using physics out of the %ld items (%.2f)",
-          packedElements,
+          physicsElements,
           totalElements,
-          (float)(packedElements) / float(totalElements))
+          (float)(physicsElements) / float(totalElements))
+    CDEBUG(Workflow,
+           rId == 0 && cascadeUQModel,
+           "The cascade surrogate computed %ld of the %ld items the "
+           "surrogate rejected",
+           packedElements - physicsElements,
+           packedElements)
 
     REPORT_MEM_USAGE(Workflow, "End")
   }
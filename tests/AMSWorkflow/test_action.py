@@ -0,0 +1,92 @@
+#!/usr/bin/env python3
+# Copyright 2021-2023 Lawrence Livermore National Security, LLC and other
+# AMSLib Project Developers
+#
+# SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+
+import json
+import os
+import tempfile
+import unittest
+
+import numpy as np
+
+from ams.action import ActionChain, AffineTransform, BoundsFilter, DropNonFinite, LogTransform, RunningStats
+
+
+class TestDataActions(unittest.TestCase):
+    def setUp(self):
+        rng = np.random.default_rng(0)
+        self.inputs = rng.random((1000, 3))
+        self.outputs = rng.random((1000, 2)).astype(np.float32)
+
+    def test_drop_non_finite(self):
+        inputs, outputs = self.inputs.copy(), self.outputs.copy()
+        inputs[3, 1] = np.nan
+        outputs[7, 0] = np.inf
+        outputs[9, 1] = -np.inf
+        i, o = DropNonFinite()(inputs, outputs)
+        self.assertEqual(i.shape, (997, 3))
+        self.assertEqual(o.shape, (997, 2))
+        self.assertTrue(np.isfinite(i).all() and np.isfinite(o).all())
+
+        # Nothing to drop, the arrays are forwarded untouched
+        i, o = DropNonFinite()(self.inputs, self.outputs)
+        self.assertIs(i, self.inputs)
+        self.assertIs(o, self.outputs)
+
+    def test_bounds(self):
+        i, o = BoundsFilter.from_spec("inputs:0.25:0.75:0,2")(self.inputs, self.outputs)
+        mask = ((self.inputs[:, [0, 2]] >= 0.25) & (self.inputs[:, [0, 2]] <= 0.75)).all(axis=1)
+        np.testing.assert_array_equal(i, self.inputs[mask])
+        np.testing.assert_array_equal(o, self.outputs[mask])
+
+        i, o = BoundsFilter.from_spec("outputs:0.5:1")(self.inputs, self.outputs)
+        self.assertTrue((o >= 0.5).all())
+        self.assertEqual(len(i), len(o))
+
+        with self.assertRaises(ValueError):
+            BoundsFilter.from_spec("both:0:1")
+        with self.assertRaises(ValueError):
+            BoundsFilter.from_spec("inputs:0")
+
+    def test_transforms(self):
+        i, o = AffineTransform.from_spec("inputs:2:-1:1")(self.inputs.copy(), self.outputs)
+        np.testing.assert_allclose(i[:, 1], self.inputs[:, 1] * 2 - 1)
+        np.testing.assert_array_equal(i[:, [0, 2]], self.inputs[:, [0, 2]])
+
+        i, o = LogTransform.from_spec("outputs:1")(self.inputs, self.outputs.copy())
+        self.assertEqual(o.dtype, np.float32)
+        np.testing.assert_allclose(o, np.log(self.outputs + 1), rtol=1e-6)
+
+        # Read-only and integer data are transformed out of place
+        ro = self.inputs.copy()
+        ro.flags.writeable = False
+        i, _ = AffineTransform("inputs", 3, 0)(ro, self.outputs)
+        np.testing.assert_allclose(i, ro * 3)
+        i, _ = LogTransform("inputs")(np.ones((4, 2), dtype=np.int32), self.outputs[:4])
+        np.testing.assert_array_equal(i, np.zeros((4, 2)))
+
+    def test_running_stats(self):
+        with tempfile.TemporaryDirectory() as tmpdir:
+            fn = os.path.join(tmpdir, "stats.json")
+            chain = ActionChain([DropNonFinite(), RunningStats(fn)])
+            for b in np.array_split(np.arange(1000), 7):
+                chain(self.inputs[b], self.outputs[b])
+            chain.finalize()
+            with open(fn, "r") as fd:
+                stats = json.load(fd)
+        self.assertEqual(stats["rows"], 1000)
+        np.testing.assert_allclose(stats["inputs"]["mean"], self.inputs.mean(axis=0))
+        np.testing.assert_allclose(stats["inputs"]["var"], self.inputs.var(axis=0))
+        np.testing.assert_allclose(stats["outputs"]["var"], self.outputs.astype(np.float64).var(axis=0), rtol=1e-6)
+
+    def test_chain_stops_on_empty(self):
+        chain = ActionChain([BoundsFilter("inputs", 2, 3), AffineTransform("inputs", 2, 0)])
+        i, o = chain(self.inputs, self.outputs)
+        self.assertEqual(i.shape[0], 0)
+        self.assertEqual(o.shape[0], 0)
+
+
+if __name__ == "__main__":
+    unittest.main()
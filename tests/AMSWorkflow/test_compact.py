@@ -0,0 +1,100 @@
+#!/usr/bin/env python3
+# Copyright 2021-2023 Lawrence Livermore National Security, LLC and other
+# AMSLib Project Developers
+#
+# SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+
+import os
+import tempfile
+import unittest
+from pathlib import Path
+
+import numpy as np
+
+from ams.compact import Compactor, load_index, plan_shards, shard_files
+from ams.faccessors import HDF5PackedReader, HDF5Writer
+
+
+class TestCompactor(unittest.TestCase):
+    def setUp(self):
+        self.tmpdir = tempfile.TemporaryDirectory()
+        self.src = Path(self.tmpdir.name) / "src"
+        self.dest = Path(self.tmpdir.name) / "shards"
+        self.src.mkdir()
+        self.sources = list()
+        # Every row is identified by its first input value
+        row_id = 0
+        for rank, rows in enumerate([37, 120, 5, 64, 0, 91, 33]):
+            ids = np.arange(row_id, row_id + rows, dtype=np.float64)
+            row_id += rows
+            fn = str(self.src / f"rank_{rank}.h5")
+            with HDF5Writer(fn) as fd:
+                if rows:
+                    fd.store(np.stack((ids, ids * 2), axis=1), np.stack((ids * 3,), axis=1))
+            self.sources.append(fn)
+        self.num_rows = row_id
+
+    def tearDown(self):
+        self.tmpdir.cleanup()
+
+    def read_shards(self, shards):
+        data = list()
+        for fn in shards:
+            with HDF5PackedReader(fn) as fd:
+                i, o = fd.load()
+            np.testing.assert_array_equal(i[:, 1], i[:, 0] * 2)
+            np.testing.assert_array_equal(o[:, 0], i[:, 0] * 3)
+            data.append(i[:, 0])
+        return data
+
+    def verify(self, shards, shard_rows):
+        data = self.read_shards(shards)
+        self.assertEqual(len(shards), int(np.ceil(self.num_rows / shard_rows)))
+        self.assertTrue(all(len(d) == shard_rows for d in data[:-1]))
+        ids = np.concatenate(data)
+        np.testing.assert_array_equal(np.sort(ids), np.arange(self.num_rows))
+        self.assertFalse(np.array_equal(ids, np.arange(self.num_rows)))
+        return ids
+
+    def test_plan(self):
+        shards = plan_shards([10, 0, 25, 7], 8, 0)
+        self.assertEqual([sum(e - s for _, s, e in p) for p in shards], [8, 8, 8, 8, 8, 2])
+        covered = sorted((src, s, e) for p in shards for src, s, e in p)
+        self.assertEqual(covered[0][0], 0)
+        self.assertEqual(sum(e - s for _, s, e in covered), 42)
+
+    def test_compact(self):
+        ids = self.verify(Compactor(self.sources, self.dest, 100)(), 100)
+        index = load_index(self.dest)
+        self.assertTrue(index["complete"])
+        self.assertEqual(index["num_rows"], self.num_rows)
+        # Parallel compaction is identical to the sequential one
+        dest = Path(self.tmpdir.name) / "parallel"
+        parallel = self.verify(Compactor(self.sources, dest, 100, workers=2)(), 100)
+        np.testing.assert_array_equal(ids, parallel)
+
+    def test_resume(self):
+        compactor = Compactor(self.sources, self.dest, 64)
+        ids = self.verify(compactor(), 64)
+
+        # Emulate an interrupted run: a shard is missing and another one is half written
+        index = load_index(self.dest)
+        index["complete"] = False
+        compactor.index = index
+        compactor._write_index()
+        os.remove(self.dest / index["shards"][1]["file"])
+        os.rename(self.dest / index["shards"][2]["file"], self.dest / "shard_000002.tmp")
+        with self.assertRaises(RuntimeError):
+            shard_files(self.dest)
+
+        resumed = Compactor(self.sources, self.dest, 64)
+        self.assertEqual(resumed.pending(), [1, 2])
+        np.testing.assert_array_equal(self.verify(resumed(), 64), ids)
+        self.assertFalse((self.dest / "shard_000002.tmp").exists())
+
+        with self.assertRaises(ValueError):
+            Compactor(self.sources, self.dest, 32).plan()
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -117,6 +117,46 @@ class TestH5PackedWriter(TestWriter):
             fn.unlink()
 
 
+class TestBufferedHDF5Writer(unittest.TestCase):
+    fn = "ams_test_buffered." + faccessors.HDF5PackedWriter.get_file_format_suffix()
+
+    def _store_blobs(self, cls, **kwargs):
+        blobs = [(np.random.rand(n, 2), np.random.rand(n, 3)) for n in (5, 17, 1, 40, 9, 33)]
+        fd = test_open(lambda fn: cls(fn, **kwargs), self.fn)
+        for i, o in blobs:
+            fd.store(i, o)
+        fd.close()
+        inputs = np.concatenate([b[0] for b in blobs])
+        outputs = np.concatenate([b[1] for b in blobs])
+        return fd, inputs, outputs
+
+    def test_aligned_flushes(self):
+        # A tiny buffer forces flushes while storing, every one of them must end on a chunk boundary
+        fd, inputs, outputs = self._store_blobs(faccessors.HDF5PackedWriter, chunk_rows=16, buffer_size=256)
+        self.assertGreater(len(fd.flushes), 1, msg="Buffered writer did not flush while storing")
+        written = 0
+        for rows, _, _ in fd.flushes[:-1]:
+            written += rows
+            self.assertEqual(written % 16, 0, msg="Flush is not aligned to the dataset chunks")
+
+        with h5py.File(self.fn, "r") as h5:
+            self.assertEqual(h5["inputs"].chunks[0], 16)
+            self.assertTrue(np.array_equal(np.array(h5["inputs"]), inputs), msg="Buffered writes lose information")
+            self.assertTrue(np.array_equal(np.array(h5["outputs"]), outputs), msg="Buffered writes lose information")
+
+    def test_compression(self):
+        fd, inputs, outputs = self._store_blobs(faccessors.HDF5Writer, chunk_rows=8, compression="gzip")
+        self.assertEqual(len(fd.flushes), 1, msg="Data smaller than the buffer should be written on close")
+        with h5py.File(self.fn, "r") as h5:
+            self.assertEqual(h5["input_0"].compression, "gzip")
+            self.assertTrue(np.array_equal(np.array(h5["output_2"]), outputs[:, 2]))
+
+    def tearDown(self):
+        fn = pathlib.Path(self.fn)
+        if fn.exists():
+            fn.unlink()
+
+
 class TestReader(unittest.TestCase):
     def _open_close(self, cls, fn):
         fd = test_open(cls, fn)
@@ -149,6 +189,38 @@ class TestReader(unittest.TestCase):
         )
 
 
+class TestBlockReader(TestReader):
+    def _cmp_blocks(self, writer_cls, reader_cls, fn):
+        fd = test_open(writer_cls, fn)
+        inputs = np.random.rand(1000, 3)
+        outputs = np.random.rand(1000, 2)
+        fd.store(inputs, outputs)
+        fd.close()
+
+        # 40 rows of 5 doubles per block
+        fd = test_open(reader_cls, fn)
+        blocks = list(fd.load_blocks(40 * 5 * 8))
+        fd.close()
+        self.assertEqual(len(blocks), 25, msg=f"Unexpected number of blocks read with {reader_cls}")
+        self.assertTrue(all(b[0].shape == (40, 3) and b[1].shape == (40, 2) for b in blocks))
+        self.assertTrue(np.array_equal(np.concatenate([b[0] for b in blocks]), inputs))
+        self.assertTrue(np.array_equal(np.concatenate([b[1] for b in blocks]), outputs))
+
+    def test_hdf5_blocks(self):
+        self._cmp_blocks(faccessors.HDF5Writer, faccessors.HDF5CLibReader, self.fn)
+
+    def test_hdf5_packed_blocks(self):
+        self._cmp_blocks(faccessors.HDF5PackedWriter, faccessors.HDF5PackedReader, self.fn)
+
+    def setUp(self):
+        self.fn = "ams_test_blocks." + faccessors.HDF5PackedReader.get_file_format_suffix()
+
+    def tearDown(self):
+        fn = pathlib.Path(self.fn)
+        if fn.exists():
+            fn.unlink()
+
+
 class TestCSVReader(TestReader):
     def test_load(self):
         fn = "ams_test." + faccessors.CSVReader.get_file_format_suffix()
@@ -185,5 +257,73 @@ class TestHDF5PackedReader(TestReader):
             fn.unlink()
 
 
+class TestColumnar(TestReader):
+    def test_load(self):
+        super()._cmp(faccessors.ColumnarWriter, faccessors.ColumnarReader, self.fn)
+
+    def test_chunks(self):
+        inputs = np.random.rand(1000, 3)
+        outputs = np.random.rand(1000, 2).astype(np.float32)
+        # Unaligned batches go through the buffers, aligned ones are written directly
+        with faccessors.get_writer("columnar")(self.fn, chunk_rows=128) as fd:
+            for start, end in [(0, 100), (100, 356), (356, 384), (384, 896), (896, 1000)]:
+                fd.store(inputs[start:end], outputs[start:end])
+
+        with faccessors.get_reader("columnar")(self.fn) as fd:
+            self.assertEqual(fd.num_rows(), 1000)
+            i, o = fd.load()
+            np.testing.assert_array_equal(i, inputs)
+            np.testing.assert_array_equal(o, outputs)
+            self.assertEqual(o.dtype, np.float32)
+
+            # Ranges within a chunk are views of the mapped file
+            i, o = fd.load_range(130, 250)
+            self.assertFalse(i.flags.owndata or i.flags.writeable)
+            np.testing.assert_array_equal(i, inputs[130:250])
+            i, o = fd.load_range(100, 900)
+            np.testing.assert_array_equal(o, outputs[100:900])
+
+            blocks = list(fd.load_blocks(100 * (3 * 8 + 2 * 4)))
+        self.assertEqual([len(b[0]) for b in blocks], [100, 28] * 7 + [100, 4])
+        np.testing.assert_array_equal(np.concatenate([b[0] for b in blocks]), inputs)
+        self.assertTrue(all(not b[1].flags.owndata for b in blocks))
+
+    def test_empty(self):
+        faccessors.ColumnarWriter(self.fn).open().close()
+        with faccessors.ColumnarReader(self.fn) as fd:
+            self.assertEqual(fd.num_rows(), 0)
+            self.assertEqual(list(fd.load_blocks(1024)), [])
+            self.assertEqual(len(fd.load()[0]), 0)
+
+    def test_shape(self):
+        # Batches of another row shape are rejected, including the aligned ones that are not copied
+        with faccessors.ColumnarWriter(self.fn, chunk_rows=4) as fd:
+            fd.store(np.zeros((4, 3)), np.zeros((4, 2)))
+            with self.assertRaises(ValueError):
+                fd.store(np.zeros((4, 2)), np.zeros((4, 2)))
+            with self.assertRaises(ValueError):
+                fd.store(np.zeros((2, 3)), np.zeros((2, 2, 1)))
+            fd.store(np.ones((2, 3)), np.ones((2, 2)))
+        with faccessors.ColumnarReader(self.fn) as fd:
+            i, o = fd.load()
+            self.assertEqual(i.shape, (6, 3))
+            np.testing.assert_array_equal(o[4:], np.ones((2, 2)))
+
+    def test_incomplete(self):
+        fd = faccessors.ColumnarWriter(self.fn).open()
+        fd.store(np.zeros((10, 2)), np.zeros((10, 1)))
+        with self.assertRaises(RuntimeError):
+            faccessors.ColumnarReader(self.fn).open()
+        fd.close()
+
+    def setUp(self):
+        self.fn = "ams_test." + faccessors.ColumnarReader.get_file_format_suffix()
+
+    def tearDown(self):
+        fn = pathlib.Path(self.fn)
+        if fn.exists():
+            fn.unlink()
+
+
 if __name__ == "__main__":
     unittest.main()
@@ -0,0 +1,51 @@
+#!/usr/bin/env python3
+# Copyright 2021-2023 Lawrence Livermore National Security, LLC and other
+# AMSLib Project Developers
+#
+# SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+
+import tempfile
+import unittest
+from pathlib import Path
+
+import numpy as np
+
+from ams import kdtree
+from ams.faccessors import HDF5Writer
+
+
+class TestKDTree(unittest.TestCase):
+    def setUp(self):
+        self.tmpdir = tempfile.TemporaryDirectory()
+        self.inputs = np.random.default_rng(5).uniform(size=(300, 3))
+
+    def tearDown(self):
+        self.tmpdir.cleanup()
+
+    def test_save_load(self):
+        fn = str(Path(self.tmpdir.name) / "tree.kdt")
+        for dtype in (np.float32, np.float64):
+            kdtree.save(fn, self.inputs, leaf_size=16, dtype=dtype)
+            with open(fn, "rb") as fd:
+                self.assertEqual(fd.read(len(kdtree.MAGIC)), kdtree.MAGIC)
+            loaded = kdtree.load(fn)
+            self.assertEqual(loaded.dtype, dtype)
+            np.testing.assert_array_equal(loaded, self.inputs.astype(dtype))
+
+    def test_from_files(self):
+        inputs = self.inputs.copy()
+        inputs[7, 1] = np.nan
+        sources = list()
+        for i, part in enumerate(np.array_split(inputs, 3)):
+            fn = str(Path(self.tmpdir.name) / f"rank_{i}.h5")
+            with HDF5Writer(fn) as fd:
+                fd.store(part, part[:, :1])
+            sources.append(fn)
+        fn = str(Path(self.tmpdir.name) / "tree.kdt")
+        # The row with a NaN is dropped
+        self.assertEqual(kdtree.from_files(sources, fn), len(inputs) - 1)
+        np.testing.assert_allclose(kdtree.load(fn), np.delete(self.inputs, 7, axis=0))
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,72 @@
+#!/usr/bin/env python3
+# Copyright 2021-2023 Lawrence Livermore National Security, LLC and other
+# AMSLib Project Developers
+#
+# SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+
+import tempfile
+import unittest
+from pathlib import Path
+
+import numpy as np
+
+from ams.faccessors import HDF5Writer
+from ams.occupancy import OccupancyGrid
+
+
+class TestOccupancyGrid(unittest.TestCase):
+    def setUp(self):
+        self.tmpdir = tempfile.TemporaryDirectory()
+        rng = np.random.default_rng(3)
+        # Two clusters on the diagonal of [0, 1]^3
+        self.centers = np.array([0.25, 0.75])
+        self.inputs = np.concatenate([c + rng.uniform(-0.02, 0.02, size=(500, 3)) for c in self.centers])
+
+    def tearDown(self):
+        self.tmpdir.cleanup()
+
+    def test_contains(self):
+        grid = OccupancyGrid([0] * 3, [1] * 3, bits=(5, 2))
+        grid.add(self.inputs)
+        self.assertEqual(grid.bits, [2, 5])
+        for b in grid.bits:
+            self.assertTrue(np.all(grid.contains(self.inputs, b)))
+        queries = np.array([[0.25, 0.75, 0.25], [1.5, 0.25, 0.25], [np.nan, 0.25, 0.25], [0.3, 0.3, 0.3]])
+        # The last query shares the cell of the first cluster only at the coarse level
+        self.assertEqual(grid.contains(queries, 2).tolist(), [False, False, False, True])
+        self.assertEqual(grid.contains(queries, 5).tolist(), [False, False, False, False])
+        self.assertEqual(sum(grid.levels[2].values()), len(self.inputs))
+
+    def test_min_count(self):
+        grid = OccupancyGrid([0] * 3, [1] * 3, bits=(2,), min_count=len(self.inputs))
+        grid.add(self.inputs)
+        self.assertFalse(np.any(grid.contains(self.inputs, 2)))
+
+    def test_save_load(self):
+        grid = OccupancyGrid([0] * 3, [1] * 3, bits=(3, 6), min_count=2)
+        grid.add(self.inputs)
+        fn = str(Path(self.tmpdir.name) / "grid.bin")
+        grid.save(fn)
+        loaded = OccupancyGrid.load(fn)
+        self.assertEqual(loaded.bits, grid.bits)
+        self.assertEqual(loaded.min_count, 2)
+        self.assertEqual(loaded.levels, grid.levels)
+        np.testing.assert_array_equal(loaded.lo, grid.lo)
+        np.testing.assert_array_equal(loaded.hi, grid.hi)
+
+    def test_from_files(self):
+        sources = list()
+        for i, part in enumerate(np.array_split(self.inputs, 3)):
+            fn = str(Path(self.tmpdir.name) / f"rank_{i}.h5")
+            with HDF5Writer(fn) as fd:
+                fd.store(part, part[:, :1])
+            sources.append(fn)
+        grid = OccupancyGrid.from_files(sources, "shdf5", bits=(4,))
+        np.testing.assert_allclose(grid.lo, self.inputs.min(axis=0))
+        np.testing.assert_allclose(grid.hi, self.inputs.max(axis=0))
+        self.assertEqual(sum(grid.levels[4].values()), len(self.inputs))
+        self.assertTrue(np.all(grid.contains(self.inputs, 4)))
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,108 @@
+#!/usr/bin/env python3
+# Copyright 2021-2023 Lawrence Livermore National Security, LLC and other
+# AMSLib Project Developers
+#
+# SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+
+import json
+import os
+import tempfile
+import unittest
+from types import SimpleNamespace
+
+from ams.rmq_async import RMQConsumer
+
+
+class FakeIOLoop:
+    def __init__(self):
+        self.timers = list()
+
+    def call_later(self, delay, callback):
+        timer = (delay, callback)
+        self.timers.append(timer)
+        return timer
+
+    def remove_timeout(self, timer):
+        self.timers.remove(timer)
+
+    def fire(self):
+        timers, self.timers = self.timers, list()
+        for _, cb in timers:
+            cb()
+
+
+class FakeChannel:
+    is_open = True
+
+    def __init__(self):
+        self.acks = list()
+
+    def basic_ack(self, delivery_tag, multiple=False):
+        self.acks.append((delivery_tag, multiple))
+
+
+class TestRMQConsumerAcks(unittest.TestCase):
+    def setUp(self):
+        self.tmpdir = tempfile.TemporaryDirectory()
+        self.creds = os.path.join(self.tmpdir.name, "creds.json")
+        with open(self.creds, "w") as fd:
+            json.dump({"service-host": "localhost", "rabbitmq-tls": False}, fd)
+        self.handed_off = list()
+
+    def tearDown(self):
+        self.tmpdir.cleanup()
+
+    def consumer(self, **kwargs):
+        consumer = RMQConsumer(
+            self.creds, None, "test", on_message_cb=lambda ch, d, p, body: self.handed_off.append(body), **kwargs
+        )
+        consumer._connection = SimpleNamespace(ioloop=FakeIOLoop())
+        consumer._channel = FakeChannel()
+        return consumer
+
+    def deliver(self, consumer, tag, body=b"\0" * 16):
+        consumer.on_message(consumer._channel, SimpleNamespace(delivery_tag=tag), None, body)
+
+    def test_tls_requires_certificate(self):
+        # Without a certificate, plain AMQP requires an explicit opt-out in the credentials
+        creds = os.path.join(self.tmpdir.name, "tls.json")
+        with open(creds, "w") as fd:
+            json.dump({"service-host": "localhost"}, fd)
+        with self.assertRaises(ValueError):
+            RMQConsumer(creds, None, "test")
+        self.assertTrue(RMQConsumer(creds, "ca.pem", "test").use_tls)
+        self.assertFalse(self.consumer().use_tls)
+
+    def test_ack_every(self):
+        consumer = self.consumer(prefetch_count=8, ack_every=4)
+        for tag in range(1, 11):
+            self.deliver(consumer, tag)
+        self.assertEqual(len(self.handed_off), 10)
+        self.assertEqual(consumer._channel.acks, [(4, True), (8, True)])
+        consumer.flush_acks()
+        self.assertEqual(consumer._channel.acks[-1], (10, True))
+        self.assertEqual(consumer.stats.messages, 10)
+        self.assertEqual(consumer.stats.bytes, 160)
+        self.assertEqual(consumer.stats.acks, 3)
+
+    def test_ack_capped_by_prefetch(self):
+        consumer = self.consumer(prefetch_count=2, ack_every=100)
+        for tag in range(1, 5):
+            self.deliver(consumer, tag)
+        self.assertEqual(consumer._channel.acks, [(2, True), (4, True)])
+
+    def test_ack_interval(self):
+        consumer = self.consumer(prefetch_count=64, ack_every=16, ack_interval_ms=10)
+        self.deliver(consumer, 1)
+        self.deliver(consumer, 2)
+        self.assertEqual(consumer._channel.acks, [])
+        self.assertEqual(len(consumer._connection.ioloop.timers), 1)
+        consumer._connection.ioloop.fire()
+        self.assertEqual(consumer._channel.acks, [(2, True)])
+        # Nothing pending, no timer and no ack
+        consumer.flush_acks()
+        self.assertEqual(len(consumer._channel.acks), 1)
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -4,6 +4,7 @@
 #
 # SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
 
+import argparse
 import glob
 import json
 import os
@@ -120,6 +121,68 @@ class TestStage(unittest.TestCase):
         msg = o_q.get()
         self.assertTrue(msg.is_terminate(), "Message should had been terminate")
 
+    def test_routed_queue(self):
+        from queue import Queue
+
+        queues = [Queue() for i in range(3)]
+        rq = stage.RoutedQueue(queues, "hash")
+        for i in range(12):
+            rq.put(stage.QueueMessage(stage.MessageType.Process, i, key=f"file_{i % 2}"))
+        rq.put(stage.QueueMessage(stage.MessageType.Terminate, None))
+        sizes = [q.qsize() for q in queues]
+        self.assertEqual(sorted(sizes)[-2:], [7, 7], "Hash routing should keep every key in a single shard")
+        for q in queues:
+            keys = set()
+            while True:
+                msg = q.get()
+                if msg.is_terminate():
+                    break
+                keys.add(msg.key)
+            self.assertLessEqual(len(keys), 2)
+            self.assertTrue(q.empty(), "Terminate should be the last message of every shard")
+
+        rq = stage.RoutedQueue(queues, "round-robin")
+        for i in range(9):
+            rq.put(stage.QueueMessage(stage.MessageType.Process, i))
+        self.assertEqual([q.qsize() for q in queues], [3, 3, 3], "Round robin should balance the shards")
+
+    def test_shm_transport(self):
+        transport = stage.SharedMemoryTransport(num_slots=2, slot_size=1024)
+        try:
+            in_data, out_data = np.random.rand(3, 2), np.random.rand(3, 5).astype(np.float32)
+            payload = transport.pack(stage.DataBlob(in_data, out_data))
+            self.assertIsInstance(payload, stage.SlotDescriptor, "Blob fitting in a slot was sent by value")
+            blob = transport.unpack(payload)
+            self.assertTrue(np.array_equal(in_data, blob.inputs), "Inputs do not match after the transport")
+            self.assertTrue(np.array_equal(out_data, blob.outputs), "Outputs do not match after the transport")
+
+            # Actions returning the unpacked views unchanged do not rewrite the slot
+            self.assertIs(transport.repack(payload, blob), payload, "Unchanged views should keep the payload")
+            # A prefix of the views starts at the same address but is rewritten
+            prefix = transport.repack(payload, stage.DataBlob(blob.inputs[:2], blob.outputs[:2]))
+            self.assertEqual(payload.slot, prefix.slot, "Repack should re-use the slot")
+            blob = transport.unpack(prefix)
+            self.assertTrue(np.array_equal(in_data[:2], blob.inputs), "Repacked prefix inputs do not match")
+            self.assertTrue(np.array_equal(out_data[:2], blob.outputs), "Repacked prefix outputs do not match")
+            transport.release(prefix)
+            payload = transport.pack(stage.DataBlob(in_data, out_data))
+            blob = transport.unpack(payload)
+
+            # Re-packing a transformation of the slot contents keeps the same slot
+            new_payload = transport.repack(payload, stage.DataBlob(blob.outputs[:, :2], blob.inputs * 2))
+            self.assertEqual(payload.slot, new_payload.slot, "Repack should re-use the slot")
+            blob = transport.unpack(new_payload)
+            self.assertTrue(np.array_equal(out_data[:, :2], blob.inputs), "Repacked inputs do not match")
+            self.assertTrue(np.array_equal(in_data * 2, blob.outputs), "Repacked outputs do not match")
+
+            # Blobs larger than a slot travel by value
+            large = stage.DataBlob(np.random.rand(100, 2), np.random.rand(100, 2))
+            self.assertIs(transport.pack(large), large, "Large blobs should be sent by value")
+            transport.release(new_payload)
+            del blob
+        finally:
+            transport.close()
+
     def verify(self, data, reader):
         ams_config = AMSInstance()
         with store.AMSDataStore(ams_config.db_path, ams_config.db_store, ams_config.name, False) as fd:
@@ -197,6 +260,130 @@ class TestStage(unittest.TestCase):
                     fn = "{0}/data_{1}.{2}".format(self.i_dir, j, src_wr.get_file_format_suffix())
                     Path(fn).unlink()
 
+    def test_fs_pipeline_shm(self):
+        data = list()
+        for i in range(0, 10):
+            in_data, out_data = np.random.rand(3, 2), np.random.rand(3, 3)
+            data.append((in_data, out_data))
+
+        src_wr = get_writer("dhdf5")
+        for j, (i, o) in enumerate(data):
+            fn = "{0}/data_{1}.{2}".format(self.i_dir, j, src_wr.get_file_format_suffix())
+            with src_wr(fn) as fd:
+                fd.store(i, o)
+
+        # Fewer slots than files, the loader has to wait for slots to be released
+        pipe = stage.FSPipeline(
+            self.o_dir,
+            True,
+            self.o_dir,
+            None,
+            "dhdf5",
+            self.i_dir,
+            "dhdf5",
+            "*.{0}".format(src_wr.get_file_format_suffix()),
+            transport_opts={"num_slots": 2, "slot_size": 4096},
+        )
+        pipe.add_data_action(lambda i, o: (i, o))
+        with timeout(10, error_message="Pipeline over shared memory took too long"):
+            pipe.execute("process")
+        self.verify(data, get_reader("dhdf5"))
+
+        for j, (i, o) in enumerate(data):
+            fn = "{0}/data_{1}.{2}".format(self.i_dir, j, src_wr.get_file_format_suffix())
+            Path(fn).unlink()
+
+    def test_fs_pipeline_sharded(self):
+        data = list()
+        for i in range(0, 10):
+            in_data, out_data = np.random.rand(3, 2), np.random.rand(3, 3)
+            data.append((in_data, out_data))
+
+        src_wr = get_writer("dhdf5")
+        for j, (i, o) in enumerate(data):
+            fn = "{0}/data_{1}.{2}".format(self.i_dir, j, src_wr.get_file_format_suffix())
+            with src_wr(fn) as fd:
+                fd.store(i, o)
+
+        # Loaders fan-in to the action (or directly to the writers), which fan-out to the writers
+        for num_actions in (0, 2):
+            for routing in stage.RoutedQueue.supported_routings:
+                for p in ("sequential", "process"):
+                    pipe = stage.FSPipeline(
+                        self.o_dir,
+                        True,
+                        self.o_dir,
+                        None,
+                        "dhdf5",
+                        self.i_dir,
+                        "dhdf5",
+                        "*.{0}".format(src_wr.get_file_format_suffix()),
+                        parallel_opts={"num_loaders": 3, "num_writers": 2, "routing": routing},
+                    )
+                    for a in range(num_actions):
+                        pipe.add_data_action(lambda i, o: (i, o))
+                    with timeout(10, error_message=f"Sharded pipeline with policy {p} and {routing} took too long"):
+                        pipe.execute(p)
+                    self.verify(data, get_reader("dhdf5"))
+
+        for j, (i, o) in enumerate(data):
+            fn = "{0}/data_{1}.{2}".format(self.i_dir, j, src_wr.get_file_format_suffix())
+            Path(fn).unlink()
+
+
+    def test_fs_pipeline_builtin_actions(self):
+        data = list()
+        for i in range(0, 10):
+            in_data, out_data = np.random.rand(3, 2), np.random.rand(3, 3)
+            data.append((in_data, out_data))
+        data[2][0][1, 0] = np.nan
+        data[5][1][0, 2] = np.inf
+
+        src_wr = get_writer("dhdf5")
+        for j, (i, o) in enumerate(data):
+            fn = "{0}/data_{1}.{2}".format(self.i_dir, j, src_wr.get_file_format_suffix())
+            with src_wr(fn) as fd:
+                fd.store(i, o)
+
+        stats_fn = Path(tempfile.mkdtemp()) / "stats.json"
+        parser = argparse.ArgumentParser()
+        stage.FSPipeline.add_cli_args(parser)
+        args = parser.parse_args(
+            [
+                "-db",
+                str(self.o_dir),
+                "--dest",
+                str(self.o_dir),
+                "--src",
+                str(self.i_dir),
+                "--src-type",
+                "dhdf5",
+                "--pattern",
+                "*.h5",
+                "--drop-non-finite",
+                "--affine",
+                "outputs:2:1",
+                "--running-stats",
+                str(stats_fn),
+            ]
+        )
+        pipe = stage.FSPipeline.from_cli(args)
+        with timeout(10, error_message="Pipeline with built-in actions took too long"):
+            pipe.execute("process")
+
+        expected = [(i, o * 2 + 1) for i, o in data if np.isfinite(i).all(axis=1).all() and np.isfinite(o).all()]
+        expected += [(data[2][0][[0, 2]], data[2][1][[0, 2]] * 2 + 1), (data[5][0][1:], data[5][1][1:] * 2 + 1)]
+        self.verify(expected, get_reader("dhdf5"))
+
+        with open(stats_fn, "r") as fd:
+            stats = json.load(fd)
+        outputs = np.concatenate([o for _, o in expected])
+        self.assertEqual(stats["rows"], len(outputs))
+        np.testing.assert_allclose(stats["outputs"]["mean"], outputs.mean(axis=0))
+
+        for j, (i, o) in enumerate(data):
+            fn = "{0}/data_{1}.{2}".format(self.i_dir, j, src_wr.get_file_format_suffix())
+            Path(fn).unlink()
 
 if __name__ == "__main__":
     unittest.main()
@@ -7,10 +7,13 @@
 
 #include <AMS.h>
 
+#include <cmath>
 #include <cstring>
 #include <iostream>
+#include <limits>
 #include <vector>
 #include <wf/data_handler.hpp>
+#include <wf/reorder.hpp>
 #include <wf/resource_manager.hpp>
 
 #define SIZE (32 * 1024 + 1)
@@ -45,6 +48,146 @@ int verify(bool* pred, double* d1, double* d2, int size, int flag)
   return 0;
 }
 
+/* Packs and unpacks 'dims' features, covering both the kernels specialized
+ * for the number of features and the generic ones */
+int verifyDims(const bool* predicate, int size, int dims, int flag)
+{
+  using data_handler = ams::DataHandler<double>;
+  std::vector<std::vector<double>> sparse(dims, std::vector<double>(size));
+  std::vector<std::vector<double>> dense(dims, std::vector<double>(size));
+  std::vector<std::vector<double>> rsparse(dims, std::vector<double>(size, -1));
+  std::vector<const double*> s_data;
+  std::vector<double*> d_data, sr_data;
+  for (int d = 0; d < dims; d++) {
+    for (int i = 0; i < size; i++)
+      sparse[d][i] = d * size + i;
+    s_data.push_back(sparse[d].data());
+    d_data.push_back(dense[d].data());
+    sr_data.push_back(rsparse[d].data());
+  }
+
+  int elements = data_handler::pack(
+      AMSResourceType::HOST, predicate, size, s_data, d_data, flag);
+  data_handler::unpack(
+      AMSResourceType::HOST, predicate, size, d_data, sr_data, flag);
+  if (elements != (size + flag) / 2) return 1;
+
+  for (int d = 0; d < dims; d++) {
+    for (int i = 0; i < elements; i++)
+      if (dense[d][i] != d * size + i * 2 + (!flag)) return 1;
+    for (int i = 0; i < size; i++)
+      if (rsparse[d][i] != (predicate[i] == flag ? sparse[d][i] : -1))
+        return 1;
+  }
+  return 0;
+}
+
+/* Linearizes 'dims' features with a fused affine transform and scatters them
+ * back with the inverse one */
+int verifyNormalization(int size, int dims)
+{
+  using data_handler = ams::DataHandler<double>;
+  std::vector<std::vector<double>> features(dims, std::vector<double>(size));
+  std::vector<std::vector<double>> restored(dims, std::vector<double>(size));
+  std::vector<double> scale(dims), offset(dims), iscale(dims), ioffset(dims);
+  std::vector<const double*> f_data;
+  std::vector<double*> r_data;
+  for (int d = 0; d < dims; d++) {
+    for (int i = 0; i < size; i++)
+      features[d][i] = d * size + i;
+    scale[d] = 0.5 * (d + 1);
+    offset[d] = -d;
+    iscale[d] = 1.0 / scale[d];
+    ioffset[d] = -offset[d] / scale[d];
+    f_data.push_back(features[d].data());
+    r_data.push_back(restored[d].data());
+  }
+
+  std::vector<double> rows(size * dims);
+  data_handler::linearize_features(
+      size, f_data, rows.data(), scale.data(), offset.data());
+  for (int i = 0; i < size; i++)
+    for (int d = 0; d < dims; d++)
+      if (std::abs(rows[i * dims + d] -
+                   (features[d][i] * scale[d] + offset[d])) > 1e-9)
+        return 1;
+
+  data_handler::delinearize_features(
+      size, rows.data(), r_data, iscale.data(), ioffset.data());
+  for (int d = 0; d < dims; d++)
+    for (int i = 0; i < size; i++)
+      if (std::abs(restored[d][i] - features[d][i]) > 1e-9 * size * dims)
+        return 1;
+  return 0;
+}
+
+/* Reorders 'dims' random features in Morton order, the order must be a
+ * permutation, (approximately) sort one dimensional data and round trip
+ * through gather and scatter */
+int verifyReorder(int size, int dims)
+{
+  using morton = ams::MortonOrder<double>;
+  std::vector<std::vector<double>> features(dims, std::vector<double>(size));
+  std::vector<std::vector<double>> sorted(dims, std::vector<double>(size));
+  std::vector<std::vector<double>> restored(dims, std::vector<double>(size));
+  std::vector<const double*> f_data;
+  std::vector<double*> f_ptrs, s_data, r_data;
+  for (int d = 0; d < dims; d++) {
+    for (int i = 0; i < size; i++)
+      features[d][i] = ((i * 7919 + d * 104729) % size) - size / 2;
+    f_data.push_back(features[d].data());
+    f_ptrs.push_back(features[d].data());
+    s_data.push_back(sorted[d].data());
+    r_data.push_back(restored[d].data());
+  }
+
+  std::vector<uint32_t> order;
+  morton::compute(size, f_data, order);
+  if (order.size() != static_cast<size_t>(size)) return 1;
+  std::vector<bool> seen(size, false);
+  for (auto idx : order) {
+    if (idx >= static_cast<uint32_t>(size) || seen[idx]) return 1;
+    seen[idx] = true;
+  }
+
+  // One dimensional data are sorted up to the resolution of the keys
+  morton::gather(order, f_ptrs.data(), s_data.data(), dims);
+  if (dims == 1)
+    for (int i = 1; i < size; i++)
+      if (sorted[0][i - 1] > sorted[0][i] + size / 1024.0) return 1;
+
+  morton::scatter(order, s_data.data(), r_data.data(), dims);
+  for (int d = 0; d < dims; d++)
+    if (restored[d] != features[d]) return 1;
+  return 0;
+}
+
+/* Infinities and NaNs do not collapse the keys of the finite values, those
+ * are still sorted and the infinities sort as the ends of the finite range */
+int verifyReorderNonFinite(int size)
+{
+  using morton = ams::MortonOrder<double>;
+  std::vector<double> feature(size);
+  for (int i = 0; i < size; i++)
+    feature[i] = ((i * 7919) % size) - size / 2;
+  feature[0] = std::numeric_limits<double>::infinity();
+  feature[1] = -std::numeric_limits<double>::infinity();
+  feature[2] = std::numeric_limits<double>::quiet_NaN();
+
+  std::vector<const double*> f_data{feature.data()};
+  std::vector<uint32_t> order;
+  morton::compute(size, f_data, order);
+  const double lo = -size / 2, hi = size / 2;
+  double prev = lo;
+  for (auto idx : order) {
+    if (std::isnan(feature[idx])) continue;
+    const double value = std::min(std::max(feature[idx], lo), hi);
+    if (prev > value + size / 1024.0) return 1;
+    prev = value;
+  }
+  return 0;
+}
+
 int main(int argc, char* argv[])
 {
   using namespace ams;
@@ -88,6 +231,34 @@ int main(int argc, char* argv[])
       }
     }
 
+    for (int dims : {2, 3, 4, 7, 8, 9}) {
+      for (int flag = 0; flag < 2; flag++) {
+        if (verifyDims(predicate, size, dims, flag)) {
+          std::cout << "Packing " << dims << " features failed\n";
+          return 1;
+        }
+      }
+    }
+
+    for (int dims : {1, 2, 4, 7}) {
+      if (verifyNormalization(size, dims)) {
+        std::cout << "Normalizing " << dims << " features failed\n";
+        return 1;
+      }
+    }
+
+    for (int dims : {1, 2, 3, 9, 70}) {
+      if (verifyReorder(size, dims)) {
+        std::cout << "Reordering " << dims << " features failed\n";
+        return 1;
+      }
+    }
+
+    if (verifyReorderNonFinite(size)) {
+      std::cout << "Reordering non finite features failed\n";
+      return 1;
+    }
+
     ResourceManager::deallocate(predicate, AMSResourceType::HOST);
     ResourceManager::deallocate(dense, AMSResourceType::HOST);
     ResourceManager::deallocate(sparse, AMSResourceType::HOST);
@@ -0,0 +1,246 @@
+/*
+ * Copyright 2021-2023 Lawrence Livermore National Security, LLC and other
+ * AMSLib Project Developers
+ *
+ * SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+ */
+
+#include <AMS.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <ml/hdcache.hpp>
+#include <ml/kdtree.hpp>
+#include <random>
+#include <unistd.h>
+#include <vector>
+#include <wf/resource_manager.hpp>
+
+#define POINTS 20000
+#define QUERIES 3000
+// A power of two, the mean of the distances is exact in any precision
+#define NEIGHBORS 4
+
+// Coordinates are multiples of 1/64 in [0, 4), the squared distances are
+// exact in single precision and the predicates do not depend on the precision
+// of the index
+template <typename T>
+std::vector<T> points(size_t n, int dims, unsigned seed)
+{
+  std::mt19937 gen(seed);
+  std::uniform_int_distribution<int> cell(0, 255);
+  std::vector<T> data(n * dims);
+  for (auto &v : data)
+    v = static_cast<T>(cell(gen)) / 64;
+  return data;
+}
+
+/* The sorted squared distances of the k nearest neighbors by brute force */
+template <typename T>
+std::vector<T> bruteForce(const std::vector<T> &data,
+                          const std::vector<T> &queries,
+                          int dims,
+                          size_t k)
+{
+  const size_t n = data.size() / dims;
+  const size_t nq = queries.size() / dims;
+  std::vector<T> result(nq * k, std::numeric_limits<T>::max());
+  std::vector<T> all(n);
+  for (size_t q = 0; q < nq; q++) {
+    for (size_t p = 0; p < n; p++) {
+      T dist = 0;
+      for (int d = 0; d < dims; d++) {
+        const T diff = queries[q * dims + d] - data[p * dims + d];
+        dist += diff * diff;
+      }
+      all[p] = dist;
+    }
+    const size_t m = std::min(k, n);
+    std::partial_sort(all.begin(), all.begin() + m, all.end());
+    std::copy_n(all.begin(), m, &result[q * k]);
+  }
+  return result;
+}
+
+template <typename T>
+bool checkSearch(const KDTree<T> &tree,
+                 const std::vector<T> &data,
+                 const std::vector<T> &queries,
+                 int dims,
+                 size_t k,
+                 ams::ThreadPool *pool)
+{
+  const size_t nq = queries.size() / dims;
+  std::vector<T> dists(nq * k);
+  tree.search(nq, queries.data(), k, dists.data(), pool);
+  auto expected = bruteForce(data, queries, dims, k);
+  for (size_t i = 0; i < dists.size(); i++) {
+    if (dists[i] != expected[i]) {
+      std::cout << "Neighbor " << i % k << " of query " << i / k << " at "
+                << dists[i] << " expected " << expected[i] << "\n";
+      return false;
+    }
+  }
+  return true;
+}
+
+/* Evaluates the HDCache on the row major 'queries', moved to 'resource' */
+template <typename T>
+std::vector<bool> evaluate(HDCache<T> &cache,
+                           const std::vector<T> &queries,
+                           int dims,
+                           AMSResourceType resource)
+{
+  const size_t n = queries.size() / dims;
+  std::vector<const T *> features;
+  std::vector<T> feature(n);
+  for (int d = 0; d < dims; d++) {
+    for (size_t i = 0; i < n; i++)
+      feature[i] = queries[i * dims + d];
+    T *ptr = ams::ResourceManager::allocate<T>(n, resource);
+    ams::ResourceManager::copy(feature.data(), ptr, n * sizeof(T));
+    features.push_back(ptr);
+  }
+  bool *predicate = ams::ResourceManager::allocate<bool>(n, resource);
+  bool *h_predicate =
+      ams::ResourceManager::allocate<bool>(n, AMSResourceType::HOST);
+  cache.evaluate(n, features, predicate);
+  ams::ResourceManager::copy(predicate, h_predicate, n * sizeof(bool));
+  std::vector<bool> result(h_predicate, h_predicate + n);
+
+  for (auto f : features)
+    ams::ResourceManager::deallocate(const_cast<T *>(f), resource);
+  ams::ResourceManager::deallocate(predicate, resource);
+  ams::ResourceManager::deallocate(h_predicate, AMSResourceType::HOST);
+  return result;
+}
+
+static bool tempFile(char *path)
+{
+  int fd = mkstemp(path);
+  if (fd < 0) return false;
+  close(fd);
+  return true;
+}
+
+template <typename T>
+int test(AMSResourceType resource, int dims, int threads)
+{
+  auto data = points<T>(POINTS, dims, 7);
+  auto queries = points<T>(QUERIES, dims, 11);
+  std::unique_ptr<ams::ThreadPool> pool;
+  if (threads > 1) pool = std::make_unique<ams::ThreadPool>(threads - 1);
+
+  // Exact neighbors, including more neighbors than points
+  KDTree<T> tree(dims);
+  tree.add(POINTS, data.data());
+  if (!checkSearch(tree, data, queries, dims, NEIGHBORS, pool.get())) return 1;
+  KDTree<T> small(dims);
+  small.add(3, data.data());
+  std::vector<T> few(data.begin(), data.begin() + 3 * dims);
+  if (!checkSearch(small, few, queries, dims, NEIGHBORS, pool.get())) return 1;
+
+  char path[] = "kdtreeXXXXXX";
+  if (!tempFile(path)) return 1;
+  tree.save(path);
+  auto loaded = KDTree<T>::load(path);
+  std::remove(path);
+  if (!checkSearch(*loaded, data, queries, dims, NEIGHBORS, pool.get()))
+    return 1;
+
+  // The HDCache predicates match the brute force distances, with and
+  // without Morton reordering. Caches are shared per path, every policy
+  // loads its own file.
+  // The threshold is the median distance to the furthest neighbor, both
+  // outcomes are tested
+  auto expected = bruteForce(data, queries, dims, NEIGHBORS);
+  std::vector<T> furthest;
+  for (size_t i = 0; i < QUERIES; i++)
+    furthest.push_back(expected[i * NEIGHBORS + NEIGHBORS - 1]);
+  std::nth_element(furthest.begin(),
+                   furthest.begin() + QUERIES / 2,
+                   furthest.end());
+  const T threshold = furthest[QUERIES / 2];
+  for (auto policy : {AMSUQPolicy::FAISS_Mean, AMSUQPolicy::FAISS_Max}) {
+    char cache_path[] = "kdtreeXXXXXX";
+    if (!tempFile(cache_path)) return 1;
+    tree.save(cache_path);
+    auto cache = HDCache<T>::getInstance(
+        cache_path, resource, policy, NEIGHBORS, threshold);
+    std::remove(cache_path);
+    cache->setThreads(threads);
+    if (cache->count() != POINTS) {
+      std::cout << "The cache holds " << cache->count() << " points\n";
+      return 1;
+    }
+    for (size_t reorder : {0, 1}) {
+      cache->setReorder(reorder);
+      auto predicate = evaluate(*cache, queries, dims, resource);
+      const size_t accepted =
+          std::count(predicate.begin(), predicate.end(), true);
+      if (accepted == 0 || accepted == predicate.size()) {
+        std::cout << accepted << " accepted queries out of "
+                  << predicate.size() << "\n";
+        return 1;
+      }
+      for (size_t i = 0; i < predicate.size(); i++) {
+        const T *dists = &expected[i * NEIGHBORS];
+        T dist = dists[NEIGHBORS - 1];
+        if (policy == AMSUQPolicy::FAISS_Mean) {
+          dist = 0;
+          for (int k = 0; k < NEIGHBORS; k++)
+            dist += dists[k];
+          dist /= NEIGHBORS;
+        }
+        if (predicate[i] != (dist < threshold)) {
+          std::cout << "Query " << i << " is " << predicate[i]
+                    << " at distance " << dist << " (policy "
+                    << static_cast<int>(policy) << ", reorder " << reorder
+                    << ")\n";
+          return 1;
+        }
+      }
+    }
+  }
+
+  // Added points are part of the executor state
+  char cache_path[] = "kdtreeXXXXXX";
+  if (!tempFile(cache_path)) return 1;
+  tree.save(cache_path);
+  auto cache = HDCache<T>::getInstance(
+      cache_path, resource, AMSUQPolicy::FAISS_Mean, NEIGHBORS, threshold);
+  std::remove(cache_path);
+  std::vector<T *> added;
+  for (int d = 0; d < dims; d++)
+    added.push_back(&queries[d]);
+  cache->add(1, added);
+  if (!cache->modified() || cache->count() != POINTS + 1) return 1;
+  cache->deserialize(cache->serialize());
+  if (cache->count() != POINTS + 1) return 1;
+  return 0;
+}
+
+int main(int argc, char *argv[])
+{
+  if (argc != 5) {
+    std::cout << "Wrong cli\n";
+    std::cout << argv[0]
+              << " use_device(0|1) data_type(double|single) dimensions "
+                 "threads\n";
+    return 1;
+  }
+
+  int use_device = std::atoi(argv[1]);
+  std::string data_type(argv[2]);
+  int dims = std::atoi(argv[3]);
+  int threads = std::atoi(argv[4]);
+  AMSResourceType resource = AMSResourceType::HOST;
+  if (use_device == 1) resource = AMSResourceType::DEVICE;
+
+  ams::ResourceManager::init();
+  if (data_type == "double") return test<double>(resource, dims, threads);
+  return test<float>(resource, dims, threads);
+}
@@ -0,0 +1,226 @@
+/*
+ * Copyright 2021-2023 Lawrence Livermore National Security, LLC and other
+ * AMSLib Project Developers
+ *
+ * SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+ */
+
+#include <AMS.h>
+
+#include <cmath>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <ml/occupancy_grid.hpp>
+#include <random>
+#include <unistd.h>
+#include <vector>
+#include <wf/resource_manager.hpp>
+
+#define CLUSTERS 4
+#define CLUSTER_POINTS 1000
+
+// The training points lie in cubes of half width 0.02 around the centers
+// (k + 0.5) / CLUSTERS of the diagonal of [0, 1]^dims
+static double center(int k) { return (k + 0.5) / CLUSTERS; }
+
+template <typename T>
+std::vector<std::vector<T>> training(int dims)
+{
+  std::mt19937 gen(7);
+  std::uniform_real_distribution<double> jitter(-0.02, 0.02);
+  std::vector<std::vector<T>> data(dims);
+  for (int k = 0; k < CLUSTERS; k++)
+    for (int i = 0; i < CLUSTER_POINTS; i++)
+      for (int d = 0; d < dims; d++)
+        data[d].push_back(static_cast<T>(center(k) + jitter(gen)));
+  return data;
+}
+
+/* Evaluates the grid on the points of 'data', moved to 'resource' */
+template <typename T>
+std::vector<bool> evaluate(OccupancyGrid<T> &grid,
+                           std::vector<std::vector<T>> &data,
+                           AMSResourceType resource)
+{
+  const size_t n = data[0].size();
+  std::vector<const T *> features;
+  for (auto &f : data) {
+    T *ptr = ams::ResourceManager::allocate<T>(n, resource);
+    ams::ResourceManager::copy(f.data(), ptr, n * sizeof(T));
+    features.push_back(ptr);
+  }
+  bool *predicate = ams::ResourceManager::allocate<bool>(n, resource);
+  bool *h_predicate =
+      ams::ResourceManager::allocate<bool>(n, AMSResourceType::HOST);
+  grid.evaluate(n, features, predicate);
+  ams::ResourceManager::copy(predicate, h_predicate, n * sizeof(bool));
+  std::vector<bool> result(h_predicate, h_predicate + n);
+
+  for (auto f : features)
+    ams::ResourceManager::deallocate(const_cast<T *>(f), resource);
+  ams::ResourceManager::deallocate(predicate, resource);
+  ams::ResourceManager::deallocate(h_predicate, AMSResourceType::HOST);
+  return result;
+}
+
+/* A query point per cluster, every feature at center(k) + 'shift', and
+ * points off the diagonal, outside the bounds and NaNs */
+template <typename T>
+std::vector<std::vector<T>> queries(int dims, double shift)
+{
+  std::vector<std::vector<T>> data(dims);
+  for (int k = 0; k < CLUSTERS; k++)
+    for (int d = 0; d < dims; d++)
+      data[d].push_back(static_cast<T>(center(k) + shift));
+  for (int d = 0; d < dims; d++) {
+    data[d].push_back(static_cast<T>(d == 0 ? center(0) : center(3)));
+    data[d].push_back(static_cast<T>(d == 0 ? 1.5 : center(0)));
+    data[d].push_back(d == 0 ? std::numeric_limits<T>::quiet_NaN()
+                             : static_cast<T>(center(0)));
+  }
+  return data;
+}
+
+/* Returns true when the cluster queries are 'clusters' and the rest is
+ * rejected */
+bool check(const std::vector<bool> &predicate, bool clusters)
+{
+  for (size_t i = 0; i < predicate.size(); i++) {
+    const bool expected = i < CLUSTERS ? clusters : false;
+    if (predicate[i] != expected) {
+      std::cout << "Query " << i << " is " << predicate[i] << " expected "
+                << expected << "\n";
+      return false;
+    }
+  }
+  return true;
+}
+
+/* Saves 'grid' to 'path' with 'value' written 'fromEnd' bytes before the
+ * end of the file, true when loading it throws a runtime_error */
+template <typename T, typename V>
+bool loadFails(const OccupancyGrid<T> &grid,
+               const char *path,
+               AMSResourceType resource,
+               long fromEnd,
+               V value)
+{
+  grid.save(path);
+  {
+    std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+    file.seekp(-fromEnd, std::ios::end);
+    file.write(reinterpret_cast<const char *>(&value), sizeof(value));
+  }
+  try {
+    OccupancyGrid<T>::load(path, resource, 0.0);
+  } catch (const std::runtime_error &) {
+    return true;
+  }
+  return false;
+}
+
+template <typename T>
+int test(AMSResourceType resource, int dims)
+{
+  // With 5 dims the finest level has 2^25 cells and is hashed
+  OccupancyGrid<T> grid(std::vector<double>(dims, 0.0),
+                        std::vector<double>(dims, 1.0),
+                        {5, 3});
+  auto data = training<T>(dims);
+  std::vector<const T *> features;
+  for (auto &f : data)
+    features.push_back(f.data());
+  grid.add(data[0].size(), features);
+
+  char path[] = "occupancy_gridXXXXXX";
+  int fd = mkstemp(path);
+  if (fd < 0) return 1;
+  close(fd);
+  grid.save(path);
+
+  // The training points are in distribution at every resolution
+  for (T threshold : {0.0, 0.1, 1.0}) {
+    auto loaded = OccupancyGrid<T>::load(path, resource, threshold);
+    auto predicate = evaluate(*loaded, data, resource);
+    for (size_t i = 0; i < predicate.size(); i++) {
+      if (!predicate[i]) {
+        std::cout << "Training point " << i << " rejected at threshold "
+                  << threshold << "\n";
+        return 1;
+      }
+    }
+  }
+
+  // Points 0.05 away from the clusters are in a neighboring cell of the
+  // finest level and in the cell of the cluster at the coarse one
+  auto near = queries<T>(dims, 0.05);
+  auto fine = OccupancyGrid<T>::load(path, resource, 0.0);
+  if (!check(evaluate(*fine, near, resource), false)) return 1;
+  auto coarse = OccupancyGrid<T>::load(path, resource, 0.1);
+  if (!check(evaluate(*coarse, near, resource), true)) return 1;
+
+  // Cells with fewer training points than the minimum count are rejected
+  OccupancyGrid<T> sparse(std::vector<double>(dims, 0.0),
+                          std::vector<double>(dims, 1.0),
+                          {3},
+                          2 * CLUSTER_POINTS);
+  sparse.add(data[0].size(), features);
+  sparse.select(0.0);
+  auto exact = queries<T>(dims, 0.0);
+  if (!check(evaluate(sparse, exact, resource), false)) return 1;
+
+  // A file of a single level of a single cell ends with the bits of the
+  // level, its number of cells, the key and the count. Corrupted keys and
+  // sizes fail the load before allocating anything
+  OccupancyGrid<T> single(std::vector<double>(dims, 0.0),
+                          std::vector<double>(dims, 1.0),
+                          {3});
+  single.add(1, features);
+  const uint64_t badKey = 1ull << (3 * dims);
+  const long dimsAt = 24 + 2 * dims * sizeof(double) + 12;
+  if (!loadFails<T, uint64_t>(single, path, resource, 12, badKey) ||
+      !loadFails<T, uint64_t>(single, path, resource, 20, 1ull << 60) ||
+      !loadFails<T, uint32_t>(single, path, resource, dimsAt, 1u << 30)) {
+    std::cout << "A corrupted grid was loaded\n";
+    return 1;
+  }
+
+  // Levels whose keys exceed 63 bits are rejected even when the product of
+  // the bits and the dimensions wraps around in 32 bits
+  const uint32_t wrapping = (0xffffffffull + dims) / dims;
+  try {
+    OccupancyGrid<T>(std::vector<double>(dims, 0.0),
+                     std::vector<double>(dims, 1.0),
+                     {wrapping});
+    std::cout << "A level of " << wrapping << " bits was accepted\n";
+    return 1;
+  } catch (const std::invalid_argument &) {
+  }
+
+  std::remove(path);
+  return 0;
+}
+
+int main(int argc, char *argv[])
+{
+  if (argc != 4) {
+    std::cout << "Wrong cli\n";
+    std::cout << argv[0]
+              << " use_device(0|1) data_type(double|single) dimensions\n";
+    return 1;
+  }
+
+  int use_device = std::atoi(argv[1]);
+  std::string data_type(argv[2]);
+  int dims = std::atoi(argv[3]);
+  AMSResourceType resource = AMSResourceType::HOST;
+  if (use_device == 1) resource = AMSResourceType::DEVICE;
+
+  ams::ResourceManager::init();
+  if (data_type == "double") return test<double>(resource, dims);
+  return test<float>(resource, dims);
+}
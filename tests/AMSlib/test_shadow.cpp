@@ -0,0 +1,127 @@
+/*
+ * Copyright 2021-2023 Lawrence Livermore National Security, LLC and other
+ * AMSLib Project Developers
+ *
+ * SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+ */
+
+#include <AMS.h>
+
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <wf/shadow.hpp>
+
+#define POINTS 100000
+
+/* The physics is y = 2 x + bias, the surrogate outputs 2 x and its error is
+ * the bias of the problem */
+struct Problem {
+  double bias;
+};
+
+template <typename T>
+static void physics(void *probDescr,
+                    long n,
+                    const void *const *inputs,
+                    void *const *outputs)
+{
+  const double bias = static_cast<Problem *>(probDescr)->bias;
+  const T *in = static_cast<const T *>(inputs[0]);
+  for (int d = 0; d < 2; d++) {
+    T *out = static_cast<T *>(outputs[d]);
+    for (long i = 0; i < n; i++)
+      out[i] = 2 * in[i] + static_cast<T>((d + 1) * bias);
+  }
+}
+
+template <typename T>
+int test(double fraction)
+{
+  Problem problem{0.5};
+  std::vector<T> x(POINTS), y0(POINTS), y1(POINTS);
+  bool *predicate = new bool[POINTS];
+  for (int i = 0; i < POINTS; i++) {
+    x[i] = static_cast<T>(i);
+    y0[i] = y1[i] = 2 * x[i];
+    predicate[i] = i % 2 == 0;
+  }
+  std::vector<const T *> inputs{x.data()};
+  std::vector<T *> outputs{y0.data(), y1.data()};
+
+  // The stored points are accepted ones with the physics outputs, the
+  // capacity holds all the calls and no point is dropped
+  size_t stored = 0;
+  bool valid = true;
+  ams::ShadowSampler<T> sampler(
+      physics<T>,
+      fraction,
+      4 * POINTS,
+      [&](size_t n, std::vector<T *> &in, std::vector<T *> &out) {
+        stored += n;
+        for (size_t i = 0; i < n; i++) {
+          const long idx = static_cast<long>(in[0][i]);
+          valid &= predicate[idx] && out[0][i] == 2 * in[0][i] + 0.5;
+        }
+      });
+
+  long sampled = 0;
+  for (int call = 0; call < 4; call++)
+    sampled += sampler.sample(&problem, POINTS, predicate, inputs, outputs);
+  sampler.drain();
+  delete[] predicate;
+
+  // Four calls of POINTS / 2 accepted points
+  const double expected = fraction * 2 * POINTS;
+  if (fraction == 1.0 ? sampled != expected
+                      : std::abs(sampled - expected) > 0.05 * expected) {
+    std::cout << "Sampled " << sampled << " points, expected " << expected
+              << "\n";
+    return 1;
+  }
+  if (stored != static_cast<size_t>(sampled) || !valid) {
+    std::cout << "Stored " << stored << " points of " << sampled << "\n";
+    return 1;
+  }
+
+  auto errors = sampler.errors();
+  if (errors.size() != 2) return 1;
+  for (size_t d = 0; d < errors.size(); d++) {
+    const auto &e = errors[d];
+    const double bias = (d + 1) * problem.bias;
+    if (e.points != static_cast<uint64_t>(sampled) ||
+        std::abs(e.sumAbs / e.points - bias) > 1e-6 ||
+        std::abs(std::sqrt(e.sumSquared / e.points) - bias) > 1e-6 ||
+        std::abs(e.maxAbs - bias) > 1e-6) {
+      std::cout << "Output " << d << ": " << e.points << " points, mae "
+                << e.sumAbs / e.points << " max " << e.maxAbs
+                << ", expected " << bias << "\n";
+      return 1;
+    }
+  }
+  if (sampler.droppedPoints() != 0) return 1;
+  return 0;
+}
+
+int main(int argc, char *argv[])
+{
+  if (argc != 4) {
+    std::cout << "Wrong cli\n";
+    std::cout << argv[0] << " use_device(0) data_type(double|single) "
+                            "fraction\n";
+    return 1;
+  }
+
+  // Shadow sampling requires host data
+  if (std::atoi(argv[1]) != 0) {
+    std::cout << "The shadow sampler test runs on the host only\n";
+    return 1;
+  }
+
+  std::string data_type(argv[2]);
+  double fraction = std::atof(argv[3]);
+  if (data_type == "double") return test<double>(fraction);
+  return test<float>(fraction);
+}
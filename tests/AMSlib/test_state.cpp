@@ -0,0 +1,212 @@
+/*
+ * Copyright 2021-2023 Lawrence Livermore National Security, LLC and other
+ * AMSLib Project Developers
+ *
+ * SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+ */
+
+#include <AMS.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <ml/hdcache.hpp>
+#include <ml/kdtree.hpp>
+#include <string>
+#include <unistd.h>
+#include <vector>
+#include <wf/resource_manager.hpp>
+
+// The queries are the nodes of a SIDE x SIDE grid of spacing 2 far from the
+// points of the HDCaches, a query is accepted only once it is added
+#define SIDE 32
+#define QUERIES (SIDE * SIDE)
+#define IN_DIM 2
+#define OUT_DIM 4
+#define SENTINEL -1
+
+/* Every output of a point computed by the physics is SENTINEL */
+template <typename T>
+static void physics(void *, long n, const void *const *, void *const *outputs)
+{
+  for (int d = 0; d < OUT_DIM; d++) {
+    T *out = static_cast<T *>(outputs[d]);
+    for (long i = 0; i < n; i++)
+      out[i] = SENTINEL;
+  }
+}
+
+static bool tempFile(char *path)
+{
+  int fd = mkstemp(path);
+  if (fd < 0) return false;
+  close(fd);
+  return true;
+}
+
+/* Writes a KD-tree of the nodes of a 16 x 16 grid of spacing 1/4 at 'origin' */
+template <typename T>
+static bool writeCache(char *path, T origin)
+{
+  if (!tempFile(path)) return false;
+  std::vector<T> points;
+  for (int i = 0; i < 16; i++) {
+    for (int j = 0; j < 16; j++) {
+      points.push_back(origin + static_cast<T>(i) / 4);
+      points.push_back(origin + static_cast<T>(j) / 4);
+    }
+  }
+  KDTree<T> tree(IN_DIM);
+  tree.add(points.size() / IN_DIM, points.data());
+  tree.save(path);
+  return true;
+}
+
+/* Adds the queries i such that i % 4 == 'residue' to the HDCache at 'path' */
+template <typename T>
+static void addQueries(const char *path,
+                       std::vector<std::vector<T>> &queries,
+                       int residue,
+                       T threshold)
+{
+  std::vector<std::vector<T>> added(IN_DIM);
+  for (int i = residue; i < QUERIES; i += 4)
+    for (int d = 0; d < IN_DIM; d++)
+      added[d].push_back(queries[d][i]);
+  std::vector<T *> features{added[0].data(), added[1].data()};
+  HDCache<T>::getInstance(path,
+                          AMSResourceType::HOST,
+                          AMSUQPolicy::FAISS_Mean,
+                          1,
+                          threshold)
+      ->add(added[0].size(), features);
+}
+
+/* Evaluates the queries, returns whether the physics computed every point */
+template <typename T>
+static std::vector<bool> execute(AMSExecutor executor,
+                                 std::vector<std::vector<T>> &queries)
+{
+  std::vector<T> outputs(OUT_DIM * QUERIES, 0);
+  const T *in[IN_DIM] = {queries[0].data(), queries[1].data()};
+  T *out[OUT_DIM];
+  for (int d = 0; d < OUT_DIM; d++)
+    out[d] = &outputs[d * QUERIES];
+  AMSExecute(executor,
+             nullptr,
+             QUERIES,
+             reinterpret_cast<const void **>(in),
+             reinterpret_cast<void **>(out),
+             IN_DIM,
+             OUT_DIM);
+  std::vector<bool> computed(QUERIES);
+  for (int i = 0; i < QUERIES; i++)
+    computed[i] = outputs[i] == SENTINEL;
+  return computed;
+}
+
+static size_t count(const std::vector<bool> &computed)
+{
+  return std::count(computed.begin(), computed.end(), true);
+}
+
+template <typename T>
+int test(AMSDType dType, char *model)
+{
+  const T threshold = 1;
+  std::vector<std::vector<T>> queries(IN_DIM);
+  for (int i = 0; i < QUERIES; i++) {
+    queries[0].push_back(static_cast<T>(16 + 2 * (i / SIDE)));
+    queries[1].push_back(static_cast<T>(16 + 2 * (i % SIDE)));
+  }
+
+  // Two executors with the same configuration, HDCaches are shared per path
+  // hence every executor loads its own copy of the files
+  char paths[4][16];
+  for (auto &path : paths)
+    std::strcpy(path, "stateXXXXXX");
+  if (!writeCache<T>(paths[0], 0) || !writeCache<T>(paths[1], 0) ||
+      !writeCache<T>(paths[2], 4) || !writeCache<T>(paths[3], 4))
+    return 1;
+
+  AMSExecutor executors[2];
+  for (int e = 0; e < 2; e++) {
+    AMSConfig conf = {AMSExecPolicy::UBALANCED,
+                      dType,
+                      AMSResourceType::HOST,
+                      AMSDBType::None,
+                      physics<T>,
+                      model,
+                      paths[e],
+                      nullptr,
+                      threshold,
+                      AMSUQPolicy::FAISS_Mean,
+                      1,
+                      0,
+                      1,
+                      model,
+                      paths[2 + e],
+                      threshold};
+    executors[e] = AMSCreateExecutor(conf);
+  }
+  for (auto &path : paths)
+    std::remove(path);
+
+  // Half of the queries are added to the first tier and a quarter to the
+  // cascade, the physics computes the last quarter
+  addQueries<T>(paths[0], queries, 0, threshold);
+  addQueries<T>(paths[0], queries, 1, threshold);
+  addQueries<T>(paths[2], queries, 2, threshold);
+  const auto expected = execute(executors[0], queries);
+  if (count(expected) != QUERIES / 4) {
+    std::cout << "The physics computed " << count(expected)
+              << " points before saving\n";
+    return 1;
+  }
+
+  char state[] = "stateXXXXXX";
+  if (!tempFile(state)) return 1;
+  AMSSaveExecutorState(executors[0], state);
+  if (count(execute(executors[1], queries)) != QUERIES) {
+    std::cout << "The executor accepts points before loading the state\n";
+    return 1;
+  }
+  AMSLoadExecutorState(executors[1], state);
+  std::remove(state);
+
+  // The restored executor makes the same decisions
+  const auto restored = execute(executors[1], queries);
+  for (int i = 0; i < QUERIES; i++) {
+    if (restored[i] != expected[i]) {
+      std::cout << "Point " << i << " is " << (restored[i] ? "" : "not ")
+                << "computed by the physics after loading the state\n";
+      return 1;
+    }
+  }
+
+  for (auto executor : executors)
+    AMSDestroyExecutor(executor);
+  return 0;
+}
+
+int main(int argc, char *argv[])
+{
+  if (argc != 4) {
+    std::cout << "Wrong cli\n";
+    std::cout << argv[0] << " use_device(0) model data_type(double|single)\n";
+    return 1;
+  }
+
+  // The physics writes the outputs on the host
+  if (std::atoi(argv[1]) != 0) {
+    std::cout << "The executor state test runs on the host only\n";
+    return 1;
+  }
+
+  ams::ResourceManager::init();
+  if (std::strcmp(argv[3], "double") == 0)
+    return test<double>(AMSDType::Double, argv[2]);
+  return test<float>(AMSDType::Single, argv[2]);
+}
@@ -0,0 +1,98 @@
+/*
+ * Copyright 2021-2023 Lawrence Livermore National Security, LLC and other
+ * AMSLib Project Developers
+ *
+ * SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+ */
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+#include <wf/tuner.hpp>
+
+using namespace ams;
+
+#define FP_SIZE 8
+#define IN_DIM 2
+#define OUT_DIM 3
+
+/* Tunes with one call per candidate, the candidate of 'fastThreads' threads
+ * and reordering is the fastest. Returns the winner */
+TunedKnobs tune(const std::string &path, int maxThreads, int fastThreads)
+{
+  AutoTuner tuner(path, "model", 1, AutoTuner::candidatesFor(1024, maxThreads));
+  while (true) {
+    const TunedKnobs knobs = tuner.next(FP_SIZE, IN_DIM, OUT_DIM);
+    const bool fast = knobs.physicsThreads == fastThreads &&
+                      knobs.reorderMinElements > 0;
+    if (tuner.record(fast ? 1.0 : 2.0, 1000))
+      return tuner.next(FP_SIZE, IN_DIM, OUT_DIM);
+  }
+}
+
+bool same(const TunedKnobs &a, const TunedKnobs &b)
+{
+  return a.reorderMinElements == b.reorderMinElements &&
+         a.physicsThreads == b.physicsThreads;
+}
+
+/* Replaces the thread count of every entry of the cache at 'path' */
+void rewriteThreads(const std::string &path, int threads)
+{
+  std::ifstream in(path);
+  std::ostringstream out;
+  std::string key, reorder, old, seconds;
+  while (std::getline(in, key, '\t') && std::getline(in, reorder, '\t') &&
+         std::getline(in, old, '\t') && std::getline(in, seconds))
+    out << key << '\t' << reorder << '\t' << threads << '\t' << seconds
+        << '\n';
+  in.close();
+  std::ofstream(path, std::ios::trunc) << out.str();
+}
+
+int main()
+{
+  char path[] = "tunerXXXXXX";
+  int fd = mkstemp(path);
+  if (fd < 0) return 1;
+  close(fd);
+
+  // A reentrant run of 4 threads tunes and persists its winner
+  const TunedKnobs winner = tune(path, 4, 4);
+  if (winner.physicsThreads != 4 || winner.reorderMinElements == 0) {
+    std::cout << "Unexpected winner " << winner.physicsThreads << "\n";
+    return 1;
+  }
+
+  // The same configuration starts tuned
+  AutoTuner hit(path, "model", 1, AutoTuner::candidatesFor(1024, 4));
+  if (!same(hit.next(FP_SIZE, IN_DIM, OUT_DIM), winner) || !hit.done()) {
+    std::cout << "The cached winner is not used\n";
+    return 1;
+  }
+
+  // A physics that is not reentrant never gets the threads of the winner
+  AutoTuner serial(path, "model", 1, AutoTuner::candidatesFor(1024, 0));
+  if (serial.done() ||
+      serial.next(FP_SIZE, IN_DIM, OUT_DIM).physicsThreads != 1 ||
+      serial.done()) {
+    std::cout << "A serial physics uses the cached threads\n";
+    return 1;
+  }
+
+  // A cached winner that is not one of the candidates is ignored
+  rewriteThreads(path, 3);
+  AutoTuner stale(path, "model", 1, AutoTuner::candidatesFor(1024, 4));
+  stale.next(FP_SIZE, IN_DIM, OUT_DIM);
+  if (stale.done()) {
+    std::cout << "A cached winner out of the candidates is used\n";
+    return 1;
+  }
+
+  std::remove(path);
+  return 0;
+}